@@ -1,6 +1,7 @@
 #include <gflags/gflags.h>
 
 #include "nexus/app/app_base.h"
+#include "nexus/common/async_log.h"
 
 using namespace nexus;
 using namespace nexus::app;
@@ -41,6 +42,8 @@ int main(int argc, char** argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   // Setup backtrace on segfault
   google::InstallFailureSignalHandler();
+  // Move stderr logging off the request threads
+  InitAsyncLogging();
   LOG(INFO) << "App port " << FLAGS_port << ", rpc port " << FLAGS_rpc_port;
   // Create the frontend server
   FaceRecApp app(FLAGS_port, FLAGS_rpc_port, FLAGS_sch_addr, FLAGS_nthread);
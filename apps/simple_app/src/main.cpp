@@ -1,6 +1,7 @@
 #include <gflags/gflags.h>
 
 #include "nexus/app/app_base.h"
+#include "nexus/common/async_log.h"
 
 using namespace nexus;
 using namespace nexus::app;
@@ -79,6 +80,8 @@ int main(int argc, char** argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   // Setup backtrace on segfault
   google::InstallFailureSignalHandler();
+  // Move stderr logging off the request threads
+  InitAsyncLogging();
 
   CHECK_GT(FLAGS_framework.length(), 0) << "Missing framework";
   CHECK_GT(FLAGS_model.length(), 0) << "Missing model";
@@ -1,3 +1,4 @@
 from .proto.nnquery_pb2 import *
 from .client import Client
 from .async_client import AsyncClient
+from .native_client import NativeClient
@@ -0,0 +1,119 @@
+import ctypes
+import ctypes.util
+
+from .proto import nnquery_pb2 as npb
+
+
+def _load_library(lib_path):
+    if lib_path is None:
+        lib_path = ctypes.util.find_library('nexus_client') or \
+            'libnexus_client.so'
+    lib = ctypes.CDLL(lib_path)
+    lib.nexus_client_create.restype = ctypes.c_void_p
+    lib.nexus_client_create.argtypes = [
+        ctypes.c_char_p, ctypes.c_uint32, ctypes.c_int, ctypes.c_int]
+    lib.nexus_client_destroy.restype = None
+    lib.nexus_client_destroy.argtypes = [ctypes.c_void_p]
+    lib.nexus_client_submit.restype = ctypes.c_uint32
+    lib.nexus_client_submit.argtypes = [
+        ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.nexus_client_submit_batch.restype = ctypes.c_size_t
+    lib.nexus_client_submit_batch.argtypes = [
+        ctypes.c_void_p, ctypes.c_char_p, ctypes.POINTER(ctypes.c_size_t),
+        ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint32)]
+    lib.nexus_client_next_reply.restype = ctypes.c_void_p
+    lib.nexus_client_next_reply.argtypes = [
+        ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_size_t)]
+    lib.nexus_client_free.restype = None
+    lib.nexus_client_free.argtypes = [ctypes.c_void_p]
+    lib.nexus_client_num_inflight.restype = ctypes.c_size_t
+    lib.nexus_client_num_inflight.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+class NativeClient:
+    """Client backed by libnexus_client.
+
+    Requests are pipelined over a pool of connections and replies are
+    matched by req_id in C++, so many requests can be in flight without a
+    Python thread per request.
+    """
+    def __init__(self, server_addr, user_id, num_connections=1,
+                 num_threads=1, lib_path=None):
+        self._lib = _load_library(lib_path)
+        self._handle = self._lib.nexus_client_create(
+            server_addr.encode(), user_id, num_connections, num_threads)
+        if not self._handle:
+            raise RuntimeError("Error in connecting to %s" % server_addr)
+
+
+    def __del__(self):
+        self.close()
+
+
+    def close(self):
+        if getattr(self, '_handle', None):
+            self._lib.nexus_client_destroy(self._handle)
+            self._handle = None
+
+
+    @property
+    def num_inflight(self):
+        return self._lib.nexus_client_num_inflight(self._handle)
+
+
+    def submit(self, img):
+        """Sends a JPEG image and returns the request ID."""
+        return self.submit_request(self._prepare_req(img))
+
+
+    def submit_request(self, req):
+        body = req.SerializeToString()
+        return self._lib.nexus_client_submit(self._handle, body, len(body))
+
+
+    def submit_batch(self, imgs):
+        """Sends JPEG images and returns their request IDs."""
+        bodies = [self._prepare_req(img).SerializeToString() for img in imgs]
+        lens = (ctypes.c_size_t * len(bodies))(*[len(b) for b in bodies])
+        req_ids = (ctypes.c_uint32 * len(bodies))()
+        n = self._lib.nexus_client_submit_batch(
+            self._handle, b''.join(bodies), lens, len(bodies), req_ids)
+        return list(req_ids[:n])
+
+
+    def next_reply(self, timeout=1.0):
+        """Waits for the next reply in completion order, None on timeout."""
+        size = ctypes.c_size_t()
+        buf = self._lib.nexus_client_next_reply(
+            self._handle, int(timeout * 1000), ctypes.byref(size))
+        if not buf:
+            return None
+        try:
+            reply = npb.ReplyProto()
+            reply.ParseFromString(ctypes.string_at(buf, size.value))
+        finally:
+            self._lib.nexus_client_free(buf)
+        return reply
+
+
+    def request(self, img, timeout=1.0):
+        """Sends an image and waits for its reply, like Client.request.
+
+        Replies of other requests received meanwhile are dropped, so don't mix
+        with submit.
+        """
+        req_id = self.submit(img)
+        while True:
+            reply = self.next_reply(timeout)
+            if reply is None or reply.req_id == req_id:
+                return reply
+
+
+    def _prepare_req(self, img):
+        req = npb.RequestProto()
+        req.input.data_type = npb.DT_IMAGE
+        req.input.image.data = img
+        req.input.image.format = npb.ImageProto.JPEG
+        req.input.image.color = True
+        return req
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cmath>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "nexus/app/admission_control.h"
+
+DEFINE_int32(admission_window_ms, 10000, "Window to track the minimum "
+             "request latency for admission control in ms");
+
+namespace nexus {
+namespace app {
+
+TokenBucket::TokenBucket(double rate, double burst, TimePoint now) :
+    rate_(rate),
+    burst_(burst),
+    tokens_(burst),
+    last_(now) {
+}
+
+bool TokenBucket::TryAcquire(TimePoint now, uint32_t* retry_after_ms) {
+  double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - last_).count() / 1e6;
+  if (elapsed > 0) {
+    tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+    last_ = now;
+  }
+  if (tokens_ >= 1.) {
+    tokens_ -= 1.;
+    return true;
+  }
+  *retry_after_ms = static_cast<uint32_t>(
+      std::ceil((1. - tokens_) / rate_ * 1e3));
+  return false;
+}
+
+bool TokenBucket::Full(TimePoint now) const {
+  double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - last_).count() / 1e6;
+  return tokens_ + elapsed * rate_ >= burst_;
+}
+
+AdmissionController::AdmissionController() :
+    num_inflight_(0),
+    num_overloaded_(0),
+    num_rate_limited_(0),
+    slo_ms_(0.),
+    capacity_(0.),
+    window_start_(Clock::now()),
+    window_min_ms_(0.),
+    prev_window_min_ms_(0.),
+    user_rate_(0.),
+    user_burst_(0.),
+    next_eviction_(Clock::now()) {
+}
+
+void AdmissionController::SetSlo(double slo_ms) {
+  std::lock_guard<std::mutex> lock(mu_);
+  slo_ms_ = slo_ms;
+}
+
+void AdmissionController::SetCapacity(double capacity) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (capacity_ != capacity) {
+    LOG(INFO) << "Admission capacity: " << capacity << " req/s";
+  }
+  capacity_ = capacity;
+}
+
+void AdmissionController::SetUserRateLimit(double rate, double burst) {
+  std::lock_guard<std::mutex> lock(user_mu_);
+  user_rate_ = rate;
+  user_burst_ = std::max(burst, 1.);
+  user_buckets_.clear();
+}
+
+CtrlStatus AdmissionController::Admit(uint32_t user_id, TimePoint now,
+                                      uint32_t* retry_after_ms) {
+  {
+    std::lock_guard<std::mutex> lock(user_mu_);
+    if (user_rate_ > 0) {
+      EvictIdleUsersLocked(now);
+      auto iter = user_buckets_.find(user_id);
+      if (iter == user_buckets_.end()) {
+        iter = user_buckets_.emplace(
+            user_id, TokenBucket(user_rate_, user_burst_, now)).first;
+      }
+      if (!iter->second.TryAcquire(now, retry_after_ms)) {
+        ++num_rate_limited_;
+        return RATE_LIMITED;
+      }
+    }
+  }
+  double slo_ms;
+  double estimate;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    slo_ms = slo_ms_;
+    estimate = (slo_ms > 0 && capacity_ > 0) ? EstimateLatencyLocked(now) : 0.;
+  }
+  if (estimate > slo_ms) {
+    *retry_after_ms = static_cast<uint32_t>(std::ceil(estimate - slo_ms));
+    ++num_overloaded_;
+    return OVERLOADED;
+  }
+  ++num_inflight_;
+  return CTRL_OK;
+}
+
+void AdmissionController::Complete(TimePoint now, uint64_t latency_us) {
+  --num_inflight_;
+  double latency_ms = latency_us / 1e3;
+  std::lock_guard<std::mutex> lock(mu_);
+  RecentMinLatencyLocked(now);
+  if (window_min_ms_ == 0 || latency_ms < window_min_ms_) {
+    window_min_ms_ = latency_ms;
+  }
+}
+
+void AdmissionController::Abandon() {
+  --num_inflight_;
+}
+
+double AdmissionController::EstimateLatency(TimePoint now) {
+  std::lock_guard<std::mutex> lock(mu_);
+  return EstimateLatencyLocked(now);
+}
+
+double AdmissionController::EstimateLatencyLocked(TimePoint now) {
+  if (capacity_ <= 0) {
+    return 0.;
+  }
+  double base_ms = RecentMinLatencyLocked(now);
+  if (base_ms >= slo_ms_) {
+    // The SLO cannot be met even without queuing, only shed on the backlog
+    base_ms = 0.;
+  }
+  return base_ms + std::max<int64_t>(num_inflight_, 0) / capacity_ * 1e3;
+}
+
+double AdmissionController::RecentMinLatencyLocked(TimePoint now) {
+  auto window = std::chrono::milliseconds(FLAGS_admission_window_ms);
+  if (now - window_start_ >= window) {
+    // Keep the last window so the minimum isn't lost at each rotation
+    prev_window_min_ms_ = (now - window_start_ >= 2 * window) ? 0. :
+                          window_min_ms_;
+    window_min_ms_ = 0.;
+    window_start_ = now;
+  }
+  if (window_min_ms_ == 0) {
+    return prev_window_min_ms_;
+  }
+  if (prev_window_min_ms_ == 0) {
+    return window_min_ms_;
+  }
+  return std::min(window_min_ms_, prev_window_min_ms_);
+}
+
+void AdmissionController::EvictIdleUsersLocked(TimePoint now) {
+  if (now < next_eviction_) {
+    return;
+  }
+  // A bucket refills within burst / rate, so sweeping once per refill time
+  // keeps the map to the users active in about the last two of them
+  double refill_sec = std::max(user_burst_ / user_rate_, 1.);
+  next_eviction_ = now + std::chrono::microseconds(
+      static_cast<int64_t>(refill_sec * 1e6));
+  for (auto iter = user_buckets_.begin(); iter != user_buckets_.end();) {
+    if (iter->second.Full(now)) {
+      iter = user_buckets_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+} // namespace app
+} // namespace nexus
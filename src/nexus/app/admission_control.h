@@ -0,0 +1,123 @@
+#ifndef NEXUS_APP_ADMISSION_CONTROL_H_
+#define NEXUS_APP_ADMISSION_CONTROL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "nexus/common/time_util.h"
+#include "nexus/proto/control.pb.h"
+
+namespace nexus {
+namespace app {
+
+/*! \brief TokenBucket limits the request rate of one user. */
+class TokenBucket {
+ public:
+  /*!
+   * \brief Constructor of TokenBucket, which starts full.
+   * \param rate Tokens added per second
+   * \param burst Maximum number of tokens
+   * \param now Current time
+   */
+  TokenBucket(double rate, double burst, TimePoint now);
+  /*!
+   * \brief Takes one token if available.
+   * \param now Current time
+   * \param retry_after_ms Time until a token is available if there is none
+   * \return true if a token is taken
+   */
+  bool TryAcquire(TimePoint now, uint32_t* retry_after_ms);
+  /*! \brief Whether the bucket has refilled, as a new one would be. */
+  bool Full(TimePoint now) const;
+
+ private:
+  double rate_;
+  double burst_;
+  double tokens_;
+  TimePoint last_;
+};
+
+/*!
+ * \brief AdmissionController rejects requests of an app early when they
+ * would miss the SLO anyway, so that admitted requests finish in time
+ * instead of every request queuing past its deadline.
+ *
+ * The completion time of a new request is estimated as the minimum latency
+ * observed recently plus the time to drain the requests in flight at the
+ * capacity of the bottleneck model route. Route throughput covers all
+ * frontends of the app, so the estimate errs on admitting with several
+ * frontends.
+ */
+class AdmissionController {
+ public:
+  AdmissionController();
+  /*! \brief Sets the end-to-end SLO in ms, 0 disables shedding. */
+  void SetSlo(double slo_ms);
+  /*! \brief Sets the bottleneck route throughput in req/s, 0 if unknown. */
+  void SetCapacity(double capacity);
+  /*!
+   * \brief Limits the request rate of each user.
+   * \param rate Requests per second of each user, 0 disables the limit
+   * \param burst Number of requests a user can send at once
+   */
+  void SetUserRateLimit(double rate, double burst);
+  /*!
+   * \brief Decides whether to admit a request. An admitted request must be
+   * reported with Complete.
+   * \param user_id User that sends the request
+   * \param now Current time
+   * \param retry_after_ms Time to wait before retrying if rejected
+   * \return CTRL_OK if admitted, RATE_LIMITED or OVERLOADED if rejected
+   */
+  CtrlStatus Admit(uint32_t user_id, TimePoint now, uint32_t* retry_after_ms);
+  /*!
+   * \brief Records that an admitted request is replied.
+   * \param now Current time
+   * \param latency_us End-to-end latency of the request
+   */
+  void Complete(TimePoint now, uint64_t latency_us);
+  /*!
+   * \brief Records that an admitted request ends without a reply, e.g., a
+   * lost backend reply. Frees its slot without a latency sample.
+   */
+  void Abandon();
+  /*! \brief Estimated completion time of a new request in ms. */
+  double EstimateLatency(TimePoint now);
+  /*! \brief Number of admitted requests not replied yet. */
+  int64_t num_inflight() const { return num_inflight_; }
+
+  uint64_t num_overloaded() const { return num_overloaded_; }
+
+  uint64_t num_rate_limited() const { return num_rate_limited_; }
+
+ private:
+  double EstimateLatencyLocked(TimePoint now);
+  /*! \brief Minimum latency over the last two windows, 0 if unknown. */
+  double RecentMinLatencyLocked(TimePoint now);
+  /*! \brief Drops the buckets of idle users, which have refilled. */
+  void EvictIdleUsersLocked(TimePoint now);
+
+  std::atomic<int64_t> num_inflight_;
+  std::atomic<uint64_t> num_overloaded_;
+  std::atomic<uint64_t> num_rate_limited_;
+  /*! \brief SLO, capacity and latency window. Guarded by mu_ */
+  double slo_ms_;
+  double capacity_;
+  TimePoint window_start_;
+  double window_min_ms_;
+  double prev_window_min_ms_;
+  std::mutex mu_;
+  /*! \brief Per-user token buckets. Guarded by user_mu_ */
+  double user_rate_;
+  double user_burst_;
+  std::unordered_map<uint32_t, TokenBucket> user_buckets_;
+  TimePoint next_eviction_;
+  std::mutex user_mu_;
+};
+
+} // namespace app
+} // namespace nexus
+
+#endif // NEXUS_APP_ADMISSION_CONTROL_H_
@@ -61,6 +61,59 @@ std::shared_ptr<ModelHandler> AppBase::GetModelHandler(
   return model_handler;
 }
 
+std::shared_ptr<ModelHandler> AppBase::GetModelHandler(
+    const std::string& framework, const std::string& model_name,
+    uint32_t version, uint64_t latency_sla,
+    const std::vector<ModelSession>& variants, float estimate_workload,
+    LoadBalancePolicy lb_policy) {
+  LoadModelRequest req;
+  req.set_node_id(node_id());
+  auto model_sess = req.mutable_model_session();
+  model_sess->set_framework(framework);
+  model_sess->set_model_name(model_name);
+  model_sess->set_version(version);
+  model_sess->set_latency_sla(latency_sla);
+  for (auto const& variant : variants) {
+    req.add_variants()->CopyFrom(variant);
+  }
+  if (estimate_workload < 0) {
+    LOG(ERROR) << "Estimate workload must be non-negative value";
+    return nullptr;
+  }
+  if (estimate_workload > 0) {
+    req.set_estimate_workload(estimate_workload);
+  }
+
+  auto model_handler = LoadModel(req, lb_policy);
+  if (model_handler == nullptr) {
+    LOG(FATAL) << "Load model failed";
+  }
+  return model_handler;
+}
+
+std::shared_ptr<Cascade> AppBase::GetCascade(
+    const ModelSession& fast, const ModelSession& heavy, uint64_t latency_sla,
+    float threshold, float estimate_workload, float escalation_rate,
+    LoadBalancePolicy lb_policy) {
+  LoadCascadeRequest req;
+  req.set_node_id(node_id());
+  req.mutable_fast_model_session()->CopyFrom(fast);
+  req.mutable_heavy_model_session()->CopyFrom(heavy);
+  req.set_latency_sla(latency_sla);
+  if (estimate_workload < 0) {
+    LOG(ERROR) << "Estimate workload must be non-negative value";
+    return nullptr;
+  }
+  req.set_estimate_workload(estimate_workload);
+  req.set_escalation_rate(escalation_rate);
+
+  std::shared_ptr<ModelHandler> fast_handler, heavy_handler;
+  if (!LoadCascade(req, lb_policy, &fast_handler, &heavy_handler)) {
+    LOG(FATAL) << "Load cascade failed";
+  }
+  return std::make_shared<Cascade>(fast_handler, heavy_handler, threshold);
+}
+
 bool AppBase::IsComplexQuery() const {
   return slo_us_ != 0;
 }
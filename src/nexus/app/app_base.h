@@ -2,6 +2,7 @@
 #define NEXUS_APP_APP_BASE_H_
 
 #include <gflags/gflags.h>
+#include "nexus/app/cascade.h"
 #include "nexus/app/frontend.h"
 
 DECLARE_int32(load_balance);
@@ -35,6 +36,35 @@ class AppBase : public Frontend {
       uint32_t version, uint64_t latency_sla, float estimate_workload=0.,
       std::vector<uint32_t> image_size={},
       LoadBalancePolicy lb_policy=LoadBalancePolicy(FLAGS_load_balance));
+  /*!
+   * \brief Loads a model session with cheaper variants that the scheduler
+   * degrades queries to under overload.
+   * \param variants Variants ordered from the most to the least accurate,
+   *   zero latency_sla means the latency_sla of the model session
+   */
+  std::shared_ptr<ModelHandler> GetModelHandler(
+      const std::string& framework, const std::string& model_name,
+      uint32_t version, uint64_t latency_sla,
+      const std::vector<ModelSession>& variants, float estimate_workload=0.,
+      LoadBalancePolicy lb_policy=LoadBalancePolicy(FLAGS_load_balance));
+  /*!
+   * \brief Loads a cascade of a fast model and a heavy model. The scheduler
+   * splits latency_sla between the two models.
+   * \param fast Model session of the fast model, latency_sla is ignored
+   * \param heavy Model session of the heavy model, latency_sla is ignored
+   * \param latency_sla End-to-end latency SLA in ms
+   * \param threshold Queries with a fast model confidence below threshold
+   *   are escalated to the heavy model
+   * \param estimate_workload Estimated request rate
+   * \param escalation_rate Expected fraction of escalated queries
+   * \param lb_policy Load balance policy
+   */
+  std::shared_ptr<Cascade> GetCascade(
+      const ModelSession& fast, const ModelSession& heavy,
+      uint64_t latency_sla, float threshold, float estimate_workload=0.,
+      float escalation_rate=0.5,
+      LoadBalancePolicy lb_policy=LoadBalancePolicy(FLAGS_load_balance));
+
   size_t nthreads_;
   QueryProcessor* qp_;
 
@@ -0,0 +1,52 @@
+#include "nexus/app/cascade.h"
+
+namespace nexus {
+namespace app {
+
+Cascade::Cascade(std::shared_ptr<ModelHandler> fast,
+                 std::shared_ptr<ModelHandler> heavy, float threshold) :
+    fast_(fast),
+    heavy_(heavy),
+    threshold_(threshold) {
+}
+
+std::vector<ExecBlock*> Cascade::CreateExecBlocks(
+    int first_block_id, const std::string& output_var) {
+  std::string fast_var = output_var + "_fast";
+  auto run_fast = [this, fast_var](std::shared_ptr<RequestContext> ctx) {
+    auto output = fast_->Execute(ctx, ctx->const_request().input(),
+                                 {"class_id", "class_prob", "class_name"});
+    return std::vector<VariablePtr>{
+      std::make_shared<Variable>(fast_var, output)};
+  };
+  auto escalate = [this, fast_var, output_var](
+      std::shared_ptr<RequestContext> ctx) {
+    auto fast_output = ctx->GetVariable(fast_var)->result();
+    if (IsConfident(*fast_output)) {
+      return std::vector<VariablePtr>{
+        std::make_shared<Variable>(output_var, fast_output)};
+    }
+    auto output = heavy_->Execute(ctx, ctx->const_request().input());
+    return std::vector<VariablePtr>{
+      std::make_shared<Variable>(output_var, output)};
+  };
+  return {new ExecBlock(first_block_id, run_fast, {}),
+          new ExecBlock(first_block_id + 1, escalate, {fast_var})};
+}
+
+bool Cascade::IsConfident(const QueryResult& result) const {
+  // Failed fast queries never get here as RequestContext fails the whole
+  // request on them. Escalate results without records, e.g. when the backend
+  // omits the output
+  if (result.num_records() == 0) {
+    return false;
+  }
+  const Record& record = result[0];
+  if (!record.HasValue("class_prob")) {
+    return false;
+  }
+  return record["class_prob"].as<float>() >= threshold_;
+}
+
+} // namespace app
+} // namespace nexus
@@ -0,0 +1,59 @@
+#ifndef NEXUS_APP_CASCADE_H_
+#define NEXUS_APP_CASCADE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nexus/app/exec_block.h"
+#include "nexus/app/model_handler.h"
+
+namespace nexus {
+namespace app {
+
+/*!
+ * \brief Cascade runs every query on a fast model first and escalates it to
+ * a heavy model only if the fast model is not confident enough.
+ *
+ * Both models must output class_prob, e.g. classification models.
+ */
+class Cascade {
+ public:
+  /*!
+   * \brief Constructor of Cascade
+   * \param fast Model handler of the fast model
+   * \param heavy Model handler of the heavy model
+   * \param threshold Minimum class_prob of the fast model to skip the heavy
+   *   model
+   */
+  Cascade(std::shared_ptr<ModelHandler> fast,
+          std::shared_ptr<ModelHandler> heavy, float threshold);
+
+  std::shared_ptr<ModelHandler> fast_model() const { return fast_; }
+
+  std::shared_ptr<ModelHandler> heavy_model() const { return heavy_; }
+
+  float threshold() const { return threshold_; }
+  /*!
+   * \brief Creates two exec blocks that run the cascade on the request input.
+   * \param first_block_id ID of the first exec block, the second one gets
+   *   first_block_id + 1
+   * \param output_var Name of the variable holding the cascade output
+   * \return Exec blocks of the cascade
+   */
+  std::vector<ExecBlock*> CreateExecBlocks(int first_block_id,
+                                           const std::string& output_var);
+
+ private:
+  /*! \brief Whether the fast model output is confident enough */
+  bool IsConfident(const QueryResult& result) const;
+
+  std::shared_ptr<ModelHandler> fast_;
+  std::shared_ptr<ModelHandler> heavy_;
+  float threshold_;
+};
+
+} // namespace app
+} // namespace nexus
+
+#endif // NEXUS_APP_CASCADE_H_
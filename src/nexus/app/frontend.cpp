@@ -1,10 +1,23 @@
+#include <algorithm>
 #include <limits>
 #include <gflags/gflags.h>
 
 #include "nexus/app/frontend.h"
+#include "nexus/common/alloc_tracker.h"
+#include "nexus/common/async_log.h"
 #include "nexus/common/config.h"
 
 DECLARE_int32(load_balance);
+DEFINE_bool(admission_control, false, "Reject requests early with OVERLOADED "
+            "when they are estimated to miss the SLO");
+DEFINE_int32(admission_slo_ms, 0, "End-to-end SLO for admission control in "
+             "ms, 0 means the largest latency SLA of the model sessions");
+DEFINE_double(user_rate_limit, 0, "Requests per second of each user, 0 "
+              "means unlimited");
+DEFINE_double(user_burst, 10, "Number of requests a user can send at once "
+              "under the rate limit");
+DEFINE_int32(request_timeout_ms, 10000, "Reply TIMEOUT to requests still "
+             "waiting for backends this long past their deadline");
 
 namespace nexus {
 namespace app {
@@ -14,6 +27,7 @@ Frontend::Frontend(std::string port, std::string rpc_port,
     ServerBase(port),
     rpc_service_(this, rpc_port),
     rand_gen_(rd_()) {
+  admission_.SetUserRateLimit(FLAGS_user_rate_limit, FLAGS_user_burst);
   // Start RPC service
   rpc_service_.Start();
   // Init scheduler client
@@ -44,7 +58,7 @@ void Frontend::Run(QueryProcessor* qp, size_t nthreads) {
   daemon_thread_ = std::thread(&Frontend::Daemon, this);
   LOG(INFO) << "Frontend server (id: " << node_id_ << ") is listening on " <<
       address();
-  io_context_.run();
+  RunListeners();
 }
 
 void Frontend::Stop() {
@@ -53,12 +67,17 @@ void Frontend::Stop() {
   Unregister();
   // Stop all accept new connections
   ServerBase::Stop();
-  // Stop all frontend connections
-  for (auto conn: connection_pool_) {
+  // Stop all frontend connections. Listeners on other threads may still
+  // accept until their acceptors close.
+  std::unordered_set<std::shared_ptr<Connection> > conns;
+  {
+    std::lock_guard<std::mutex> lock(user_mutex_);
+    conns.swap(connection_pool_);
+    user_sessions_.clear();
+  }
+  for (auto conn: conns) {
     conn->Stop();
   }
-  connection_pool_.clear();
-  user_sessions_.clear();
   // Stop all backend connections
   backend_pool_.StopAll();
   // Stop workers
@@ -74,10 +93,15 @@ void Frontend::Stop() {
   LOG(INFO) << "Frontend server stopped";
 }
 
-void Frontend::HandleAccept() {
-  auto conn = std::make_shared<UserSession>(std::move(socket_), this);
-  connection_pool_.insert(conn);
+std::shared_ptr<Connection> Frontend::HandleAccept(
+    boost::asio::ip::tcp::socket socket) {
+  auto conn = std::make_shared<UserSession>(std::move(socket), this);
+  {
+    std::lock_guard<std::mutex> lock(user_mutex_);
+    connection_pool_.insert(conn);
+  }
   conn->Start();
+  return conn;
 }
 
 void Frontend::HandleMessage(std::shared_ptr<Connection> conn,
@@ -105,20 +129,32 @@ void Frontend::HandleMessage(std::shared_ptr<Connection> conn,
         LOG(ERROR) << "UserRequest message comes from non-user connection";
         break;
       }
-      request_pool_.AddNewRequest(std::make_shared<RequestContext>(
-          user_sess, message, request_pool_));
+      auto ctx = RequestContext::Create(user_sess, message, request_pool_);
+      if (FLAGS_admission_control || FLAGS_user_rate_limit > 0) {
+        uint32_t retry_after_ms = 0;
+        CtrlStatus status = admission_.Admit(user_sess->user_id(),
+                                             Clock::now(), &retry_after_ms);
+        if (status != CTRL_OK) {
+          // Reply right away, the request would miss its deadline anyway
+          ctx->reply()->set_status(status);
+          ctx->reply()->set_error_message(CtrlStatus_Name(status));
+          ctx->reply()->set_retry_after_ms(retry_after_ms);
+          ctx->SendReply();
+          break;
+        }
+        ctx->set_admission(&admission_);
+      }
+      request_pool_.AddNewRequest(ctx);
       break;
     }
     case kBackendReply: {
       QueryResultProto result;
       message->DecodeBody(&result);
-      std::string model_session_id = result.model_session_id();
-      auto itr = model_pool_.find(model_session_id);
-      if (itr == model_pool_.end()) {
-        LOG(ERROR) << "Cannot find model handler for " << model_session_id;
-        break;
+      ModelHandler* handler = FindModelHandler(result.session_index(),
+                                               result.model_session_id());
+      if (handler != nullptr) {
+        handler->HandleReply(result);
       }
-      itr->second->HandleReply(result);
       break;
     }
     default: {
@@ -164,6 +200,7 @@ void Frontend::UpdateModelRoutes(const ModelRouteUpdates& request,
       success = false;
     }
   }
+  UpdateAdmission();
   if (success) {
     reply->set_status(CTRL_OK);
   } else {
@@ -198,11 +235,52 @@ std::shared_ptr<ModelHandler> Frontend::LoadModel(const LoadModelRequest& req,
     LOG(ERROR) << "Load model error: " << CtrlStatus_Name(reply.status());
     return nullptr;
   }
+  // Variants go first so that the model route can refer to them
+  for (auto const& route : reply.variant_route()) {
+    variant_sessions_.insert(route.model_session_id());
+    AddModelHandler(route, lb_policy);
+  }
+  return AddModelHandler(reply.model_route(), lb_policy);
+}
+
+bool Frontend::LoadCascade(const LoadCascadeRequest& req,
+                           LoadBalancePolicy lb_policy,
+                           std::shared_ptr<ModelHandler>* fast,
+                           std::shared_ptr<ModelHandler>* heavy) {
+  LoadCascadeReply reply;
+  grpc::ClientContext context;
+  grpc::Status status = sch_stub_->LoadCascade(&context, req, &reply);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to connect to scheduler: " <<
+        status.error_message() << "(" << status.error_code() << ")";
+    return false;
+  }
+  if (reply.status() != CTRL_OK) {
+    LOG(ERROR) << "Load cascade error: " << CtrlStatus_Name(reply.status());
+    return false;
+  }
+  *fast = AddModelHandler(reply.fast_model_route(), lb_policy);
+  *heavy = AddModelHandler(reply.heavy_model_route(), lb_policy);
+  return true;
+}
+
+std::shared_ptr<ModelHandler> Frontend::AddModelHandler(
+    const ModelRouteProto& route, LoadBalancePolicy lb_policy) {
   auto model_handler = std::make_shared<ModelHandler>(
-      reply.model_route().model_session_id(), backend_pool_, lb_policy);
+      route.model_session_id(), route.session_index(), backend_pool_,
+      lb_policy);
   // Only happens at Setup stage, so no concurrent modification to model_pool_
+  // and model_handlers_
   model_pool_.emplace(model_handler->model_session_id(), model_handler);
-  UpdateBackendPoolAndModelRoute(reply.model_route());
+  uint32_t session_index = model_handler->session_index();
+  if (session_index > 0) {
+    if (session_index >= model_handlers_.size()) {
+      model_handlers_.resize(session_index + 1);
+    }
+    model_handlers_[session_index] = model_handler;
+  }
+  UpdateBackendPoolAndModelRoute(route);
+  UpdateAdmission();
 
   return model_handler;
 }
@@ -297,6 +375,7 @@ void Frontend::KeepAlive() {
   KeepAliveRequest request;
   request.set_node_type(FRONTEND_NODE);
   request.set_node_id(node_id_);
+  request.set_cpu_utilization(cpu_util_.Update());
   RpcReply reply;
   grpc::Status status = sch_stub_->KeepAlive(&context, request, &reply);
   if (!status.ok()) {
@@ -310,6 +389,48 @@ void Frontend::KeepAlive() {
   }
 }
 
+void Frontend::HandleExpired(std::shared_ptr<Connection> conn,
+                             std::shared_ptr<Message> message) {
+  if (message->type() != kBackendRequest) {
+    return;
+  }
+  QueryProto query;
+  message->DecodeBody(&query);
+  ModelHandler* handler = FindModelHandler(query.session_index(),
+                                           query.model_session_id());
+  if (handler == nullptr) {
+    return;
+  }
+  QueryResultProto result;
+  result.set_query_id(query.query_id());
+  result.set_session_index(query.session_index());
+  result.set_model_session_id(query.model_session_id());
+  result.set_status(TIMEOUT);
+  result.set_error_message("Query expired before it was sent to backend");
+  handler->HandleReply(result);
+}
+
+ModelHandler* Frontend::FindModelHandler(uint32_t session_index,
+                                         const std::string& model_session_id) {
+  ModelHandler* handler = nullptr;
+  if (session_index > 0) {
+    if (session_index < model_handlers_.size()) {
+      handler = model_handlers_[session_index].get();
+    }
+  } else {
+    auto itr = model_pool_.find(model_session_id);
+    if (itr != model_pool_.end()) {
+      handler = itr->second.get();
+    }
+  }
+  if (handler == nullptr) {
+    LOG(ERROR) << "Cannot find model handler for " <<
+        (session_index > 0 ? std::to_string(session_index) :
+         model_session_id);
+  }
+  return handler;
+}
+
 bool Frontend::UpdateBackendPoolAndModelRoute(const ModelRouteProto& route) {
   auto& model_session_id = route.model_session_id();
   LOG(INFO) << "Update model route for " << model_session_id;
@@ -352,6 +473,19 @@ bool Frontend::UpdateBackendPoolAndModelRoute(const ModelRouteProto& route) {
   }
   // Update route to backends with throughput in model handler
   model_handler->UpdateRoute(route);
+  if (route.variant_share_size() > 0) {
+    std::vector<std::pair<std::shared_ptr<ModelHandler>, double> > variants;
+    for (auto const& variant_share : route.variant_share()) {
+      auto variant_iter = model_pool_.find(variant_share.model_session_id());
+      if (variant_iter == model_pool_.end()) {
+        LOG(ERROR) << "Cannot find model handler for " <<
+            variant_share.model_session_id();
+        continue;
+      }
+      variants.emplace_back(variant_iter->second, variant_share.share());
+    }
+    model_handler->UpdateVariants(variants);
+  }
   return true;
 }
 
@@ -373,6 +507,29 @@ void Frontend::RegisterUser(
   reply->set_status(CTRL_OK);
 }
 
+void Frontend::UpdateAdmission() {
+  if (!FLAGS_admission_control) {
+    return;
+  }
+  // Requests are served at the rate of the slowest model session they go
+  // through, variants count towards the model session they degrade
+  double capacity = 0.;
+  uint32_t slo_ms = 0;
+  for (auto const& iter : model_pool_) {
+    if (variant_sessions_.count(iter.first) > 0) {
+      continue;
+    }
+    double throughput = iter.second->Throughput();
+    if (throughput > 0 && (capacity == 0 || throughput < capacity)) {
+      capacity = throughput;
+    }
+    slo_ms = std::max(slo_ms, iter.second->model_session().latency_sla());
+  }
+  admission_.SetCapacity(capacity);
+  admission_.SetSlo(FLAGS_admission_slo_ms > 0 ? FLAGS_admission_slo_ms :
+                    slo_ms);
+}
+
 void Frontend::Daemon() {
   while (running_) {
     auto next_time = Clock::now() + std::chrono::seconds(beacon_interval_sec_);
@@ -388,6 +545,30 @@ void Frontend::Daemon() {
       }
     }
     ReportWorkload(workload_stats);
+    size_t num_expired = request_pool_.ExpireBlockRequests(
+        Clock::now(), std::chrono::milliseconds(FLAGS_request_timeout_ms));
+    if (num_expired > 0) {
+      LOG(WARNING) << num_expired << " requests timed out waiting for "
+          "backends";
+    }
+    if (FLAGS_admission_control || FLAGS_user_rate_limit > 0) {
+      VLOG(1) << "Admission: " << admission_.num_inflight() << " in flight, " <<
+          admission_.num_overloaded() << " overloaded, " <<
+          admission_.num_rate_limited() << " rate limited";
+    }
+    if (VLOG_IS_ON(1)) {
+      AllocTracker::Singleton().LogStats();
+      LogListenerStats();
+      auto lv = GetLogVolume();
+      VLOG(1) << "Logs: " << lv.logged << " async written, " << lv.dropped <<
+          " dropped, " << lv.suppressed << " suppressed";
+      VLOG(1) << "Write queues: " << Connection::num_reordered() <<
+          " reordered, " << Connection::num_expired() << " expired";
+      auto cs = GetCompressionStats();
+      VLOG(1) << "Compression: " << cs.num_compressed << " compressed, " <<
+          cs.num_skipped << " skipped, " << cs.raw_bytes << " -> " <<
+          cs.wire_bytes << " bytes, " << cs.cpu_us << " us";
+    }
     std::this_thread::sleep_until(next_time);
   }
 }
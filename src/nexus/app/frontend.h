@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "nexus/app/admission_control.h"
 #include "nexus/app/model_handler.h"
 #include "nexus/app/query_processor.h"
 #include "nexus/app/request_context.h"
@@ -20,6 +21,7 @@
 #include "nexus/common/model_def.h"
 #include "nexus/common/server_base.h"
 #include "nexus/common/spinlock.h"
+#include "nexus/common/util.h"
 #include "nexus/proto/control.grpc.pb.h"
 #include "nexus/proto/nnquery.pb.h"
 
@@ -42,7 +44,8 @@ class Frontend : public ServerBase, public MessageHandler {
 
   void Stop();
   /*! \brief Accepts new user connection */
-  void HandleAccept() final;
+  std::shared_ptr<Connection> HandleAccept(
+      boost::asio::ip::tcp::socket socket) final;
   /*!
    * \brief Handles new messages from user or backend connections
    * \param conn Shared pointer of Connection
@@ -57,6 +60,14 @@ class Frontend : public ServerBase, public MessageHandler {
    */
   void HandleError(std::shared_ptr<Connection> conn,
                    boost::system::error_code ec) final;
+  /*!
+   * \brief Completes a query dropped before reaching its backend with a
+   * timeout result
+   * \param conn Backend connection that drops the query
+   * \param message Dropped message
+   */
+  void HandleExpired(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final;
 
   void UpdateModelRoutes(const ModelRouteUpdates& request, RpcReply* reply);
 
@@ -67,6 +78,17 @@ class Frontend : public ServerBase, public MessageHandler {
 
   std::shared_ptr<ModelHandler> LoadModel(const LoadModelRequest& req,
                                           LoadBalancePolicy lb_policy);
+  /*!
+   * \brief Loads the two model sessions of a cascade.
+   * \param req Load cascade request
+   * \param lb_policy Load balance policy of both model handlers
+   * \param fast Model handler of the fast model
+   * \param heavy Model handler of the heavy model
+   * \return true if both model sessions are loaded
+   */
+  bool LoadCascade(const LoadCascadeRequest& req, LoadBalancePolicy lb_policy,
+                   std::shared_ptr<ModelHandler>* fast,
+                   std::shared_ptr<ModelHandler>* heavy);
 
   void ComplexQuerySetup(const ComplexQuerySetupRequest& req);
 
@@ -80,9 +102,24 @@ class Frontend : public ServerBase, public MessageHandler {
   void KeepAlive();
 
   bool UpdateBackendPoolAndModelRoute(const ModelRouteProto& route);
+  /*!
+   * \brief Finds the model handler of a query by session index, or by model
+   * session ID if the index is 0.
+   * \return Model handler, nullptr if not found
+   */
+  ModelHandler* FindModelHandler(uint32_t session_index,
+                                 const std::string& model_session_id);
+
+  std::shared_ptr<ModelHandler> AddModelHandler(const ModelRouteProto& route,
+                                                LoadBalancePolicy lb_policy);
 
   void RegisterUser(std::shared_ptr<UserSession> user_sess,
                     const RequestProto& request, ReplyProto* reply);
+  /*!
+   * \brief Updates the SLO and capacity of admission control from the model
+   * sessions and their routes.
+   */
+  void UpdateAdmission();
 
   void Daemon();
 
@@ -99,6 +136,8 @@ class Frontend : public ServerBase, public MessageHandler {
   RpcService rpc_service_;
   /*! \brief RPC client connected to scheduler */
   std::unique_ptr<SchedulerCtrl::Stub> sch_stub_;
+  /*! \brief CPU utilization reported in keep alive */
+  CpuUtilization cpu_util_;
   /*! \brief Backend pool */
   BackendPool backend_pool_;
   /*!
@@ -119,6 +158,18 @@ class Frontend : public ServerBase, public MessageHandler {
    * \brief Map from model session ID to model handler.
    */
   std::unordered_map<std::string, std::shared_ptr<ModelHandler> > model_pool_;
+  /*!
+   * \brief Model handlers indexed by session index, used to dispatch backend
+   * replies.
+   */
+  std::vector<std::shared_ptr<ModelHandler> > model_handlers_;
+  /*!
+   * \brief Model sessions only loaded as cheaper variants of another model
+   * session. Only modified at Setup stage.
+   */
+  std::unordered_set<std::string> variant_sessions_;
+  /*! \brief Admission control of user requests */
+  AdmissionController admission_;
 
   std::thread daemon_thread_;
   /*! \brief Mutex for connection_pool_ and user_sessions_ */
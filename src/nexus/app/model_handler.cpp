@@ -1,14 +1,20 @@
+#include <algorithm>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 #include <typeinfo>
 
 #include "nexus/app/model_handler.h"
 #include "nexus/app/request_context.h"
+#include "nexus/common/async_log.h"
 #include "nexus/common/model_def.h"
 
 DEFINE_int32(count_interval, 1, "Interval to count number of requests in sec");
 DEFINE_int32(load_balance, 1, "Load balance policy (1: random, 2: choice of 2, "
              "3: deficit round robin)");
+DEFINE_bool(frontend_transcode, false, "Decode request images once at the "
+            "frontend and send each model an image resized to its input");
+DEFINE_string(transcode_format, "jpeg", "Format of images transcoded by the "
+              "frontend, jpeg or raw");
 
 namespace nexus {
 namespace app {
@@ -76,16 +82,22 @@ void QueryResult::SetError(uint32_t status, const std::string& error_msg) {
 std::atomic<uint64_t> ModelHandler::global_query_id_(0);
 
 ModelHandler::ModelHandler(const std::string& model_session_id,
-                           BackendPool& pool, LoadBalancePolicy lb_policy) :
+                           uint32_t session_index, BackendPool& pool,
+                           LoadBalancePolicy lb_policy) :
     model_session_id_(model_session_id),
+    session_index_(session_index),
     backend_pool_(pool),
     lb_policy_(lb_policy),
     total_throughput_(0.),
+    image_height_(0),
+    image_width_(0),
+    frontend_preprocess_(false),
     rand_gen_(rd_()) {
   ParseModelSession(model_session_id, &model_session_);
   counter_ = MetricRegistry::Singleton().CreateIntervalCounter(
       FLAGS_count_interval);
-  LOG(INFO) << model_session_id_ << " load balance policy: " << lb_policy_;
+  LOG(INFO) << model_session_id_ << " (session index " << session_index_ <<
+      ") load balance policy: " << lb_policy_;
   if (lb_policy_ == LB_DeficitRR) {
     running_ = true;
     deficit_thread_ = std::thread(&ModelHandler::DeficitDaemon, this);
@@ -104,6 +116,10 @@ std::shared_ptr<QueryResult> ModelHandler::Execute(
     std::shared_ptr<RequestContext> ctx, const ValueProto& input,
     std::vector<std::string> output_fields, uint32_t topk,
     std::vector<RectProto> windows) {
+  auto variant = GetVariant();
+  if (variant != nullptr) {
+    return variant->Execute(ctx, input, output_fields, topk, windows);
+  }
   uint64_t qid = global_query_id_.fetch_add(1, std::memory_order_relaxed);
   counter_->Increase(1);
   auto reply = std::make_shared<QueryResult>(qid);
@@ -114,8 +130,17 @@ std::shared_ptr<QueryResult> ModelHandler::Execute(
   }
   QueryProto query;
   query.set_query_id(qid);
-  query.set_model_session_id(model_session_id_);
-  query.mutable_input()->CopyFrom(input);
+  if (session_index_ > 0) {
+    query.set_session_index(session_index_);
+  } else {
+    query.set_model_session_id(model_session_id_);
+  }
+  ValueProto transcoded;
+  if (TranscodeInput(ctx, input, &windows, &transcoded)) {
+    query.mutable_input()->Swap(&transcoded);
+  } else {
+    query.mutable_input()->CopyFrom(input);
+  }
   for (auto field : output_fields) {
     query.add_output_field(field);
   }
@@ -133,7 +158,11 @@ std::shared_ptr<QueryResult> ModelHandler::Execute(
     std::lock_guard<std::mutex> lock(query_ctx_mu_);
     query_ctx_.emplace(qid, ctx);
   }
-  auto msg = std::make_shared<Message>(kBackendRequest, query.ByteSizeLong());
+  // The backend gives the query the same budget from its arrival
+  auto deadline = Clock::now() + std::chrono::milliseconds(
+      model_session_.latency_sla() + std::max(query.slack_ms(), 0));
+  auto msg = std::make_shared<Message>(kBackendRequest, query.ByteSizeLong(),
+                                       deadline);
   msg->EncodeBody(query);
   backend->Write(std::move(msg));
   return reply;
@@ -145,11 +174,12 @@ void ModelHandler::HandleReply(const QueryResultProto& result) {
   auto iter = query_ctx_.find(qid);
   if (iter == query_ctx_.end()) {
     // FIXME why this happens? lower from FATAL to ERROR temporarily
-    LOG(ERROR) << model_session_id_ << " cannot find query context for query " << qid;
+    LOG_EVERY_MS(ERROR, 1000) << model_session_id_ <<
+        " cannot find query context for query " << qid;
     return;
   }
   auto ctx = iter->second;
-  ctx->HandleQueryResult(result);
+  ctx->HandleQueryResult(result, *this);
   query_ctx_.erase(qid);
 }
 
@@ -158,6 +188,9 @@ void ModelHandler::UpdateRoute(const ModelRouteProto& route) {
   backends_.clear();
   backend_rates_.clear();
   total_throughput_ = 0.;
+  image_height_ = route.image_height();
+  image_width_ = route.image_width();
+  frontend_preprocess_ = route.frontend_preprocess();
   
   for (auto itr : route.backend_rate()) {
     uint32_t backend_id = itr.info().node_id();
@@ -180,6 +213,60 @@ void ModelHandler::UpdateRoute(const ModelRouteProto& route) {
   }
 }
 
+void ModelHandler::UpdateVariants(
+    const std::vector<std::pair<std::shared_ptr<ModelHandler>, double> >&
+    variants) {
+  std::lock_guard<std::mutex> lock(route_mu_);
+  variants_ = variants;
+  for (auto const& iter : variants_) {
+    if (iter.second > 0) {
+      LOG(INFO) << "- degrade " << iter.second << " to " <<
+          iter.first->model_session_id();
+    }
+  }
+}
+
+bool ModelHandler::TranscodeInput(std::shared_ptr<RequestContext> ctx,
+                                  const ValueProto& input,
+                                  std::vector<RectProto>* windows,
+                                  ValueProto* transcoded) {
+  // The scheduler places preprocessing at the frontend per model session, in
+  // which case raw pixels are sent so the backend skips the decode
+  bool frontend_preprocess = frontend_preprocess_;
+  if (!FLAGS_frontend_transcode && !frontend_preprocess) {
+    return false;
+  }
+  // Only the request input is transcoded, it is decoded once and shared by
+  // all models the request is sent to
+  if (&input != &ctx->const_request().input()) {
+    return false;
+  }
+  auto transcoder = ctx->transcoder();
+  if (transcoder == nullptr) {
+    return false;
+  }
+  auto format = (frontend_preprocess || FLAGS_transcode_format == "raw") ?
+                ImageProto::RAW : ImageProto::JPEG;
+  return transcoder->Transcode(image_height_, image_width_, format, windows,
+                               transcoded);
+}
+
+std::shared_ptr<ModelHandler> ModelHandler::GetVariant() {
+  std::lock_guard<std::mutex> lock(route_mu_);
+  if (variants_.empty()) {
+    return nullptr;
+  }
+  std::uniform_real_distribution<double> dis(0, 1);
+  double select = dis(rand_gen_);
+  for (auto const& iter : variants_) {
+    select -= iter.second;
+    if (select < 0) {
+      return iter.first;
+    }
+  }
+  return nullptr;
+}
+
 std::vector<uint32_t> ModelHandler::BackendList() {
   std::vector<uint32_t> ret;
   std::lock_guard<std::mutex> lock(route_mu_);
@@ -189,6 +276,24 @@ std::vector<uint32_t> ModelHandler::BackendList() {
   return ret;
 }
 
+double ModelHandler::Throughput() {
+  std::vector<std::shared_ptr<ModelHandler> > variants;
+  double throughput;
+  {
+    std::lock_guard<std::mutex> lock(route_mu_);
+    throughput = total_throughput_;
+    for (auto const& iter : variants_) {
+      if (iter.second > 0) {
+        variants.push_back(iter.first);
+      }
+    }
+  }
+  for (auto const& variant : variants) {
+    throughput += variant->Throughput();
+  }
+  return throughput;
+}
+
 std::shared_ptr<BackendSession> ModelHandler::GetBackend() {
   std::lock_guard<std::mutex> lock(route_mu_);
   switch (lb_policy_) {
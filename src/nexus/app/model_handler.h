@@ -11,6 +11,7 @@
 
 #include "nexus/common/backend_pool.h"
 #include "nexus/common/data_type.h"
+#include "nexus/common/flat_map.h"
 #include "nexus/common/metric.h"
 #include "nexus/proto/nnquery.pb.h"
 
@@ -78,14 +79,16 @@ enum LoadBalancePolicy {
 
 class ModelHandler {
  public:
-  ModelHandler(const std::string& model_session_id, BackendPool& pool,
-               LoadBalancePolicy lb_policy);
+  ModelHandler(const std::string& model_session_id, uint32_t session_index,
+               BackendPool& pool, LoadBalancePolicy lb_policy);
 
   ~ModelHandler();
 
-  ModelSession model_session() const { return model_session_; }
+  const ModelSession& model_session() const { return model_session_; }
 
-  std::string model_session_id() const { return model_session_id_; }
+  const std::string& model_session_id() const { return model_session_id_; }
+  /*! \brief Session index assigned by scheduler, 0 if not assigned */
+  uint32_t session_index() const { return session_index_; }
 
   std::shared_ptr<IntervalCounter> counter() const { return counter_; }
 
@@ -97,10 +100,32 @@ class ModelHandler {
   void HandleReply(const QueryResultProto& result);
 
   void UpdateRoute(const ModelRouteProto& route);
+  /*!
+   * \brief Updates the cheaper variants that queries are degraded to.
+   * \param variants Pairs of variant model handler and fraction of queries
+   */
+  void UpdateVariants(
+      const std::vector<std::pair<std::shared_ptr<ModelHandler>, double> >&
+      variants);
 
   std::vector<uint32_t> BackendList();
+  /*!
+   * \brief Gets the route throughput in req/s, including the variants that
+   * queries are degraded to.
+   */
+  double Throughput();
 
  private:
+  /*!
+   * \brief Transcodes the request image to the model input size.
+   * \return false if the input should be sent as is
+   */
+  bool TranscodeInput(std::shared_ptr<RequestContext> ctx,
+                      const ValueProto& input, std::vector<RectProto>* windows,
+                      ValueProto* transcoded);
+  /*! \brief Picks a variant to degrade the query to, nullptr if none */
+  std::shared_ptr<ModelHandler> GetVariant();
+
   std::shared_ptr<BackendSession> GetBackend();
   
   std::shared_ptr<BackendSession> GetBackendWeightedRoundRobin();
@@ -111,6 +136,7 @@ class ModelHandler {
 
   ModelSession model_session_;
   std::string model_session_id_;
+  uint32_t session_index_;
   BackendPool& backend_pool_;
   LoadBalancePolicy lb_policy_;
   static std::atomic<uint64_t> global_query_id_;
@@ -124,13 +150,24 @@ class ModelHandler {
   std::unordered_map<uint32_t, double> backend_rates_;
 
   std::unordered_map<uint32_t, double> backend_quantums_;
+  /*!
+   * \brief Cheaper variants and fraction of queries sent to each of them.
+   *
+   *   Guarded by route_mu_
+   */
+  std::vector<std::pair<std::shared_ptr<ModelHandler>, double> > variants_;
   float total_throughput_;
+  /*! \brief Model input image size from the route, 0 if unknown */
+  std::atomic<uint32_t> image_height_;
+  std::atomic<uint32_t> image_width_;
+  /*! \brief Whether the scheduler placed preprocessing at the frontend */
+  std::atomic<bool> frontend_preprocess_;
   /*! \brief Interval counter to count number of requests within each
    *  interval.
    */
   std::shared_ptr<IntervalCounter> counter_;
 
-  std::unordered_map<uint64_t, std::shared_ptr<RequestContext> > query_ctx_;
+  FlatMap<uint64_t, std::shared_ptr<RequestContext> > query_ctx_;
   std::mutex route_mu_;
   std::mutex query_ctx_mu_;
   /*! \brief random number generator */
@@ -1,22 +1,104 @@
 #include "nexus/app/exec_block.h"
 #include "nexus/app/request_context.h"
+#include "nexus/common/alloc_tracker.h"
 #include "nexus/common/model_def.h"
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
+DEFINE_int32(transcode_quality, 90, "JPEG quality of images transcoded by "
+             "the frontend");
+
 namespace nexus {
 namespace app {
 
-RequestContext::RequestContext(std::shared_ptr<UserSession> user_sess,
-                               std::shared_ptr<Message> msg,
-                               RequestPool& req_pool) :
+namespace {
+
+google::protobuf::ArenaOptions RequestArenaOptions(char* block, size_t size) {
+  google::protobuf::ArenaOptions options;
+  options.initial_block = block;
+  options.initial_block_size = size;
+  options.block_alloc = AllocateProtobufBlock;
+  options.block_dealloc = FreeProtobufBlock;
+  return options;
+}
+
+} // namespace
+
+RequestContext::RequestContext() :
     DeadlineItem(),
-    user_session_(user_sess),
-    req_pool_(req_pool),
+    req_pool_(nullptr),
+    admission_(nullptr),
+    arena_(RequestArenaOptions(arena_block_, kArenaBlockSize)),
+    request_(nullptr),
+    reply_(nullptr),
     state_(kUninitialized),
     slack_ms_(0.) {
+}
+
+RequestContext::RequestContext(std::shared_ptr<UserSession> user_sess,
+                               std::shared_ptr<Message> msg,
+                               RequestPool& req_pool) :
+    RequestContext() {
+  Init(user_sess, msg, req_pool);
+}
+
+std::shared_ptr<RequestContext> RequestContext::Create(
+    std::shared_ptr<UserSession> user_sess, std::shared_ptr<Message> msg,
+    RequestPool& req_pool) {
+  static ObjectPool<RequestContext>* ctx_pool =
+      new ObjectPool<RequestContext>();
+  auto ctx = ctx_pool->Get();
+  ctx->Init(user_sess, msg, req_pool);
+  return ctx;
+}
+
+void RequestContext::Init(std::shared_ptr<UserSession> user_sess,
+                          std::shared_ptr<Message> msg,
+                          RequestPool& req_pool) {
+  ResetBegin();
   SetDeadline(std::chrono::milliseconds(50));
-  //beg_ = Clock::now();
-  msg->DecodeBody(&request_);
+  user_session_ = user_sess;
+  req_pool_ = &req_pool;
+  request_ = google::protobuf::Arena::CreateMessage<RequestProto>(&arena_);
+  reply_ = google::protobuf::Arena::CreateMessage<ReplyProto>(&arena_);
+  msg->DecodeBody(request_);
+}
+
+void RequestContext::Clear() {
+  if (admission_ != nullptr) {
+    // Admitted but never replied, e.g., a backend reply was lost
+    admission_->Abandon();
+    admission_ = nullptr;
+  }
+  user_session_.reset();
+  req_pool_ = nullptr;
+  state_ = kUninitialized;
+  slack_ms_ = 0.;
+  ready_blocks_.clear();
+  pending_blocks_.clear();
+  block_deps_.clear();
+  vars_.clear();
+  waiting_vars_.clear();
+  qid_var_map_.clear();
+  dangling_results_.clear();
+  query_send_.clear();
+  transcoder_.reset();
+  request_ = nullptr;
+  reply_ = nullptr;
+  arena_.Reset();
+}
+
+ImageTranscoder* RequestContext::transcoder() {
+  const auto& input = request_->input();
+  if (input.data_type() != DT_IMAGE) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  if (transcoder_ == nullptr) {
+    transcoder_.reset(new ImageTranscoder(input.image(),
+                                          FLAGS_transcode_quality));
+  }
+  return transcoder_.get();
 }
 
 bool RequestContext::finished() {
@@ -34,11 +116,11 @@ void RequestContext::SetState(RequestState state) {
   }
   if (prev_state == kBlocking) {
     if (state == kRunning || state == kError) {
-      req_pool_.MoveToReady(shared_from_this());
+      req_pool_->MoveToReady(shared_from_this());
     }
   } else if (prev_state == kRunning) {
     if (state == kBlocking) {
-      req_pool_.AddBlockRequest(shared_from_this());
+      req_pool_->AddBlockRequest(shared_from_this());
     }
   }
 }
@@ -98,7 +180,8 @@ void RequestContext::AddBlockReturn(std::vector<VariablePtr> vars) {
   }
 }
 
-void RequestContext::HandleQueryResult(const QueryResultProto& result) {
+void RequestContext::HandleQueryResult(const QueryResultProto& result,
+                                       const ModelHandler& handler) {
   if (state_ == kError) {
     return;
   }
@@ -106,11 +189,11 @@ void RequestContext::HandleQueryResult(const QueryResultProto& result) {
   // Add query latency info
   uint64_t qid = result.query_id();
 
-  auto query_latency = reply_.add_query_latency();
+  auto query_latency = reply_->add_query_latency();
   auto recv_ts = std::chrono::duration_cast<std::chrono::microseconds>(
       Clock::now() - begin_).count();
   query_latency->set_query_id(qid);
-  query_latency->set_model_session_id(result.model_session_id());
+  query_latency->set_model_session_id(handler.model_session_id());
   query_latency->set_frontend_send_timestamp_us(query_send_.at(qid));
   query_latency->set_frontend_recv_timestamp_us(recv_ts);
   query_latency->set_backend_latency_us(result.latency_us());
@@ -118,13 +201,11 @@ void RequestContext::HandleQueryResult(const QueryResultProto& result) {
   query_latency->set_use_backup(result.use_backup());
   
   double latency = recv_ts - query_send_.at(qid);
-  ModelSession model_sess;
-  ParseModelSession(result.model_session_id(), &model_sess);
-  slack_ms_ += model_sess.latency_sla() - latency / 1e3;
+  slack_ms_ += handler.model_session().latency_sla() - latency / 1e3;
   query_send_.erase(qid);
 
   if (result.status() != CTRL_OK) {
-    // LOG(INFO) << request_.user_id() << ":" << request_.req_id() << ":" <<
+    // LOG(INFO) << request_->user_id() << ":" << request_->req_id() << ":" <<
     //     result.query_id() << " error: " << result.status();
     HandleErrorLocked(result.status(), result.error_message());
     return;
@@ -159,14 +240,19 @@ void RequestContext::RecordQuerySend(uint64_t qid) {
 }
 
 void RequestContext::SendReply() {
-  reply_.set_user_id(request_.user_id());
-  reply_.set_req_id(request_.req_id());
+  reply_->set_user_id(request_->user_id());
+  reply_->set_req_id(request_->req_id());
+  auto now = Clock::now();
   auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
-      Clock::now() - begin_).count();
-  reply_.set_latency_us(latency);
+      now - begin_).count();
+  reply_->set_latency_us(latency);
+  if (admission_ != nullptr) {
+    admission_->Complete(now, latency);
+    admission_ = nullptr;
+  }
   auto reply_msg = std::make_shared<Message>(kUserReply,
-                                             reply_.ByteSizeLong());
-  reply_msg->EncodeBody(reply_);
+                                             reply_->ByteSizeLong());
+  reply_msg->EncodeBody(*reply_);
   user_session_->Write(std::move(reply_msg));
 }
 
@@ -192,12 +278,30 @@ void RequestContext::AddReadyVariable(std::shared_ptr<Variable> var) {
 
 void RequestContext::HandleErrorLocked(uint32_t status,
                                        const std::string& error_msg) {
-  reply_.set_status(status);
-  reply_.set_error_message(error_msg);
+  reply_->set_status(status);
+  reply_->set_error_message(error_msg);
   ready_blocks_.clear();
   pending_blocks_.clear();
   SetState(kError);
 }
 
+size_t RequestPool::ExpireBlockRequests(TimePoint now,
+                                        std::chrono::milliseconds timeout) {
+  std::vector<std::shared_ptr<RequestContext> > expired;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (auto& req : block_requests_) {
+      if (req->deadline() + timeout < now) {
+        expired.push_back(req);
+      }
+    }
+  }
+  // Failing a request moves it to the ready queue, which takes mu_
+  for (auto& req : expired) {
+    req->HandleError(TIMEOUT, "Request timed out");
+  }
+  return expired.size();
+}
+
 } // namespace app
 } // namespace nexus
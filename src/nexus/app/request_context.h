@@ -1,14 +1,19 @@
 #ifndef NEXUS_APP_REQUEST_CONTEXT_H_
 #define NEXUS_APP_REQUEST_CONTEXT_H_
 
+#include <google/protobuf/arena.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <mutex>
 
+#include "nexus/app/admission_control.h"
 #include "nexus/app/model_handler.h"
 #include "nexus/app/user_session.h"
 #include "nexus/common/block_queue.h"
+#include "nexus/common/flat_map.h"
+#include "nexus/common/image_transcoder.h"
+#include "nexus/common/object_pool.h"
 #include "nexus/proto/nnquery.pb.h"
 
 namespace nexus {
@@ -90,20 +95,39 @@ class RequestContext : public DeadlineItem,
  public:
   RequestContext(std::shared_ptr<UserSession> user_sess,
                  std::shared_ptr<Message> msg, RequestPool& req_pool);
+  /*!
+   * \brief Get a request context from the context pool. The context is
+   * returned to the pool once the last reference is released.
+   * \param user_sess User session that sends the request
+   * \param msg Request message
+   * \param req_pool Request pool that schedules the request
+   * \return Request context pointer
+   */
+  static std::shared_ptr<RequestContext> Create(
+      std::shared_ptr<UserSession> user_sess, std::shared_ptr<Message> msg,
+      RequestPool& req_pool);
+  /*! \brief Release all state of the request so the context can be reused. */
+  void Clear();
 
-  RequestProto* request() { return &request_; }
+  RequestProto* request() { return request_; }
 
-  const RequestProto& const_request() const { return request_; }
+  const RequestProto& const_request() const { return *request_; }
 
-  ReplyProto* reply() { return &reply_; }
+  ReplyProto* reply() { return reply_; }
 
-  const ReplyProto& const_reply() const { return reply_; }
+  const ReplyProto& const_reply() const { return *reply_; }
 
   RequestState state() const { return state_; }
 
   bool finished();
 
   double slack_ms() const { return slack_ms_; }
+  /*!
+   * \brief Gets the transcoder of the request input image, created on the
+   * first call so the image is decoded at most once per request.
+   * \return Image transcoder, nullptr if the input is not an image
+   */
+  ImageTranscoder* transcoder();
 
   void SetState(RequestState state);
 
@@ -115,24 +139,43 @@ class RequestContext : public DeadlineItem,
 
   void AddBlockReturn(std::vector<VariablePtr> vars);
 
-  void HandleQueryResult(const QueryResultProto& result);
+  void HandleQueryResult(const QueryResultProto& result,
+                         const ModelHandler& handler);
 
   void HandleError(uint32_t status, const std::string& error_msg);
 
   void RecordQuerySend(uint64_t qid);
+  /*!
+   * \brief Marks the request as admitted, so its completion is reported to
+   * admission control when replied.
+   */
+  void set_admission(AdmissionController* admission) { admission_ = admission; }
 
   void SendReply();
 
  private:
+  RequestContext();
+
+  void Init(std::shared_ptr<UserSession> user_sess,
+            std::shared_ptr<Message> msg, RequestPool& req_pool);
+
   void AddReadyVariable(std::shared_ptr<Variable> var);
 
   void HandleErrorLocked(uint32_t status, const std::string& error_msg);
 
  protected:
   std::shared_ptr<UserSession> user_session_;
-  RequestPool& req_pool_;
-  RequestProto request_;
-  ReplyProto reply_;
+  RequestPool* req_pool_;
+  /*! \brief Admission control that admitted the request, nullptr if none */
+  AdmissionController* admission_;
+  /*! \brief Size of the arena block embedded in each request context */
+  static constexpr size_t kArenaBlockSize = 4096;
+  /*! \brief Initial arena block, reused across resets */
+  char arena_block_[kArenaBlockSize];
+  /*! \brief Arena that holds request and reply */
+  google::protobuf::Arena arena_;
+  RequestProto* request_;
+  ReplyProto* reply_;
   std::atomic<RequestState> state_;
   double slack_ms_;
   
@@ -142,10 +185,13 @@ class RequestContext : public DeadlineItem,
   
   std::unordered_map<std::string, VariablePtr> vars_;
   std::unordered_map<std::string, VariablePtr> waiting_vars_;
-  std::unordered_map<uint64_t, std::string> qid_var_map_;
-  std::unordered_map<uint64_t, QueryResultProto> dangling_results_;
-  std::unordered_map<uint64_t, uint64_t> query_send_;
+  FlatMap<uint64_t, std::string> qid_var_map_;
+  FlatMap<uint64_t, QueryResultProto> dangling_results_;
+  FlatMap<uint64_t, uint64_t> query_send_;
+  std::unique_ptr<ImageTranscoder> transcoder_;
   std::mutex mu_;
+
+  friend class ObjectPool<RequestContext>;
 };
 
 class RequestPool {
@@ -168,6 +214,13 @@ class RequestPool {
   std::shared_ptr<RequestContext> GetRequest(std::chrono::milliseconds timeout) {
     return ready_requests_.pop(timeout);
   }
+  /*!
+   * \brief Fails the blocked requests that are past their deadline by more
+   * than timeout with TIMEOUT, so that they are replied and released even
+   * if a backend never returns their queries.
+   * \return Number of requests failed
+   */
+  size_t ExpireBlockRequests(TimePoint now, std::chrono::milliseconds timeout);
 
  private:
   BlockPriorityQueue<RequestContext> ready_requests_;
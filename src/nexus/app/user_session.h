@@ -9,7 +9,9 @@ namespace app {
 class UserSession : public Connection {
  public:
   UserSession(boost::asio::ip::tcp::socket socket, MessageHandler* handler) :
-      Connection(std::move(socket), handler), user_id_(0) {}
+      Connection(std::move(socket), handler), user_id_(0) {
+    max_header_version_ = 0;
+  }
 
   uint32_t user_id() const { return user_id_; }
 
@@ -10,6 +10,7 @@
 #include <glog/logging.h>
 
 #include "nexus/backend/backend_server.h"
+#include "nexus/common/async_log.h"
 #include "nexus/common/config.h"
 #include "nexus/common/image.h"
 #include "nexus/common/util.h"
@@ -70,6 +71,8 @@ int main(int argc, char **argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
   // Setup backtrace on segfault
   google::InstallFailureSignalHandler();
+  // Move stderr logging off the request threads
+  InitAsyncLogging();
   // Decide server IP address
   LOG(INFO) << "Backend server: port " << FLAGS_port << ", rpc port "
             << FLAGS_rpc_port << ", workers " << FLAGS_num_workers << ", gpu "
@@ -3,6 +3,8 @@
 #include <pthread.h>
 #include <unordered_set>
 
+#include "nexus/common/alloc_tracker.h"
+#include "nexus/common/async_log.h"
 #include "nexus/common/config.h"
 #include "nexus/common/model_db.h"
 #include "nexus/backend/backend_server.h"
@@ -99,7 +101,7 @@ void BackendServer::Run() {
   LOG(INFO) << "Backend server (id: " << node_id_ << ") is listening on " <<
       address();
   // Start the IO service
-  io_context_.run();
+  RunListeners();
 }
 
 void BackendServer::Stop() {
@@ -134,11 +136,13 @@ void BackendServer::Stop() {
   LOG(INFO) << "Backend server stopped";
 }
 
-void BackendServer::HandleAccept() {
+std::shared_ptr<Connection> BackendServer::HandleAccept(
+    boost::asio::ip::tcp::socket socket) {
   std::lock_guard<std::mutex> lock(frontend_mutex_);
-  auto conn = std::make_shared<Connection>(std::move(socket_), this);
+  auto conn = std::make_shared<Connection>(std::move(socket), this);
   frontend_connections_.insert(conn);
   conn->Start();
+  return conn;
 }
 
 void BackendServer::HandleMessage(std::shared_ptr<Connection> conn,
@@ -146,8 +150,11 @@ void BackendServer::HandleMessage(std::shared_ptr<Connection> conn,
   switch (message->type()) {
     case kBackendRequest:
     case kBackendRelay: {
-      auto task = std::make_shared<Task>(conn);
+      auto task = Task::Create(conn);
       task->DecodeQuery(message);
+      uint32_t latency_sla_ms;
+      task->model = GetModel(task->query, &latency_sla_ms);
+      task->SetLatencySla(latency_sla_ms);
       task_queue_.push(std::move(task));
       break;
     }
@@ -173,6 +180,42 @@ void BackendServer::HandleError(std::shared_ptr<Connection> conn,
   conn->Stop();
 }
 
+void BackendServer::HandleExpired(std::shared_ptr<Connection> conn,
+                                  std::shared_ptr<Message> message) {
+  switch (message->type()) {
+    case kBackendReply:
+    case kBackendRelayReply: {
+      QueryResultProto result;
+      message->DecodeBody(&result);
+      result.clear_output();
+      result.set_status(TIMEOUT);
+      // Without a deadline, the timeout reply is never dropped
+      auto msg = std::make_shared<Message>(message->type(),
+                                           result.ByteSizeLong());
+      msg->EncodeBody(result);
+      conn->Write(std::move(msg));
+      break;
+    }
+    case kBackendRelay: {
+      // The query ID of a relayed query is the task ID
+      QueryProto query;
+      message->DecodeBody(&query);
+      QueryResultProto result;
+      result.set_query_id(query.query_id());
+      result.set_session_index(query.session_index());
+      result.set_model_session_id(query.model_session_id());
+      result.set_status(TIMEOUT);
+      auto msg = std::make_shared<Message>(kBackendRelayReply,
+                                           result.ByteSizeLong());
+      msg->EncodeBody(result);
+      std::static_pointer_cast<BackupClient>(conn)->Reply(std::move(msg));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
 void BackendServer::UpdateModelTableAsync(const ModelTableConfig& request) {
   auto cfg = std::make_shared<ModelTableConfig>();
   cfg->CopyFrom(request);
@@ -374,6 +417,43 @@ void BackendServer::UpdateModelTable(const ModelTableConfig& request) {
     }
   }
   
+  // Update the duty cycles each model runs in
+  for (auto const& config : request.model_instance_config()) {
+    auto model_iter = model_table_.find(
+        ModelSessionToString(config.model_session(0)));
+    if (model_iter != model_table_.end()) {
+      model_iter->second->SetCycle(config.cycle_period(), config.cycle_phase());
+    }
+  }
+
+  // Rebuild the session index table used by the request path
+  std::vector<SessionEntry> session_entries;
+  std::unordered_map<std::string, uint32_t> session_indices;
+  for (auto const& config : request.model_instance_config()) {
+    for (auto const& model_sess : config.model_session()) {
+      uint32_t index = model_sess.session_index();
+      if (index == 0) {
+        continue;
+      }
+      std::string session_id = ModelSessionToString(model_sess);
+      auto model_iter = model_table_.find(session_id);
+      if (model_iter == model_table_.end()) {
+        continue;
+      }
+      if (index >= session_entries.size()) {
+        session_entries.resize(index + 1, SessionEntry{nullptr, 0});
+      }
+      session_entries[index] = SessionEntry{model_iter->second,
+                                            model_sess.latency_sla()};
+      session_indices.emplace(session_id, index);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> session_lock(session_mu_);
+    session_entries_.swap(session_entries);
+    session_indices_.swap(session_indices);
+  }
+
   // Update duty cycle
   gpu_executor_->SetDutyCycle(request.duty_cycle_us());
   LOG(INFO) << "Duty cycle: " << request.duty_cycle_us() << " us";
@@ -382,14 +462,28 @@ void BackendServer::UpdateModelTable(const ModelTableConfig& request) {
 #endif
 }
 
-ModelExecutorPtr BackendServer::GetModel(const std::string& model_session_id) {
-  std::lock_guard<std::mutex> lock(model_table_mu_);
-  auto itr = model_table_.find(model_session_id);
-  if (itr == model_table_.end()) {
-    LOG(WARNING) << "Model session is not loaded: " << model_session_id;
+ModelExecutorPtr BackendServer::GetModel(QueryProto* query,
+                                         uint32_t* latency_sla_ms) {
+  *latency_sla_ms = 0;
+  std::lock_guard<std::mutex> lock(session_mu_);
+  uint32_t index = query->session_index();
+  if (index == 0) {
+    auto iter = session_indices_.find(query->model_session_id());
+    if (iter == session_indices_.end()) {
+      LOG(WARNING) << "Model session is not loaded: " <<
+          query->model_session_id();
+      return nullptr;
+    }
+    index = iter->second;
+    query->set_session_index(index);
+  }
+  if (index >= session_entries_.size() ||
+      session_entries_[index].model == nullptr) {
+    LOG(WARNING) << "Model session is not loaded: " << index;
     return nullptr;
   }
-  return itr->second;
+  *latency_sla_ms = session_entries_[index].latency_sla_ms;
+  return session_entries_[index].model;
 }
 
 BackendServer::ModelTable BackendServer::GetModelTable() {
@@ -423,6 +517,19 @@ void BackendServer::Daemon() {
             ", drop rate: " << drop_rate;
       }
     }
+    if (VLOG_IS_ON(1)) {
+      AllocTracker::Singleton().LogStats();
+      LogListenerStats();
+      auto lv = GetLogVolume();
+      VLOG(1) << "Logs: " << lv.logged << " async written, " << lv.dropped <<
+          " dropped, " << lv.suppressed << " suppressed";
+      VLOG(1) << "Write queues: " << Connection::num_reordered() <<
+          " reordered, " << Connection::num_expired() << " expired";
+      auto cs = GetCompressionStats();
+      VLOG(1) << "Compression: " << cs.num_compressed << " compressed, " <<
+          cs.num_skipped << " skipped, " << cs.raw_bytes << " -> " <<
+          cs.wire_bytes << " bytes, " << cs.cpu_us << " us";
+    }
     std::this_thread::sleep_until(next_time);
   }
 }
@@ -507,6 +614,7 @@ void BackendServer::KeepAlive() {
   KeepAliveRequest req;
   req.set_node_type(BACKEND_NODE);
   req.set_node_id(node_id_);
+  req.set_cpu_utilization(cpu_util_.Update());
   RpcReply reply;
   grpc::Status status = sch_stub_->KeepAlive(&context, req, &reply);
   if (!status.ok()) {
@@ -21,6 +21,7 @@
 #include "nexus/common/model_def.h"
 #include "nexus/common/server_base.h"
 #include "nexus/common/spinlock.h"
+#include "nexus/common/util.h"
 #include "nexus/proto/control.grpc.pb.h"
 
 namespace nexus {
@@ -56,7 +57,8 @@ class BackendServer : public ServerBase, public MessageHandler {
   /*! \brief Stops the backend server */
   void Stop() final;
   /*! \brief Accepts a new connection */
-  void HandleAccept() final;
+  std::shared_ptr<Connection> HandleAccept(
+      boost::asio::ip::tcp::socket socket) final;
   /*!
    * \brief Handles a new message
    * \param conn Connection that receives the message
@@ -71,6 +73,14 @@ class BackendServer : public ServerBase, public MessageHandler {
    */
   void HandleError(std::shared_ptr<Connection> conn,
                    boost::system::error_code ec) final;
+  /*!
+   * \brief Replaces an expired reply with a status-only timeout reply, so
+   * that the frontend still completes the query
+   * \param conn Connection that drops the message
+   * \param message Dropped message
+   */
+  void HandleExpired(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final;
 
   void UpdateModelTableAsync(const ModelTableConfig& req);
   /*!
@@ -80,11 +90,16 @@ class BackendServer : public ServerBase, public MessageHandler {
    */
   void UpdateModelTable(const ModelTableConfig& req);
   /*!
-   * \brief Gets the model instance given model session ID
-   * \param model_session_id Model session ID
-   * \return Model instance pointer
+   * \brief Gets the model instance that serves the model session of query.
+   *
+   * Queries are looked up by session index. A query that only carries the
+   * model session ID gets its session index filled in.
+   *
+   * \param query Query to look up
+   * \param latency_sla_ms Latency SLA of the model session, 0 if not loaded
+   * \return Model instance pointer, nullptr if not loaded
    */
-  ModelExecutorPtr GetModel(const std::string& model_session_id);
+  ModelExecutorPtr GetModel(QueryProto* query, uint32_t* latency_sla_ms);
   /*!
    * \brief Gets all model instances loaded in the backend server
    * \return All model instances
@@ -132,6 +147,8 @@ class BackendServer : public ServerBase, public MessageHandler {
   BackendRpcService rpc_service_;
   /*! \brief RPC client for sending requests to scheduler */
   std::unique_ptr<SchedulerCtrl::Stub> sch_stub_;
+  /*! \brief CPU utilization reported in keep alive */
+  CpuUtilization cpu_util_;
   /*! \brief Daemon thread */
   std::thread daemon_thread_;
 
@@ -157,6 +174,26 @@ class BackendServer : public ServerBase, public MessageHandler {
   BlockQueue<ModelTableConfig> model_table_requests_;
   /*! \brief Mutex for accessing model_table_ */
   std::mutex model_table_mu_;
+  /*! \brief Model instance and latency SLA of a model session */
+  struct SessionEntry {
+    ModelExecutorPtr model;
+    uint32_t latency_sla_ms;
+  };
+  /*!
+   * \brief Model sessions indexed by session index, rebuilt on every model
+   * table update. Guarded by session_mu_.
+   */
+  std::vector<SessionEntry> session_entries_;
+  /*!
+   * \brief Map from model session ID to session index, only used for queries
+   * without session index. Guarded by session_mu_.
+   */
+  std::unordered_map<std::string, uint32_t> session_indices_;
+  /*!
+   * \brief Mutex for session_entries_ and session_indices_. Separate from
+   * model_table_mu_ so that lookups don't wait for model loading.
+   */
+  std::mutex session_mu_;
   /*! \brief Backend pool for backup servers. */
   BackendPool backend_pool_;
   /*! \brief Random number genertor */
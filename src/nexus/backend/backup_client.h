@@ -6,6 +6,7 @@
 
 #include "nexus/backend/task.h"
 #include "nexus/common/backend_pool.h"
+#include "nexus/common/flat_map.h"
 
 namespace nexus {
 namespace backend {
@@ -21,10 +22,13 @@ class BackupClient : public BackendSession {
   void Reply(std::shared_ptr<Message> message);
 
  private:
-  /*! \brief Map from task id to frontend connection. Guarded by relay_mu_. */
-  std::unordered_map<uint64_t, std::shared_ptr<Connection> > conns_;
-  /*! \brief Map from task id to query id. Guarded by relay_mu_. */
-  std::unordered_map<uint64_t, uint64_t> qid_lookup_;
+  /*! \brief Original query id and frontend connection of relayed task */
+  struct RelayEntry {
+    uint64_t qid;
+    std::shared_ptr<Connection> conn;
+  };
+  /*! \brief Map from task id to relay entry. Guarded by relay_mu_. */
+  FlatMap<uint64_t, RelayEntry> relays_;
   std::mutex relay_mu_;
 };
 
@@ -1,4 +1,5 @@
 #include "nexus/backend/batch_task.h"
+#include "nexus/common/alloc_tracker.h"
 #include "nexus/common/util.h"
 #include <glog/logging.h>
 
@@ -36,6 +37,7 @@ void BatchTask::CreateOutputArrays(
   if (inputs_.size() > 0) {
     batch = inputs_.size();
   }
+  AllocTagScope alloc_tag(kAllocBatchOutput);
   for (auto iter : sizes) {
     auto arr = std::make_shared<Array>(DT_FLOAT, batch * iter.second,
                                        device);
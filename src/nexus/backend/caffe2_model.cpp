@@ -23,15 +23,16 @@ namespace backend {
 Caffe2Model::Caffe2Model(int gpu_id, const ModelInstanceConfig& config) :
     ModelInstance(gpu_id, config),
     first_input_array_(true) {
-  CHECK(model_info_["init_net"]) << "Missing cfg_file in the model info";
-  CHECK(model_info_["predict_net"]) << "Missing weight_file in the model info";
-  CHECK(model_info_["mean_file"] || model_info_["mean_value"])
+  const YAML::Node& model_config = model_info_->config;
+  CHECK(model_config["init_net"]) << "Missing cfg_file in the model info";
+  CHECK(model_config["predict_net"]) << "Missing weight_file in the model info";
+  CHECK(!model_info_->mean_file.empty() || !model_info_->input_mean.empty())
       << "Missing mean_file or mean_value in the model info";
   // load caffe model
-  fs::path model_dir = fs::path(model_info_["model_dir"].as<std::string>());
-  fs::path init_net_path = model_dir / model_info_["init_net"].
+  fs::path model_dir = fs::path(model_info_->model_dir);
+  fs::path init_net_path = model_dir / model_config["init_net"].
                            as<std::string>();
-  fs::path predict_net_path = model_dir / model_info_["predict_net"].
+  fs::path predict_net_path = model_dir / model_config["predict_net"].
                               as<std::string>();
   CHECK(fs::exists(init_net_path)) << "init_net file " << init_net_path <<
       " doesn't exist";
@@ -86,14 +87,15 @@ Caffe2Model::Caffe2Model(int gpu_id, const ModelInstanceConfig& config) :
       " (" << output_size_ << ")";
   
   // Get preprocessing parameters
-  if (model_info_["scale"]) {
-    scale_ = model_info_["scale"].as<float>();
-  } else {
-    scale_ = 1.;
-  }
-  if (model_info_["mean_file"]) {
-    has_mean_file_ = true;
-    fs::path mean_file = model_dir / model_info_["mean_file"].as<std::string>();
+  scale_ = model_info_->scale;
+  ImageTransformParam transform_param;
+  transform_param.height = image_height_;
+  transform_param.width = image_width_;
+  transform_param.layout = kLayoutNCHW;
+  transform_param.data_type = DT_FLOAT;
+  transform_param.channel_order = CO_BGR;
+  if (!model_info_->mean_file.empty()) {
+    fs::path mean_file = model_dir / model_info_->mean_file;
     caffe::BlobProto mean_proto;
     caffe2::ReadProtoFromBinaryFile(mean_file.string().c_str(), &mean_proto);
     size_t mean_size = 1;
@@ -111,23 +113,36 @@ Caffe2Model::Caffe2Model(int gpu_id, const ModelInstanceConfig& config) :
     for (uint i = 0; i < mean_size; ++i) {
       mean_blob_[i] = mean_proto.data(i);
     }
+    transform_param.norm = kNormMeanBlob;
+    transform_param.mean_blob = mean_blob_.data();
+    transform_param.scale[0] = scale_;
   } else {
-    has_mean_file_ = false;
-    const YAML::Node& mean_values = model_info_["mean_value"];
-    CHECK(mean_values.IsSequence()) << "mean_value in the config is " <<
-        "not sequence";
-    CHECK_EQ(mean_values.size(), 3) << "mean_value must have 3 values";
-    for (uint i = 0; i < mean_values.size(); ++i) {
-      mean_value_.push_back(mean_values[i].as<float>());
+    CHECK_EQ(model_info_->input_mean.size(), 3) << "mean_value must have " <<
+        "3 values";
+    mean_value_ = model_info_->input_mean;
+    transform_param.norm = kNormMeanValue;
+    for (int c = 0; c < 3; ++c) {
+      transform_param.mean[c] = mean_value_[c];
+      transform_param.scale[c] = scale_;
     }
   }
+  preprocessor_ = ImagePreprocessor(transform_param, cpu_device_);
   
   // Load classnames
-  if (model_info_["class_names"]) {
-    fs::path cns_path = model_dir / model_info_["class_names"].
-                        as<std::string>();
+  if (!model_info_->class_names.empty()) {
+    fs::path cns_path = model_dir / model_info_->class_names;
     LoadClassnames(cns_path.string(), &classnames_);
   }
+
+  if (model_type_ == kClassification) {
+    const auto* classnames = classnames_.empty() ? nullptr : &classnames_;
+    postprocess_output_ = [this, classnames](
+        Task* task, const std::shared_ptr<Output>& output) {
+      float* out_data = output->arrays.at(output_blob_name_)->Data<float>();
+      PostprocessClassification(*task->query, out_data, output_size_,
+                                task->result, classnames);
+    };
+  }
 }
 
 Shape Caffe2Model::InputShape() {
@@ -185,54 +200,7 @@ std::unordered_map<std::string, ArrayPtr> Caffe2Model::GetOutputGpuArrays() {
 }
 
 void Caffe2Model::Preprocess(std::shared_ptr<Task> task) {
-  auto prepare_image = [&](cv::Mat& image) {
-    auto in_arr = std::make_shared<Array>(DT_FLOAT, input_size_, cpu_device_);
-    cv::Mat resized_img;
-    cv::resize(image, resized_img, cv::Size(image_width_, image_height_));
-    float* out_ptr = in_arr->Data<float>();
-    int out_index;
-    for (int h = 0; h < image_height_; ++h) {
-      const uchar* ptr = resized_img.ptr<uchar>(h);
-      int in_index = 0;
-      for (int w = 0; w < image_width_; ++w) {
-        for (int c = 0; c < 3; ++c) {
-          out_index = (c * image_height_ + h) * image_width_ + w;
-          float pixel = static_cast<float>(ptr[in_index++]);
-          if (has_mean_file_) {
-            out_ptr[out_index] = (pixel - mean_blob_[out_index]) * scale_;
-          } else {
-            out_ptr[out_index] = (pixel - mean_value_[c]) * scale_;
-          }
-        }
-      }
-    }
-    task->AppendInput(in_arr);
-  };
-
-  const auto& query = task->query;
-  const auto& input_data = query.input();
-  switch (input_data.data_type()) {
-    case DT_IMAGE: {
-      cv::Mat cv_img_bgr = DecodeImage(input_data.image(), CO_BGR);
-      if (query.window_size() > 0) {
-        for (int i = 0; i < query.window_size(); ++i) {
-          const auto& rect = query.window(i);
-          cv::Mat crop_img = cv_img_bgr(cv::Rect(
-              rect.left(), rect.top(), rect.right() - rect.left(),
-              rect.bottom() - rect.top()));
-          prepare_image(crop_img);
-        }
-      } else {
-        prepare_image(cv_img_bgr);
-      }
-      break;
-    }
-    default:
-      task->result.set_status(INPUT_TYPE_INCORRECT);
-      task->result.set_error_message("Input type incorrect: " +
-                                     DataType_Name(input_data.data_type()));
-      break;
-  }
+  preprocessor_.Process(task.get());
 }
 
 void Caffe2Model::Forward(std::shared_ptr<BatchTask> batch_task) {
@@ -291,27 +259,7 @@ void Caffe2Model::WaitOutput(std::shared_ptr<BatchTask> batch_task) {
 }
 
 void Caffe2Model::Postprocess(std::shared_ptr<Task> task) {
-  const QueryProto& query = task->query;
-  QueryResultProto* result = &task->result;
-  result->set_status(CTRL_OK);
-  for (auto& output : task->outputs) {
-    auto out_arr = output->arrays.at(output_blob_name_);
-    float* out_data = out_arr->Data<float>();
-    if (type() == "classification") {
-      if (classnames_.empty()) {
-        PostprocessClassification(query, out_data, output_size_, result);
-      } else {
-        PostprocessClassification(query, out_data, output_size_, result,
-                                  &classnames_);
-      }
-    } else {
-      std::ostringstream oss;
-      oss << "Unsupported model type " << type() << " for " << framework();
-      result->set_status(MODEL_TYPE_NOT_SUPPORT);
-      result->set_error_message(oss.str());
-      break;
-    }
-  }
+  PostprocessOutputs(task.get());
 }
 
 void Caffe2Model::LoadModel(const std::string& init_path,
@@ -366,13 +314,15 @@ void Caffe2Model::LoadModel(const std::string& init_path,
     CHECK_EQ(external_outputs.size(), 1) << "Number of outputs must be 1";
   }
   if (config.start_index() == 0) {
-    input_blob_name_ = model_info_["input_blob"].as<std::string>();
+    CHECK(!model_info_->input_name.empty()) << "Missing input_blob in " <<
+        "the model info";
+    input_blob_name_ = model_info_->input_name;
     if (model_session_.image_height() > 0) {
       image_height_ = model_session_.image_height();
       image_width_ = model_session_.image_width();
     } else {
-      image_height_ = model_info_["image_height"].as<int>();
-      image_width_ = model_info_["image_width"].as<int>();
+      image_height_ = model_info_->image_height;
+      image_width_ = model_info_->image_width;
     }
     input_shape_.set_dims({static_cast<int>(max_batch_), 3, image_height_, image_width_});
   } else {
@@ -393,7 +343,9 @@ void Caffe2Model::LoadModel(const std::string& init_path,
     input_shape_.set_dims(shape);
   }
   if (config.end_index() == 0) {
-    output_blob_name_ = model_info_["output_blob"].as<std::string>();
+    CHECK_EQ(model_info_->output_names.size(), 1) << "Caffe2Model only " <<
+        "supports a single output_blob";
+    output_blob_name_ = model_info_->output_names[0];
   } else {
     for (auto iter : external_outputs) {
       output_blob_name_ = iter;
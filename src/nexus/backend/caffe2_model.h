@@ -4,6 +4,7 @@
 #ifdef USE_CAFFE2
 
 #include "nexus/backend/model_ins.h"
+#include "nexus/backend/preprocess.h"
 // Caffe2 headers
 #include "caffe2/core/context_gpu.h"
 #include "caffe2/core/predictor.h"
@@ -71,10 +72,10 @@ class Caffe2Model : public ModelInstance {
   caffe2::TensorCUDA* output_tensor_;
 
   std::unordered_map<int, std::string> classnames_;
-  bool has_mean_file_;
   std::vector<float> mean_value_;
   std::vector<float> mean_blob_;
   float scale_;
+  ImagePreprocessor preprocessor_;
   
   // transformer for input
   //std::unique_ptr<caffe::DataTransformer<float> > transformer_;
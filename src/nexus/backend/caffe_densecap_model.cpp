@@ -21,41 +21,40 @@ namespace fs = boost::filesystem;
 CaffeDenseCapModel::CaffeDenseCapModel(int gpu_id,
                                        const ModelInstanceConfig& config) :
     ModelInstance(gpu_id, config) {
-  CHECK(model_info_["feature_prototxt"]) << "Missing feature_prototxt in " <<
+  const YAML::Node& model_config = model_info_->config;
+  CHECK(model_config["feature_prototxt"]) << "Missing feature_prototxt in " <<
       "the config";
-  CHECK(model_info_["rnn_prototxt"]) << "Missing rnn_prototxt in the config";
-  CHECK(model_info_["embed_prototxt"]) << "Missing embed_prototxt in " <<
+  CHECK(model_config["rnn_prototxt"]) << "Missing rnn_prototxt in the config";
+  CHECK(model_config["embed_prototxt"]) << "Missing embed_prototxt in " <<
+      "the config";
+  CHECK(model_config["model_file"]) << "Missing model_file in the config";
+  CHECK(model_config["vocab_file"]) << "Missing vocab_file in the config";
+  CHECK_EQ(model_info_->input_mean.size(), 3) << "Missing mean_value in " <<
       "the config";
-  CHECK(model_info_["model_file"]) << "Missing model_file in the config";
-  CHECK(model_info_["vocab_file"]) << "Missing vocab_file in the config";
-  CHECK(model_info_["mean_value"]) << "Missing mean_value in the config";
-  CHECK_EQ(model_info_["mean_value"].size(), 3);
   // load config
-  max_boxes_ = model_info_["max_boxes"].as<int>();
-  max_timestep_ = model_info_["max_timestep"].as<int>();
-  nms_threshold_ = model_info_["nms_threshold"].as<float>();
-  score_threshold_ = model_info_["score_threshold"].as<float>();
-  for (uint i = 0; i < model_info_["mean_value"].size(); ++i) {
-    mean_values_.push_back(model_info_["mean_value"][i].as<float>());
-  }
-  for (uint i = 0; i < model_info_["bbox_mean"].size(); ++i) {
-    bbox_mean_.push_back(model_info_["bbox_mean"][i].as<float>());
+  max_boxes_ = model_config["max_boxes"].as<int>();
+  max_timestep_ = model_config["max_timestep"].as<int>();
+  nms_threshold_ = model_config["nms_threshold"].as<float>();
+  score_threshold_ = model_config["score_threshold"].as<float>();
+  mean_values_ = model_info_->input_mean;
+  for (uint i = 0; i < model_config["bbox_mean"].size(); ++i) {
+    bbox_mean_.push_back(model_config["bbox_mean"][i].as<float>());
   }
-  for (uint i = 0; i < model_info_["bbox_stds"].size(); ++i) {
-    bbox_stds_.push_back(model_info_["bbox_stds"][i].as<float>());
+  for (uint i = 0; i < model_config["bbox_stds"].size(); ++i) {
+    bbox_stds_.push_back(model_config["bbox_stds"][i].as<float>());
   }
   // init gpu device
   caffe::Caffe::SetDevice(gpu_id);
   caffe::Caffe::set_mode(caffe::Caffe::GPU);
   // load caffe model
-  fs::path model_dir = fs::path(model_info_["model_dir"].as<std::string>());
-  fs::path feature_prototxt = model_dir / model_info_["feature_prototxt"].
+  fs::path model_dir = fs::path(model_info_->model_dir);
+  fs::path feature_prototxt = model_dir / model_config["feature_prototxt"].
                               as<std::string>();
-  fs::path rnn_prototxt = model_dir / model_info_["rnn_prototxt"].
+  fs::path rnn_prototxt = model_dir / model_config["rnn_prototxt"].
                           as<std::string>();
-  fs::path embed_prototxt = model_dir / model_info_["embed_prototxt"].
+  fs::path embed_prototxt = model_dir / model_config["embed_prototxt"].
                             as<std::string>();
-  fs::path model_file = model_dir / model_info_["model_file"].as<std::string>();
+  fs::path model_file = model_dir / model_config["model_file"].as<std::string>();
   feature_net_.reset(new caffe::ServeNet<float>(
       feature_prototxt.string(), max_batch_));
   rnn_net_.reset(new caffe::ServeNet<float>(
@@ -71,9 +70,9 @@ CaffeDenseCapModel::CaffeDenseCapModel(int gpu_id,
   image_height_ = model_session_.image_height();
   image_width_ = model_session_.image_width();
   /*
-  int target_size = model_info_["target_size"].as<int>();
-  int max_size = model_info_["max_size"].as<int>();
-  float aspect_ratio = model_info_["aspect_ratio"].as<float>();
+  int target_size = model_config["target_size"].as<int>();
+  int max_size = model_config["max_size"].as<int>();
+  float aspect_ratio = model_config["aspect_ratio"].as<float>();
   if (aspect_ratio > 1) {
     input_width_ = (int) round(
         std::min((float) max_size, target_size * aspect_ratio));
@@ -92,7 +91,7 @@ CaffeDenseCapModel::CaffeDenseCapModel(int gpu_id,
   feature_net_->input_blobs()[0]->Reshape(input_shape_.dims());
   feature_net_->Reshape();
   // load vocabulary
-  fs::path vocab_file = model_dir / model_info_["vocab_file"].as<std::string>();
+  fs::path vocab_file = model_dir / model_config["vocab_file"].as<std::string>();
   LoadVocabulary(vocab_file.string());
   // set helper buffer
   multiplier_.reset(new caffe::Blob<float>({max_boxes_}));
@@ -137,11 +136,11 @@ std::unordered_map<std::string, ArrayPtr> CaffeDenseCapModel::GetOutputGpuArrays
 }
 
 void CaffeDenseCapModel::Preprocess(std::shared_ptr<Task> task) {
-  const auto& query = task->query;
+  const auto& query = *task->query;
   const auto& input_data = query.input();
   if (input_data.data_type() != DT_IMAGE) {
-    task->result.set_status(INPUT_TYPE_INCORRECT);
-    task->result.set_error_message("Input type incorrect: " +
+    task->result->set_status(INPUT_TYPE_INCORRECT);
+    task->result->set_error_message("Input type incorrect: " +
                                    DataType_Name(input_data.data_type()));
     return;
   }
@@ -160,10 +159,10 @@ void CaffeDenseCapModel::Preprocess(std::shared_ptr<Task> task) {
   float scale_h = float(image_height_) / origin_height;
   float scale_w = float(image_width_) / origin_width;
   // set the attributes
-  task->attrs["im_height"] = origin_height;
-  task->attrs["im_width"] = origin_width;
-  task->attrs["scale_h"] = scale_h;
-  task->attrs["scale_w"] = scale_w;
+  task->attrs.im_height = origin_height;
+  task->attrs.im_width = origin_width;
+  task->attrs.scale_h = scale_h;
+  task->attrs.scale_w = scale_w;
   // transpose the image
   const float* im_data = (const float*) resized.data;
   auto in_arr = std::make_shared<Array>(DT_FLOAT, input_size_, cpu_device_);
@@ -200,7 +199,7 @@ void CaffeDenseCapModel::Forward(std::shared_ptr<BatchTask> batch_task) {
   float* im_info = im_info_blob->mutable_cpu_data();
   im_info[0] = image_height_;  // input image height
   im_info[1] = image_width_;  // input image width
-  im_info[2] = batch_task->inputs()[0]->task->attrs["scale_h"].as<float>();
+  im_info[2] = batch_task->inputs()[0]->task->attrs.scale_h;
   
   // set the slice points
   auto split_fc7_layer = dynamic_cast<caffe::SliceLayer<float>*>(
@@ -349,8 +348,8 @@ void CaffeDenseCapModel::Forward(std::shared_ptr<BatchTask> batch_task) {
 }
 
 void CaffeDenseCapModel::Postprocess(std::shared_ptr<Task> task) {
-  const QueryProto& query = task->query;
-  QueryResultProto* result = &task->result;
+  const QueryProto& query = *task->query;
+  QueryResultProto* result = task->result;
   std::vector<std::string> output_fields(query.output_field().begin(),
                                          query.output_field().end());
   if (output_fields.size() == 0) {
@@ -366,9 +365,9 @@ void CaffeDenseCapModel::Postprocess(std::shared_ptr<Task> task) {
   float* captions = output->arrays.at("captions")->Data<float>();
   float* scores = output->arrays.at("scores")->Data<float>();
   // get attributes
-  int im_height = task->attrs["im_height"].as<int>();
-  int im_width = task->attrs["im_width"].as<int>();
-  float scale = task->attrs["scale_h"].as<float>();
+  int im_height = task->attrs.im_height;
+  int im_width = task->attrs.im_width;
+  float scale = task->attrs.scale_h;
   int* order = new int[nboxes];
   for (int i = 0; i < nboxes; ++i) {
     order[i] = i;
@@ -20,14 +20,15 @@ namespace backend {
 
 CaffeModel::CaffeModel(int gpu_id, const ModelInstanceConfig& config) :
     ModelInstance(gpu_id, config) {
-  CHECK(model_info_["cfg_file"]) << "Missing cfg_file in the model info";
-  CHECK(model_info_["weight_file"]) << "Missing weight_file in the model info";
-  CHECK(model_info_["mean_file"] || model_info_["mean_value"])
+  const YAML::Node& model_config = model_info_->config;
+  CHECK(model_config["cfg_file"]) << "Missing cfg_file in the model info";
+  CHECK(model_config["weight_file"]) << "Missing weight_file in the model info";
+  CHECK(!model_info_->mean_file.empty() || !model_info_->input_mean.empty())
       << "Missing mean_file or mean_value in the model info";
   // load caffe model
-  fs::path model_dir = fs::path(model_info_["model_dir"].as<std::string>());
-  fs::path cfg_path = model_dir / model_info_["cfg_file"].as<std::string>();
-  fs::path weight_path = model_dir / model_info_["weight_file"].
+  fs::path model_dir = fs::path(model_info_->model_dir);
+  fs::path cfg_path = model_dir / model_config["cfg_file"].as<std::string>();
+  fs::path weight_path = model_dir / model_config["weight_file"].
                          as<std::string>();
   CHECK(fs::exists(cfg_path)) << "cfg file " << cfg_path <<
       " doesn't exist";
@@ -64,27 +65,22 @@ CaffeModel::CaffeModel(int gpu_id, const ModelInstanceConfig& config) :
   
   // Set up data transformer
   caffe::TransformationParameter transform_param;
-  if (model_info_["scale"]) {
-    transform_param.set_scale(model_info_["scale"].as<float>());
-  }
+  transform_param.set_scale(model_info_->scale);
   transform_param.set_crop_size(image_height_);
-  if (model_info_["mean_file"]) {
-    fs::path mean_file = model_dir / model_info_["mean_file"].as<std::string>();
+  if (!model_info_->mean_file.empty()) {
+    fs::path mean_file = model_dir / model_info_->mean_file;
     transform_param.set_mean_file(mean_file.string());
   } else {
-    const YAML::Node& mean_values = model_info_["mean_value"];
-    CHECK(mean_values.IsSequence()) <<
-        "mean_value in the config is not sequence";
-    for (uint i = 0; i < mean_values.size(); ++i) {
-      transform_param.add_mean_value(mean_values[i].as<float>());
+    for (float mean_value : model_info_->input_mean) {
+      transform_param.add_mean_value(mean_value);
     }
   }
   transformer_.reset(new caffe::DataTransformer<float>(
       transform_param, net_->phase()));
 
   // whether enbable prefix batching
-  if (model_info_["prefix_layer"]) {
-    prefix_layer_ = model_info_["prefix_layer"].as<std::string>();
+  if (model_config["prefix_layer"]) {
+    prefix_layer_ = model_config["prefix_layer"].as<std::string>();
     prefix_index_ = net_->layer_index_by_name(prefix_layer_);
     LOG(INFO) << "Prefix layer up to " << prefix_layer_ << "(" <<
         prefix_index_ << ")";
@@ -93,11 +89,20 @@ CaffeModel::CaffeModel(int gpu_id, const ModelInstanceConfig& config) :
     prefix_index_ = -1;
   }
   // load classnames
-  if (model_info_["class_names"]) {
-    fs::path cns_path = model_dir / model_info_["class_names"].
-                        as<std::string>();
+  if (!model_info_->class_names.empty()) {
+    fs::path cns_path = model_dir / model_info_->class_names;
     LoadClassnames(cns_path.string(), &classnames_);
   }
+
+  if (model_type_ == kClassification) {
+    const auto* classnames = classnames_.empty() ? nullptr : &classnames_;
+    postprocess_output_ = [this, classnames](
+        Task* task, const std::shared_ptr<Output>& output) {
+      float* out_data = output->arrays.at(output_blob_name_)->Data<float>();
+      PostprocessClassification(*task->query, out_data, output_size_,
+                                task->result, classnames);
+    };
+  }
 }
 
 Shape CaffeModel::InputShape() {
@@ -146,7 +151,7 @@ void CaffeModel::Preprocess(std::shared_ptr<Task> task) {
     task->AppendInput(in_arr);
   };
 
-  const auto& query = task->query;
+  const auto& query = *task->query;
   const auto& input_data = query.input();
   switch (input_data.data_type()) {
     case DT_IMAGE: {
@@ -165,8 +170,8 @@ void CaffeModel::Preprocess(std::shared_ptr<Task> task) {
       break;
     }
     default:
-      task->result.set_status(INPUT_TYPE_INCORRECT);
-      task->result.set_error_message("Input type incorrect: " +
+      task->result->set_status(INPUT_TYPE_INCORRECT);
+      task->result->set_error_message("Input type incorrect: " +
                                      DataType_Name(input_data.data_type()));
       break;
   }
@@ -193,27 +198,7 @@ void CaffeModel::Forward(std::shared_ptr<BatchTask> batch_task) {
 }
 
 void CaffeModel::Postprocess(std::shared_ptr<Task> task) {
-  const QueryProto& query = task->query;
-  QueryResultProto* result = &task->result;
-  result->set_status(CTRL_OK);
-  for (auto& output : task->outputs) {
-    auto out_arr = output->arrays.at(output_blob_name_);
-    float* out_data = out_arr->Data<float>();
-    if (type() == "classification") {
-      if (classnames_.empty()) {
-        PostprocessClassification(query, out_data, output_size_, result);
-      } else {
-        PostprocessClassification(query, out_data, output_size_, result,
-                                  &classnames_);
-      }
-    } else {
-      std::ostringstream oss;
-      oss << "Unsupported model type " << type() << " for " << framework();
-      result->set_status(MODEL_TYPE_NOT_SUPPORT);
-      result->set_error_message(oss.str());
-      break;
-    }
-  }
+  PostprocessOutputs(task.get());
 }
 
 void CaffeModel::LoadClassnames(const std::string& filepath) {
@@ -43,11 +43,12 @@ DarknetModel::DarknetModel(int gpu_id, const ModelInstanceConfig& config) :
     ModelInstance(gpu_id, config),
     first_input_array_(true) {
   // load darknet model
-  CHECK(model_info_["cfg_file"]) << "Missing cfg_file in the model info";
-  CHECK(model_info_["weight_file"]) << "Missing weight_file in the model info";
-  fs::path model_dir = fs::path(model_info_["model_dir"].as<std::string>());
-  fs::path cfg_path = model_dir / model_info_["cfg_file"].as<std::string>();
-  fs::path weight_path = model_dir / model_info_["weight_file"].
+  const YAML::Node& model_config = model_info_->config;
+  CHECK(model_config["cfg_file"]) << "Missing cfg_file in the model info";
+  CHECK(model_config["weight_file"]) << "Missing weight_file in the model info";
+  fs::path model_dir = fs::path(model_info_->model_dir);
+  fs::path cfg_path = model_dir / model_config["cfg_file"].as<std::string>();
+  fs::path weight_path = model_dir / model_config["weight_file"].
                          as<std::string>();
   CHECK(fs::exists(cfg_path)) << "Config file " << cfg_path <<
       " doesn't exist";
@@ -94,11 +95,52 @@ DarknetModel::DarknetModel(int gpu_id, const ModelInstanceConfig& config) :
   // Darknet doesn't have name for layers, so hardcode name as "output"
   output_name_ = "output"; 
   // load classnames
-  if (model_info_["class_names"]) {
-    fs::path cns_path = model_dir / model_info_["class_names"].
-                        as<std::string>();
+  if (!model_info_->class_names.empty()) {
+    fs::path cns_path = model_dir / model_info_->class_names;
     LoadClassnames(cns_path.string(), &classnames_);
   }
+
+  switch (model_type_) {
+    case kDetection:
+      postprocess_output_ = [this](Task* task,
+                                   const std::shared_ptr<Output>& output) {
+        float* out_data = output->arrays.at(output_name_)->Data<float>();
+        // TODO: check predicates in the query
+        layer l = net_->layers[net_->n - 1];
+        size_t nboxes = l.w * l.h * l.n;
+        size_t nprobs = nboxes * (l.classes + 1);
+        int* boxes = new int[nboxes * 4];
+        float* probs = new float[nprobs];
+        int only_objectness = 0;
+        float tree_threshold = 0.5;
+        int relative = 1;
+        float nms = 0.3;
+        float threshold = 0.24;
+        int im_height = task->attrs.im_height;
+        int im_width = task->attrs.im_width;
+        output_detection_results(
+            out_data, l, im_width, im_height, net_->w, net_->h, threshold,
+            probs, nprobs, boxes, nboxes * 4, only_objectness, nullptr,
+            tree_threshold, relative, nms);
+        MarshalDetectionResult(*task->query, probs, nprobs, boxes, nboxes,
+                               task->result);
+        delete[] boxes;
+        delete[] probs;
+      };
+      break;
+    case kClassification: {
+      const auto* classnames = classnames_.empty() ? nullptr : &classnames_;
+      postprocess_output_ = [this, classnames](
+          Task* task, const std::shared_ptr<Output>& output) {
+        float* out_data = output->arrays.at(output_name_)->Data<float>();
+        PostprocessClassification(*task->query, out_data, output_size_,
+                                  task->result, classnames);
+      };
+      break;
+    }
+    default:
+      break;
+  }
 }
 
 DarknetModel::~DarknetModel() {
@@ -151,20 +193,26 @@ void DarknetModel::Preprocess(std::shared_ptr<Task> task) {
     cv::resize(cv_img, resized_image, cv::Size(net_->w, net_->h));
     image input = cvmat_to_image(resized_image);
     size_t nfloats = net_->w * net_->h * 3;
-    auto buf = std::make_shared<Buffer>(
-        input.data, nfloats * sizeof(float), cpu_device_, true);
+    // Copy into a tracked buffer since CPUDevice can only free memory
+    // allocated by itself
+    auto in_arr = std::make_shared<Array>(DT_FLOAT, nfloats, cpu_device_);
+    Memcpy(in_arr->Data<void>(), cpu_device_, input.data, cpu_device_,
+           nfloats * sizeof(float));
+    free_image(input);
 #endif
-    auto in_arr = std::make_shared<Array>(DT_FLOAT, nfloats, buf);
     task->AppendInput(in_arr);
   };
 
-  const auto& query = task->query;
+  const auto& query = *task->query;
   const auto& input_data = query.input();
   switch (input_data.data_type()) {
     case DT_IMAGE: {
-      cv::Mat cv_img_rgb = DecodeImage(input_data.image(), CO_RGB);
-      task->attrs["im_height"] = cv_img_rgb.rows;
-      task->attrs["im_width"] = cv_img_rgb.cols;
+      const auto& image = input_data.image();
+      cv::Mat cv_img_rgb = DecodeImage(image, CO_RGB);
+      task->attrs.im_height = (image.orig_height() > 0) ?
+                              image.orig_height() : cv_img_rgb.rows;
+      task->attrs.im_width = (image.orig_width() > 0) ?
+                             image.orig_width() : cv_img_rgb.cols;
       if (query.window_size() > 0) {
         for (int i = 0; i < query.window_size(); ++i) {
           auto rect = query.window(i);
@@ -179,8 +227,8 @@ void DarknetModel::Preprocess(std::shared_ptr<Task> task) {
       break;
     }
     default:
-      task->result.set_status(INPUT_TYPE_INCORRECT);
-      task->result.set_error_message("Input type incorrect: " +
+      task->result->set_status(INPUT_TYPE_INCORRECT);
+      task->result->set_error_message("Input type incorrect: " +
                                      DataType_Name(input_data.data_type()));
       break;
   }
@@ -200,48 +248,7 @@ void DarknetModel::Forward(std::shared_ptr<BatchTask> batch_task) {
 }
 
 void DarknetModel::Postprocess(std::shared_ptr<Task> task) {
-  const auto& query = task->query;
-  auto* result = &task->result;
-  result->set_status(CTRL_OK);
-  for (auto& output : task->outputs) {
-    auto out_arr = output->arrays.at(output_name_);
-    float* out_data = out_arr->Data<float>();
-    // TODO: check predicates in the query
-    if (type() == "detection") {
-      layer l = net_->layers[net_->n - 1];
-      size_t nboxes = l.w * l.h * l.n;
-      size_t nprobs = nboxes * (l.classes + 1);
-      int* boxes = new int[nboxes * 4];
-      float* probs = new float[nprobs];
-      int only_objectness = 0;
-      float tree_threshold = 0.5;
-      int relative = 1;
-      float nms = 0.3;
-      float threshold = 0.24;
-      int im_height = task->attrs["im_height"].as<int>();
-      int im_width = task->attrs["im_width"].as<int>();
-      output_detection_results(
-          out_data, l, im_width, im_height, net_->w, net_->h, threshold, probs,
-          nprobs, boxes, nboxes * 4, only_objectness, nullptr, tree_threshold,
-          relative, nms);
-      MarshalDetectionResult(query, probs, nprobs, boxes, nboxes, result);
-      delete[] boxes;
-      delete[] probs;
-    } else if (type() == "classification") {
-      if (classnames_.empty()) {
-        PostprocessClassification(query, out_data, output_size_, result);
-      } else {
-        PostprocessClassification(query, out_data, output_size_, result,
-                                  &classnames_);
-      }
-    } else {
-      std::ostringstream oss;
-      oss << "Unsupported model type " << type() << " for " << framework();
-      result->set_status(MODEL_TYPE_NOT_SUPPORT);
-      result->set_error_message(oss.str());
-      break;
-    }
-  }
+  PostprocessOutputs(task.get());
 }
 
 void DarknetModel::MarshalDetectionResult(
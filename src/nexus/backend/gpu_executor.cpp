@@ -1,5 +1,6 @@
 #ifdef USE_GPU
 
+#include <algorithm>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <pthread.h>
@@ -8,13 +9,41 @@
 #include "nexus/backend/backend_server.h"
 #include "nexus/backend/caffe_model.h"
 #include "nexus/backend/gpu_executor.h"
+#include "nexus/common/async_log.h"
 #include "nexus/common/device.h"
+#include "nexus/common/time_util.h"
 
 DECLARE_int32(occupancy_valid);
 
 namespace nexus {
 namespace backend {
 
+namespace {
+
+/*!
+ * \brief Returns whether the model runs in a pass covering duty cycles
+ * first_cycle to cycle. A multi-rate model runs once if one of its cycles
+ * started since the last pass, so a pass that overruns a duty cycle does
+ * not skip it.
+ */
+bool RunsInPass(const ModelExecutor& model, uint64_t first_cycle,
+                uint64_t cycle) {
+  uint64_t period = model.cycle_period();
+  if (period <= 1) {
+    return true;
+  }
+  uint64_t beg = std::max(first_cycle, cycle + 1 > period ?
+                          cycle + 1 - period : 0);
+  for (uint64_t c = beg; c <= cycle; ++c) {
+    if (model.RunsInCycle(c)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
 GpuExecutorMultiBatching::GpuExecutorMultiBatching(int gpu_id) : 
     gpu_id_(gpu_id),
     running_(false),
@@ -95,10 +124,12 @@ double GpuExecutorMultiBatching::CurrentUtilization() {
           now - last_exec_time).count();
     int est_queue_len = (int) std::min(elapse / duty_cycle_us_ * curr_queue_len,
                                        (double) model->model()->max_batch());
-    LOG(INFO) << model->model()->model_session_id() <<
+    VLOG(1) << model->model()->model_session_id() <<
         " estimate batch size: " << est_queue_len;
     if (est_queue_len > 0) {
-      exec_cycle += model->profile()->GetForwardLatency(est_queue_len);
+      // Model only runs in one of every cycle_period duty cycles
+      exec_cycle += model->profile()->GetForwardLatency(est_queue_len) /
+                    model->cycle_period();
     }
   }
   for (auto& model : backup_models) {
@@ -111,8 +142,8 @@ double GpuExecutorMultiBatching::CurrentUtilization() {
   // LOG(INFO) << "Utilization: " << utilization_ << " (exec/duty: " <<
   //     exec_cycle << " / " << duty_cycle_us_ << " us)";
   double utilization = exec_cycle / duty_cycle_us_;
-  LOG(INFO) << "Utilization: " << utilization << " (exec/duty: " <<
-      exec_cycle << " / " << duty_cycle_us_ << " us)";
+  LOG_EVERY_MS(INFO, 1000) << "Utilization: " << utilization <<
+      " (exec/duty: " << exec_cycle << " / " << duty_cycle_us_ << " us)";
   return utilization;
 }
 
@@ -125,6 +156,11 @@ void GpuExecutorMultiBatching::Run() {
 
   NEXUS_CUDA_CHECK(cudaSetDevice(gpu_id_));
   double min_cycle_us = 50.; // us
+  // Duty cycles are counted on the wall clock, a pass of the loop can be
+  // much shorter than a duty cycle
+  TimePoint start = Clock::now();
+  double start_duty_cycle_us = duty_cycle_us_;
+  uint64_t next_cycle = 0;
   LOG(INFO) << "GpuExecutor started";
   while (running_) {
     std::vector<std::shared_ptr<ModelExecutor> > models;
@@ -135,11 +171,27 @@ void GpuExecutorMultiBatching::Run() {
       models = models_;
       backup_models = backup_models_;
     }
+    double duty_cycle_us = duty_cycle_us_;
+    if (duty_cycle_us != start_duty_cycle_us) {
+      // Counts the cycles of a new plan from now
+      start = Clock::now();
+      start_duty_cycle_us = duty_cycle_us;
+      next_cycle = 0;
+    }
+    uint64_t cycle = next_cycle;
+    if (duty_cycle_us > 0) {
+      cycle = static_cast<uint64_t>(std::chrono::duration_cast<
+          std::chrono::microseconds>(Clock::now() - start).count() /
+          duty_cycle_us);
+    }
     double exec_cycle_us = 0.;
     for (auto model : models) {
-      exec_cycle_us += model->Execute();
+      if (RunsInPass(*model, next_cycle, cycle)) {
+        exec_cycle_us += model->Execute();
+      }
     }
-    double budget = duty_cycle_us_ - exec_cycle_us;
+    next_cycle = std::max(next_cycle, cycle + 1);
+    double budget = duty_cycle_us - exec_cycle_us;
     for (auto model : backup_models) {
       if (budget <= 0) {
         break;
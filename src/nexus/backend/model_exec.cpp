@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sstream>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
@@ -15,6 +16,11 @@ DEFINE_int32(backend_count_interval, 1, "Interval to count number of requests in
 DEFINE_int32(backend_avg_interval, 5, "Moving average interval in sec");
 DEFINE_int32(backend_batch_policy, 0, "0: Sliding window; 1: Earliest first;");
 
+namespace {
+/*! \brief Batch input tagged with the session index of its query */
+using SessionInput = std::pair<uint32_t, std::shared_ptr<Input> >;
+} // namespace
+
 ModelExecutor::ModelExecutor(int gpu_id, const ModelInstanceConfig& config,
                              BlockPriorityQueue<Task>& task_queue) :
     backup_(config.backup()),
@@ -38,6 +44,7 @@ ModelExecutor::ModelExecutor(int gpu_id, const ModelInstanceConfig& config,
   for (auto const& info : config.backup_backend()) {
     backup_backends_.push_back(info.node_id());
   }
+  SetCycle(config.cycle_period(), config.cycle_phase());
 }
 
 ModelExecutor::~ModelExecutor() {
@@ -91,10 +98,23 @@ void ModelExecutor::UpdateBackupBackends(const ModelInstanceConfig& config) {
   }
 }
 
+void ModelExecutor::SetCycle(uint32_t period, uint32_t phase) {
+  if (period == 0) {
+    period = 1;
+  }
+  cycle_period_ = period;
+  cycle_phase_ = phase % period;
+}
+
+bool ModelExecutor::RunsInCycle(uint64_t cycle) const {
+  uint32_t period = cycle_period_.load();
+  return period <= 1 || cycle % period == cycle_phase_.load();
+}
+
 bool ModelExecutor::Preprocess(std::shared_ptr<Task> task, bool force) {
   int cnt = 1;
-  if (task->query.window_size() > 0) {
-    cnt = task->query.window_size();
+  if (task->query->window_size() > 0) {
+    cnt = task->query->window_size();
   }
   bool limit = !force && HasBackup();
   if (!IncreaseOpenRequests(cnt, limit)) {
@@ -102,7 +122,7 @@ bool ModelExecutor::Preprocess(std::shared_ptr<Task> task, bool force) {
   }
   req_counter_->Increase(cnt);
   model_->Preprocess(task);
-  if (task->result.status() != CTRL_OK) {
+  if (task->result->status() != CTRL_OK) {
     return false;
   }
   std::lock_guard<std::mutex> lock(task_mu_);
@@ -246,14 +266,14 @@ std::pair<std::shared_ptr<BatchTask>, int> ModelExecutor::GetBatchTaskSlidingWin
   }
   int dequeue_cnt = 0;
   int current_batch = 0;
-  std::unordered_map<std::string, std::vector<std::shared_ptr<Input> > > model_inputs;
+  std::vector<SessionInput> model_inputs;
   while (current_batch < expect_batch_size && !input_queue_.empty()) {
     auto input = std::move(input_queue_.top());
     input_queue_.pop();
     ++dequeue_cnt;
     auto task = processing_tasks_.at(input->task_id);
     task->timer.Record("exec");
-    if (task->result.status() != CTRL_OK ||
+    if (task->result->status() != CTRL_OK ||
         (profile_ != nullptr && input->deadline() < finish)) {
       VLOG(1) << model_->model_session_id() << " drops task " <<
           task->task_id << "/" << input->index << ", waiting time " <<
@@ -262,12 +282,7 @@ std::pair<std::shared_ptr<BatchTask>, int> ModelExecutor::GetBatchTaskSlidingWin
         RemoveTask(task);
       }
     } else {
-      auto& model_sess_id = task->query.model_session_id();
-      if (model_inputs.find(model_sess_id) == model_inputs.end()) {
-        model_inputs.emplace(model_sess_id,
-                             std::vector<std::shared_ptr<Input> >{});
-      }
-      model_inputs.at(model_sess_id).push_back(input);
+      model_inputs.emplace_back(task->query->session_index(), input);
       ++current_batch;
     }
     // Check whether there is enough requests left to fill the batch size
@@ -280,13 +295,16 @@ std::pair<std::shared_ptr<BatchTask>, int> ModelExecutor::GetBatchTaskSlidingWin
       }
     }
   }
+  // Group inputs of the same model session together
+  std::stable_sort(model_inputs.begin(), model_inputs.end(),
+                   [](const SessionInput& a, const SessionInput& b) {
+                     return a.first < b.first;
+                   });
   std::stringstream ss;
   for (auto const& iter : model_inputs) {
-    for (auto input : iter.second) {
-      auto task = processing_tasks_.at(input->task_id);
-      batch_task->AppendInput(input, task);
-      ss << task->task_id << " ";
-    }
+    auto task = processing_tasks_.at(iter.second->task_id);
+    batch_task->AppendInput(iter.second, task);
+    ss << task->task_id << " ";
   }
   VLOG(1) << model_->model_session_id() << " batch size " <<
       batch_task->batch_size() << ": " << ss.str();
@@ -319,7 +337,7 @@ std::pair<std::shared_ptr<BatchTask>, int> ModelExecutor::GetBatchTaskEarliest(
   while (!input_queue_.empty()) {
     auto &input = input_queue_.top();
     auto &task = processing_tasks_.at(input->task_id);
-    if (task->result.status() != CTRL_OK || input->deadline() < finish) {
+    if (task->result->status() != CTRL_OK || input->deadline() < finish) {
       task->timer.Record("exec");
       VLOG(1) << model_->model_session_id() << " drops task " <<
               task->task_id << "/" << input->index << ", waiting time " <<
@@ -345,7 +363,7 @@ std::pair<std::shared_ptr<BatchTask>, int> ModelExecutor::GetBatchTaskEarliest(
 
   // gather inputs
   uint32_t current_batch = 0;
-  std::unordered_map<std::string, std::vector<std::shared_ptr<Input> > > model_inputs;
+  std::vector<SessionInput> model_inputs;
   while (current_batch < batch_size && !input_queue_.empty()) {
     auto input = input_queue_.top();
     input_queue_.pop();
@@ -353,22 +371,20 @@ std::pair<std::shared_ptr<BatchTask>, int> ModelExecutor::GetBatchTaskEarliest(
 
     auto task = processing_tasks_.at(input->task_id);
     task->timer.Record("exec");
-    auto& model_sess_id = task->query.model_session_id();
-    if (model_inputs.find(model_sess_id) == model_inputs.end()) {
-      model_inputs.emplace(model_sess_id,
-                           std::vector<std::shared_ptr<Input> >{});
-    }
-    model_inputs.at(model_sess_id).push_back(input);
+    model_inputs.emplace_back(task->query->session_index(), input);
     ++current_batch;
   }
 
+  // Group inputs of the same model session together
+  std::stable_sort(model_inputs.begin(), model_inputs.end(),
+                   [](const SessionInput& a, const SessionInput& b) {
+                     return a.first < b.first;
+                   });
   std::stringstream ss;
   for (auto const& iter : model_inputs) {
-    for (auto input : iter.second) {
-      auto task = processing_tasks_.at(input->task_id);
-      batch_task->AppendInput(input, task);
-      ss << task->task_id << " ";
-    }
+    auto task = processing_tasks_.at(iter.second->task_id);
+    batch_task->AppendInput(iter.second, task);
+    ss << task->task_id << " ";
   }
   VLOG(1) << model_->model_session_id() << " batch size " <<
           batch_task->batch_size() << ": " << ss.str();
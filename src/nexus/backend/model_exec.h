@@ -7,6 +7,7 @@
 
 #include "nexus/backend/model_ins.h"
 #include "nexus/common/block_queue.h"
+#include "nexus/common/flat_map.h"
 #include "nexus/common/metric.h"
 #include "nexus/common/model_db.h"
 
@@ -29,6 +30,16 @@ class ModelExecutor {
   const ModelProfile* profile() const { return profile_; }
 
   void SetBatch(uint32_t batch) { model_->set_batch(batch); }
+  /*!
+   * \brief Sets the duty cycles to run the model in.
+   * \param period Model runs once every period duty cycles, 0 means 1
+   * \param phase Index of the duty cycle to run in within the period
+   */
+  void SetCycle(uint32_t period, uint32_t phase);
+  /*! \brief Number of duty cycles between two executions */
+  uint32_t cycle_period() const { return cycle_period_.load(); }
+  /*! \brief Returns whether the model runs in the given duty cycle. */
+  bool RunsInCycle(uint64_t cycle) const;
 
   double GetRequestRate();
 
@@ -79,7 +90,7 @@ class ModelExecutor {
    * \brief Map from task id to current processing tasks.
    * Guarded by task_mu_.
    */
-  std::unordered_map<uint64_t, std::shared_ptr<Task> > processing_tasks_;
+  FlatMap<uint64_t, std::shared_ptr<Task> > processing_tasks_;
   /*! \brief Priority queue of inputs based on deadline. Guarded by task_mu_. */
   std::priority_queue<std::shared_ptr<Input>,
                       std::vector<std::shared_ptr<Input> >,
@@ -99,6 +110,8 @@ class ModelExecutor {
   EWMA drop_rate_;
 
   std::vector<uint32_t> backup_backends_;
+  std::atomic<uint32_t> cycle_period_;
+  std::atomic<uint32_t> cycle_phase_;
   /*!
    * \brief Last time point that finishes the batch execution.
    * Guarded by time_mu_.
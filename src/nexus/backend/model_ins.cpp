@@ -8,6 +8,7 @@
 #include "nexus/backend/tf_share_model.h"
 
 #include <glog/logging.h>
+#include <sstream>
 
 namespace nexus {
 namespace backend {
@@ -69,9 +70,10 @@ ModelInstance::ModelInstance(int gpu_id, const ModelInstanceConfig &config) :
   CHECK_GT(batch_, 0) << "batch must be greater than 0";
   CHECK_GE(max_batch_, batch_) << "max_batch must be greater than batch";
   std::string model_id = ModelSessionToModelID(model_session_);
-  auto info = ModelDatabase::Singleton().GetModelInfo(model_id);
-  CHECK(info != nullptr) << "Model not found in the database";
-  model_info_ = *info;
+  model_info_ = ModelDatabase::Singleton().GetModelInfo(model_id);
+  CHECK(model_info_ != nullptr) << "Model not found in the database";
+  type_ = model_info_->type;
+  model_type_ = model_info_->model_type;
   model_session_id_ = ModelSessionToString(model_session_);
   cpu_device_ = DeviceManager::Singleton().GetCPUDevice();
 #ifdef USE_GPU
@@ -102,5 +104,19 @@ void ModelInstance::ForwardAsync(std::shared_ptr<BatchTask> batch_task) {
 void ModelInstance::WaitOutput(std::shared_ptr<BatchTask> batch_task) {
   LOG(WARNING) << "Don't support async forward";
 }
+void ModelInstance::PostprocessOutputs(Task* task) {
+  QueryResultProto* result = task->result;
+  if (!postprocess_output_) {
+    std::ostringstream oss;
+    oss << "Unsupported model type " << type() << " for " << framework();
+    result->set_status(MODEL_TYPE_NOT_SUPPORT);
+    result->set_error_message(oss.str());
+    return;
+  }
+  result->set_status(CTRL_OK);
+  for (auto& output : task->outputs) {
+    postprocess_output_(task, output);
+  }
+}
 } // namespace backend
 } // namespace nexus
@@ -2,6 +2,7 @@
 #define NEXUS_BACKEND_MODEL_INS_H_
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -42,7 +43,9 @@ class ModelInstance {
   /*! \brief Get the model session ID. */
   std::string model_session_id() const { return model_session_id_; }
   /*! \brief Get the model type. */
-  std::string type() const { return model_info_["type"].as<std::string>(); }
+  std::string type() const { return type_; }
+  /*! \brief Get the model type parsed at load time. */
+  ModelType model_type() const { return model_type_; }
   /*! \brief Get the suggested batch size. */
   uint32_t batch() const { return batch_.load(); }
   /*!
@@ -118,6 +121,15 @@ class ModelInstance {
   virtual void Postprocess(std::shared_ptr<Task> task) = 0;
 
  protected:
+  /*! \brief Postprocesses a single output of the task into its result. */
+  using OutputPostprocessFunc = std::function<void(
+      Task* task, const std::shared_ptr<Output>& output)>;
+  /*!
+   * \brief Runs postprocess_output_ on every output of the task. Sets
+   * MODEL_TYPE_NOT_SUPPORT in the result if no function is bound.
+   * \param task Pointer to task.
+   */
+  void PostprocessOutputs(Task* task);
   /*! \brief GPU index */
   int gpu_id_;
   /*! \brief Model session information */
@@ -128,8 +140,14 @@ class ModelInstance {
   std::atomic<uint32_t> batch_;
   /*! \brief Maximum batch size allowed given latency SLO */
   uint32_t max_batch_;
-  /*! \brief Model metadata loaded from model database */
-  YAML::Node model_info_;
+  /*! \brief Model metadata owned by the model database */
+  const ModelInfo* model_info_;
+  /*! \brief Model type string in the model info */
+  std::string type_;
+  /*! \brief Model type */
+  ModelType model_type_;
+  /*! \brief Bound by subclasses at load time according to model type */
+  OutputPostprocessFunc postprocess_output_;
   /*! \brief Pointer to CPU device */
   CPUDevice* cpu_device_;
 #ifdef USE_GPU
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "nexus/backend/preprocess.h"
+#include "nexus/common/alloc_tracker.h"
+
+DEFINE_int32(preprocess_threads, 4, "Threads converting the windows of a "
+             "query in parallel, shared by all models");
+DEFINE_int32(preprocess_fanout_windows, 4, "Queries with at least this many "
+             "windows convert them on the preprocess threads");
+
+namespace nexus {
+namespace backend {
+
+namespace {
+
+template <TensorLayout L, typename T, Normalization N>
+ImageTransformFunc BindTransform(const ImageTransformParam& param) {
+  return [param](const cv::Mat& image, void* out) {
+    ImageTransformer<L, T, N>::Run(param, image, static_cast<T*>(out));
+  };
+}
+
+template <TensorLayout L, typename T>
+ImageTransformFunc BindTransform(const ImageTransformParam& param) {
+  switch (param.norm) {
+    case kNormNone:
+      return BindTransform<L, T, kNormNone>(param);
+    case kNormMeanValue:
+      return BindTransform<L, T, kNormMeanValue>(param);
+    case kNormMeanBlob:
+      CHECK(param.mean_blob != nullptr) << "Missing mean blob";
+      return BindTransform<L, T, kNormMeanBlob>(param);
+  }
+  LOG(FATAL) << "Unknown normalization " << param.norm;
+  return nullptr;
+}
+
+template <TensorLayout L>
+ImageTransformFunc BindTransform(const ImageTransformParam& param) {
+  switch (param.data_type) {
+    case DT_FLOAT:
+      return BindTransform<L, float>(param);
+    case DT_UINT8:
+      return BindTransform<L, uint8_t>(param);
+    default:
+      LOG(FATAL) << "Unsupported image input type " <<
+          DataType_Name(param.data_type);
+  }
+  return nullptr;
+}
+
+} // namespace
+
+ImageTransformFunc MakeImageTransform(const ImageTransformParam& param) {
+  switch (param.layout) {
+    case kLayoutNHWC:
+      return BindTransform<kLayoutNHWC>(param);
+    case kLayoutNCHW:
+      return BindTransform<kLayoutNCHW>(param);
+  }
+  LOG(FATAL) << "Unknown layout " << param.layout;
+  return nullptr;
+}
+
+PreprocessPool& PreprocessPool::Singleton() {
+  static PreprocessPool preprocess_pool_;
+  return preprocess_pool_;
+}
+
+PreprocessPool::PreprocessPool() :
+    running_(true) {
+  for (int i = 0; i < FLAGS_preprocess_threads; ++i) {
+    threads_.emplace_back(&PreprocessPool::Run, this);
+  }
+}
+
+PreprocessPool::~PreprocessPool() {
+  running_ = false;
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void PreprocessPool::Run() {
+  AllocTagScope alloc_tag(kAllocPreprocess);
+  auto timeout = std::chrono::milliseconds(50);
+  while (running_) {
+    auto job = jobs_.pop(timeout);
+    if (job != nullptr) {
+      (*job)();
+    }
+  }
+}
+
+void PreprocessPool::ParallelFor(size_t n,
+                                 const std::function<void(size_t)>& func) {
+  struct State {
+    std::function<void(size_t)> func;
+    std::atomic<size_t> next;
+    size_t done;
+    std::mutex mu;
+    std::condition_variable cv;
+  };
+  auto state = std::make_shared<State>();
+  state->func = func;
+  state->next = 0;
+  state->done = 0;
+  // Threads claim indices until none are left, so a job that starts late
+  // finds nothing to do and never calls func after ParallelFor returns
+  auto job = std::make_shared<std::function<void()> >([state, n]() {
+      size_t i;
+      while ((i = state->next++) < n) {
+        state->func(i);
+        std::lock_guard<std::mutex> lock(state->mu);
+        if (++state->done == n) {
+          state->cv.notify_all();
+        }
+      }
+    });
+  size_t num_helpers = std::min(n - 1, threads_.size());
+  for (size_t i = 0; i < num_helpers; ++i) {
+    jobs_.push(job);
+  }
+  (*job)();
+  std::unique_lock<std::mutex> lock(state->mu);
+  state->cv.wait(lock, [&state, n]() { return state->done == n; });
+}
+
+ImagePreprocessor::ImagePreprocessor() :
+    input_size_(0),
+    cpu_device_(nullptr) {}
+
+ImagePreprocessor::ImagePreprocessor(const ImageTransformParam& param,
+                                     CPUDevice* cpu_device) :
+    param_(param),
+    transform_(MakeImageTransform(param)),
+    input_size_(static_cast<size_t>(param.height) * param.width * 3),
+    cpu_device_(cpu_device) {}
+
+void ImagePreprocessor::Process(Task* task) const {
+  const auto& query = *task->query;
+  const auto& input_data = query.input();
+  switch (input_data.data_type()) {
+    case DT_IMAGE: {
+      const auto& image = input_data.image();
+      DecodeTarget target;
+      target.size = cv::Size(param_.width, param_.height);
+      for (int i = 0; i < query.window_size(); ++i) {
+        const auto& rect = query.window(i);
+        target.regions.emplace_back(rect.left(), rect.top(),
+                                    rect.right() - rect.left(),
+                                    rect.bottom() - rect.top());
+      }
+      int scale_denom = 1;
+      cv::Size full_size;
+      cv::Mat img = DecodeImage(image, param_.channel_order, target,
+                                &scale_denom, &full_size);
+      task->attrs.im_height = (image.orig_height() > 0) ?
+                              image.orig_height() : full_size.height;
+      task->attrs.im_width = (image.orig_width() > 0) ?
+                             image.orig_width() : full_size.width;
+      if (!target.regions.empty()) {
+        TransformWindows(img, scale_denom, target.regions, task);
+      } else {
+        Transform(img, task);
+      }
+      break;
+    }
+    default:
+      task->result->set_status(INPUT_TYPE_INCORRECT);
+      task->result->set_error_message("Input type incorrect: " +
+                                      DataType_Name(input_data.data_type()));
+      break;
+  }
+}
+
+void ImagePreprocessor::Transform(const cv::Mat& image, Task* task) const {
+  auto in_arr = std::make_shared<Array>(param_.data_type, input_size_,
+                                        cpu_device_);
+  transform_(image, in_arr->Data<void>());
+  task->AppendInput(in_arr);
+}
+
+void ImagePreprocessor::TransformWindows(const cv::Mat& image,
+                                         int scale_denom,
+                                         const std::vector<cv::Rect>& windows,
+                                         Task* task) const {
+  // Allocated here to keep them tagged and in window order
+  std::vector<ArrayPtr> arrays;
+  for (size_t i = 0; i < windows.size(); ++i) {
+    arrays.push_back(std::make_shared<Array>(param_.data_type, input_size_,
+                                             cpu_device_));
+  }
+  auto transform_window = [&](size_t i) {
+    const auto& rect = windows[i];
+    // Flooring keeps the window inside the reduced image
+    cv::Mat crop_img = image(cv::Rect(
+        rect.x / scale_denom, rect.y / scale_denom,
+        rect.width / scale_denom, rect.height / scale_denom));
+    transform_(crop_img, arrays[i]->Data<void>());
+  };
+  if (windows.size() >= size_t(std::max(FLAGS_preprocess_fanout_windows, 2))) {
+    PreprocessPool::Singleton().ParallelFor(windows.size(), transform_window);
+  } else {
+    for (size_t i = 0; i < windows.size(); ++i) {
+      transform_window(i);
+    }
+  }
+  for (auto& arr : arrays) {
+    task->AppendInput(arr);
+  }
+}
+
+} // namespace backend
+} // namespace nexus
@@ -0,0 +1,243 @@
+#ifndef NEXUS_BACKEND_PREPROCESS_H_
+#define NEXUS_BACKEND_PREPROCESS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+
+#include "nexus/backend/task.h"
+#include "nexus/common/block_queue.h"
+#include "nexus/common/data_type.h"
+#include "nexus/common/device.h"
+#include "nexus/common/image.h"
+
+namespace nexus {
+namespace backend {
+
+/*! \brief Memory layout of a single image in the model input */
+enum TensorLayout {
+  kLayoutNHWC = 0,
+  kLayoutNCHW = 1,
+};
+
+/*! \brief Normalization applied to each pixel value */
+enum Normalization {
+  /*! \brief Pixel values are used as is */
+  kNormNone = 0,
+  /*! \brief (pixel - mean[c]) * scale[c] */
+  kNormMeanValue = 1,
+  /*! \brief (pixel - mean_blob[i]) * scale[0], mean blob in output layout */
+  kNormMeanBlob = 2,
+};
+
+/*!
+ * \brief ImageTransformParam describes how a decoded image is converted into
+ * the input of a model. It is filled once when the model is loaded.
+ */
+struct ImageTransformParam {
+  /*! \brief Model input height */
+  int height = 0;
+  /*! \brief Model input width */
+  int width = 0;
+  TensorLayout layout = kLayoutNHWC;
+  /*! \brief Element type of model input, DT_FLOAT or DT_UINT8 */
+  DataType data_type = DT_FLOAT;
+  /*! \brief Channel order the image is decoded in */
+  ChannelOrder channel_order = CO_RGB;
+  Normalization norm = kNormNone;
+  float mean[3] = {0., 0., 0.};
+  float scale[3] = {1., 1., 1.};
+  /*! \brief Mean blob of height*width*3 values, not owned */
+  const float* mean_blob = nullptr;
+};
+
+/*!
+ * \brief Converts an 8-bit 3-channel image to the model input at out, which
+ * must hold height*width*3 elements of the input data type.
+ */
+using ImageTransformFunc = std::function<void(const cv::Mat& image,
+                                              void* out)>;
+
+template <TensorLayout L>
+struct LayoutIndex;
+
+template <>
+struct LayoutIndex<kLayoutNHWC> {
+  static size_t Get(int height, int width, int h, int w, int c) {
+    return (static_cast<size_t>(h) * width + w) * 3 + c;
+  }
+};
+
+template <>
+struct LayoutIndex<kLayoutNCHW> {
+  static size_t Get(int height, int width, int h, int w, int c) {
+    return (static_cast<size_t>(c) * height + h) * width + w;
+  }
+};
+
+template <Normalization N>
+struct Normalizer;
+
+template <>
+struct Normalizer<kNormNone> {
+  static float Apply(const ImageTransformParam& param, float pixel, int c,
+                     size_t index) {
+    return pixel;
+  }
+};
+
+template <>
+struct Normalizer<kNormMeanValue> {
+  static float Apply(const ImageTransformParam& param, float pixel, int c,
+                     size_t index) {
+    return (pixel - param.mean[c]) * param.scale[c];
+  }
+};
+
+template <>
+struct Normalizer<kNormMeanBlob> {
+  static float Apply(const ImageTransformParam& param, float pixel, int c,
+                     size_t index) {
+    return (pixel - param.mean_blob[index]) * param.scale[0];
+  }
+};
+
+/*!
+ * \brief ImageTransformer is the image to tensor conversion specialized on
+ * layout, element type and normalization. The generic version resizes in
+ * 8-bit and then scatters each pixel into place.
+ */
+template <TensorLayout L, typename T, Normalization N>
+struct ImageTransformer {
+  static void Run(const ImageTransformParam& param, const cv::Mat& image,
+                  T* out) {
+    cv::Mat resized;
+    cv::resize(image, resized, cv::Size(param.width, param.height));
+    for (int h = 0; h < param.height; ++h) {
+      const uchar* ptr = resized.ptr<uchar>(h);
+      int in_index = 0;
+      for (int w = 0; w < param.width; ++w) {
+        for (int c = 0; c < 3; ++c) {
+          size_t index = LayoutIndex<L>::Get(param.height, param.width, h, w,
+                                             c);
+          float pixel = static_cast<float>(ptr[in_index++]);
+          out[index] = cv::saturate_cast<T>(
+              Normalizer<N>::Apply(param, pixel, c, index));
+        }
+      }
+    }
+  }
+};
+
+/*!
+ * \brief NHWC float input is resized in float directly into the output
+ * buffer, and then normalized in place.
+ */
+template <Normalization N>
+struct ImageTransformer<kLayoutNHWC, float, N> {
+  static void Run(const ImageTransformParam& param, const cv::Mat& image,
+                  float* out) {
+    cv::Mat fimg;
+    image.convertTo(fimg, CV_32FC3);
+    cv::Mat resized(param.height, param.width, CV_32FC3, out);
+    cv::resize(fimg, resized, cv::Size(param.width, param.height));
+    if (N == kNormNone) {
+      return;
+    }
+    size_t n = static_cast<size_t>(param.height) * param.width * 3;
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = Normalizer<N>::Apply(param, out[i], i % 3, i);
+    }
+  }
+};
+
+/*! \brief NHWC uint8 input without normalization is a plain resize. */
+template <>
+struct ImageTransformer<kLayoutNHWC, uint8_t, kNormNone> {
+  static void Run(const ImageTransformParam& param, const cv::Mat& image,
+                  uint8_t* out) {
+    cv::Mat resized(param.height, param.width, CV_8UC3, out);
+    cv::resize(image, resized, cv::Size(param.width, param.height));
+  }
+};
+
+/*!
+ * \brief Selects the specialized image transform for param. All dispatch on
+ * the parameters happens here, the returned function doesn't branch on them.
+ * \param param Transform parameters
+ * \return Image transform function
+ */
+ImageTransformFunc MakeImageTransform(const ImageTransformParam& param);
+
+/*!
+ * \brief PreprocessPool runs the windows of one query on several threads.
+ * The calling thread takes part, so a busy pool only makes the call serial.
+ * It has --preprocess_threads threads, shared by all models.
+ */
+class PreprocessPool {
+ public:
+  static PreprocessPool& Singleton();
+
+  ~PreprocessPool();
+  /*!
+   * \brief Calls func(i) for every i in [0, n) on the calling thread and up
+   * to n - 1 pool threads, and returns when all calls finish.
+   */
+  void ParallelFor(size_t n, const std::function<void(size_t)>& func);
+
+ private:
+  PreprocessPool();
+
+  void Run();
+
+  BlockQueue<std::function<void()> > jobs_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> running_;
+};
+
+/*!
+ * \brief ImagePreprocessor decodes the image in a query and converts it, or
+ * each of its windows, into a model input appended to the task. Queries
+ * with at least --preprocess_fanout_windows windows convert them on the
+ * PreprocessPool.
+ */
+class ImagePreprocessor {
+ public:
+  ImagePreprocessor();
+
+  ImagePreprocessor(const ImageTransformParam& param, CPUDevice* cpu_device);
+
+  const ImageTransformParam& param() const { return param_; }
+  /*!
+   * \brief Preprocesses the query in task. Sets an error status in the result
+   * if the input is not an image.
+   * \param task Task to preprocess
+   */
+  void Process(Task* task) const;
+
+ private:
+  void Transform(const cv::Mat& image, Task* task) const;
+  /*!
+   * \brief Converts each window into an input appended to the task, in
+   * window order.
+   * \param image Decoded image, at 1/scale_denom resolution
+   * \param windows Windows in full resolution pixels
+   */
+  void TransformWindows(const cv::Mat& image, int scale_denom,
+                        const std::vector<cv::Rect>& windows,
+                        Task* task) const;
+
+  ImageTransformParam param_;
+  ImageTransformFunc transform_;
+  size_t input_size_;
+  CPUDevice* cpu_device_;
+};
+
+} // namespace backend
+} // namespace nexus
+
+#endif // NEXUS_BACKEND_PREPROCESS_H_
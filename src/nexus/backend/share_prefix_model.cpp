@@ -33,37 +33,12 @@ SharePrefixModel::SharePrefixModel(int gpu_id,
   }
   prefix_batch_output_arr_ = prefix_model_->GetOutputGpuArrays();
 
-  max_suffix_output_size_ = 0; 
+  max_suffix_output_size_ = 0;
   for (int i = 0; i < config.model_session_size(); ++i) {
-    ModelInstanceConfig suffix_cfg;
-    suffix_cfg.add_model_session()->CopyFrom(config.model_session(i));
-    suffix_cfg.set_batch(batch_);
-    suffix_cfg.set_max_batch(max_batch_);
-    suffix_cfg.set_start_index(prefix_length_);
-    suffix_cfg.set_input_name(prefix_output_name_);
-    // Don't include batch dim in the shape, so start from 1
-    for (uint i = 1; i < prefix_output_shape_.ndims(); ++i) {
-      suffix_cfg.add_input_shape(prefix_output_shape_.dim(i));
-    }
-    //LOG(INFO) << suffix_cfg.DebugString();
-
-    std::unique_ptr<ModelInstance> suffix_model;
-    CreateModelInstance(gpu_id, suffix_cfg, &suffix_model);
-    auto model_sess_id = suffix_model->model_session_id();
-    suffix_input_arrays_.emplace(model_sess_id,
-                                 suffix_model->CreateInputGpuArray());
-    auto suffix_output_shape = suffix_model->OutputShapes();
-    CHECK_EQ(suffix_output_shape.size(), 1) << "All models must have only one "
-        "output in the prefix batching";
-    for (auto iter : suffix_output_shape) {
-      size_t size = iter.second.NumElements(1);
-      suffix_output_sizes_.emplace(model_sess_id, size);
-      suffix_output_names_.emplace(model_sess_id, iter.first);
-      if (size > max_suffix_output_size_) {
-        max_suffix_output_size_ = size;
-      }
-    }
-    suffix_models_.emplace(model_sess_id, std::move(suffix_model));
+    const auto& model_sess = config.model_session(i);
+    InsertSuffixModel(model_sess.session_index(),
+                      ModelSessionToString(model_sess),
+                      CreateSuffixModel(model_sess));
   }
 
   LOG(INFO) << "Prefix output shape: " << prefix_output_shape_ <<
@@ -74,8 +49,10 @@ void SharePrefixModel::set_batch(size_t batch) {
   CHECK_LE(batch, max_batch_) << "Batch size must be less than max_batch";
   batch_.store(batch);
   prefix_model_->set_batch(batch);
-  for (auto& iter : suffix_models_) {
-    iter.second->set_batch(batch);
+  for (auto& suffix : suffix_models_) {
+    if (suffix != nullptr) {
+      suffix->model->set_batch(batch);
+    }
   }
 }
 
@@ -103,7 +80,7 @@ void SharePrefixModel::Preprocess(std::shared_ptr<Task> task) {
 
 void SharePrefixModel::Forward(std::shared_ptr<BatchTask> batch_task) {
   // Do not allow to change the shared models during the forwarding
-  std::unordered_map<std::string, std::shared_ptr<ModelInstance> > suffix_models;
+  std::vector<std::shared_ptr<SuffixModel> > suffix_models;
   {
     std::lock_guard<std::mutex> lock(suffix_mu_);
     suffix_models = suffix_models_;
@@ -133,8 +110,8 @@ void SharePrefixModel::Forward(std::shared_ptr<BatchTask> batch_task) {
   // Prepare the suffix batch tasks
   for (uint32_t i = 0; i < batch_size; ++i) {
     auto task = tasks[i];
-    auto model_sess_id = task->query.model_session_id();
-    auto suffix_model = suffix_models.at(model_sess_id);
+    auto suffix = suffix_models.at(task->query->session_index());
+    auto suffix_model = suffix->model;
     task->suffix_model = suffix_model;
     auto suffix_batch_task = std::make_shared<BatchTask>(1);
 
@@ -150,11 +127,10 @@ void SharePrefixModel::Forward(std::shared_ptr<BatchTask> batch_task) {
     suffix_batch_task->AppendInput(suffix_input, task);
 
     // Set output array in batch task
-    size_t suffix_output_nfloats = suffix_output_sizes_.at(model_sess_id);
+    size_t suffix_output_nfloats = suffix->output_size;
     auto out_arr = suffix_output_arr->Slice(offset, suffix_output_nfloats);
     offset += suffix_output_nfloats;
-    suffix_batch_task->SetOutputArrays({{
-          suffix_output_names_.at(model_sess_id), out_arr }});
+    suffix_batch_task->SetOutputArrays({{ suffix->output_name, out_arr }});
 
     suffix_batch_tasks.push_back(suffix_batch_task);
     suffix_input_arrs.push_back(suffix_input_arr);
@@ -188,13 +164,14 @@ void SharePrefixModel::Forward(std::shared_ptr<BatchTask> batch_task) {
 
   for (int i = 0; i < tasks.size();) {
     int base = i;
-    auto model_sess_id = tasks[i]->query.model_session_id();
-    auto suffix_model = suffix_models.at(model_sess_id);
+    uint32_t session_index = tasks[i]->query->session_index();
+    auto suffix = suffix_models.at(session_index);
+    auto suffix_model = suffix->model;
     std::vector<std::shared_ptr<Task> > suffix_tasks;
     suffix_tasks.push_back(tasks[i]);
     ++i;
     while (i < tasks.size() &&
-           tasks[i]->query.model_session_id() == model_sess_id) {
+           tasks[i]->query->session_index() == session_index) {
       suffix_tasks.push_back(tasks[i]);
       ++i;
     }
@@ -206,12 +183,11 @@ void SharePrefixModel::Forward(std::shared_ptr<BatchTask> batch_task) {
     prefix_batch_output_ptr += prefix_output_nfloats * suffix_batch_size;
     suffix_batch_task->SetInputArray(suffix_batch_input_arr);
     // Slice cpu output array and set as output array
-    size_t suffix_output_nfloats = suffix_output_sizes_.at(model_sess_id);
+    size_t suffix_output_nfloats = suffix->output_size;
     auto out_arr = suffix_output_arr->Slice(
         cpu_output_offset, suffix_output_nfloats * suffix_batch_size);
     cpu_output_offset += suffix_output_nfloats * suffix_batch_size;
-    suffix_batch_task->SetOutputArrays({{
-          suffix_output_names_.at(model_sess_id), out_arr }});
+    suffix_batch_task->SetOutputArrays({{ suffix->output_name, out_arr }});
     // Append input into suffix batch task. Because each input array has the
     // same memory address as the batch input buffer, no memcpy occurs.
     size_t input_offset = 0;
@@ -254,13 +230,13 @@ void SharePrefixModel::Postprocess(std::shared_ptr<Task> task) {
 
 int SharePrefixModel::num_model_sessions() {
   std::lock_guard<std::mutex> lock(suffix_mu_);
-  return suffix_models_.size();
+  return suffix_indices_.size();
 }
 
 std::vector<std::string> SharePrefixModel::ModelSessions() {
   std::lock_guard<std::mutex> lock(suffix_mu_);
   std::vector<std::string> ret;
-  for (auto& iter : suffix_models_) {
+  for (auto& iter : suffix_indices_) {
     ret.push_back(iter.first);
   }
   return ret;
@@ -268,26 +244,38 @@ std::vector<std::string> SharePrefixModel::ModelSessions() {
 
 bool SharePrefixModel::HasModelSession(const std::string& model_sess_id) {
   std::lock_guard<std::mutex> lock(suffix_mu_);
-  return (suffix_models_.count(model_sess_id) > 0);
+  return (suffix_indices_.count(model_sess_id) > 0);
 }
 
 bool SharePrefixModel::AddModelSession(const ModelSession& model_sess) {
   std::string model_id = ModelSessionToModelID(model_sess);
-  int pref_len = -1;
-  for (auto& iter : suffix_models_) {
-    ModelSession base_model_sess;
-    ParseModelSession(iter.first, &base_model_sess);
-    std::string base_model_id = ModelSessionToModelID(base_model_sess);
-    pref_len = ModelDatabase::Singleton().GetSharePrefixLength(
-        model_id, base_model_id);
-    break;
-  }
+  std::string base_model_id = ModelSessionToModelID(model_session_);
+  int pref_len = ModelDatabase::Singleton().GetSharePrefixLength(
+      model_id, base_model_id);
   if (pref_len != prefix_length_) {
     LOG(ERROR) << "New prefix length is not same as old (" << pref_len <<
         " vs " << prefix_length_ << ")";
     return false;
   }
+  auto suffix = CreateSuffixModel(model_sess);
+  std::lock_guard<std::mutex> lock(suffix_mu_);
+  InsertSuffixModel(model_sess.session_index(),
+                    ModelSessionToString(model_sess), suffix);
+  return true;
+}
+
+void SharePrefixModel::RemoveModelSession(const std::string& model_sess_id) {
+  std::lock_guard<std::mutex> lock(suffix_mu_);
+  auto iter = suffix_indices_.find(model_sess_id);
+  if (iter == suffix_indices_.end()) {
+    return;
+  }
+  suffix_models_[iter->second] = nullptr;
+  suffix_indices_.erase(iter);
+}
 
+std::shared_ptr<SharePrefixModel::SuffixModel>
+SharePrefixModel::CreateSuffixModel(const ModelSession& model_sess) {
   ModelInstanceConfig suffix_cfg;
   suffix_cfg.add_model_session()->CopyFrom(model_sess);
   suffix_cfg.set_batch(batch_);
@@ -302,33 +290,32 @@ bool SharePrefixModel::AddModelSession(const ModelSession& model_sess) {
 
   std::unique_ptr<ModelInstance> suffix_model;
   CreateModelInstance(gpu_id_, suffix_cfg, &suffix_model);
-  //auto suffix_model = CreateModelInstance(gpu_id_, suffix_cfg);
-  auto model_sess_id = suffix_model->model_session_id();
-
-  std::lock_guard<std::mutex> lock(suffix_mu_);
-  suffix_input_arrays_.emplace(model_sess_id,
-                               suffix_model->CreateInputGpuArray());
+  auto suffix = std::make_shared<SuffixModel>();
+  suffix->input_array = suffix_model->CreateInputGpuArray();
   auto suffix_output_shape = suffix_model->OutputShapes();
   CHECK_EQ(suffix_output_shape.size(), 1) << "All models must have only one "
       "output in the prefix batching";
   for (auto iter : suffix_output_shape) {
-    size_t size = iter.second.NumElements(1);
-    suffix_output_sizes_.emplace(model_sess_id, size);
-    suffix_output_names_.emplace(model_sess_id, iter.first);
-    if (size > max_suffix_output_size_) {
-      max_suffix_output_size_ = size;
-    }
+    suffix->output_name = iter.first;
+    suffix->output_size = iter.second.NumElements(1);
   }
-  suffix_models_.emplace(model_sess_id, std::move(suffix_model));
-  return true;
+  suffix->model = std::move(suffix_model);
+  return suffix;
 }
 
-void SharePrefixModel::RemoveModelSession(const std::string& model_sess_id) {
-  std::lock_guard<std::mutex> lock(suffix_mu_);
-  suffix_models_.erase(model_sess_id);
-  suffix_input_arrays_.erase(model_sess_id);
-  suffix_output_names_.erase(model_sess_id);
-  suffix_output_sizes_.erase(model_sess_id);
+void SharePrefixModel::InsertSuffixModel(uint32_t session_index,
+                                         const std::string& model_sess_id,
+                                         std::shared_ptr<SuffixModel> suffix) {
+  CHECK_GT(session_index, 0) << "Model session " << model_sess_id <<
+      " has no session index";
+  if (session_index >= suffix_models_.size()) {
+    suffix_models_.resize(session_index + 1);
+  }
+  if (suffix->output_size > max_suffix_output_size_) {
+    max_suffix_output_size_ = suffix->output_size;
+  }
+  suffix_models_[session_index] = std::move(suffix);
+  suffix_indices_[model_sess_id] = session_index;
 }
 
 } // namespace backend
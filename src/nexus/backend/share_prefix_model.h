@@ -46,14 +46,24 @@ class SharePrefixModel : public ModelInstance {
   Shape prefix_output_shape_;
   std::unordered_map<std::string, ArrayPtr> prefix_batch_output_arr_;
   // Suffix models information
-  std::unordered_map<std::string,
-                     std::shared_ptr<ModelInstance> > suffix_models_;
-  std::unordered_map<std::string, ArrayPtr> suffix_input_arrays_;
-  std::unordered_map<std::string, std::string> suffix_output_names_;
-  std::unordered_map<std::string, size_t> suffix_output_sizes_;
+  struct SuffixModel {
+    std::shared_ptr<ModelInstance> model;
+    ArrayPtr input_array;
+    std::string output_name;
+    size_t output_size;
+  };
+  /*! \brief Creates the suffix model of a model session */
+  std::shared_ptr<SuffixModel> CreateSuffixModel(const ModelSession& model_sess);
+  /*! \brief Adds suffix model at session index, requires suffix_mu_ held */
+  void InsertSuffixModel(uint32_t session_index,
+                         const std::string& model_sess_id,
+                         std::shared_ptr<SuffixModel> suffix);
+  /*! \brief Suffix models indexed by session index, nullptr if absent */
+  std::vector<std::shared_ptr<SuffixModel> > suffix_models_;
+  /*! \brief Map from model session ID to session index */
+  std::unordered_map<std::string, uint32_t> suffix_indices_;
   size_t max_suffix_output_size_;
-  // Guard suffix_models_, suffix_input_arrays_, suffix_output_names_,
-  // suffix_output_sizes_, max_suffix_output_size_
+  // Guard suffix_models_, suffix_indices_, max_suffix_output_size_
   std::mutex suffix_mu_;
 };
 
@@ -1,5 +1,7 @@
 #include "nexus/backend/task.h"
+#include "nexus/common/alloc_tracker.h"
 #include "nexus/common/model_def.h"
+#include "nexus/common/object_pool.h"
 
 namespace nexus {
 namespace backend {
@@ -18,27 +20,74 @@ Output::Output(uint64_t tid, int idx,
 
 std::atomic<uint64_t> Task::global_task_id_(0);
 
+namespace {
+
+google::protobuf::ArenaOptions TaskArenaOptions(char* block, size_t size) {
+  google::protobuf::ArenaOptions options;
+  options.initial_block = block;
+  options.initial_block_size = size;
+  options.block_alloc = AllocateProtobufBlock;
+  options.block_dealloc = FreeProtobufBlock;
+  return options;
+}
+
+} // namespace
+
 Task::Task() : Task(nullptr) {}
 
 Task::Task(std::shared_ptr<Connection> conn) :
     DeadlineItem(),
-    connection(conn),
-    model(nullptr),
-    stage(kPreprocess),
-    filled_outputs(0) {
+    arena_(TaskArenaOptions(arena_block_, kArenaBlockSize)) {
+  Init(conn);
+}
+
+std::shared_ptr<Task> Task::Create(std::shared_ptr<Connection> conn) {
+  static ObjectPool<Task>* task_pool = new ObjectPool<Task>();
+  auto task = task_pool->Get();
+  if (task->query == nullptr) {
+    // Recycled task
+    task->Init(conn);
+  } else {
+    task->connection = conn;
+  }
+  return task;
+}
+
+void Task::Init(std::shared_ptr<Connection> conn) {
+  ResetBegin();
+  connection = conn;
+  model = nullptr;
+  stage = kPreprocess;
+  filled_outputs = 0;
+  query = google::protobuf::Arena::CreateMessage<QueryProto>(&arena_);
+  result = google::protobuf::Arena::CreateMessage<QueryResultProto>(&arena_);
   task_id = global_task_id_.fetch_add(1, std::memory_order_relaxed);
   timer.Record("begin");
 }
 
+void Task::Clear() {
+  connection.reset();
+  model.reset();
+  suffix_model.reset();
+  inputs.clear();
+  outputs.clear();
+  attrs = TaskAttrs();
+  timer.Reset();
+  query = nullptr;
+  result = nullptr;
+  arena_.Reset();
+}
+
 void Task::DecodeQuery(std::shared_ptr<Message> message) {
   msg_type = message->type();
-  message->DecodeBody(&query);
-  ModelSession sess;
-  ParseModelSession(query.model_session_id(), &sess);
-  uint32_t budget = sess.latency_sla();
-  if (query.slack_ms() > 0) {
-    budget += query.slack_ms();
-    // LOG(INFO) << "slack " << query.slack_ms() << " ms";
+  message->DecodeBody(query);
+}
+
+void Task::SetLatencySla(uint32_t latency_sla_ms) {
+  uint32_t budget = latency_sla_ms;
+  if (query->slack_ms() > 0) {
+    budget += query->slack_ms();
+    // LOG(INFO) << "slack " << query->slack_ms() << " ms";
   }
   SetDeadline(std::chrono::milliseconds(budget));
 }
@@ -60,7 +109,7 @@ bool Task::AddOutput(std::shared_ptr<Output> output) {
 }
 
 bool Task::AddVirtualOutput(int index) {
-  result.set_status(TIMEOUT);
+  result->set_status(TIMEOUT);
   uint32_t filled = ++filled_outputs;
   if (filled == outputs.size()) {
     return true;
@@ -3,9 +3,9 @@
 
 #include <atomic>
 #include <chrono>
+#include <google/protobuf/arena.h>
 #include <memory>
 #include <opencv2/opencv.hpp>
-#include <yaml-cpp/yaml.h>
 
 #include "nexus/common/block_queue.h"
 #include "nexus/common/connection.h"
@@ -65,6 +65,21 @@ class Output {
   std::unordered_map<std::string, ArrayPtr> arrays;
 };
 
+/*!
+ * \brief TaskAttrs holds the attributes computed in preprocessing that are
+ * needed by forward and postprocessing.
+ */
+struct TaskAttrs {
+  /*! \brief Height of the decoded image */
+  int im_height = 0;
+  /*! \brief Width of the decoded image */
+  int im_width = 0;
+  /*! \brief Vertical scale from the decoded image to the model input */
+  float scale_h = 1.;
+  /*! \brief Horizontal scale from the decoded image to the model input */
+  float scale_w = 1.;
+};
+
 /*! \brief Stage indicates the context processing stage */
 enum Stage {
   /* !\brief Task at the pre-processing stage */
@@ -84,11 +99,29 @@ class Task : public DeadlineItem, public std::enable_shared_from_this<Task> {
    * \param conn Connection to frontend server
    */
   Task(std::shared_ptr<Connection> conn);
+  /*!
+   * \brief Get a task from the task pool.
+   *
+   * The task is returned to the pool and its arena is reset once the last
+   * reference is released.
+   *
+   * \param conn Connection to frontend server
+   * \return Task pointer
+   */
+  static std::shared_ptr<Task> Create(std::shared_ptr<Connection> conn);
+  /*! \brief Release all references held by the task so it can be reused. */
+  void Clear();
   /*!
    * \brief Decode query from message.
    * \param message Message received from frontend
    */
   void DecodeQuery(std::shared_ptr<Message> message);
+  /*!
+   * \brief Set the deadline of task to the latency SLA of its model session
+   * plus the slack in the query.
+   * \param latency_sla_ms Latency SLA in milliseconds
+   */
+  void SetLatencySla(uint32_t latency_sla_ms);
   /*!
    * \brief Append preprocessed input array to task.
    * \param arr Input array
@@ -114,10 +147,10 @@ class Task : public DeadlineItem, public std::enable_shared_from_this<Task> {
   std::shared_ptr<Connection> connection;
   /*! \brief Message type */
   MessageType msg_type;
-  /*! \brief Query to process */
-  QueryProto query;
-  /*! \brief Query result */
-  QueryResultProto result;
+  /*! \brief Query to process, allocated on the task arena */
+  QueryProto* query;
+  /*! \brief Query result, allocated on the task arena */
+  QueryResultProto* result;
   /*! \brief Model instance to execute for the task */
   std::shared_ptr<ModelExecutor> model;
   /*!
@@ -133,11 +166,23 @@ class Task : public DeadlineItem, public std::enable_shared_from_this<Task> {
   /*! \brief Number of outputs that has been filled in */
   std::atomic<uint32_t> filled_outputs;
   /*! \brief Attributes that needs to be kept during the task */
-  YAML::Node attrs;
+  TaskAttrs attrs;
   /*! \brief Timer that counts the time spent in each stage */
   Timer timer;
 
  private:
+  /*!
+   * \brief Initialize the task for a new query.
+   * \param conn Connection to frontend server
+   */
+  void Init(std::shared_ptr<Connection> conn);
+
+  /*! \brief Size of the arena block embedded in each task */
+  static constexpr size_t kArenaBlockSize = 4096;
+  /*! \brief Initial arena block, reused across resets */
+  char arena_block_[kArenaBlockSize];
+  /*! \brief Arena that holds query and result */
+  google::protobuf::Arena arena_;
   /*! \brief Global task ID */
   static std::atomic<uint64_t> global_task_id_;
 };
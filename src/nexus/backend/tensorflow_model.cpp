@@ -18,7 +18,8 @@ namespace backend {
 TensorflowModel::TensorflowModel(int gpu_id, const ModelInstanceConfig& config):
     ModelInstance(gpu_id, config),
     first_input_array_(true), num_suffixes_(0) {
-  CHECK(model_info_["model_file"]) << "Missing model_file in the model info";
+  const YAML::Node& model_config = model_info_->config;
+  CHECK(model_config["model_file"]) << "Missing model_file in the model info";
 
   // Init session options
   auto gpu_opt = gpu_option_.config.mutable_gpu_options();
@@ -39,8 +40,8 @@ TensorflowModel::TensorflowModel(int gpu_id, const ModelInstanceConfig& config):
 
   // Init session and load model
   session_.reset(tf::NewSession(gpu_option_));
-  fs::path model_dir = fs::path(model_info_["model_dir"].as<std::string>());
-  fs::path model_file = model_dir / model_info_["model_file"].as<std::string>();
+  fs::path model_dir = fs::path(model_info_->model_dir);
+  fs::path model_file = model_dir / model_config["model_file"].as<std::string>();
   CHECK(fs::exists(model_file)) << "model file " << model_file <<
       " doesn't exist";
   tf::GraphDef graph_def;
@@ -61,27 +62,33 @@ TensorflowModel::TensorflowModel(int gpu_id, const ModelInstanceConfig& config):
     image_height_ = model_session_.image_height();
     image_width_ = model_session_.image_width();
   } else {
-    image_height_ = model_info_["image_height"].as<int>();
-    image_width_ = model_info_["image_width"].as<int>();
+    image_height_ = model_info_->image_height;
+    image_width_ = model_info_->image_width;
   }
+  CHECK_GT(image_height_, 0) << "Missing image_height in the model info";
+  CHECK_GT(image_width_, 0) << "Missing image_width in the model info";
   // Tensorflow uses NHWC by default. More details see
   // https://www.tensorflow.org/versions/master/performance/performance_guide
   input_shape_.set_dims({static_cast<int>(max_batch_), image_height_, image_width_, 3});
   input_size_ = input_shape_.NumElements(1);
-  input_layer_ = model_info_["input_layer"].as<std::string>();
-
-  if (model_info_["output_layer"].IsSequence()) {
-    for (size_t i = 0; i < model_info_["output_layer"].size(); ++i) {
-      output_layers_.push_back(model_info_["output_layer"][i].as<std::string>());
-    }
-  } else {
-    output_layers_.push_back(model_info_["output_layer"].as<std::string>());
-  }
+  CHECK(!model_info_->input_name.empty()) << "Missing input_layer in the " <<
+      "model info";
+  CHECK(!model_info_->output_names.empty()) << "Missing output_layer in " <<
+      "the model info";
+  input_layer_ = model_info_->input_name;
+  output_layers_ = model_info_->output_names;
   LOG(INFO) << "Model " << model_session_id_ << ", input: " <<
       input_layer_ << ", shape: " << input_shape_ << " (" << input_size_ <<
       ")";
 
-  if (model_name() == "ssd_mobilenet" || model_name() == "ssd_mobilenet_0.75") {
+  if (model_config["input_type"]) {
+    std::string input_type = model_config["input_type"].as<std::string>();
+    CHECK(input_type == "uint8" || input_type == "float") <<
+        "Unsupported input_type " << input_type;
+    input_data_type_ = input_type == "uint8" ? DT_UINT8 : DT_FLOAT;
+  } else if (model_name() == "ssd_mobilenet" ||
+             model_name() == "ssd_mobilenet_0.75") {
+    // Model infos written before input_type was introduced
     input_data_type_ = DT_UINT8;
   } else {
     input_data_type_ = DT_FLOAT;
@@ -97,11 +104,11 @@ TensorflowModel::TensorflowModel(int gpu_id, const ModelInstanceConfig& config):
   std::vector<std::pair<std::string, tf::Tensor>> inputs;
   std::vector<tf::Tensor> out_tensors;
   inputs.emplace_back(input_layer_, in_tensor);
-  if (model_info_["slice_beg_vector"]) {
+  if (model_config["slice_beg_vector"]) {
     // TFShareModel
-    auto slice_beg_vector = model_info_["slice_beg_vector"].as<std::string>();
-    auto slice_end_vector = model_info_["slice_len_vector"].as<std::string>();
-    num_suffixes_ = model_info_["suffix_models"].size();
+    auto slice_beg_vector = model_config["slice_beg_vector"].as<std::string>();
+    auto slice_end_vector = model_config["slice_len_vector"].as<std::string>();
+    num_suffixes_ = model_config["suffix_models"].size();
     tf::TensorShape shape;
     shape.AddDim(num_suffixes_);
     slice_beg_tensor_.reset(new tf::Tensor(/* gpu_allocator_, */tf::DT_INT32, shape));
@@ -134,27 +141,59 @@ TensorflowModel::TensorflowModel(int gpu_id, const ModelInstanceConfig& config):
   }
 
   // Load preprocessing configs
-  if (model_info_["input_mean"]) {
-    CHECK_EQ(model_info_["input_mean"].size(), 3) << "input_mean must have " <<
+  if (!model_info_->input_mean.empty()) {
+    CHECK_EQ(model_info_->input_mean.size(), 3) << "input_mean must have " <<
         "3 values";
-    for (uint i = 0; i < model_info_["input_mean"].size(); ++i) {
-      input_mean_.push_back(model_info_["input_mean"][i].as<float>());
-    }
+    input_mean_ = model_info_->input_mean;
   }
-  if (model_info_["input_std"]) {
-    CHECK_EQ(model_info_["input_std"].size(), 3) << "input_std must have " <<
+  if (!model_info_->input_std.empty()) {
+    CHECK_EQ(model_info_->input_std.size(), 3) << "input_std must have " <<
         "3 values";
-    for (uint i = 0; i < model_info_["input_std"].size(); ++i) {
-      input_std_.push_back(model_info_["input_std"][i].as<float>());
-    }
+    input_std_ = model_info_->input_std;
   }
 
   // Load class names
-  if (model_info_["class_names"]) {
-    fs::path cns_path = model_dir / model_info_["class_names"].
-                        as<std::string>();
+  if (!model_info_->class_names.empty()) {
+    fs::path cns_path = model_dir / model_info_->class_names;
     LoadClassnames(cns_path.string(), &classnames_);
   }
+
+  // Tensorflow uses NHWC by default. More details see
+  // https://www.tensorflow.org/versions/master/performance/performance_guide
+  ImageTransformParam transform_param;
+  transform_param.height = image_height_;
+  transform_param.width = image_width_;
+  transform_param.layout = kLayoutNHWC;
+  transform_param.data_type = input_data_type_;
+  transform_param.channel_order = CO_RGB;
+  transform_param.norm = kNormNone;
+  preprocessor_ = ImagePreprocessor(transform_param, cpu_device_);
+
+  switch (model_type_) {
+    case kClassification: {
+      const auto* classnames = classnames_.empty() ? nullptr : &classnames_;
+      const std::string& output_layer = output_layers_[0];
+      size_t output_size = output_sizes_.at(output_layer);
+      postprocess_output_ = [classnames, output_layer, output_size](
+          Task* task, const std::shared_ptr<Output>& output) {
+        float* out_data = output->arrays.at(output_layer)->Data<float>();
+        PostprocessClassification(*task->query, out_data, output_size,
+                                  task->result, classnames);
+      };
+      break;
+    }
+    case kDetection:
+      postprocess_output_ = [this](Task* task,
+                                   const std::shared_ptr<Output>& output) {
+        int im_height = task->attrs.im_height;
+        int im_width = task->attrs.im_width;
+        MarshalDetectionResult(*task->query, output, im_height, im_width,
+                               task->result);
+      };
+      break;
+    default:
+      break;
+  }
 }
 
 TensorflowModel::~TensorflowModel() {
@@ -193,63 +232,7 @@ std::unordered_map<std::string, ArrayPtr> TensorflowModel::GetOutputGpuArrays(){
 }
 
 void TensorflowModel::Preprocess(std::shared_ptr<Task> task) {
-  // Tensorflow uses NHWC by default. More details see
-  // https://www.tensorflow.org/versions/master/performance/performance_guide
-
-  auto prepare_image_default = [&](cv::Mat& image) {
-    // Convert to image in float
-    cv::Mat fimg;
-    image.convertTo(fimg, CV_32FC3);
-    // create a cv::Mat using buffer allocated in the in_arr
-    auto in_arr = std::make_shared<Array>(DT_FLOAT, input_size_, cpu_device_);
-    cv::Mat resized(image_height_, image_width_, CV_32FC3,
-                    in_arr->Data<void>());
-    cv::resize(fimg, resized, cv::Size(image_width_, image_height_));
-    task->AppendInput(in_arr);
-  };
-
-  auto prepare_image_ssd = [&](cv::Mat& image) {
-    auto in_arr = std::make_shared<Array>(DT_UINT8, input_size_, cpu_device_);
-    // create a cv::Mat using buffer allocated in the in_arr
-    cv::Mat resized(image_width_, image_height_, CV_8UC3,
-                    in_arr->Data<void>());
-    cv::resize(image, resized, cv::Size(image_width_, image_height_));
-    task->AppendInput(in_arr);
-  };
-
-  std::function<void(cv::Mat&)> prepare_image;
-  if (model_name() == "ssd_mobilenet" || model_name() == "ssd_mobilenet_0.75") {
-    prepare_image = prepare_image_ssd;
-  } else {
-    prepare_image = prepare_image_default;
-  }
-
-  const auto& query = task->query;
-  const auto& input_data = query.input();
-  switch (input_data.data_type()) {
-    case DT_IMAGE: {
-      cv::Mat img = DecodeImage(input_data.image(), CO_RGB);
-      task->attrs["im_height"] = img.rows;
-      task->attrs["im_width"] = img.cols;
-      if (query.window_size() > 0) {
-        for (int i = 0; i < query.window_size(); ++i) {
-          const auto& rect = query.window(i);
-          cv::Mat crop_img = img(cv::Rect(
-              rect.left(), rect.top(), rect.right() - rect.left(),
-              rect.bottom() - rect.top()));
-          prepare_image(crop_img);
-        }
-      } else {
-        prepare_image(img);
-      }
-      break;
-    }
-    default:
-      task->result.set_status(INPUT_TYPE_INCORRECT);
-      task->result.set_error_message("Input type incorrect: " +
-                                     DataType_Name(input_data.data_type()));
-      break;
-  }
+  preprocessor_.Process(task.get());
 }
 
 void TensorflowModel::Forward(std::shared_ptr<BatchTask> batch_task) {
@@ -278,33 +261,7 @@ void TensorflowModel::Forward(std::shared_ptr<BatchTask> batch_task) {
 }
 
 void TensorflowModel::Postprocess(std::shared_ptr<Task> task) {
-  const QueryProto& query = task->query;
-  QueryResultProto* result = &task->result;
-  result->set_status(CTRL_OK);
-  for (auto output : task->outputs) {
-    if (type() == "classification") {
-      auto out_arr = output->arrays.at(output_layers_[0]);
-      float* out_data = out_arr->Data<float>();
-      size_t count = out_arr->num_elements();
-      size_t output_size = output_sizes_.at(output_layers_[0]);
-      if (classnames_.empty()) {
-        PostprocessClassification(query, out_data, output_size, result);
-      } else {
-        PostprocessClassification(query, out_data, output_size, result,
-                                  &classnames_);
-      }
-    } else if (type() == "detection") {
-      int im_height = task->attrs["im_height"].as<int>();
-      int im_width = task->attrs["im_width"].as<int>();
-      MarshalDetectionResult(query, output, im_height, im_width, result);
-    } else {
-      std::ostringstream oss;
-      oss << "Unsupported model type " << type() << " for " << framework();
-      result->set_status(MODEL_TYPE_NOT_SUPPORT);
-      result->set_error_message(oss.str());
-      break;
-    }
-  }
+  PostprocessOutputs(task.get());
 }
 
 tf::Tensor* TensorflowModel::NewInputTensor() {
@@ -4,6 +4,7 @@
 #ifdef USE_TENSORFLOW
 
 #include "nexus/backend/model_ins.h"
+#include "nexus/backend/preprocess.h"
 // Tensorflow headers
 #include "tensorflow/core/public/session.h"
 
@@ -56,6 +57,7 @@ class TensorflowModel : public ModelInstance {
   std::unordered_map<std::string, size_t> output_sizes_;
   std::vector<float> input_mean_;
   std::vector<float> input_std_;
+  ImagePreprocessor preprocessor_;
   std::unordered_map<int, std::string> classnames_;
   tf::Allocator* gpu_allocator_;
   std::vector<std::unique_ptr<tf::Tensor> > input_tensors_;
@@ -25,7 +25,7 @@ TFShareModel::TFShareModel(int gpu_id, const ModelInstanceConfig &config) :
   }
 
   num_suffixes_ = tf_share_info_->suffix_models.size();
-  fs::path model_dir = fs::path(model_info_["model_dir"].as<std::string>());
+  fs::path model_dir = fs::path(model_info_->model_dir);
   for (const auto& iter : tf_share_info_->suffix_models) {
     if (iter.second.class_names.empty())
       continue;
@@ -48,6 +48,10 @@ TFShareModel::TFShareModel(int gpu_id, const ModelInstanceConfig &config) :
   auto* ptr = dynamic_cast<TensorflowModel*>(model.release());
   CHECK_NE(ptr, nullptr);
   tf_model_.reset(ptr);
+  std::lock_guard<std::mutex> lock(loaded_suffixes_mutex_);
+  for (int i = 0; i < config.model_session_size(); ++i) {
+    SetSessionSuffix(config.model_session(i));
+  }
 }
 
 void TFShareModel::set_batch(size_t batch) {
@@ -80,17 +84,20 @@ void TFShareModel::Forward(std::shared_ptr<BatchTask> batch_task) {
   std::vector<int32_t> slice_beg(num_suffixes_, 0);
   std::vector<int32_t> slice_len(num_suffixes_, 0);
   auto &tasks = batch_task->tasks();
-  ModelSession model_sess;
+  std::vector<const TFShareSuffixInfo*> session_suffixes;
+  {
+    std::lock_guard<std::mutex> lock(loaded_suffixes_mutex_);
+    session_suffixes = session_suffixes_;
+  }
   for (size_t i = 0; i < tasks.size();) {
-    const auto &model_sess_id = tasks[i]->query.model_session_id();
-    ParseModelID(model_sess_id, &model_sess);
-    auto iter = tf_share_info_->suffix_models.find(model_sess.model_name());
-    CHECK(iter != tf_share_info_->suffix_models.end())
-      << "Cannot find model " << model_sess_id << " in " << tf_share_info_->hack_internal_id;
-    const auto suffix_index = iter->second.suffix_index;
+    const uint32_t session_index = tasks[i]->query->session_index();
+    CHECK(session_index < session_suffixes.size() &&
+          session_suffixes[session_index] != nullptr)
+      << "Cannot find session " << session_index << " in " << tf_share_info_->hack_internal_id;
+    const auto suffix_index = session_suffixes[session_index]->suffix_index;
     CHECK_EQ(slice_len[suffix_index], 0) << "Detected non-consecutive BatchTask";
     slice_beg[suffix_index] = i;
-    while (i < tasks.size() && tasks[i]->query.model_session_id() == model_sess_id)
+    while (i < tasks.size() && tasks[i]->query->session_index() == session_index)
       ++i;
     slice_len[suffix_index] = i - slice_beg[suffix_index];
   }
@@ -136,36 +143,47 @@ void TFShareModel::Forward(std::shared_ptr<BatchTask> batch_task) {
 }
 
 void TFShareModel::Postprocess(std::shared_ptr<Task> task) {
-  ModelSession model_sess;
-  ParseModelID(task->query.model_session_id(), &model_sess);
-  auto suffix_info_iter = tf_share_info_->suffix_models.find(model_sess.model_name());
-  CHECK(suffix_info_iter != tf_share_info_->suffix_models.end());
-  const auto &suffix_info = suffix_info_iter->second;
+  const TFShareSuffixInfo* suffix_info_ptr = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(loaded_suffixes_mutex_);
+    const uint32_t session_index = task->query->session_index();
+    if (session_index < session_suffixes_.size())
+      suffix_info_ptr = session_suffixes_[session_index];
+  }
+  CHECK(suffix_info_ptr != nullptr);
+  const auto &suffix_info = *suffix_info_ptr;
   auto &m = *tf_model_;
-  const QueryProto& query = task->query;
-  QueryResultProto* result = &task->result;
+  const QueryProto& query = *task->query;
+  QueryResultProto* result = task->result;
   result->set_status(CTRL_OK);
   for (const auto& output : task->outputs) {
-    if (suffix_info.type == "classification") {
-      auto out_arr = output->arrays.at(suffix_info.output_layer);
-      auto* out_data = out_arr->Data<float>();
-      size_t output_size = m.output_sizes_.at(suffix_info.output_layer);
-      auto iter = classnames_.find(suffix_info.model_name);
-      if (iter == classnames_.end()) {
-        PostprocessClassification(query, out_data, output_size, result);
-      } else {
-        PostprocessClassification(query, out_data, output_size, result, &iter->second);
+    switch (suffix_info.model_type) {
+      case kClassification: {
+        auto out_arr = output->arrays.at(suffix_info.output_layer);
+        auto* out_data = out_arr->Data<float>();
+        size_t output_size = m.output_sizes_.at(suffix_info.output_layer);
+        auto iter = classnames_.find(suffix_info.model_name);
+        if (iter == classnames_.end()) {
+          PostprocessClassification(query, out_data, output_size, result);
+        } else {
+          PostprocessClassification(query, out_data, output_size, result, &iter->second);
+        }
+        break;
+      }
+      case kDetection: {
+        int im_height = task->attrs.im_height;
+        int im_width = task->attrs.im_width;
+        m.MarshalDetectionResult(query, output, im_height, im_width, result);
+        break;
+      }
+      default: {
+        std::ostringstream oss;
+        oss << "Unsupported model type " << suffix_info.type << " for " <<
+            framework();
+        result->set_status(MODEL_TYPE_NOT_SUPPORT);
+        result->set_error_message(oss.str());
+        return;
       }
-    } else if (suffix_info.type == "detection") {
-      int im_height = task->attrs["im_height"].as<int>();
-      int im_width = task->attrs["im_width"].as<int>();
-      m.MarshalDetectionResult(query, output, im_height, im_width, result);
-    } else {
-      std::ostringstream oss;
-      oss << "Unsupported model type " << type() << " for " << framework();
-      result->set_status(MODEL_TYPE_NOT_SUPPORT);
-      result->set_error_message(oss.str());
-      break;
     }
   }
 }
@@ -173,15 +191,32 @@ void TFShareModel::Postprocess(std::shared_ptr<Task> task) {
 bool TFShareModel::AddModelSession(const ModelSession &model_sess) {
   std::lock_guard<std::mutex> lock(loaded_suffixes_mutex_);
   auto pair = loaded_suffixes_.emplace(model_sess.model_name());
+  SetSessionSuffix(model_sess);
   return pair.second;
 }
 
 bool TFShareModel::RemoveModelSession(const ModelSession &model_sess) {
   std::lock_guard<std::mutex> lock(loaded_suffixes_mutex_);
   size_t n = loaded_suffixes_.erase(model_sess.model_name());
+  for (auto &suffix_info : session_suffixes_) {
+    if (suffix_info != nullptr && suffix_info->model_name == model_sess.model_name())
+      suffix_info = nullptr;
+  }
   return n > 0;
 }
 
+void TFShareModel::SetSessionSuffix(const ModelSession &model_sess) {
+  const uint32_t session_index = model_sess.session_index();
+  CHECK_GT(session_index, 0) << "Model session " << ModelSessionToString(model_sess)
+                             << " has no session index";
+  auto iter = tf_share_info_->suffix_models.find(model_sess.model_name());
+  CHECK(iter != tf_share_info_->suffix_models.end())
+    << "Cannot find model " << model_sess.model_name() << " in " << tf_share_info_->hack_internal_id;
+  if (session_index >= session_suffixes_.size())
+    session_suffixes_.resize(session_index + 1, nullptr);
+  session_suffixes_[session_index] = &iter->second;
+}
+
 size_t TFShareModel::num_model_sessions() {
   std::lock_guard<std::mutex> lock(loaded_suffixes_mutex_);
   return loaded_suffixes_.size();
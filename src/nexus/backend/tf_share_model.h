@@ -32,6 +32,10 @@ class TFShareModel : public ModelInstance {
   std::unique_ptr<TensorflowModel> tf_model_;
   std::mutex loaded_suffixes_mutex_;
   std::unordered_set<std::string> loaded_suffixes_;
+  // Records suffix info of model session, requires loaded_suffixes_mutex_ held
+  void SetSessionSuffix(const ModelSession& model_sess);
+  // Suffix info indexed by session index, guarded by loaded_suffixes_mutex_
+  std::vector<const TFShareSuffixInfo*> session_suffixes_;
   std::unordered_map<std::string, std::unordered_map<int, std::string>> classnames_;
 };
 
@@ -5,6 +5,8 @@
 #include "nexus/backend/backend_server.h"
 #include "nexus/backend/model_ins.h"
 #include "nexus/backend/worker.h"
+#include "nexus/common/alloc_tracker.h"
+#include "nexus/common/async_log.h"
 
 namespace nexus {
 namespace backend {
@@ -56,17 +58,24 @@ void Worker::Run() {
 void Worker::Process(std::shared_ptr<Task> task) {
   switch (task->stage) {
     case kPreprocess: {
-      task->model = server_->GetModel(task->query.model_session_id());
+      AllocTagScope alloc_tag(kAllocPreprocess);
+      // Model is resolved by the backend server when the query arrives
       if (task->model == nullptr) {
         std::stringstream ss;
-        ss << "Model session is not loaded: " << task->query.model_session_id();
-        task->result.set_status(MODEL_SESSION_NOT_LOADED);
+        ss << "Model session is not loaded: ";
+        if (task->query->session_index() > 0) {
+          ss << task->query->session_index();
+        } else {
+          ss << task->query->model_session_id();
+        }
+        task->result->set_status(MODEL_SESSION_NOT_LOADED);
+        task->result->set_error_message(ss.str());
         SendReply(std::move(task));
         break;
       }
       // Preprocess task
       if (!task->model->Preprocess(task)) {
-        if (task->result.status() != CTRL_OK) {
+        if (task->result->status() != CTRL_OK) {
           SendReply(std::move(task));
         } else {
           // Relay to the request to backup servers
@@ -82,12 +91,12 @@ void Worker::Process(std::shared_ptr<Task> task) {
             }
           }
           if (best_backup != nullptr) {
-            // LOG(INFO) << "Relay request " << task->query.model_session_id() <<
+            // LOG(INFO) << "Relay request " << task->query->model_session_id() <<
             //     " to backup " << best_backup->node_id() <<
             //     " with utilization " << min_util;
             best_backup->Forward(std::move(task));
           } else {
-            LOG(INFO) << "All backup servers are full";
+            LOG_EVERY_MS(INFO, 1000) << "All backup servers are full";
             task->model->Preprocess(task, true);
           }
         }
@@ -95,7 +104,7 @@ void Worker::Process(std::shared_ptr<Task> task) {
       break;
     }
     case kPostprocess: {
-      if (task->result.status() != CTRL_OK) {
+      if (task->result->status() != CTRL_OK) {
         SendReply(std::move(task));
       } else {
         task->model->Postprocess(task);
@@ -110,22 +119,26 @@ void Worker::Process(std::shared_ptr<Task> task) {
 
 void Worker::SendReply(std::shared_ptr<Task> task) {
   task->timer.Record("end");
-  task->result.set_query_id(task->query.query_id());
-  task->result.set_model_session_id(task->query.model_session_id());
-  task->result.set_latency_us(task->timer.GetLatencyMicros("begin", "end"));
-  task->result.set_queuing_us(task->timer.GetLatencyMicros("begin", "exec"));
+  task->result->set_query_id(task->query->query_id());
+  task->result->set_session_index(task->query->session_index());
+  if (task->query->session_index() == 0) {
+    task->result->set_model_session_id(task->query->model_session_id());
+  }
+  task->result->set_latency_us(task->timer.GetLatencyMicros("begin", "end"));
+  task->result->set_queuing_us(task->timer.GetLatencyMicros("begin", "exec"));
   if (task->model != nullptr && task->model->backup()) {
-    task->result.set_use_backup(true);
+    task->result->set_use_backup(true);
   } else {
-    task->result.set_use_backup(false);
+    task->result->set_use_backup(false);
   }
   MessageType reply_type = kBackendReply;
   if (task->msg_type == kBackendRelay) {
     reply_type = kBackendRelayReply;
   }
   auto msg = std::make_shared<Message>(reply_type,
-                                       task->result.ByteSizeLong());
-  msg->EncodeBody(task->result);
+                                       task->result->ByteSizeLong(),
+                                       task->deadline());
+  msg->EncodeBody(*task->result);
   task->connection->Write(std::move(msg));
 }
 
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <glog/logging.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "nexus/client/c_api.h"
+#include "nexus/client/client.h"
+#include "nexus/common/block_queue.h"
+
+struct NexusClient {
+  /*!
+   * \brief Serialized replies not fetched yet. Declared before client, whose
+   * destructor fails the pending requests into it.
+   */
+  nexus::BlockQueue<std::string> replies;
+  std::unique_ptr<nexus::client::Client> client;
+};
+
+namespace {
+
+nexus::client::ReplyCallback QueueReply(NexusClient* client) {
+  return [client](const nexus::ReplyProto& reply) {
+    auto buffer = std::make_shared<std::string>();
+    reply.SerializeToString(buffer.get());
+    client->replies.push(std::move(buffer));
+  };
+}
+
+} // namespace
+
+NexusClient* nexus_client_create(const char* server_addr, uint32_t user_id,
+                                 int num_connections, int num_threads) {
+  std::unique_ptr<NexusClient> client(new NexusClient());
+  client->client.reset(new nexus::client::Client(
+      server_addr, user_id, num_connections, num_threads));
+  if (!client->client->connected()) {
+    return nullptr;
+  }
+  return client.release();
+}
+
+void nexus_client_destroy(NexusClient* client) {
+  delete client;
+}
+
+uint32_t nexus_client_submit(NexusClient* client, const char* request,
+                             size_t request_len) {
+  nexus::RequestProto req;
+  if (!req.ParseFromArray(request, request_len)) {
+    LOG(ERROR) << "Cannot parse request";
+    return 0;
+  }
+  return client->client->Submit(std::move(req), QueueReply(client));
+}
+
+size_t nexus_client_submit_batch(NexusClient* client, const char* requests,
+                                 const size_t* request_lens,
+                                 size_t num_requests, uint32_t* req_ids) {
+  std::vector<nexus::RequestProto> batch(num_requests);
+  for (size_t i = 0; i < num_requests; ++i) {
+    if (!batch[i].ParseFromArray(requests, request_lens[i])) {
+      LOG(ERROR) << "Cannot parse request " << i << " of the batch";
+      batch.resize(i);
+      break;
+    }
+    requests += request_lens[i];
+  }
+  auto ids = client->client->SubmitBatch(std::move(batch),
+                                        QueueReply(client));
+  std::copy(ids.begin(), ids.end(), req_ids);
+  return ids.size();
+}
+
+char* nexus_client_next_reply(NexusClient* client, int timeout_ms,
+                              size_t* reply_len) {
+  auto buffer = client->replies.pop(std::chrono::milliseconds(timeout_ms));
+  if (buffer == nullptr) {
+    return nullptr;
+  }
+  char* reply = static_cast<char*>(malloc(buffer->size()));
+  memcpy(reply, buffer->data(), buffer->size());
+  *reply_len = buffer->size();
+  return reply;
+}
+
+void nexus_client_free(char* buffer) {
+  free(buffer);
+}
+
+size_t nexus_client_num_inflight(NexusClient* client) {
+  return client->client->num_inflight();
+}
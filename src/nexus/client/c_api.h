@@ -0,0 +1,62 @@
+#ifndef NEXUS_CLIENT_C_API_H_
+#define NEXUS_CLIENT_C_API_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface of nexus::client::Client for language bindings. Requests and
+ * replies are serialized RequestProto and ReplyProto. Replies are queued in
+ * the client until fetched with nexus_client_next_reply.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NexusClient NexusClient;
+
+/*!
+ * \brief Connects to a frontend and registers the user.
+ * \return Client handle, NULL if no connection succeeds
+ */
+NexusClient* nexus_client_create(const char* server_addr, uint32_t user_id,
+                                 int num_connections, int num_threads);
+
+void nexus_client_destroy(NexusClient* client);
+/*!
+ * \brief Sends a serialized RequestProto.
+ * \return Request ID assigned by the client, 0 if the request can't be parsed
+ */
+uint32_t nexus_client_submit(NexusClient* client, const char* request,
+                             size_t request_len);
+/*!
+ * \brief Sends a batch of serialized RequestProto stored back to back.
+ * \param requests Concatenated requests
+ * \param request_lens Length of each request
+ * \param num_requests Number of requests
+ * \param req_ids Output request ID of each request
+ * \return Number of requests sent
+ */
+size_t nexus_client_submit_batch(NexusClient* client, const char* requests,
+                                 const size_t* request_lens,
+                                 size_t num_requests, uint32_t* req_ids);
+/*!
+ * \brief Waits for the next reply.
+ * \param timeout_ms Time to wait in ms
+ * \param reply_len Output length of the serialized ReplyProto
+ * \return Serialized ReplyProto to release with nexus_client_free, NULL on
+ *   timeout
+ */
+char* nexus_client_next_reply(NexusClient* client, int timeout_ms,
+                              size_t* reply_len);
+
+void nexus_client_free(char* buffer);
+
+size_t nexus_client_num_inflight(NexusClient* client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NEXUS_CLIENT_C_API_H_
@@ -0,0 +1,313 @@
+#include <chrono>
+#include <glog/logging.h>
+
+#include "nexus/client/client.h"
+#include "nexus/common/message.h"
+#include "nexus/proto/control.pb.h"
+
+namespace nexus {
+namespace client {
+
+namespace {
+
+/*! \brief Request ID of the register message, never used by requests */
+const uint32_t kRegisterRequestId = 0;
+
+/*! \brief Time to wait for the frontend to acknowledge registration */
+const int kRegisterTimeoutSec = 5;
+
+std::shared_ptr<Message> EncodeMessage(MessageType type,
+                                       const RequestProto& request) {
+  auto msg = std::make_shared<Message>(type, request.ByteSizeLong());
+  msg->EncodeBody(request);
+  return msg;
+}
+
+} // namespace
+
+ServerSession::ServerSession(boost::asio::io_context& io_context,
+                             MessageHandler* handler, size_t index) :
+    Connection(io_context, handler),
+    index_(index) {
+}
+
+bool ServerSession::Connect(const std::string& host, const std::string& port) {
+  boost::system::error_code ec;
+  boost::asio::ip::tcp::resolver resolver(socket_.get_executor());
+  auto endpoints = resolver.resolve(host, port, ec);
+  if (!ec) {
+    boost::asio::connect(socket_, endpoints, ec);
+  }
+  if (ec) {
+    LOG(ERROR) << "Failed to connect to " << host << ":" << port << ": " <<
+        ec.message();
+    return false;
+  }
+  boost::asio::ip::tcp::no_delay option(true);
+  socket_.set_option(option);
+  StartReading();
+  return true;
+}
+
+Client::Client(const std::string& server_addr, uint32_t user_id,
+               int num_connections, int num_threads) :
+    user_id_(user_id),
+    io_context_(),
+    work_guard_(boost::asio::make_work_guard(io_context_)),
+    next_req_id_(kRegisterRequestId + 1) {
+  CHECK_GT(num_connections, 0) << "Client needs at least one connection";
+  auto pos = server_addr.rfind(':');
+  CHECK(pos != std::string::npos) << "Server address " << server_addr <<
+      " is not in host:port";
+  std::string host = server_addr.substr(0, pos);
+  std::string port = server_addr.substr(pos + 1);
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    io_threads_.emplace_back([this]() { io_context_.run(); });
+  }
+
+  // All sessions exist before any connects, as IO threads look them up
+  for (int i = 0; i < num_connections; ++i) {
+    std::unique_ptr<SessionState> state(new SessionState());
+    state->session = std::make_shared<ServerSession>(io_context_, this, i);
+    state->num_pending = 0;
+    state->alive = false;
+    sessions_.push_back(std::move(state));
+  }
+  std::vector<std::future<ReplyProto> > registers;
+  for (auto& state : sessions_) {
+    if (!state->session->Connect(host, port)) {
+      continue;
+    }
+    state->alive = true;
+    auto promise = std::make_shared<std::promise<ReplyProto> >();
+    registers.push_back(promise->get_future());
+    {
+      std::lock_guard<std::mutex> lock(state->mu);
+      state->pending.emplace(kRegisterRequestId,
+                             [promise](const ReplyProto& reply) {
+                               promise->set_value(reply);
+                             });
+    }
+    RequestProto request;
+    request.set_user_id(user_id_);
+    request.set_req_id(kRegisterRequestId);
+    state->session->Write(EncodeMessage(kUserRegister, request));
+  }
+  size_t num_registered = 0;
+  for (auto& future : registers) {
+    if (future.wait_for(std::chrono::seconds(kRegisterTimeoutSec)) ==
+        std::future_status::ready && future.get().status() == CTRL_OK) {
+      ++num_registered;
+    }
+  }
+  LOG(INFO) << "Registered user " << user_id_ << " on " << num_registered <<
+      " of " << num_connections << " connections to " << server_addr;
+}
+
+Client::~Client() {
+  for (auto& state : sessions_) {
+    state->alive = false;
+    state->session->Stop();
+    FailPending(state.get());
+  }
+  work_guard_.reset();
+  io_context_.stop();
+  for (auto& thread : io_threads_) {
+    thread.join();
+  }
+}
+
+bool Client::connected() const {
+  for (auto& state : sessions_) {
+    if (state->alive) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t Client::num_inflight() const {
+  size_t total = 0;
+  for (auto& state : sessions_) {
+    total += state->num_pending;
+  }
+  return total;
+}
+
+uint32_t Client::Submit(RequestProto request, ReplyCallback callback) {
+  std::vector<RequestProto> requests;
+  requests.push_back(std::move(request));
+  std::vector<ReplyCallback> callbacks{std::move(callback)};
+  SessionState* state = PickSession();
+  Send(state, &requests, callbacks);
+  return requests[0].req_id();
+}
+
+std::future<ReplyProto> Client::Submit(RequestProto request) {
+  auto promise = std::make_shared<std::promise<ReplyProto> >();
+  auto future = promise->get_future();
+  Submit(std::move(request), [promise](const ReplyProto& reply) {
+      promise->set_value(reply);
+    });
+  return future;
+}
+
+std::vector<uint32_t> Client::SubmitBatch(std::vector<RequestProto> requests,
+                                          ReplyCallback callback) {
+  std::vector<ReplyCallback> callbacks(requests.size(), callback);
+  return Dispatch(&requests, callbacks);
+}
+
+std::vector<std::future<ReplyProto> > Client::SubmitBatch(
+    std::vector<RequestProto> requests) {
+  std::vector<std::future<ReplyProto> > futures;
+  std::vector<ReplyCallback> callbacks;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    auto promise = std::make_shared<std::promise<ReplyProto> >();
+    futures.push_back(promise->get_future());
+    callbacks.push_back([promise](const ReplyProto& reply) {
+        promise->set_value(reply);
+      });
+  }
+  Dispatch(&requests, callbacks);
+  return futures;
+}
+
+void Client::HandleMessage(std::shared_ptr<Connection> conn,
+                           std::shared_ptr<Message> message) {
+  if (message->type() != kUserReply) {
+    LOG(ERROR) << "Wrong message type: " << message->type();
+    return;
+  }
+  auto session = std::static_pointer_cast<ServerSession>(conn);
+  SessionState* state = sessions_[session->index()].get();
+  ReplyProto reply;
+  message->DecodeBody(&reply);
+  ReplyCallback callback;
+  {
+    std::lock_guard<std::mutex> lock(state->mu);
+    auto iter = state->pending.find(reply.req_id());
+    if (iter == state->pending.end()) {
+      LOG(ERROR) << "Cannot find request " << reply.req_id();
+      return;
+    }
+    callback = std::move(iter->second);
+    state->pending.erase(iter);
+    // Under the lock, or FailPending may reset the count in between
+    if (reply.req_id() != kRegisterRequestId) {
+      --state->num_pending;
+    }
+  }
+  callback(reply);
+}
+
+void Client::HandleError(std::shared_ptr<Connection> conn,
+                         boost::system::error_code ec) {
+  auto session = std::static_pointer_cast<ServerSession>(conn);
+  SessionState* state = sessions_[session->index()].get();
+  if (state->alive.exchange(false)) {
+    LOG(ERROR) << "Connection " << session->index() << " error (" << ec <<
+        "): " << ec.message();
+    session->Stop();
+  }
+  FailPending(state);
+}
+
+uint32_t Client::NextRequestId() {
+  uint32_t req_id = next_req_id_++;
+  if (req_id == kRegisterRequestId) {
+    req_id = next_req_id_++;
+  }
+  return req_id;
+}
+
+std::vector<uint32_t> Client::Dispatch(
+    std::vector<RequestProto>* requests,
+    const std::vector<ReplyCallback>& callbacks) {
+  std::vector<uint32_t> req_ids;
+  size_t num_live = 0;
+  for (auto& state : sessions_) {
+    num_live += state->alive ? 1 : 0;
+  }
+  // Spread the batch over the live connections in contiguous chunks
+  size_t chunk = (requests->size() + std::max<size_t>(num_live, 1) - 1) /
+                 std::max<size_t>(num_live, 1);
+  for (size_t beg = 0; beg < requests->size(); beg += chunk) {
+    size_t end = std::min(beg + chunk, requests->size());
+    std::vector<RequestProto> part(
+        std::make_move_iterator(requests->begin() + beg),
+        std::make_move_iterator(requests->begin() + end));
+    std::vector<ReplyCallback> part_callbacks(callbacks.begin() + beg,
+                                              callbacks.begin() + end);
+    Send(PickSession(), &part, part_callbacks);
+    for (auto& request : part) {
+      req_ids.push_back(request.req_id());
+    }
+  }
+  return req_ids;
+}
+
+Client::SessionState* Client::PickSession() {
+  SessionState* best = nullptr;
+  for (auto& state : sessions_) {
+    if (state->alive && (best == nullptr ||
+                         state->num_pending < best->num_pending)) {
+      best = state.get();
+    }
+  }
+  return best;
+}
+
+void Client::Send(SessionState* state, std::vector<RequestProto>* requests,
+                  const std::vector<ReplyCallback>& callbacks) {
+  for (auto& request : *requests) {
+    request.set_user_id(user_id_);
+    request.set_req_id(NextRequestId());
+  }
+  if (state == nullptr) {
+    for (size_t i = 0; i < requests->size(); ++i) {
+      ReplyProto reply;
+      reply.set_user_id(user_id_);
+      reply.set_req_id((*requests)[i].req_id());
+      reply.set_status(SERVICE_UNAVAILABLE);
+      reply.set_error_message("Not connected");
+      callbacks[i](reply);
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(state->mu);
+    for (size_t i = 0; i < requests->size(); ++i) {
+      state->pending.emplace((*requests)[i].req_id(), callbacks[i]);
+    }
+    state->num_pending += requests->size();
+  }
+  if (!state->alive) {
+    // Connection failed before the callbacks were registered
+    FailPending(state);
+    return;
+  }
+  for (auto& request : *requests) {
+    state->session->Write(EncodeMessage(kUserRequest, request));
+  }
+}
+
+void Client::FailPending(SessionState* state) {
+  std::unordered_map<uint32_t, ReplyCallback> pending;
+  {
+    std::lock_guard<std::mutex> lock(state->mu);
+    pending.swap(state->pending);
+    state->num_pending = 0;
+  }
+  for (auto& iter : pending) {
+    ReplyProto reply;
+    reply.set_user_id(user_id_);
+    reply.set_req_id(iter.first);
+    reply.set_status(SERVICE_UNAVAILABLE);
+    reply.set_error_message("Connection to frontend failed");
+    iter.second(reply);
+  }
+}
+
+} // namespace client
+} // namespace nexus
@@ -0,0 +1,146 @@
+#ifndef NEXUS_CLIENT_CLIENT_H_
+#define NEXUS_CLIENT_CLIENT_H_
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/common/connection.h"
+#include "nexus/proto/nnquery.pb.h"
+
+namespace nexus {
+namespace client {
+
+/*!
+ * \brief Callback invoked with the reply of a request. It runs on an IO
+ * thread of the client and must not block.
+ */
+using ReplyCallback = std::function<void(const ReplyProto& reply)>;
+
+/*! \brief ServerSession is one connection from the client to a frontend. */
+class ServerSession : public Connection {
+ public:
+  ServerSession(boost::asio::io_context& io_context, MessageHandler* handler,
+                size_t index);
+  /*!
+   * \brief Connects to the frontend and starts reading replies.
+   * \return false if the connection fails
+   */
+  bool Connect(const std::string& host, const std::string& port);
+
+  size_t index() const { return index_; }
+
+ private:
+  size_t index_;
+};
+
+/*!
+ * \brief Client sends requests to a frontend over a pool of connections with
+ * many requests in flight on each connection.
+ *
+ * Every connection registers the same user ID. Requests are matched with
+ * replies by req_id, which the client assigns, so replies may arrive in any
+ * order. A request goes to the connection with the fewest requests in flight.
+ */
+class Client : public MessageHandler {
+ public:
+  /*!
+   * \brief Connects to a frontend and registers the user.
+   * \param server_addr Frontend address in host:port
+   * \param user_id User ID
+   * \param num_connections Number of connections in the pool
+   * \param num_threads Number of IO threads running callbacks
+   */
+  Client(const std::string& server_addr, uint32_t user_id,
+         int num_connections = 1, int num_threads = 1);
+
+  ~Client();
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+  /*! \brief Whether at least one connection is up. */
+  bool connected() const;
+  /*! \brief Number of requests waiting for their replies. */
+  size_t num_inflight() const;
+  /*!
+   * \brief Sends a request. user_id and req_id of the request are filled in.
+   * \param request Request to send
+   * \param callback Callback invoked with the reply, or with status
+   *   SERVICE_UNAVAILABLE if the connection fails
+   * \return Request ID
+   */
+  uint32_t Submit(RequestProto request, ReplyCallback callback);
+  /*!
+   * \brief Sends a request.
+   * \param request Request to send
+   * \return Future of the reply
+   */
+  std::future<ReplyProto> Submit(RequestProto request);
+  /*!
+   * \brief Sends a batch of requests, taking the lock of each connection
+   * once for the whole batch.
+   * \param requests Requests to send
+   * \param callback Callback invoked with the reply of each request
+   * \return Request IDs in the order of requests
+   */
+  std::vector<uint32_t> SubmitBatch(std::vector<RequestProto> requests,
+                                    ReplyCallback callback);
+  /*!
+   * \brief Sends a batch of requests.
+   * \param requests Requests to send
+   * \return Futures of the replies in the order of requests
+   */
+  std::vector<std::future<ReplyProto> > SubmitBatch(
+      std::vector<RequestProto> requests);
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final;
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final;
+
+ private:
+  /*! \brief Connection and the callbacks of its requests in flight */
+  struct SessionState {
+    std::shared_ptr<ServerSession> session;
+    std::mutex mu;
+    std::unordered_map<uint32_t, ReplyCallback> pending;
+    std::atomic<size_t> num_pending;
+    std::atomic<bool> alive;
+  };
+
+  uint32_t NextRequestId();
+  /*!
+   * \brief Splits requests over the live connections and sends them.
+   * \return Request IDs in the order of requests
+   */
+  std::vector<uint32_t> Dispatch(std::vector<RequestProto>* requests,
+                                 const std::vector<ReplyCallback>& callbacks);
+  /*! \brief Picks the live connection with the fewest requests in flight. */
+  SessionState* PickSession();
+  /*! \brief Sends requests on a connection. */
+  void Send(SessionState* state, std::vector<RequestProto>* requests,
+            const std::vector<ReplyCallback>& callbacks);
+  /*! \brief Replies to requests on a connection that cannot complete. */
+  void FailPending(SessionState* state);
+
+  uint32_t user_id_;
+  boost::asio::io_context io_context_;
+  boost::asio::executor_work_guard<
+    boost::asio::io_context::executor_type> work_guard_;
+  std::vector<std::unique_ptr<SessionState> > sessions_;
+  std::vector<std::thread> io_threads_;
+  std::atomic<uint32_t> next_req_id_;
+};
+
+} // namespace client
+} // namespace nexus
+
+#endif // NEXUS_CLIENT_CLIENT_H_
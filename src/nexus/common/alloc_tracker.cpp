@@ -0,0 +1,176 @@
+#include <cstdlib>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#ifdef USE_JEMALLOC
+#include <jemalloc/jemalloc.h>
+#endif
+
+#include "nexus/common/alloc_tracker.h"
+
+#ifdef USE_JEMALLOC
+DEFINE_bool(jemalloc_arena, true, "Serve each allocation tag from a dedicated "
+            "jemalloc arena");
+#endif
+
+namespace nexus {
+
+namespace {
+
+/*!
+ * \brief Header placed in front of every tracked allocation. It is 16 bytes
+ * to keep the returned pointer aligned the same way as malloc.
+ */
+struct AllocHeader {
+  uint32_t tag;
+  uint32_t arena;
+  uint64_t nbytes;
+};
+static_assert(sizeof(AllocHeader) == 16, "AllocHeader must be 16 bytes");
+
+thread_local AllocTag current_alloc_tag = kAllocOther;
+
+} // namespace
+
+const char* AllocTagName(AllocTag tag) {
+  switch (tag) {
+    case kAllocOther:
+      return "other";
+    case kAllocNetwork:
+      return "network";
+    case kAllocPreprocess:
+      return "preprocess";
+    case kAllocBatchOutput:
+      return "batch_output";
+    case kAllocProtobuf:
+      return "protobuf";
+    default:
+      return "unknown";
+  }
+}
+
+AllocTracker& AllocTracker::Singleton() {
+  static AllocTracker alloc_tracker_;
+  return alloc_tracker_;
+}
+
+AllocTracker::AllocTracker() :
+    prev_stats_time_(Clock::now()) {
+  for (int i = 0; i < kNumAllocTags; ++i) {
+    live_bytes_[i] = MetricRegistry::Singleton().CreateGauge();
+    num_allocs_[i] = MetricRegistry::Singleton().CreateCounter();
+    alloc_bytes_[i] = MetricRegistry::Singleton().CreateCounter();
+    prev_alloc_bytes_[i] = 0;
+    arenas_[i] = 0;
+  }
+#ifdef USE_JEMALLOC
+  if (FLAGS_jemalloc_arena) {
+    for (int i = 0; i < kNumAllocTags; ++i) {
+      unsigned arena;
+      size_t sz = sizeof(arena);
+      if (mallctl("arenas.create", &arena, &sz, nullptr, 0) != 0) {
+        LOG(ERROR) << "Failed to create jemalloc arena for " <<
+            AllocTagName(static_cast<AllocTag>(i));
+        continue;
+      }
+      arenas_[i] = arena;
+    }
+  }
+#endif
+}
+
+void* AllocTracker::Allocate(AllocTag tag, size_t nbytes) {
+  size_t total = sizeof(AllocHeader) + nbytes;
+  void* raw;
+#ifdef USE_JEMALLOC
+  if (arenas_[tag] != 0) {
+    raw = mallocx(total, MALLOCX_ARENA(arenas_[tag]) | MALLOCX_TCACHE_NONE);
+  } else {
+    raw = malloc(total);
+  }
+#else
+  raw = malloc(total);
+#endif
+  if (raw == nullptr) {
+    return nullptr;
+  }
+  auto header = static_cast<AllocHeader*>(raw);
+  header->tag = tag;
+  header->arena = arenas_[tag];
+  header->nbytes = nbytes;
+  live_bytes_[tag]->Increase(nbytes);
+  num_allocs_[tag]->Increase(1);
+  alloc_bytes_[tag]->Increase(nbytes);
+  return header + 1;
+}
+
+void AllocTracker::Free(void* buf) {
+  if (buf == nullptr) {
+    return;
+  }
+  auto header = static_cast<AllocHeader*>(buf) - 1;
+  CHECK_LT(header->tag, kNumAllocTags) << "Corrupted allocation header";
+  live_bytes_[header->tag]->Decrease(header->nbytes);
+#ifdef USE_JEMALLOC
+  if (header->arena != 0) {
+    dallocx(header, MALLOCX_TCACHE_NONE);
+    return;
+  }
+#endif
+  free(header);
+}
+
+std::vector<AllocStats> AllocTracker::GetStats() {
+  std::lock_guard<std::mutex> lock(stats_mu_);
+  auto now = Clock::now();
+  double elapsed_sec = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - prev_stats_time_).count() / 1e6;
+  prev_stats_time_ = now;
+  std::vector<AllocStats> stats;
+  for (int i = 0; i < kNumAllocTags; ++i) {
+    AllocStats s;
+    s.tag = static_cast<AllocTag>(i);
+    s.live_bytes = live_bytes_[i]->value();
+    s.total_allocs = num_allocs_[i]->value();
+    uint64_t alloc_bytes = alloc_bytes_[i]->value();
+    s.alloc_bytes_rate = elapsed_sec <= 0 ? 0. :
+        (alloc_bytes - prev_alloc_bytes_[i]) / elapsed_sec;
+    prev_alloc_bytes_[i] = alloc_bytes;
+    stats.push_back(s);
+  }
+  return stats;
+}
+
+void AllocTracker::LogStats() {
+  for (auto const& s : GetStats()) {
+    if (s.total_allocs == 0) {
+      continue;
+    }
+    LOG(INFO) << "Memory " << AllocTagName(s.tag) << ": live " <<
+        s.live_bytes / 1024. / 1024. << " MB, alloc rate " <<
+        s.alloc_bytes_rate / 1024. / 1024. << " MB/s, total allocs " <<
+        s.total_allocs;
+  }
+}
+
+void* AllocateProtobufBlock(size_t nbytes) {
+  return AllocTracker::Singleton().Allocate(kAllocProtobuf, nbytes);
+}
+
+void FreeProtobufBlock(void* buf, size_t nbytes) {
+  AllocTracker::Singleton().Free(buf);
+}
+
+AllocTag CurrentAllocTag() {
+  return current_alloc_tag;
+}
+
+AllocTagScope::AllocTagScope(AllocTag tag) :
+    prev_tag_(current_alloc_tag) {
+  current_alloc_tag = tag;
+}
+
+AllocTagScope::~AllocTagScope() {
+  current_alloc_tag = prev_tag_;
+}
+
+} // namespace nexus
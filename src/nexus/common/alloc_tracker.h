@@ -0,0 +1,126 @@
+#ifndef NEXUS_COMMON_ALLOC_TRACKER_H_
+#define NEXUS_COMMON_ALLOC_TRACKER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "nexus/common/metric.h"
+#include "nexus/common/time_util.h"
+
+namespace nexus {
+
+/*! \brief Subsystem that owns a host memory allocation. */
+enum AllocTag {
+  kAllocOther = 0,
+  /*! \brief Message buffers read from or written to sockets */
+  kAllocNetwork = 1,
+  /*! \brief Decoded images and model input arrays */
+  kAllocPreprocess = 2,
+  /*! \brief Batch output arrays filled by forward */
+  kAllocBatchOutput = 3,
+  /*! \brief Protobuf messages placed on arenas */
+  kAllocProtobuf = 4,
+  kNumAllocTags,
+};
+
+const char* AllocTagName(AllocTag tag);
+
+/*! \brief Snapshot of the accounting state of one tag. */
+struct AllocStats {
+  AllocTag tag;
+  /*! \brief Bytes currently allocated and not yet freed */
+  int64_t live_bytes;
+  /*! \brief Number of allocations since start */
+  uint64_t total_allocs;
+  /*! \brief Average allocation rate in bytes/sec since last snapshot */
+  double alloc_bytes_rate;
+};
+
+/*!
+ * \brief AllocTracker accounts host memory by subsystem.
+ *
+ * Every tracked allocation carries a small header recording its tag and size,
+ * so that Free can be attributed without the caller knowing the tag. When
+ * built with USE_JEMALLOC, each tag is additionally served from a dedicated
+ * jemalloc arena so that fragmentation of one subsystem doesn't leak into the
+ * others.
+ */
+class AllocTracker {
+ public:
+  static AllocTracker& Singleton();
+  /*!
+   * \brief Allocates nbytes of host memory accounted to tag.
+   * \param tag Allocation tag.
+   * \param nbytes Number of bytes.
+   * \return Pointer to the memory, aligned to 16 bytes.
+   */
+  void* Allocate(AllocTag tag, size_t nbytes);
+  /*!
+   * \brief Frees memory returned by Allocate.
+   * \param buf Pointer returned by Allocate, can be nullptr.
+   */
+  void Free(void* buf);
+  /*!
+   * \brief Gets the stats of all tags, and resets the rate window.
+   *
+   * Rates are computed against the previous call, so there should be only one
+   * caller that periodically polls the stats in each process.
+   */
+  std::vector<AllocStats> GetStats();
+  /*! \brief Logs the stats of all tags that have been used. */
+  void LogStats();
+
+ private:
+  AllocTracker();
+
+  std::shared_ptr<Gauge> live_bytes_[kNumAllocTags];
+  std::shared_ptr<Counter> num_allocs_[kNumAllocTags];
+  std::shared_ptr<Counter> alloc_bytes_[kNumAllocTags];
+  /*!
+   * \brief Allocated bytes and time at the previous GetStats. A plain
+   * counter keeps no history, so nothing grows when stats are never polled.
+   * Guarded by stats_mu_
+   */
+  uint64_t prev_alloc_bytes_[kNumAllocTags];
+  TimePoint prev_stats_time_;
+  std::mutex stats_mu_;
+  /*! \brief jemalloc arena index per tag, 0 if not bound */
+  unsigned arenas_[kNumAllocTags];
+};
+
+/*!
+ * \brief Block allocation hooks for google::protobuf::ArenaOptions. Blocks
+ * are accounted to kAllocProtobuf.
+ */
+void* AllocateProtobufBlock(size_t nbytes);
+
+void FreeProtobufBlock(void* buf, size_t nbytes);
+
+/*! \brief Returns the allocation tag of the calling thread. */
+AllocTag CurrentAllocTag();
+
+/*!
+ * \brief AllocTagScope sets the allocation tag of the calling thread during
+ * its lifetime. Allocations made through CPUDevice inside the scope are
+ * accounted to the tag.
+ */
+class AllocTagScope {
+ public:
+  explicit AllocTagScope(AllocTag tag);
+
+  ~AllocTagScope();
+
+  AllocTagScope(const AllocTagScope&) = delete;
+  AllocTagScope& operator=(const AllocTagScope&) = delete;
+
+ private:
+  AllocTag prev_tag_;
+};
+
+} // namespace nexus
+
+#endif // NEXUS_COMMON_ALLOC_TRACKER_H_
@@ -0,0 +1,308 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "nexus/common/async_log.h"
+
+DEFINE_bool(async_log, false, "Write stderr logs from a background thread");
+DEFINE_int32(async_log_queue, 65536, "Number of messages the async log queue "
+             "holds before dropping, rounded up to a power of 2");
+
+namespace nexus {
+
+namespace {
+
+std::atomic<uint64_t> num_suppressed(0);
+
+int64_t SteadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*!
+ * \brief AsyncLogSink receives messages from glog and writes them to stderr
+ * in a background thread.
+ *
+ * The queue is a bounded multi-producer ring buffer where each slot carries a
+ * sequence number, so producers only contend on one atomic increment. The
+ * background thread is the only consumer except on FATAL, where the caller
+ * drains the queue under drain_mu_. The background thread sleeps on wake_cv_
+ * when the queue is empty, and producers only notify it when it is asleep.
+ */
+class AsyncLogSink : public google::LogSink {
+ public:
+  AsyncLogSink(size_t capacity, google::LogSeverity min_severity) :
+      min_severity_(min_severity),
+      enqueue_pos_(0),
+      dequeue_pos_(0),
+      num_logged_(0),
+      num_dropped_(0),
+      sleeping_(false),
+      running_(true) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    slots_.reset(new Slot[size]);
+    for (size_t i = 0; i < size; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    thread_ = std::thread(&AsyncLogSink::Run, this);
+  }
+
+  ~AsyncLogSink() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mu_);
+      running_ = false;
+    }
+    wake_cv_.notify_one();
+    thread_.join();
+    Drain();
+  }
+
+  void send(google::LogSeverity severity, const char* full_filename,
+            const char* base_filename, int line, const struct ::tm* tm_time,
+            const char* message, size_t message_len) override {
+    if (severity < min_severity_) {
+      return;
+    }
+    std::string msg = ToString(severity, base_filename, line, tm_time,
+                               message, message_len);
+    msg.push_back('\n');
+    if (severity == google::GLOG_FATAL) {
+      // glog aborts after the sinks, so the FATAL message is written here
+      // right after what was queued before it
+      Drain(msg);
+      return;
+    }
+    if (!TryPush(std::move(msg))) {
+      num_dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // Pairs with the fence in Run so that either the consumer sees the
+    // message before it sleeps or this sees it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(wake_mu_);
+      wake_cv_.notify_one();
+    }
+  }
+
+  uint64_t num_logged() const {
+    return num_logged_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t num_dropped() const {
+    return num_dropped_.load(std::memory_order_relaxed);
+  }
+
+  /*!
+   * \brief Writes all queued messages to stderr.
+   * \param last Message written after the queued ones, can be empty
+   */
+  void Drain(const std::string& last = "") {
+    std::lock_guard<std::mutex> lock(drain_mu_);
+    std::string batch;
+    std::string msg;
+    uint64_t count = 0;
+    while (TryPop(&msg)) {
+      batch.append(msg);
+      ++count;
+    }
+    if (!last.empty()) {
+      batch.append(last);
+      ++count;
+    }
+    if (count > 0) {
+      fwrite(batch.data(), 1, batch.size(), stderr);
+      fflush(stderr);
+      num_logged_.fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    std::string msg;
+  };
+
+  bool TryPush(std::string&& msg) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[pos & mask_];
+      size_t seq = slot.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          slot.msg = std::move(msg);
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // Queue is full
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  bool Empty() {
+    std::lock_guard<std::mutex> lock(drain_mu_);
+    Slot& slot = slots_[dequeue_pos_ & mask_];
+    size_t seq = slot.seq.load(std::memory_order_acquire);
+    return (intptr_t) seq - (intptr_t) (dequeue_pos_ + 1) < 0;
+  }
+  /*! \brief Pops one message. Requires drain_mu_. */
+  bool TryPop(std::string* msg) {
+    Slot& slot = slots_[dequeue_pos_ & mask_];
+    size_t seq = slot.seq.load(std::memory_order_acquire);
+    if ((intptr_t) seq - (intptr_t) (dequeue_pos_ + 1) < 0) {
+      return false;
+    }
+    msg->swap(slot.msg);
+    slot.msg.clear();
+    slot.seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+    ++dequeue_pos_;
+    return true;
+  }
+
+  void Run() {
+    while (running_) {
+      Drain();
+      std::unique_lock<std::mutex> lock(wake_mu_);
+      sleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (running_ && Empty()) {
+        // The timeout only bounds the delay if a wakeup is ever missed
+        wake_cv_.wait_for(lock, std::chrono::milliseconds(100));
+      }
+      sleeping_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  google::LogSeverity min_severity_;
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  std::atomic<size_t> enqueue_pos_;
+  size_t dequeue_pos_;
+  std::atomic<uint64_t> num_logged_;
+  std::atomic<uint64_t> num_dropped_;
+  std::mutex drain_mu_;
+  std::mutex wake_mu_;
+  std::condition_variable wake_cv_;
+  /*! \brief Whether the background thread is about to wait on wake_cv_ */
+  std::atomic<bool> sleeping_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+/*! \brief Installed sink and the glog flags it replaced */
+struct AsyncLogState {
+  std::unique_ptr<AsyncLogSink> sink;
+  bool logtostderr;
+  bool alsologtostderr;
+  int stderrthreshold;
+};
+
+AsyncLogState& GetAsyncLogState() {
+  // Never destructed so that messages logged during static destruction
+  // don't reach a destroyed sink
+  static AsyncLogState* state = new AsyncLogState();
+  return *state;
+}
+
+void DrainAtExit() {
+  auto& sink = GetAsyncLogState().sink;
+  if (sink != nullptr) {
+    sink->Drain();
+  }
+}
+
+} // namespace
+
+LogRateLimiter::LogRateLimiter(int64_t interval_ms) :
+    interval_ns_(interval_ms * 1000000),
+    next_ns_(0),
+    suppressed_(0) {
+}
+
+bool LogRateLimiter::Allow(uint64_t* suppressed) {
+  int64_t now = SteadyNowNs();
+  int64_t next = next_ns_.load(std::memory_order_relaxed);
+  if (now >= next &&
+      next_ns_.compare_exchange_strong(next, now + interval_ns_,
+                                       std::memory_order_relaxed)) {
+    *suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+  suppressed_.fetch_add(1, std::memory_order_relaxed);
+  num_suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+std::string SuppressedNote(uint64_t suppressed) {
+  if (suppressed == 0) {
+    return "";
+  }
+  return "(" + std::to_string(suppressed) + " similar messages suppressed) ";
+}
+
+LogVolume GetLogVolume() {
+  LogVolume volume;
+  auto& sink = GetAsyncLogState().sink;
+  volume.logged = (sink == nullptr) ? 0 : sink->num_logged();
+  volume.dropped = (sink == nullptr) ? 0 : sink->num_dropped();
+  volume.suppressed = num_suppressed.load(std::memory_order_relaxed);
+  return volume;
+}
+
+void InitAsyncLogging() {
+  auto& state = GetAsyncLogState();
+  if (!FLAGS_async_log || state.sink != nullptr) {
+    return;
+  }
+  static bool registered = false;
+  if (!registered) {
+    std::atexit(DrainAtExit);
+    registered = true;
+  }
+  state.logtostderr = FLAGS_logtostderr;
+  state.alsologtostderr = FLAGS_alsologtostderr;
+  state.stderrthreshold = FLAGS_stderrthreshold;
+  google::LogSeverity min_severity =
+      (FLAGS_logtostderr || FLAGS_alsologtostderr) ? google::GLOG_INFO :
+      FLAGS_stderrthreshold;
+  if (FLAGS_logtostderr) {
+    // Without logtostderr glog would also create log files
+    for (int severity = 0; severity < google::NUM_SEVERITIES; ++severity) {
+      google::SetLogDestination(severity, "");
+    }
+  }
+  state.sink.reset(new AsyncLogSink(FLAGS_async_log_queue, min_severity));
+  google::AddLogSink(state.sink.get());
+  FLAGS_logtostderr = false;
+  FLAGS_alsologtostderr = false;
+  // glog writes to stderr before it calls the sinks, so it must not write
+  // FATAL messages either for them to come after the queued ones
+  FLAGS_stderrthreshold = google::NUM_SEVERITIES;
+}
+
+void ShutdownAsyncLogging() {
+  auto& state = GetAsyncLogState();
+  if (state.sink == nullptr) {
+    return;
+  }
+  google::RemoveLogSink(state.sink.get());
+  state.sink.reset();
+  FLAGS_logtostderr = state.logtostderr;
+  FLAGS_alsologtostderr = state.alsologtostderr;
+  FLAGS_stderrthreshold = state.stderrthreshold;
+}
+
+} // namespace nexus
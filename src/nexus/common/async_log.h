@@ -0,0 +1,83 @@
+#ifndef NEXUS_COMMON_ASYNC_LOG_H_
+#define NEXUS_COMMON_ASYNC_LOG_H_
+
+#include <atomic>
+#include <cstdint>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <string>
+
+DECLARE_bool(async_log);
+
+namespace nexus {
+
+/*!
+ * \brief LogRateLimiter allows one message per interval from a log site and
+ * counts the messages suppressed in between. It is lock-free and safe to
+ * share between threads.
+ */
+class LogRateLimiter {
+ public:
+  explicit LogRateLimiter(int64_t interval_ms);
+  /*!
+   * \brief Checks whether the log site may log now.
+   * \param suppressed Output number of messages suppressed since the last
+   *   allowed one, only set when allowed
+   * \return true if the message should be logged
+   */
+  bool Allow(uint64_t* suppressed);
+
+ private:
+  int64_t interval_ns_;
+  /*! \brief Steady clock time in ns when the next message is allowed */
+  std::atomic<int64_t> next_ns_;
+  std::atomic<uint64_t> suppressed_;
+};
+
+/*! \brief Prefix of a rate-limited message, empty if nothing was dropped */
+std::string SuppressedNote(uint64_t suppressed);
+
+/*! \brief Log volume since the process started */
+struct LogVolume {
+  /*! \brief Messages written by the async sink */
+  uint64_t logged;
+  /*! \brief Messages dropped because the async queue was full */
+  uint64_t dropped;
+  /*! \brief Messages suppressed by LOG_EVERY_MS */
+  uint64_t suppressed;
+};
+
+LogVolume GetLogVolume();
+/*!
+ * \brief Moves stderr logging off the calling threads if --async_log is set.
+ * It is off by default.
+ *
+ * glog then only enqueues formatted messages into a bounded lock-free queue,
+ * and a background thread writes them to stderr. Messages are dropped and
+ * counted when the queue is full instead of blocking. FATAL messages are
+ * still written synchronously after the queue is drained. Log files, if
+ * enabled, are left to glog as they are already buffered.
+ *
+ * Call after parsing command line flags.
+ */
+void InitAsyncLogging();
+/*! \brief Drains the queue and restores synchronous logging. */
+void ShutdownAsyncLogging();
+
+} // namespace nexus
+
+/*!
+ * \brief Logs at most once every interval_ms from this site, e.g.,
+ * LOG_EVERY_MS(WARNING, 1000) << "Queue is full";
+ * interval_ms must be a constant.
+ */
+#define LOG_EVERY_MS(severity, interval_ms)                             \
+  for (uint64_t nexus_log_suppressed_ = 0, nexus_log_once_ =            \
+           ([]() -> ::nexus::LogRateLimiter& {                          \
+             static ::nexus::LogRateLimiter limiter(interval_ms);       \
+             return limiter;                                            \
+           })().Allow(&nexus_log_suppressed_);                          \
+       nexus_log_once_; nexus_log_once_ = 0)                            \
+    LOG(severity) << ::nexus::SuppressedNote(nexus_log_suppressed_)
+
+#endif // NEXUS_COMMON_ASYNC_LOG_H_
@@ -1,11 +1,76 @@
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 #include <grpc++/grpc++.h>
 
 #include "nexus/common/backend_pool.h"
 #include "nexus/common/util.h"
 
+DEFINE_int32(backend_lanes, 1, "Number of TCP connections to each backend. "
+             "With more than one, messages larger than --backend_bulk_bytes "
+             "go on separate bulk connections");
+DEFINE_int32(backend_bulk_bytes, 16384, "Messages with a larger body are sent "
+             "on bulk connections to backends");
+
 namespace nexus {
 
+BackendLane::BackendLane(std::weak_ptr<BackendSession> session,
+                         boost::asio::io_context& io_context,
+                         MessageHandler* session_handler) :
+    Connection(io_context, this),
+    session_(session),
+    session_handler_(session_handler),
+    connected_(false) {}
+
+void BackendLane::Connect(const std::string& ip, const std::string& port) {
+  boost::asio::ip::tcp::resolver resolver(socket_.get_executor());
+  boost::asio::ip::tcp::resolver::iterator endpoint =
+      resolver.resolve({ ip, port });
+  auto self = shared_from_this();
+  boost::asio::async_connect(
+      socket_, endpoint,
+      [this, self](boost::system::error_code ec,
+                   boost::asio::ip::tcp::resolver::iterator) {
+        if (ec) {
+          if (ec != boost::asio::error::operation_aborted) {
+            HandleError(self, ec);
+          }
+        } else {
+          boost::asio::ip::tcp::no_delay option(true);
+          socket_.set_option(option);
+          StartReading();
+          SendHello();
+          connected_ = true;
+        }
+      });
+}
+
+size_t BackendLane::QueueLength() {
+  std::lock_guard<std::mutex> lock(write_queue_mutex_);
+  return write_queue_.size();
+}
+
+void BackendLane::HandleMessage(std::shared_ptr<Connection>,
+                                std::shared_ptr<Message> message) {
+  if (auto session = session_.lock()) {
+    session_handler_->HandleMessage(session, std::move(message));
+  }
+}
+
+void BackendLane::HandleExpired(std::shared_ptr<Connection>,
+                                std::shared_ptr<Message> message) {
+  if (auto session = session_.lock()) {
+    session_handler_->HandleExpired(session, std::move(message));
+  }
+}
+
+void BackendLane::HandleError(std::shared_ptr<Connection>,
+                              boost::system::error_code ec) {
+  connected_ = false;
+  if (auto session = session_.lock()) {
+    session_handler_->HandleError(session, ec);
+  }
+}
+
 BackendSession::BackendSession(const BackendInfo& info,
                                boost::asio::io_context& io_context,
                                MessageHandler* handler):
@@ -31,9 +96,18 @@ BackendSession::~BackendSession() {
 void BackendSession::Start() {
   // Connect to backend server
   DoConnect();
+  auto self = std::static_pointer_cast<BackendSession>(shared_from_this());
+  for (int i = 1; i < FLAGS_backend_lanes; ++i) {
+    auto lane = std::make_shared<BackendLane>(self, io_context_, handler_);
+    lane->Connect(ip_, server_port_);
+    bulk_lanes_.push_back(lane);
+  }
 }
 
 void BackendSession::Stop() {
+  for (auto& lane : bulk_lanes_) {
+    lane->Stop();
+  }
   if (running_) {
     LOG(INFO) << "Disconnect to backend " << node_id_;
     running_ = false;
@@ -41,6 +115,29 @@ void BackendSession::Stop() {
   }
 }
 
+void BackendSession::Write(std::shared_ptr<Message> msg) {
+  if (!bulk_lanes_.empty() && msg->body_length() > size_t(FLAGS_backend_bulk_bytes)) {
+    BackendLane* target = nullptr;
+    size_t min_queue = 0;
+    for (auto& lane : bulk_lanes_) {
+      if (!lane->connected()) {
+        continue;
+      }
+      size_t queue = lane->QueueLength();
+      if (target == nullptr || queue < min_queue) {
+        target = lane.get();
+        min_queue = queue;
+      }
+    }
+    if (target != nullptr) {
+      target->Write(std::move(msg));
+      return;
+    }
+    // Falls back to the session connection until a bulk lane connects
+  }
+  Connection::Write(std::move(msg));
+}
+
 void BackendSession::DoConnect() {
   boost::asio::ip::tcp::resolver::iterator endpoint;
   boost::asio::ip::tcp::resolver resolver(io_context_);
@@ -56,7 +153,8 @@ void BackendSession::DoConnect() {
           socket_.set_option(option);
           running_ = true;
           LOG(INFO) << "Connected to backend " << node_id_;
-          DoReadHeader();
+          StartReading();
+          SendHello();
         }
       });
 }
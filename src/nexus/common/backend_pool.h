@@ -3,6 +3,7 @@
 
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 #include "nexus/common/connection.h"
 #include "nexus/common/time_util.h"
@@ -11,7 +12,50 @@
 namespace nexus {
 
 class BackendPool;
+class BackendSession;
+
+/*!
+ * \brief BackendLane is an extra connection of a BackendSession to the same
+ * backend. Messages received on a lane are handed to the handler of the
+ * session as if the session received them, and errors of a lane are
+ * reported as errors of the session.
+ */
+class BackendLane : public Connection, public MessageHandler {
+ public:
+  BackendLane(std::weak_ptr<BackendSession> session,
+              boost::asio::io_context& io_context,
+              MessageHandler* session_handler);
+  /*! \brief Asynchronously connects to the backend server. */
+  void Connect(const std::string& ip, const std::string& port);
+
+  bool connected() const { return connected_; }
+  /*! \brief Number of messages waiting to be sent on the lane. */
+  size_t QueueLength();
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final;
+
+  void HandleError(std::shared_ptr<Connection> conn,
+                   boost::system::error_code ec) final;
+
+  void HandleExpired(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final;
+
+ private:
+  std::weak_ptr<BackendSession> session_;
+  MessageHandler* session_handler_;
+  std::atomic_bool connected_;
+};
 
+/*!
+ * \brief BackendSession is the link from a frontend or a backup client to a
+ * backend server. With --backend_lanes > 1 the link is striped over several
+ * TCP connections: messages up to --backend_bulk_bytes, i.e., queries
+ * without large inputs and control messages, go on the session connection
+ * itself, and larger ones go on the least loaded bulk lane, so that large
+ * images do not hold up small messages. The backend replies on the
+ * connection a request arrives on.
+ */
 class BackendSession : public Connection {
  public:
   explicit BackendSession(const BackendInfo& info,
@@ -31,6 +75,8 @@ class BackendSession : public Connection {
   virtual void Start();
 
   virtual void Stop();
+  /*! \brief Sends the message on the lane of its size class. */
+  virtual void Write(std::shared_ptr<Message> msg);
 
   double GetUtilization();
 
@@ -45,6 +91,8 @@ class BackendSession : public Connection {
   std::string server_port_;
   std::string rpc_port_;
   std::atomic_bool running_;
+  /*! \brief Bulk lanes, fixed after Start */
+  std::vector<std::shared_ptr<BackendLane> > bulk_lanes_;
   std::unique_ptr<BackendCtrl::Stub> stub_;
   double utilization_;
   TimePoint expire_;
@@ -95,6 +95,12 @@ class DeadlineItem {
   TimePoint deadline() const { return deadline_; }
 
  protected:
+  /*! \brief Restarts the clock of the item, used when it is reused. */
+  void ResetBegin() {
+    begin_ = Clock::now();
+  }
+
+
   TimePoint begin_;
   TimePoint deadline_;
 };
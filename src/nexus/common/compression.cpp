@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <sys/resource.h>
+#include <thread>
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "nexus/common/compression.h"
+#include "nexus/common/time_util.h"
+
+DEFINE_string(compression, "none", "Codec to compress large message bodies "
+              "on links between frontends and backends, none, lz4 or zstd. "
+              "Used only if the peer supports it");
+DEFINE_int32(compress_min_bytes, 4096, "Bodies smaller than this are never "
+             "compressed");
+DEFINE_double(compress_max_ratio, 0.9, "Back off compressing on a link whose "
+              "bodies compress to more than this fraction of their size");
+DEFINE_double(compress_max_cpu, 0.8, "Skip compression while the process uses "
+              "more than this fraction of all cores");
+DEFINE_int32(compress_probe_interval, 64, "Eligible messages sent "
+             "uncompressed between probes after backing off");
+
+namespace nexus {
+
+namespace {
+
+std::atomic<uint64_t> raw_bytes(0);
+std::atomic<uint64_t> wire_bytes(0);
+std::atomic<uint64_t> num_compressed(0);
+std::atomic<uint64_t> num_skipped(0);
+std::atomic<uint64_t> cpu_us(0);
+
+/*! \brief Fraction of all cores used by the process, sampled every 200ms */
+double ProcessCpuLoad() {
+  static std::mutex mu;
+  static TimePoint last_time = Clock::now();
+  static double last_cpu_sec = 0.;
+  static std::atomic<double> load(0.);
+  static const unsigned num_cores = std::max(
+      std::thread::hardware_concurrency(), 1u);
+  std::unique_lock<std::mutex> lock(mu, std::try_to_lock);
+  if (lock.owns_lock()) {
+    auto now = Clock::now();
+    double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - last_time).count() / 1e6;
+    if (elapsed >= 0.2) {
+      struct rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      double cpu_sec = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                       usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+      load = (cpu_sec - last_cpu_sec) / elapsed / num_cores;
+      last_cpu_sec = cpu_sec;
+      last_time = now;
+    }
+  }
+  return load;
+}
+
+} // namespace
+
+uint32_t SupportedCodecs() {
+  uint32_t codecs = 0;
+#ifdef USE_LZ4
+  codecs |= 1 << kCodecLz4;
+#endif
+#ifdef USE_ZSTD
+  codecs |= 1 << kCodecZstd;
+#endif
+  return codecs;
+}
+
+CompressionCodec PreferredCodec() {
+  static CompressionCodec codec = []() {
+    CompressionCodec c = kCodecNone;
+    if (FLAGS_compression == "lz4") {
+      c = kCodecLz4;
+    } else if (FLAGS_compression == "zstd") {
+      c = kCodecZstd;
+    } else if (FLAGS_compression != "none") {
+      LOG(ERROR) << "Unknown compression codec: " << FLAGS_compression;
+    }
+    if (c != kCodecNone && (SupportedCodecs() & (1 << c)) == 0) {
+      LOG(ERROR) << "Compression codec " << FLAGS_compression <<
+          " is not built in";
+      c = kCodecNone;
+    }
+    return c;
+  }();
+  return codec;
+}
+
+size_t CompressBound(CompressionCodec codec, size_t size) {
+  switch (codec) {
+#ifdef USE_LZ4
+    case kCodecLz4:
+      return LZ4_compressBound(size);
+#endif
+#ifdef USE_ZSTD
+    case kCodecZstd:
+      return ZSTD_compressBound(size);
+#endif
+    default:
+      return 0;
+  }
+}
+
+size_t Compress(CompressionCodec codec, const char* src, size_t size,
+                char* dst) {
+  switch (codec) {
+#ifdef USE_LZ4
+    case kCodecLz4: {
+      int ret = LZ4_compress_default(src, dst, size, LZ4_compressBound(size));
+      return ret > 0 ? ret : 0;
+    }
+#endif
+#ifdef USE_ZSTD
+    case kCodecZstd: {
+      size_t ret = ZSTD_compress(dst, ZSTD_compressBound(size), src, size, 1);
+      return ZSTD_isError(ret) ? 0 : ret;
+    }
+#endif
+    default:
+      return 0;
+  }
+}
+
+bool Decompress(CompressionCodec codec, const char* src, size_t size,
+                char* dst, size_t dst_size) {
+  switch (codec) {
+#ifdef USE_LZ4
+    case kCodecLz4:
+      return LZ4_decompress_safe(src, dst, size, dst_size) == int(dst_size);
+#endif
+#ifdef USE_ZSTD
+    case kCodecZstd:
+      return ZSTD_decompress(dst, dst_size, src, size) == dst_size;
+#endif
+    default:
+      return false;
+  }
+}
+
+CompressionStats GetCompressionStats() {
+  CompressionStats stats;
+  stats.raw_bytes = raw_bytes;
+  stats.wire_bytes = wire_bytes;
+  stats.num_compressed = num_compressed;
+  stats.num_skipped = num_skipped;
+  stats.cpu_us = cpu_us;
+  return stats;
+}
+
+CompressionPolicy::CompressionPolicy() :
+    ratio_(0.),
+    skip_(0) {}
+
+bool CompressionPolicy::ShouldCompress(size_t body_length) {
+  if (body_length < size_t(FLAGS_compress_min_bytes)) {
+    return false;
+  }
+  bool compress = true;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (skip_ > 0) {
+      --skip_;
+      compress = false;
+    }
+  }
+  if (compress && ProcessCpuLoad() > FLAGS_compress_max_cpu) {
+    compress = false;
+  }
+  if (!compress) {
+    raw_bytes += body_length;
+    wire_bytes += body_length;
+    ++num_skipped;
+  }
+  return compress;
+}
+
+void CompressionPolicy::Record(size_t raw_size, size_t compressed_size,
+                               uint64_t cpu) {
+  raw_bytes += raw_size;
+  cpu_us += cpu;
+  bool sent_compressed = compressed_size > 0 && compressed_size < raw_size;
+  if (sent_compressed) {
+    wire_bytes += compressed_size;
+    ++num_compressed;
+  } else {
+    wire_bytes += raw_size;
+    ++num_skipped;
+  }
+  double ratio = sent_compressed ? double(compressed_size) / raw_size : 1.;
+  std::lock_guard<std::mutex> lock(mu_);
+  ratio_ = ratio_ == 0. ? ratio : 0.8 * ratio_ + 0.2 * ratio;
+  if (ratio_ > FLAGS_compress_max_ratio) {
+    skip_ = FLAGS_compress_probe_interval;
+    // A single good probe is enough to resume
+    ratio_ = 0.;
+  }
+}
+
+void CompressionPolicy::RecordDecompress(uint64_t cpu) {
+  cpu_us += cpu;
+}
+
+} // namespace nexus
@@ -0,0 +1,95 @@
+#ifndef NEXUS_COMMON_COMPRESSION_H_
+#define NEXUS_COMMON_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace nexus {
+
+/*! \brief Codecs of compressed message bodies */
+enum CompressionCodec {
+  kCodecNone = 0,
+  /*! \brief LZ4, built with USE_LZ4 */
+  kCodecLz4 = 1,
+  /*! \brief zstd at level 1, built with USE_ZSTD */
+  kCodecZstd = 2,
+};
+
+/*! \brief Bitmask of the codecs this build can compress and decompress. */
+uint32_t SupportedCodecs();
+/*!
+ * \brief Codec selected by --compression for links to and from backends,
+ * kCodecNone if disabled or not built in.
+ */
+CompressionCodec PreferredCodec();
+/*!
+ * \brief Compresses a buffer.
+ * \param codec Codec to use
+ * \param src Input buffer
+ * \param size Input size in bytes
+ * \param dst Output buffer, at least CompressBound(codec, size) bytes
+ * \return Compressed size, 0 on failure
+ */
+size_t Compress(CompressionCodec codec, const char* src, size_t size,
+                char* dst);
+/*! \brief Maximum compressed size of an input of the size. */
+size_t CompressBound(CompressionCodec codec, size_t size);
+/*!
+ * \brief Decompresses a buffer.
+ * \return true if exactly dst_size bytes are decompressed
+ */
+bool Decompress(CompressionCodec codec, const char* src, size_t size,
+                char* dst, size_t dst_size);
+
+/*! \brief Process-wide compression counters */
+struct CompressionStats {
+  /*! \brief Body bytes of messages eligible for compression */
+  uint64_t raw_bytes;
+  /*! \brief Body bytes of the same messages as sent */
+  uint64_t wire_bytes;
+  /*! \brief Number of messages sent compressed */
+  uint64_t num_compressed;
+  /*! \brief Number of eligible messages sent uncompressed */
+  uint64_t num_skipped;
+  /*! \brief Time spent compressing and decompressing in us */
+  uint64_t cpu_us;
+};
+
+CompressionStats GetCompressionStats();
+
+/*!
+ * \brief CompressionPolicy decides whether to compress the messages of one
+ * link. Bodies under --compress_min_bytes are sent as they are. Compression
+ * is skipped while the process uses more than --compress_max_cpu of the
+ * cores, and backs off for a while after bodies compress worse than
+ * --compress_max_ratio, probing again every --compress_probe_interval
+ * eligible messages.
+ */
+class CompressionPolicy {
+ public:
+  CompressionPolicy();
+  /*! \brief Whether to try compressing a body of the size now. */
+  bool ShouldCompress(size_t body_length);
+  /*!
+   * \brief Records the outcome of a compression attempt.
+   * \param raw_size Body size before compression
+   * \param compressed_size Body size after, 0 if it failed
+   * \param cpu_us Time spent compressing
+   */
+  void Record(size_t raw_size, size_t compressed_size, uint64_t cpu_us);
+  /*! \brief Records a body decompressed on receive. */
+  static void RecordDecompress(uint64_t cpu_us);
+
+ private:
+  /*! \brief Moving average of compressed / raw size. Guarded by mu_ */
+  double ratio_;
+  /*! \brief Eligible messages to skip before probing again */
+  uint32_t skip_;
+  std::mutex mu_;
+};
+
+} // namespace nexus
+
+#endif // NEXUS_COMMON_COMPRESSION_H_
@@ -1,14 +1,41 @@
+#include <arpa/inet.h>
 #include <glog/logging.h>
+#include <sys/socket.h>
 
 #include "nexus/common/connection.h"
+#include "nexus/common/io_uring_engine.h"
+#include "nexus/common/metric.h"
+#include "nexus/common/time_util.h"
 
 namespace nexus {
 
+namespace {
+
+Counter& ReorderedCounter() {
+  static Counter counter;
+  return counter;
+}
+
+Counter& ExpiredCounter() {
+  static Counter counter;
+  return counter;
+}
+
+} // namespace
+
 Connection::Connection(boost::asio::ip::tcp::socket socket,
                        MessageHandler* handler) :
     socket_(std::move(socket)),
     handler_(handler),
-    wrong_header_(false) {
+    wrong_header_(false),
+    uring_(nullptr),
+    uring_slot_(0),
+    uring_flush_pending_(false),
+    uring_handoff_(false),
+    stopped_(false),
+    peer_codecs_(0),
+    hello_sent_(false),
+    max_header_version_(MESSAGE_HEADER_VERSION) {
   boost::asio::ip::tcp::no_delay option(true);
   socket_.set_option(option);
 }
@@ -17,26 +44,164 @@ Connection::Connection(boost::asio::io_context& io_context,
                        MessageHandler* handler) :
     socket_(io_context),
     handler_(handler),
-    wrong_header_(false) {
+    wrong_header_(false),
+    uring_(nullptr),
+    uring_slot_(0),
+    uring_flush_pending_(false),
+    uring_handoff_(false),
+    stopped_(false),
+    peer_codecs_(0),
+    hello_sent_(false),
+    max_header_version_(MESSAGE_HEADER_VERSION) {
 }
 
 void Connection::Start() {
-  DoReadHeader();
+  StartReading();
 }
 
 void Connection::Stop() {
   LOG(INFO) << "Connection Stop";
   std::lock_guard<std::mutex> socket_guard(socket_mutex_);
+  if (!stopped_.exchange(true) && uring_ != nullptr) {
+    // Ends the multishot receive. The engine closes its duplicate of the
+    // socket descriptor once its operations complete.
+    ::shutdown(socket_.native_handle(), SHUT_RDWR);
+    uring_->Remove(uring_slot_);
+  }
   socket_.close();
 }
 
 void Connection::Write(std::shared_ptr<Message> msg) {
+  msg = MaybeCompress(std::move(msg));
+  std::vector<std::shared_ptr<Message> > dropped;
+  {
+    std::lock_guard<std::mutex> lock(write_queue_mutex_);
+    bool write_in_progress = !write_queue_.empty();
+    // The front of the queue is being written by asio
+    size_t in_flight = (uring_ != nullptr ? uring_handoff_ :
+                        write_in_progress) ? 1 : 0;
+    auto pos = write_queue_.end();
+    if (msg->has_deadline()) {
+      TimePoint deadline = msg->deadline();
+      while (pos - write_queue_.begin() > ptrdiff_t(in_flight) &&
+             (*(pos - 1))->deadline() > deadline) {
+        --pos;
+      }
+      if (pos != write_queue_.end()) {
+        ReorderedCounter().Increase(1);
+      }
+    }
+    write_queue_.insert(pos, std::move(msg));
+    if (uring_ != nullptr) {
+      if (!uring_handoff_ && !uring_flush_pending_.exchange(true)) {
+        uring_->Flush(uring_slot_);
+      }
+    } else if (!write_in_progress) {
+      DoWrite(&dropped);
+    }
+  }
+  ReportExpired(&dropped);
+}
+
+void Connection::SendHello() {
+  if (SupportedCodecs() == 0 || hello_sent_.exchange(true)) {
+    return;
+  }
+  auto msg = std::make_shared<Message>(kLinkHello, 2 * sizeof(uint32_t));
+  *((uint32_t*) msg->body()) = htonl(MESSAGE_HEADER_VERSION);
+  *((uint32_t*) (msg->body() + 4)) = htonl(SupportedCodecs());
+  Write(std::move(msg));
+}
+
+void Connection::Dispatch(std::shared_ptr<Message> msg) {
+  if (msg->type() == kLinkHello) {
+    if (max_header_version_ == 0) {
+      // Never compress toward user clients
+      return;
+    }
+    if (msg->body_length() >= 2 * sizeof(uint32_t)) {
+      peer_codecs_ = ntohl(*(const uint32_t*) (msg->body() + 4));
+    }
+    SendHello();
+    return;
+  }
+  if (msg->compressed()) {
+    auto beg = Clock::now();
+    auto raw = msg->Decompress();
+    CompressionPolicy::RecordDecompress(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - beg).count());
+    if (raw == nullptr) {
+      LOG(ERROR) << "Failed to decompress message of type " << msg->type();
+      return;
+    }
+    msg = std::move(raw);
+  }
+  handler_->HandleMessage(shared_from_this(), std::move(msg));
+}
+
+std::shared_ptr<Message> Connection::MaybeCompress(
+    std::shared_ptr<Message> msg) {
+  CompressionCodec codec = PreferredCodec();
+  if (codec == kCodecNone || (peer_codecs_ & (1 << codec)) == 0 ||
+      msg->compressed() || !compression_.ShouldCompress(msg->body_length())) {
+    return msg;
+  }
+  auto beg = Clock::now();
+  auto compressed = msg->Compress(codec);
+  compression_.Record(
+      msg->body_length(), compressed ? compressed->body_length() : 0,
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - beg).count());
+  return compressed ? compressed : msg;
+}
+
+uint64_t Connection::num_reordered() {
+  return ReorderedCounter().value();
+}
+
+uint64_t Connection::num_expired() {
+  return ExpiredCounter().value();
+}
+
+void Connection::ReportExpired(std::vector<std::shared_ptr<Message> >* dropped) {
+  if (dropped->empty()) {
+    return;
+  }
+  ExpiredCounter().Increase(dropped->size());
+  auto self = shared_from_this();
+  for (auto& msg : *dropped) {
+    // Write compressed the message, handlers expect it as it was written
+    if (msg->compressed()) {
+      auto raw = msg->Decompress();
+      if (raw == nullptr) {
+        LOG(ERROR) << "Failed to decompress expired message of type " <<
+            msg->type();
+        continue;
+      }
+      msg = std::move(raw);
+    }
+    handler_->HandleExpired(self, std::move(msg));
+  }
+  dropped->clear();
+}
+
+void Connection::StartReading() {
+  IoUringEngine* engine = IoUringEngine::Assign();
+  if (engine == nullptr) {
+    DoReadHeader();
+    return;
+  }
   std::lock_guard<std::mutex> lock(write_queue_mutex_);
-  bool write_in_progress = !write_queue_.empty();
-  write_queue_.push_back(std::move(msg));
-  if (!write_in_progress) {
-    DoWrite();
+  // The engine duplicates the socket descriptor, which Stop closes
+  std::lock_guard<std::mutex> socket_guard(socket_mutex_);
+  if (stopped_) {
+    return;
   }
+  // An asio write in flight owns the front of write_queue_ until it completes
+  uring_handoff_ = !write_queue_.empty();
+  uring_slot_ = engine->Add(shared_from_this());
+  uring_ = engine;
 }
 
 void Connection::DoReadHeader() {
@@ -53,7 +218,8 @@ void Connection::DoReadHeader() {
           return;
         }
         MessageHeader msg_header;
-        if (!DecodeHeader(msg_header_buffer_, &msg_header)) {
+        if (!DecodeHeader(msg_header_buffer_, &msg_header,
+                          max_header_version_)) {
           if (!wrong_header_) {
             LOG(ERROR) << "Wrong header detected";
             wrong_header_ = true;
@@ -74,7 +240,7 @@ void Connection::DoReadBody(std::shared_ptr<Message> msg) {
   std::lock_guard<std::mutex> socket_guard(socket_mutex_);
   boost::asio::async_read(
       socket_,
-      boost::asio::buffer(msg->body(), msg->body_length()),
+      boost::asio::buffer(msg->payload(), msg->payload_length()),
       [this, self, msg](boost::system::error_code ec,
                         size_t /* bytes_transferred */) {
         if (ec) {
@@ -82,13 +248,22 @@ void Connection::DoReadBody(std::shared_ptr<Message> msg) {
             handler_->HandleError(self, ec);
           }
         } else {
-          handler_->HandleMessage(self, std::move(msg));
+          Dispatch(std::move(msg));
           DoReadHeader();
         }
       });
 }
 
-void Connection::DoWrite() {
+void Connection::DoWrite(std::vector<std::shared_ptr<Message> >* dropped) {
+  auto now = Clock::now();
+  while (!write_queue_.empty() && write_queue_.front()->expired(now)) {
+    dropped->push_back(std::move(write_queue_.front()));
+    write_queue_.pop_front();
+  }
+  if (write_queue_.empty()) {
+    return;
+  }
+  write_queue_.front()->StampDeadline(now);
   auto self(shared_from_this());
   std::lock_guard<std::mutex> socket_guard(socket_mutex_);
   boost::asio::async_write(
@@ -96,17 +271,28 @@ void Connection::DoWrite() {
       boost::asio::buffer(write_queue_.front()->data(),
                           write_queue_.front()->length()),
       [this, self](boost::system::error_code ec, size_t) {
-        std::lock_guard<std::mutex> lock(write_queue_mutex_);
-        if (ec) {
-          if (ec != boost::asio::error::operation_aborted) {
-            handler_->HandleError(self, ec);
+        std::vector<std::shared_ptr<Message> > dropped;
+        {
+          std::lock_guard<std::mutex> lock(write_queue_mutex_);
+          if (ec) {
+            if (ec != boost::asio::error::operation_aborted) {
+              handler_->HandleError(self, ec);
+            }
+            return;
           }
-        } else {
           write_queue_.pop_front();
-          if (!write_queue_.empty()) {
-            DoWrite();
+          if (uring_ != nullptr) {
+            // Hands the rest of the queue over to the io_uring engine
+            uring_handoff_ = false;
+            if (!write_queue_.empty() &&
+                !uring_flush_pending_.exchange(true)) {
+              uring_->Flush(uring_slot_);
+            }
+          } else if (!write_queue_.empty()) {
+            DoWrite(&dropped);
           }
         }
+        ReportExpired(&dropped);
       });
 }
 
@@ -1,16 +1,19 @@
 #ifndef NEXUS_COMMON_CONNECTION_H_
 #define NEXUS_COMMON_CONNECTION_H_
 
+#include <atomic>
 #include <boost/asio.hpp>
 #include <deque>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "nexus/common/message.h"
 
 namespace nexus {
 
 class Connection; // forward declare
+class IoUringEngine;
 
 class MessageHandler {
  public:
@@ -28,6 +31,14 @@ class MessageHandler {
    */
   virtual void HandleError(std::shared_ptr<Connection> conn,
                            boost::system::error_code ec) = 0;
+  /*!
+   * \brief Handles an outbound message dropped because its deadline passed
+   * before it could be sent. Runs without any connection lock held.
+   * \param conn Connection that drops the message
+   * \param message Dropped message, decompressed if Write compressed it
+   */
+  virtual void HandleExpired(std::shared_ptr<Connection> conn,
+                             std::shared_ptr<Message> message) {}
 };
 
 class Connection : public std::enable_shared_from_this<Connection> {
@@ -43,19 +54,49 @@ class Connection : public std::enable_shared_from_this<Connection> {
   /*! \brief stops the socket */
   virtual void Stop();
   /*!
-   * \brief sends a message through socket
+   * \brief sends a message through socket. Messages with a deadline are
+   * queued in deadline order ahead of those without one, and dropped if the
+   * deadline passes before they are sent.
    * \param msg Shared pointer of message, yield the ownership to the function
    */
   virtual void Write(std::shared_ptr<Message> msg);
+  /*!
+   * \brief announces the codecs this end can decompress, so that the peer
+   * may compress large bodies sent to it. The connecting end of a link
+   * between a frontend and a backend sends it, and the accepting end
+   * answers. Sent at most once per connection.
+   */
+  void SendHello();
+  /*! \brief Number of messages queued ahead of earlier ones, process-wide */
+  static uint64_t num_reordered();
+  /*! \brief Number of messages dropped before sending, process-wide */
+  static uint64_t num_expired();
 
  protected:
   Connection(boost::asio::io_context& io_context, MessageHandler* handler);
+  /*!
+   * \brief starts reading messages from the connected socket, through the
+   * io_uring engine if --io_engine=io_uring
+   */
+  void StartReading();
   /*! \brief reads the header from the connection */
   void DoReadHeader();
   /*! \brief reads the body of message and invoke the handler */
   void DoReadBody(std::shared_ptr<Message> msg);
-  /*! \brief sends the message to the peer */
-  void DoWrite();
+  /*!
+   * \brief sends the message at the front of write_queue_ to the peer, after
+   * dropping expired ones into dropped. Requires write_queue_mutex_.
+   */
+  void DoWrite(std::vector<std::shared_ptr<Message> >* dropped);
+  /*!
+   * \brief handles link hellos and decompresses bodies of received messages
+   * before passing them to the handler
+   */
+  void Dispatch(std::shared_ptr<Message> msg);
+  /*! \brief compresses the body if the peer and the policy allow */
+  std::shared_ptr<Message> MaybeCompress(std::shared_ptr<Message> msg);
+  /*! \brief reports dropped messages to the handler, without locks held */
+  void ReportExpired(std::vector<std::shared_ptr<Message> >* dropped);
 
  protected:
   /*! \brief Socket */
@@ -72,6 +113,30 @@ class Connection : public std::enable_shared_from_this<Connection> {
   std::deque<std::shared_ptr<Message> > write_queue_;
   /*! \brief Mutex for write_queue_ */
   std::mutex write_queue_mutex_;
+  /*! \brief io_uring engine doing the socket IO, nullptr for asio */
+  IoUringEngine* uring_;
+  /*! \brief Slot of the connection in the io_uring engine */
+  uint32_t uring_slot_;
+  /*! \brief Whether a flush of write_queue_ is posted to the engine */
+  std::atomic<bool> uring_flush_pending_;
+  /*!
+   * \brief Whether an asio write started before switching to io_uring is in
+   * flight. Guarded by write_queue_mutex_
+   */
+  bool uring_handoff_;
+  /*! \brief Whether Stop is called */
+  std::atomic<bool> stopped_;
+  /*! \brief Bitmask of codecs the peer decompresses, from its hello */
+  std::atomic<uint32_t> peer_codecs_;
+  std::atomic<bool> hello_sent_;
+  CompressionPolicy compression_;
+  /*!
+   * \brief Latest header version accepted from the peer. User connections
+   * set it to 0, as user clients neither extend headers nor compress.
+   */
+  uint32_t max_header_version_;
+
+  friend class IoUringEngine;
 };
 
 } // namespace nexus
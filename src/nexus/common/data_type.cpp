@@ -224,4 +224,8 @@ const Value& Record::operator[](const std::string&& key) const {
   return values_.at(key);
 }
 
+bool Record::HasValue(const std::string& key) const {
+  return values_.count(key) > 0;
+}
+
 } // namespace nexus
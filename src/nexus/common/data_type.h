@@ -47,25 +47,29 @@ template<> struct TypeMap<DT_DOUBLE> {
   static constexpr size_t size = 8;
 };
 
+template <DataType DT>
+constexpr size_t type_size() { return TypeMap<DT>::size; }
+
+/*!
+ * \brief Gets the element size of a data type.
+ * \return Size in bytes, or 0 for types without fixed size.
+ */
 inline size_t type_size(DataType type) {
-  switch (type) {
-    case DT_INT8:
-      return TypeMap<DT_INT8>::size;
-    case DT_UINT8:
-      return TypeMap<DT_UINT8>::size;
-    case DT_INT32:
-      return TypeMap<DT_INT32>::size;
-    case DT_UINT32:
-      return TypeMap<DT_UINT32>::size;
-    case DT_FLOAT:
-      return TypeMap<DT_FLOAT>::size;
-    case DT_DOUBLE:
-      return TypeMap<DT_DOUBLE>::size;
-    case DT_BOOL:
-      return TypeMap<DT_BOOL>::size;
-    default:
-      return 0;
+  // Indexed by DataType value. Avoids the switch in the per-request paths
+  // that compute buffer sizes.
+  static constexpr size_t kTypeSizes[] = {
+    0,                       // DT_UNKNOWN
+    type_size<DT_BOOL>(),
+    type_size<DT_INT8>(),
+    type_size<DT_UINT8>(),
+    type_size<DT_INT32>(),
+    type_size<DT_UINT32>(),
+    type_size<DT_FLOAT>(),
+    type_size<DT_DOUBLE>(),
   };
+  size_t index = static_cast<size_t>(type);
+  return index < sizeof(kTypeSizes) / sizeof(kTypeSizes[0]) ?
+      kTypeSizes[index] : 0;
 }
 
 class Array {
@@ -165,6 +169,8 @@ class Record {
   void ToProto(RecordProto* proto) const;
 
   const Value& operator[](const std::string&& key) const;
+
+  bool HasValue(const std::string& key) const;
   
  private:
   std::unordered_map<std::string, Value> values_;
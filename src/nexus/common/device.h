@@ -10,6 +10,8 @@
 #include <cuda_runtime.h>
 #endif
 
+#include "nexus/common/alloc_tracker.h"
+
 namespace nexus {
 
 enum DeviceType {
@@ -45,13 +47,16 @@ class Device {
 
 class CPUDevice : public Device {
  public:
+  /*!
+   * \brief Allocates host memory accounted to the allocation tag of the
+   * calling thread (see AllocTagScope).
+   */
   void* Allocate(size_t nbytes) final {
-    void* buf = malloc(nbytes);
-    return buf;
+    return AllocTracker::Singleton().Allocate(CurrentAllocTag(), nbytes);
   }
 
   void Free(void* buf) final {
-    free(buf);
+    AllocTracker::Singleton().Free(buf);
   }
 
   std::string name() const final { return "cpu"; }
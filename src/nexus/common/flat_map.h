@@ -0,0 +1,326 @@
+#ifndef NEXUS_COMMON_FLAT_MAP_H_
+#define NEXUS_COMMON_FLAT_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace nexus {
+
+/*!
+ * \brief FlatMap is an open addressing hash map with Robin Hood linear probing
+ * that keeps all entries in one contiguous slot array.
+ *
+ * It is meant for the per-request bookkeeping tables keyed by query or task
+ * ID: insertion doesn't allocate a node, and erase uses backward shift so
+ * that no tombstones accumulate. Entries of a probe run are kept ordered by
+ * home slot, so lookups and erases stop as soon as they pass the home slot of
+ * the key. clear() keeps the slot array, so a pooled owner reuses the
+ * capacity across requests.
+ *
+ * The home slot is taken from the top bits of the hash multiplied by the
+ * golden ratio (Fibonacci hashing). With the identity std::hash of integers,
+ * sequential and strided IDs spread evenly while nearby IDs stay close.
+ *
+ * Unlike std::unordered_map, insert and erase invalidate all iterators,
+ * pointers and references to entries. K and V must be default constructible
+ * and move assignable.
+ */
+template <typename K, typename V, typename Hash = std::hash<K> >
+class FlatMap {
+ private:
+  struct Slot {
+    std::pair<K, V> kv;
+    /*! \brief Distance from home slot plus one, 0 if the slot is empty */
+    uint32_t dist = 0;
+  };
+
+  template <typename SlotT, typename ValueT>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<K, V>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = ValueT*;
+    using reference = ValueT&;
+
+    Iterator() : slot_(nullptr), end_(nullptr) {}
+
+    Iterator(SlotT* slot, SlotT* end) : slot_(slot), end_(end) {
+      SkipEmpty();
+    }
+    /*! \brief Allows conversion from iterator to const_iterator */
+    template <typename S, typename U>
+    Iterator(const Iterator<S, U>& other) :
+        slot_(other.slot_), end_(other.end_) {}
+
+    reference operator*() const { return slot_->kv; }
+
+    pointer operator->() const { return &slot_->kv; }
+
+    Iterator& operator++() {
+      ++slot_;
+      SkipEmpty();
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return slot_ == other.slot_;
+    }
+
+    bool operator!=(const Iterator& other) const {
+      return slot_ != other.slot_;
+    }
+
+   private:
+    friend class FlatMap;
+    template <typename S, typename U> friend class Iterator;
+
+    void SkipEmpty() {
+      while (slot_ != end_ && slot_->dist == 0) {
+        ++slot_;
+      }
+    }
+
+    SlotT* slot_;
+    SlotT* end_;
+  };
+
+ public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<K, V>;
+  using iterator = Iterator<Slot, value_type>;
+  using const_iterator = Iterator<const Slot, const value_type>;
+
+  /*!
+   * \brief Constructs an empty map.
+   * \param capacity Number of entries that can be held before rehashing
+   */
+  explicit FlatMap(size_t capacity = 8) : size_(0) {
+    Rehash(CapacityFor(capacity));
+  }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  iterator begin() { return iterator(slots_.data(), SlotsEnd()); }
+
+  iterator end() { return iterator(SlotsEnd(), SlotsEnd()); }
+
+  const_iterator begin() const {
+    return const_iterator(slots_.data(), SlotsEnd());
+  }
+
+  const_iterator end() const {
+    return const_iterator(SlotsEnd(), SlotsEnd());
+  }
+  /*! \brief Removes all entries and keeps the slot array. */
+  void clear() {
+    if (size_ == 0) {
+      return;
+    }
+    for (auto& slot : slots_) {
+      if (slot.dist > 0) {
+        slot.kv.second = V();
+        slot.dist = 0;
+      }
+    }
+    size_ = 0;
+  }
+  /*! \brief Grows the slot array to hold n entries without rehashing. */
+  void reserve(size_t n) {
+    size_t capacity = CapacityFor(n);
+    if (capacity > slots_.size()) {
+      Rehash(capacity);
+    }
+  }
+
+  iterator find(const K& key) {
+    size_t index;
+    if (!Lookup(key, &index)) {
+      return end();
+    }
+    return iterator(&slots_[index], SlotsEnd());
+  }
+
+  const_iterator find(const K& key) const {
+    size_t index;
+    if (!Lookup(key, &index)) {
+      return end();
+    }
+    return const_iterator(&slots_[index], SlotsEnd());
+  }
+
+  size_t count(const K& key) const {
+    size_t index;
+    return Lookup(key, &index) ? 1 : 0;
+  }
+
+  V& at(const K& key) {
+    size_t index;
+    if (!Lookup(key, &index)) {
+      throw std::out_of_range("FlatMap::at");
+    }
+    return slots_[index].kv.second;
+  }
+
+  const V& at(const K& key) const {
+    size_t index;
+    if (!Lookup(key, &index)) {
+      throw std::out_of_range("FlatMap::at");
+    }
+    return slots_[index].kv.second;
+  }
+
+  V& operator[](const K& key) {
+    return emplace(key, V()).first->second;
+  }
+  /*!
+   * \brief Inserts value at key if key is not in the map.
+   * \return Iterator to the entry of key, and whether insertion took place
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(const K& key, Args&&... args) {
+    size_t index;
+    if (Lookup(key, &index)) {
+      return {iterator(&slots_[index], SlotsEnd()), false};
+    }
+    if ((size_ + 1) * kMaxLoadDen > slots_.size() * kMaxLoadNum) {
+      Rehash(slots_.size() * 2);
+    }
+    index = Insert(value_type(key, V(std::forward<Args>(args)...)));
+    ++size_;
+    return {iterator(&slots_[index], SlotsEnd()), true};
+  }
+  /*! \brief Removes the entry of key, returns number of entries removed. */
+  size_t erase(const K& key) {
+    size_t index;
+    if (!Lookup(key, &index)) {
+      return 0;
+    }
+    EraseSlot(index);
+    return 1;
+  }
+  /*! \brief Removes the entry at pos, which must be valid. */
+  void erase(const_iterator pos) {
+    EraseSlot(pos.slot_ - slots_.data());
+  }
+
+ private:
+  static constexpr size_t kMaxLoadNum = 3;
+  static constexpr size_t kMaxLoadDen = 4;
+
+  /*! \brief Smallest power of two slot count that holds n entries */
+  static size_t CapacityFor(size_t n) {
+    size_t capacity = 8;
+    while (n * kMaxLoadDen > capacity * kMaxLoadNum) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+
+  Slot* SlotsEnd() { return slots_.data() + slots_.size(); }
+
+  const Slot* SlotsEnd() const { return slots_.data() + slots_.size(); }
+
+  size_t HomeSlot(const K& key) const {
+    return static_cast<size_t>(
+        (static_cast<uint64_t>(hash_(key)) * 0x9e3779b97f4a7c15ULL) >> shift_);
+  }
+  /*! \brief Probes for key, returns true and its slot if found. */
+  bool Lookup(const K& key, size_t* index) const {
+    size_t i = HomeSlot(key);
+    // An entry closer to its home than key would be is never passed by the
+    // probe run of key.
+    for (uint32_t dist = 1; slots_[i].dist >= dist; ++dist) {
+      if (slots_[i].kv.first == key) {
+        *index = i;
+        return true;
+      }
+      i = (i + 1) & mask_;
+    }
+    return false;
+  }
+  /*!
+   * \brief Inserts kv, whose key must not be in the map, and returns its slot.
+   * Entries that are closer to their home slot are displaced further.
+   */
+  size_t Insert(value_type&& kv) {
+    size_t i = HomeSlot(kv.first);
+    uint32_t dist = 1;
+    size_t index = slots_.size();
+    while (slots_[i].dist > 0) {
+      if (slots_[i].dist < dist) {
+        std::swap(slots_[i].kv, kv);
+        std::swap(slots_[i].dist, dist);
+        if (index == slots_.size()) {
+          index = i;
+        }
+      }
+      i = (i + 1) & mask_;
+      ++dist;
+    }
+    slots_[i].kv = std::move(kv);
+    slots_[i].dist = dist;
+    return index == slots_.size() ? i : index;
+  }
+
+  void EraseSlot(size_t hole) {
+    // Backward shift: pull the rest of the probe run one slot closer to home,
+    // up to an empty slot or an entry already at its home slot.
+    size_t i = (hole + 1) & mask_;
+    while (slots_[i].dist > 1) {
+      slots_[hole].kv = std::move(slots_[i].kv);
+      slots_[hole].dist = slots_[i].dist - 1;
+      hole = i;
+      i = (i + 1) & mask_;
+    }
+    slots_[hole].kv.second = V();
+    slots_[hole].dist = 0;
+    --size_;
+  }
+
+  void Rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+    mask_ = capacity - 1;
+    shift_ = 64;
+    for (size_t c = capacity; c > 1; c >>= 1) {
+      --shift_;
+    }
+    for (auto& slot : old_slots) {
+      if (slot.dist > 0) {
+        Insert(std::move(slot.kv));
+      }
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t mask_;
+  /*! \brief 64 - log2(number of slots) */
+  int shift_;
+  size_t size_;
+  Hash hash_;
+};
+
+template <typename K, typename V, typename Hash>
+constexpr size_t FlatMap<K, V, Hash>::kMaxLoadNum;
+
+template <typename K, typename V, typename Hash>
+constexpr size_t FlatMap<K, V, Hash>::kMaxLoadDen;
+
+} // namespace nexus
+
+#endif // NEXUS_COMMON_FLAT_MAP_H_
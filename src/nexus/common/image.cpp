@@ -4,15 +4,32 @@
 #include <glog/logging.h>
 #include <opencv2/opencv.hpp>
 
+#include <algorithm>
+#include <csetjmp>
+#include <cstring>
 #include <fstream>
 #include <iterator>
 #include <string>
 #include <unordered_map>
 #include <vector>
+#ifdef USE_LIBJPEG_TURBO
+#include <cstdio>
+#include <jpeglib.h>
+#endif
 
+#include "nexus/common/async_log.h"
 #include "nexus/common/image.h"
+#include "nexus/common/image_pack.h"
 
 DEFINE_string(hack_image_root, "", "HACK: path to directory of images");
+DEFINE_string(hack_image_pack, "", "HACK: image pack built by "
+              "build_image_pack, used instead of hack_image_root");
+DEFINE_bool(reduced_decode, true, "Decode JPEG images at 1/2, 1/4 or 1/8 "
+            "resolution when the regions used stay at least the model input "
+            "size");
+DEFINE_double(roi_decode_max_fraction, 0.5, "Decode only the bounding box "
+              "of the regions of a JPEG image when it covers at most this "
+              "fraction of the frame. Needs USE_LIBJPEG_TURBO");
 
 class _Hack_Images {
 public:
@@ -59,13 +76,257 @@ private:
 
 namespace nexus {
 
-cv::Mat DecodeImageImpl(const std::vector<char> &vec_data, bool color,
-                        ChannelOrder order) {
+namespace {
+
+/*! \brief Reads the frame size from the SOF segment of a JPEG image. */
+bool JpegSize(const char *data, size_t size, cv::Size *full_size) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+    return false;
+  }
+  size_t pos = 2;
+  while (pos + 4 <= size) {
+    if (p[pos] != 0xFF) {
+      return false;
+    }
+    unsigned char marker = p[pos + 1];
+    if (marker == 0xFF) {
+      // Fill byte
+      ++pos;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      // Markers without a segment
+      pos += 2;
+      continue;
+    }
+    if (marker == 0xD9 || marker == 0xDA) {
+      // End of image or start of scan before any frame header
+      return false;
+    }
+    // SOF0 to SOF15, except DHT, JPG and DAC
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (pos + 9 > size) {
+        return false;
+      }
+      full_size->height = (p[pos + 5] << 8) | p[pos + 6];
+      full_size->width = (p[pos + 7] << 8) | p[pos + 8];
+      return full_size->height > 0 && full_size->width > 0;
+    }
+    pos += 2 + ((p[pos + 2] << 8) | p[pos + 3]);
+  }
+  return false;
+}
+
+int ReducedReadFlag(bool color, int scale_denom) {
+  switch (scale_denom) {
+    case 2:
+      return color ? cv::IMREAD_REDUCED_COLOR_2 :
+                     cv::IMREAD_REDUCED_GRAYSCALE_2;
+    case 4:
+      return color ? cv::IMREAD_REDUCED_COLOR_4 :
+                     cv::IMREAD_REDUCED_GRAYSCALE_4;
+    case 8:
+      return color ? cv::IMREAD_REDUCED_COLOR_8 :
+                     cv::IMREAD_REDUCED_GRAYSCALE_8;
+    default:
+      return color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
+  }
+}
+
+#ifdef USE_LIBJPEG_TURBO
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf jmp;
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  longjmp(reinterpret_cast<JpegErrorManager *>(cinfo->err)->jmp, 1);
+}
+
+void JpegOutputMessage(j_common_ptr cinfo) {}
+
+/*! \brief Whether the EXIF orientation in an APP1 segment is not upright. */
+bool ExifRotated(jpeg_saved_marker_ptr marker) {
+  for (; marker != nullptr; marker = marker->next) {
+    const unsigned char *p = marker->data;
+    size_t len = marker->data_length;
+    if (marker->marker != JPEG_APP0 + 1 || len < 14 ||
+        memcmp(p, "Exif\0\0", 6) != 0) {
+      continue;
+    }
+    // TIFF header follows the EXIF header
+    p += 6;
+    len -= 6;
+    bool le = p[0] == 'I';
+    auto u16 = [p, le](size_t off) {
+      return le ? p[off] | (p[off + 1] << 8) : (p[off] << 8) | p[off + 1];
+    };
+    auto u32 = [&u16, le](size_t off) {
+      return le ? u16(off) | (size_t(u16(off + 2)) << 16) :
+                  (size_t(u16(off)) << 16) | u16(off + 2);
+    };
+    size_t ifd = u32(4);
+    if (ifd + 2 > len) {
+      return false;
+    }
+    size_t num_entries = u16(ifd);
+    for (size_t i = 0; i < num_entries; ++i) {
+      size_t entry = ifd + 2 + i * 12;
+      if (entry + 12 > len) {
+        break;
+      }
+      if (u16(entry) == 0x0112) {
+        return u16(entry + 8) != 1;
+      }
+    }
+  }
+  return false;
+}
+
+/*!
+ * \brief Decodes only the rows and the iMCU columns of a JPEG image that
+ * cover roi, with libjpeg-turbo. out has the size of the whole image at
+ * 1/scale_denom resolution, and pixels outside roi are left undefined.
+ * \return false if the image needs the general decoder
+ */
+bool DecodeJpegRegion(const char *data, size_t size, bool color,
+                      ChannelOrder order, int scale_denom, cv::Rect roi,
+                      cv::Mat *out) {
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager jerr;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = JpegErrorExit;
+  jerr.pub.output_message = JpegOutputMessage;
+  if (setjmp(jerr.jmp)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, reinterpret_cast<const unsigned char *>(data), size);
+  jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF);
+  jpeg_read_header(&cinfo, TRUE);
+  // Leave rotated and CMYK images to OpenCV, which handles both
+  if (ExifRotated(cinfo.marker_list) ||
+      (cinfo.jpeg_color_space != JCS_YCbCr &&
+       cinfo.jpeg_color_space != JCS_GRAYSCALE &&
+       cinfo.jpeg_color_space != JCS_RGB)) {
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = scale_denom;
+  if (!color) {
+    cinfo.out_color_space = JCS_GRAYSCALE;
+  } else {
+    cinfo.out_color_space = order == CO_BGR ? JCS_EXT_BGR : JCS_EXT_RGB;
+  }
+  jpeg_start_decompress(&cinfo);
+  int height = cinfo.output_height;
+  int width = cinfo.output_width;
+  int channels = cinfo.output_components;
+  JDIMENSION left = std::min(roi.x / scale_denom, width - 1);
+  JDIMENSION right = std::min(
+      (roi.x + roi.width + scale_denom - 1) / scale_denom, width);
+  JDIMENSION top = std::min(roi.y / scale_denom, height);
+  JDIMENSION bottom = std::min(
+      (roi.y + roi.height + scale_denom - 1) / scale_denom, height);
+  JDIMENSION crop_width = std::max(right, left + 1) - left;
+  // Widens the columns to iMCU boundaries
+  jpeg_crop_scanline(&cinfo, &left, &crop_width);
+  out->create(height, width, channels == 3 ? CV_8UC3 : CV_8UC1);
+  jpeg_skip_scanlines(&cinfo, top);
+  while (cinfo.output_scanline < bottom) {
+    JSAMPROW row = out->ptr<uchar>(cinfo.output_scanline) + left * channels;
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  // The rows below the region are never decoded
+  jpeg_abort_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+#endif
+
+} // namespace
+
+int JpegScaleDenom(cv::Size full_size, const DecodeTarget &target) {
+  if (target.size.width <= 0 || target.size.height <= 0) {
+    return 1;
+  }
+  std::vector<cv::Rect> regions = target.regions;
+  if (regions.empty()) {
+    regions.emplace_back(0, 0, full_size.width, full_size.height);
+  }
+  for (int denom = 8; denom > 1; denom /= 2) {
+    bool fits = true;
+    for (const auto &rect : regions) {
+      if (rect.width / denom < target.size.width ||
+          rect.height / denom < target.size.height) {
+        fits = false;
+        break;
+      }
+    }
+    if (fits) {
+      return denom;
+    }
+  }
+  return 1;
+}
+
+cv::Mat DecodeImageImpl(const char *data, size_t size, bool color,
+                        ChannelOrder order,
+                        const DecodeTarget *target = nullptr,
+                        int *scale_denom = nullptr,
+                        cv::Size *full_size = nullptr) {
   cv::Mat img_bgr;
-  int cv_read_flag = color ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
-  img_bgr = cv::imdecode(vec_data, cv_read_flag);
+  cv::Size jpeg_size;
+  int denom = 1;
+  if (target != nullptr && JpegSize(data, size, &jpeg_size) &&
+      FLAGS_reduced_decode) {
+    denom = JpegScaleDenom(jpeg_size, *target);
+  }
+#ifdef USE_LIBJPEG_TURBO
+  if (target != nullptr && !target->regions.empty() && jpeg_size.area() > 0) {
+    cv::Rect roi = target->regions[0];
+    for (const auto &rect : target->regions) {
+      roi |= rect;
+    }
+    roi &= cv::Rect(0, 0, jpeg_size.width, jpeg_size.height);
+    cv::Mat img;
+    if (roi.area() > 0 &&
+        roi.area() <= FLAGS_roi_decode_max_fraction * jpeg_size.area() &&
+        DecodeJpegRegion(data, size, color, order, denom, roi, &img)) {
+      if (scale_denom != nullptr) {
+        *scale_denom = denom;
+      }
+      if (full_size != nullptr) {
+        *full_size = jpeg_size;
+      }
+      return img;
+    }
+  }
+#endif
+  int cv_read_flag = ReducedReadFlag(color, denom);
+  // Wraps the encoded bytes without copying them
+  cv::Mat buf(1, size, CV_8UC1, const_cast<char *>(data));
+  img_bgr = cv::imdecode(buf, cv_read_flag);
   if (!img_bgr.data) {
-    LOG(ERROR) << "Could not decode image";
+    LOG_EVERY_MS(ERROR, 1000) << "Could not decode image";
+  }
+  if (scale_denom != nullptr) {
+    *scale_denom = denom;
+  }
+  if (full_size != nullptr) {
+    if (denom == 1) {
+      *full_size = img_bgr.size();
+    } else if (img_bgr.cols == (jpeg_size.height + denom - 1) / denom &&
+               img_bgr.rows == (jpeg_size.width + denom - 1) / denom) {
+      // Rotated by the EXIF orientation
+      *full_size = cv::Size(jpeg_size.height, jpeg_size.width);
+    } else {
+      *full_size = jpeg_size;
+    }
   }
   if (order == CO_BGR) {
     return img_bgr;
@@ -76,25 +337,81 @@ cv::Mat DecodeImageImpl(const std::vector<char> &vec_data, bool color,
 }
 
 cv::Mat _Hack_DecodeImageByFilename(const ImageProto &image,
-                                    ChannelOrder order) {
+                                    ChannelOrder order,
+                                    const DecodeTarget *target,
+                                    int *scale_denom, cv::Size *full_size) {
+  if (!FLAGS_hack_image_pack.empty()) {
+    static ImagePack *_pack = new ImagePack(FLAGS_hack_image_pack);
+    const char *data;
+    size_t size;
+    if (!_pack->Get(image.hack_filename(), &data, &size)) {
+      if (image.hack_filename() != "__init_Hack_Images")
+        LOG_EVERY_MS(ERROR, 1000) << "Cannot find image by filename: "
+                                  << image.hack_filename();
+      return {};
+    }
+    return DecodeImageImpl(data, size, image.color(), order, target,
+                           scale_denom, full_size);
+  }
   static _Hack_Images *_images = new _Hack_Images(FLAGS_hack_image_root);
   const auto &vec_data = _images->get(image.hack_filename());
   if (vec_data.empty()) {
     if (image.hack_filename() != "__init_Hack_Images")
-      LOG(ERROR) << "Cannot find image by filename: " << image.hack_filename();
+      LOG_EVERY_MS(ERROR, 1000) << "Cannot find image by filename: "
+                                << image.hack_filename();
+    return {};
+  }
+  return DecodeImageImpl(vec_data.data(), vec_data.size(), image.color(),
+                         order, target, scale_denom, full_size);
+}
+
+cv::Mat DecodeRawImage(const ImageProto &image, ChannelOrder order) {
+  const std::string &data = image.data();
+  if (data.size() != size_t(image.height()) * image.width() * 3) {
+    LOG_EVERY_MS(ERROR, 1000) << "Raw image size mismatch: " <<
+        data.size() << " bytes for " << image.height() << "x" <<
+        image.width();
     return {};
   }
-  return DecodeImageImpl(vec_data, image.color(), order);
+  cv::Mat img_bgr(image.height(), image.width(), CV_8UC3,
+                  const_cast<char *>(data.data()));
+  if (order == CO_BGR) {
+    return img_bgr.clone();
+  }
+  cv::Mat img_rgb;
+  cv::cvtColor(img_bgr, img_rgb, cv::COLOR_BGR2RGB);
+  return img_rgb;
 }
 
 cv::Mat DecodeImage(const ImageProto &image, ChannelOrder order) {
+  if (image.format() == ImageProto::RAW) {
+    return DecodeRawImage(image, order);
+  }
   if (image.hack_filename().empty()) {
     const std::string &data = image.data();
-    std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-    return DecodeImageImpl(vec_data, image.color(), order);
+    return DecodeImageImpl(data.data(), data.size(), image.color(), order);
   } else {
     return _Hack_DecodeImageByFilename(image, order);
   }
 }
 
+cv::Mat DecodeImage(const ImageProto &image, ChannelOrder order,
+                    const DecodeTarget &target, int *scale_denom,
+                    cv::Size *full_size) {
+  if (image.format() == ImageProto::RAW) {
+    cv::Mat img = DecodeRawImage(image, order);
+    *scale_denom = 1;
+    *full_size = img.size();
+    return img;
+  }
+  if (image.hack_filename().empty()) {
+    const std::string &data = image.data();
+    return DecodeImageImpl(data.data(), data.size(), image.color(), order,
+                           &target, scale_denom, full_size);
+  } else {
+    return _Hack_DecodeImageByFilename(image, order, &target, scale_denom,
+                                       full_size);
+  }
+}
+
 } // namespace nexus
@@ -2,6 +2,7 @@
 #define NEXUS_COMMON_IMAGE_H_
 
 #include <opencv2/core/core.hpp>
+#include <vector>
 
 #include "nexus/proto/nnquery.pb.h"
 
@@ -12,10 +13,43 @@ enum ChannelOrder {
   CO_BGR = 1,
 };
 
+/*!
+ * \brief How the caller uses a decoded image: every region is cropped and
+ * resized to the target size. JPEG images are then decoded at a reduced
+ * resolution as long as every region stays at least the target size.
+ */
+struct DecodeTarget {
+  /*! \brief Size each region is resized to */
+  cv::Size size;
+  /*! \brief Regions in full resolution pixels, the whole image if empty */
+  std::vector<cv::Rect> regions;
+};
+
+/*!
+ * \brief Picks the largest libjpeg scaling denominator, 1, 2, 4 or 8, that
+ * keeps every region of the target at least the target size.
+ * \param full_size Size of the image at full resolution
+ * \param target How the decoded image is used
+ */
+int JpegScaleDenom(cv::Size full_size, const DecodeTarget &target);
+
 cv::Mat _Hack_DecodeImageByFilename(const ImageProto &image,
-                                    ChannelOrder order);
+                                    ChannelOrder order,
+                                    const DecodeTarget *target = nullptr,
+                                    int *scale_denom = nullptr,
+                                    cv::Size *full_size = nullptr);
 
 cv::Mat DecodeImage(const ImageProto &image, ChannelOrder order);
+/*!
+ * \brief Decodes the image at the lowest resolution the target allows.
+ * \param target How the decoded image is used
+ * \param scale_denom Set to the factor the image is scaled down by; regions
+ * are divided by it to index the decoded image
+ * \param full_size Set to the size of the image at full resolution
+ */
+cv::Mat DecodeImage(const ImageProto &image, ChannelOrder order,
+                    const DecodeTarget &target, int *scale_denom,
+                    cv::Size *full_size);
 
 } // namespace nexus
 
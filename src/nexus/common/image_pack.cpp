@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <glog/logging.h>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "nexus/common/image_pack.h"
+
+namespace nexus {
+
+namespace {
+
+const char kImagePackMagic[8] = {'N', 'X', 'I', 'M', 'G', 'P', 'K', '1'};
+
+void WriteAt(int fd, const void* buf, size_t size, uint64_t offset) {
+  const char* ptr = static_cast<const char*>(buf);
+  while (size > 0) {
+    ssize_t n = pwrite(fd, ptr, size, offset);
+    PCHECK(n > 0) << "Failed to write image pack";
+    ptr += n;
+    size -= n;
+    offset += n;
+  }
+}
+
+} // namespace
+
+ImagePack::ImagePack(const std::string& path) :
+    path_(path),
+    fd_(-1),
+    base_(nullptr),
+    file_size_(0),
+    num_images_(0),
+    index_(nullptr),
+    names_(nullptr) {
+  fd_ = open(path.c_str(), O_RDONLY);
+  PCHECK(fd_ >= 0) << "Cannot open image pack " << path;
+  struct stat st;
+  PCHECK(fstat(fd_, &st) == 0) << "Cannot stat image pack " << path;
+  file_size_ = st.st_size;
+  CHECK_GE(file_size_, sizeof(ImagePackHeader)) << "Image pack " << path <<
+      " is truncated";
+  void* addr = mmap(nullptr, file_size_, PROT_READ, MAP_SHARED, fd_, 0);
+  PCHECK(addr != MAP_FAILED) << "Cannot mmap image pack " << path;
+  base_ = static_cast<const char*>(addr);
+  // Replay picks images at random, readahead only wastes page cache
+  madvise(addr, file_size_, MADV_RANDOM);
+
+  const auto* header = reinterpret_cast<const ImagePackHeader*>(base_);
+  CHECK(memcmp(header->magic, kImagePackMagic, sizeof(kImagePackMagic)) == 0)
+      << path << " is not an image pack";
+  num_images_ = header->num_images;
+  // Offsets come from the file, so bounds are compared without sums that
+  // could overflow
+  CHECK_LE(header->names_offset, file_size_) << "Image pack " << path <<
+      " is truncated";
+  CHECK(header->index_offset <= header->names_offset &&
+        num_images_ <= (header->names_offset - header->index_offset) /
+        sizeof(ImagePackEntry)) << "Image pack " << path << " is corrupted";
+  index_ = reinterpret_cast<const ImagePackEntry*>(
+      base_ + header->index_offset);
+  names_ = base_ + header->names_offset;
+  // Lookups compare names while searching, so all of them must be in bounds
+  uint64_t names_size = file_size_ - header->names_offset;
+  for (uint64_t i = 0; i < num_images_; ++i) {
+    const ImagePackEntry& entry = index_[i];
+    CHECK(entry.name_offset <= names_size &&
+          entry.name_size <= names_size - entry.name_offset) <<
+        "Name of image " << i << " is out of the bounds of " << path;
+  }
+  LOG(INFO) << "Mapped " << num_images_ << " images from " << path;
+}
+
+ImagePack::~ImagePack() {
+  if (base_ != nullptr) {
+    munmap(const_cast<char*>(base_), file_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool ImagePack::Get(const std::string& name, const char** data,
+                    size_t* size) const {
+  auto compare = [this](const ImagePackEntry& entry, const std::string& key) {
+    size_t len = std::min<size_t>(entry.name_size, key.size());
+    int ret = memcmp(Name(entry), key.data(), len);
+    return ret < 0 || (ret == 0 && entry.name_size < key.size());
+  };
+  const ImagePackEntry* end = index_ + num_images_;
+  const ImagePackEntry* entry = std::lower_bound(index_, end, name, compare);
+  if (entry == end || entry->name_size != name.size() ||
+      memcmp(Name(*entry), name.data(), name.size()) != 0) {
+    return false;
+  }
+  if (entry->data_offset > file_size_ ||
+      entry->data_size > file_size_ - entry->data_offset) {
+    LOG(ERROR) << "Image " << name << " is out of the bounds of " << path_;
+    return false;
+  }
+  *data = base_ + entry->data_offset;
+  *size = entry->data_size;
+  return true;
+}
+
+size_t ImagePack::Build(const std::string& root, const std::string& output,
+                        int num_threads) {
+  namespace fs = boost::filesystem;
+  struct ImageFile {
+    std::string name;
+    std::string path;
+    uint64_t size;
+  };
+  auto root_path = fs::absolute(root);
+  std::vector<ImageFile> files;
+  for (auto it = fs::recursive_directory_iterator(root_path),
+            end = fs::recursive_directory_iterator(); it != end; ++it) {
+    if (!fs::is_regular_file(it->path()) ||
+        it->path().extension().string() != ".jpg") {
+      continue;
+    }
+    files.push_back({fs::relative(it->path(), root_path).string(),
+                     it->path().string(), fs::file_size(it->path())});
+  }
+  std::sort(files.begin(), files.end(),
+            [](const ImageFile& a, const ImageFile& b) {
+              return a.name < b.name;
+            });
+
+  ImagePackHeader header;
+  memcpy(header.magic, kImagePackMagic, sizeof(kImagePackMagic));
+  header.num_images = files.size();
+  std::vector<ImagePackEntry> index(files.size());
+  std::string names;
+  uint64_t offset = sizeof(ImagePackHeader);
+  for (size_t i = 0; i < files.size(); ++i) {
+    auto& entry = index[i];
+    entry.name_offset = names.size();
+    entry.name_size = files[i].name.size();
+    entry.reserved = 0;
+    entry.data_offset = offset;
+    entry.data_size = files[i].size;
+    names.append(files[i].name);
+    offset += files[i].size;
+  }
+  header.index_offset = offset;
+  header.names_offset = offset + index.size() * sizeof(ImagePackEntry);
+
+  int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  PCHECK(fd >= 0) << "Cannot create image pack " << output;
+  // Images have known offsets, so threads copy them without coordination
+  std::vector<std::thread> threads;
+  for (int t = 0; t < std::max(num_threads, 1); ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = t; i < files.size(); i += std::max(num_threads, 1)) {
+        std::ifstream fin(files[i].path, std::ios::binary);
+        CHECK(fin.good()) << "Cannot read " << files[i].path;
+        std::vector<char> data((std::istreambuf_iterator<char>(fin)),
+                               std::istreambuf_iterator<char>());
+        CHECK_EQ(data.size(), files[i].size) << files[i].path <<
+            " changed while building the image pack";
+        WriteAt(fd, data.data(), data.size(), index[i].data_offset);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  WriteAt(fd, index.data(), index.size() * sizeof(ImagePackEntry),
+          header.index_offset);
+  WriteAt(fd, names.data(), names.size(), header.names_offset);
+  // Header goes last so that a partially written pack is rejected
+  WriteAt(fd, &header, sizeof(header), 0);
+  PCHECK(close(fd) == 0) << "Failed to close image pack " << output;
+  return files.size();
+}
+
+} // namespace nexus
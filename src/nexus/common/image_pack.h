@@ -0,0 +1,94 @@
+#ifndef NEXUS_COMMON_IMAGE_PACK_H_
+#define NEXUS_COMMON_IMAGE_PACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nexus {
+
+/*!
+ * \brief Header at the beginning of an image pack file.
+ *
+ * An image pack stores the images back to back after the header, followed by
+ * an index of ImagePackEntry sorted by image name and a table of the names.
+ * All integers are in host byte order.
+ */
+struct ImagePackHeader {
+  char magic[8];
+  uint64_t num_images;
+  /*! \brief File offset of the ImagePackEntry array */
+  uint64_t index_offset;
+  /*! \brief File offset of the name table */
+  uint64_t names_offset;
+};
+
+struct ImagePackEntry {
+  /*! \brief Offset of the name in the name table */
+  uint64_t name_offset;
+  uint32_t name_size;
+  uint32_t reserved;
+  /*! \brief File offset of the image data */
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+
+/*!
+ * \brief ImagePack is a read-only, memory mapped archive of encoded images
+ * for benchmark replay.
+ *
+ * The file is mapped shared, so processes on the same host share one copy
+ * in the page cache. The index is sorted when the pack is built and searched
+ * in place, so opening a pack costs the same regardless of its size. Image
+ * data returned points into the mapping and is valid until the pack is
+ * destroyed.
+ */
+class ImagePack {
+ public:
+  /*!
+   * \brief Maps an image pack file.
+   * \param path Path to the image pack
+   */
+  explicit ImagePack(const std::string& path);
+
+  ~ImagePack();
+
+  ImagePack(const ImagePack&) = delete;
+  ImagePack& operator=(const ImagePack&) = delete;
+
+  size_t size() const { return num_images_; }
+  /*!
+   * \brief Looks up an image by name.
+   * \param name Image path relative to the root the pack was built from
+   * \param data Output pointer to the encoded image
+   * \param size Output size of the encoded image
+   * \return false if the image is not in the pack
+   */
+  bool Get(const std::string& name, const char** data, size_t* size) const;
+  /*!
+   * \brief Builds an image pack from all .jpg files under a directory.
+   * \param root Directory to search recursively
+   * \param output Path of the image pack to write
+   * \param num_threads Number of threads copying images into the pack
+   * \return Number of images in the pack
+   */
+  static size_t Build(const std::string& root, const std::string& output,
+                      int num_threads);
+
+ private:
+  const char* Name(const ImagePackEntry& entry) const {
+    return names_ + entry.name_offset;
+  }
+
+  std::string path_;
+  int fd_;
+  const char* base_;
+  size_t file_size_;
+  size_t num_images_;
+  const ImagePackEntry* index_;
+  const char* names_;
+};
+
+} // namespace nexus
+
+#endif // NEXUS_COMMON_IMAGE_PACK_H_
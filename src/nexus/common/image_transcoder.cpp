@@ -0,0 +1,95 @@
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "nexus/common/image.h"
+#include "nexus/common/image_transcoder.h"
+
+namespace nexus {
+
+ImageTranscoder::ImageTranscoder(const ImageProto& image, int jpeg_quality) :
+    image_(image),
+    jpeg_quality_(jpeg_quality),
+    decoded_(false) {
+}
+
+bool ImageTranscoder::Transcode(int height, int width,
+                                ImageProto::ImageFormat format,
+                                std::vector<RectProto>* windows,
+                                ValueProto* value) {
+  CHECK(format == ImageProto::JPEG || format == ImageProto::RAW) <<
+      "Cannot transcode to " << ImageProto::ImageFormat_Name(format);
+  if (height <= 0 || width <= 0) {
+    return false;
+  }
+  cv::Mat out;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!DecodeLocked()) {
+      return false;
+    }
+    if (windows->empty()) {
+      if (img_.rows <= height && img_.cols <= width) {
+        // Already small enough
+        return false;
+      }
+      cv::resize(img_, out, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    } else {
+      out.create(height * windows->size(), width, CV_8UC3);
+      cv::Rect bounds(0, 0, img_.cols, img_.rows);
+      for (size_t i = 0; i < windows->size(); ++i) {
+        const auto& rect = (*windows)[i];
+        cv::Rect crop = cv::Rect(rect.left(), rect.top(),
+                                 rect.right() - rect.left(),
+                                 rect.bottom() - rect.top()) & bounds;
+        if (crop.area() == 0) {
+          return false;
+        }
+        cv::Mat tile = out(cv::Rect(0, height * i, width, height));
+        cv::resize(img_(crop), tile, cv::Size(width, height), 0, 0,
+                   cv::INTER_AREA);
+      }
+    }
+  }
+  value->set_data_type(DT_IMAGE);
+  auto image = value->mutable_image();
+  Encode(out, format, image);
+  if (windows->empty()) {
+    image->set_orig_height(img_.rows);
+    image->set_orig_width(img_.cols);
+  } else {
+    for (size_t i = 0; i < windows->size(); ++i) {
+      auto& rect = (*windows)[i];
+      rect.set_left(0);
+      rect.set_top(height * i);
+      rect.set_right(width);
+      rect.set_bottom(height * (i + 1));
+    }
+  }
+  return true;
+}
+
+bool ImageTranscoder::DecodeLocked() {
+  if (!decoded_) {
+    img_ = DecodeImage(image_, CO_BGR);
+    decoded_ = true;
+  }
+  return img_.data != nullptr && img_.type() == CV_8UC3;
+}
+
+void ImageTranscoder::Encode(const cv::Mat& img,
+                             ImageProto::ImageFormat format,
+                             ImageProto* image) const {
+  image->set_format(format);
+  image->set_color(true);
+  if (format == ImageProto::RAW) {
+    image->set_height(img.rows);
+    image->set_width(img.cols);
+    image->set_data(img.data, img.total() * img.elemSize());
+  } else {
+    std::vector<uchar> buf;
+    cv::imencode(".jpg", img, buf, {cv::IMWRITE_JPEG_QUALITY, jpeg_quality_});
+    image->set_data(buf.data(), buf.size());
+  }
+}
+
+} // namespace nexus
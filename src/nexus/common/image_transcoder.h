@@ -0,0 +1,62 @@
+#ifndef NEXUS_COMMON_IMAGE_TRANSCODER_H_
+#define NEXUS_COMMON_IMAGE_TRANSCODER_H_
+
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+#include "nexus/proto/nnquery.pb.h"
+
+namespace nexus {
+
+/*!
+ * \brief ImageTranscoder decodes the image of a request once at the frontend
+ * and re-encodes it for each model at the model input size, so that backends
+ * receive and decode much smaller images.
+ */
+class ImageTranscoder {
+ public:
+  /*!
+   * \brief Constructor of ImageTranscoder
+   * \param image Image to transcode, must outlive the transcoder
+   * \param jpeg_quality JPEG quality of the transcoded images
+   */
+  ImageTranscoder(const ImageProto& image, int jpeg_quality);
+  /*!
+   * \brief Resizes the image, or each window in it, to height x width.
+   *
+   * Windows are tiled vertically into one image and replaced by the tiles,
+   * so the backend still gets one query with one input per window. Without
+   * windows, the original size is kept in orig_height and orig_width so that
+   * rects in the output refer to the original image.
+   *
+   * This function is thread-safe.
+   *
+   * \param height Model input height
+   * \param width Model input width
+   * \param format Format of the transcoded image, JPEG or RAW
+   * \param windows Windows in the original image, replaced by the tiles
+   * \param value Output transcoded image
+   * \return false if the original image should be sent instead
+   */
+  bool Transcode(int height, int width, ImageProto::ImageFormat format,
+                 std::vector<RectProto>* windows, ValueProto* value);
+
+ private:
+  /*! \brief Decodes the image on the first call. Requires mu_. */
+  bool DecodeLocked();
+
+  void Encode(const cv::Mat& img, ImageProto::ImageFormat format,
+              ImageProto* image) const;
+
+  const ImageProto& image_;
+  int jpeg_quality_;
+  std::mutex mu_;
+  bool decoded_;
+  /*! \brief Decoded image in BGR */
+  cv::Mat img_;
+};
+
+} // namespace nexus
+
+#endif // NEXUS_COMMON_IMAGE_TRANSCODER_H_
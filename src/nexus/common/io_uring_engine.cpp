@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "nexus/common/io_uring_engine.h"
+
+DEFINE_string(io_engine, "asio", "Socket IO engine of connections, asio or "
+              "io_uring");
+DEFINE_int32(io_uring_threads, 1, "Number of io_uring engine threads");
+DEFINE_int32(io_uring_entries, 4096, "Submission queue size of each ring");
+DEFINE_int32(io_uring_buffers, 256, "Number of provided receive buffers of "
+             "each ring, a power of 2");
+DEFINE_int32(io_uring_buffer_size, 65536, "Size of each provided receive "
+             "buffer in bytes");
+
+namespace nexus {
+
+namespace {
+
+/*! \brief Buffer group of the provided receive buffers */
+const uint16_t kBufGroup = 0;
+/*! \brief Maximum number of messages sent by one sendmsg */
+const size_t kMaxIov = 64;
+
+enum UringOp : uint64_t {
+  kOpWake = 1,
+  kOpRecv = 2,
+  kOpSend = 3,
+};
+
+inline uint64_t EncodeUserData(uint32_t slot, UringOp op) {
+  return (static_cast<uint64_t>(slot) << 8) | op;
+}
+
+inline unsigned LoadAcquire(const unsigned* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+inline void StoreRelease(unsigned* p, unsigned v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+} // namespace
+
+struct IoUringEngine::UringConn {
+  uint32_t slot;
+  int fd;
+  std::shared_ptr<Connection> conn;
+  /*! \brief Receiving message */
+  char header[MESSAGE_HEADER_SIZE];
+  size_t header_got;
+  std::shared_ptr<Message> msg;
+  size_t body_got;
+  bool wrong_header;
+  /*! \brief Messages being sent and bytes of the first one already sent */
+  std::vector<std::shared_ptr<Message> > sending;
+  size_t send_offset;
+  struct iovec iov[kMaxIov];
+  struct msghdr msghdr;
+  bool recv_active;
+  bool send_inflight;
+  bool closing;
+  bool error_reported;
+};
+
+IoUringEngine* IoUringEngine::Assign() {
+  static std::once_flag once;
+  // Leaked on purpose, engine threads run until the process exits
+  static std::vector<IoUringEngine*>* engines = nullptr;
+  static std::atomic<uint32_t> next(0);
+  std::call_once(once, []() {
+      engines = new std::vector<IoUringEngine*>();
+      if (FLAGS_io_engine == "asio") {
+        return;
+      }
+      CHECK_EQ(FLAGS_io_engine, "io_uring") << "Unknown IO engine " <<
+          FLAGS_io_engine;
+      for (int i = 0; i < std::max(FLAGS_io_uring_threads, 1); ++i) {
+        auto engine = new IoUringEngine();
+        if (!engine->Init()) {
+          CHECK(engines->empty()) << "Failed to start io_uring engine " << i;
+          LOG(WARNING) << "io_uring is not supported, fall back to asio";
+          delete engine;
+          return;
+        }
+        engine->thread_ = std::thread(&IoUringEngine::Loop, engine);
+        engine->thread_.detach();
+        engines->push_back(engine);
+      }
+      LOG(INFO) << "Use io_uring engine with " << engines->size() <<
+          " threads";
+    });
+  if (engines->empty()) {
+    return nullptr;
+  }
+  return (*engines)[next.fetch_add(1, std::memory_order_relaxed) %
+                    engines->size()];
+}
+
+IoUringEngine::IoUringEngine() :
+    ring_fd_(-1),
+    wake_fd_(-1),
+    wake_buf_(0),
+    sq_local_tail_(0),
+    to_submit_(0),
+    buf_ring_(nullptr),
+    buffers_(nullptr),
+    num_buffers_(FLAGS_io_uring_buffers),
+    buffer_size_(FLAGS_io_uring_buffer_size),
+    buf_tail_(0),
+    next_slot_(1),
+    wake_pending_(false) {
+}
+
+bool IoUringEngine::Init() {
+  CHECK_EQ(num_buffers_ & (num_buffers_ - 1), 0) <<
+      "--io_uring_buffers must be a power of 2";
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = syscall(__NR_io_uring_setup, FLAGS_io_uring_entries, &params);
+  if (ring_fd_ < 0) {
+    LOG(WARNING) << "io_uring_setup failed: " << strerror(errno);
+    return false;
+  }
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(params.features & IORING_FEAT_NODROP)) {
+    LOG(WARNING) << "io_uring of the kernel is too old";
+    close(ring_fd_);
+    return false;
+  }
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size = params.cq_off.cqes +
+                   params.cq_entries * sizeof(io_uring_cqe);
+  size_t ring_size = std::max(sq_size, cq_size);
+  char* ring = static_cast<char*>(mmap(
+      nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      ring_fd_, IORING_OFF_SQ_RING));
+  PCHECK(ring != MAP_FAILED) << "Failed to map io_uring";
+  sq_head_ = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  sq_array_ = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+  sq_local_tail_ = *sq_tail_;
+  cq_head_ = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+  sqes_ = static_cast<io_uring_sqe*>(mmap(
+      nullptr, params.sq_entries * sizeof(io_uring_sqe),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+      IORING_OFF_SQES));
+  PCHECK(sqes_ != MAP_FAILED) << "Failed to map io_uring sqes";
+
+  // Provided buffers that multishot receives pick from
+  buf_ring_ = static_cast<io_uring_buf_ring*>(mmap(
+      nullptr, num_buffers_ * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  PCHECK(buf_ring_ != MAP_FAILED) << "Failed to map io_uring buffer ring";
+  io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+  reg.ring_entries = num_buffers_;
+  reg.bgid = kBufGroup;
+  if (syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING,
+              &reg, 1) < 0) {
+    LOG(WARNING) << "io_uring buffer ring registration failed: " <<
+        strerror(errno);
+    close(ring_fd_);
+    return false;
+  }
+  buffers_ = static_cast<char*>(mmap(
+      nullptr, size_t(num_buffers_) * buffer_size_, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0));
+  PCHECK(buffers_ != MAP_FAILED) << "Failed to allocate io_uring buffers";
+  for (uint32_t bid = 0; bid < num_buffers_; ++bid) {
+    ReturnBuffer(bid);
+  }
+  // Buffer rings came in Linux 5.19, one release before multishot recv
+  if (!ProbeMultishotRecv()) {
+    LOG(WARNING) << "io_uring multishot recv is not supported";
+    close(ring_fd_);
+    return false;
+  }
+
+  wake_fd_ = eventfd(0, EFD_CLOEXEC);
+  PCHECK(wake_fd_ >= 0) << "Failed to create eventfd";
+  return true;
+}
+
+bool IoUringEngine::ProbeMultishotRecv() {
+  int fds[2];
+  PCHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0) <<
+      "Failed to create socket pair";
+  // Slot 0 is never assigned to a connection
+  UringConn probe;
+  probe.slot = 0;
+  probe.fd = fds[0];
+  PrepareRecv(&probe);
+  // One byte and then EOF, which ends a supported multishot recv
+  char byte = 0;
+  PCHECK(write(fds[1], &byte, 1) == 1) << "Failed to write socket pair";
+  close(fds[1]);
+  bool supported = true;
+  bool done = false;
+  while (!done) {
+    Enter(to_submit_, 1);
+    DrainCompletions();
+    for (const auto& cqe : pending_cqes_) {
+      if (cqe.flags & IORING_CQE_F_BUFFER) {
+        ReturnBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+      }
+      if (cqe.res == -EINVAL) {
+        supported = false;
+      }
+      if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        done = true;
+      }
+    }
+    pending_cqes_.clear();
+  }
+  close(fds[0]);
+  return supported;
+}
+
+uint32_t IoUringEngine::Add(std::shared_ptr<Connection> conn) {
+  int fd = dup(conn->socket_.native_handle());
+  PCHECK(fd >= 0) << "Failed to duplicate socket";
+  uint32_t slot = next_slot_.fetch_add(1, std::memory_order_relaxed);
+  Post({Command::kAdd, slot, std::move(conn), fd});
+  return slot;
+}
+
+void IoUringEngine::Flush(uint32_t slot) {
+  Post({Command::kFlush, slot, nullptr, -1});
+}
+
+void IoUringEngine::Remove(uint32_t slot) {
+  Post({Command::kRemove, slot, nullptr, -1});
+}
+
+void IoUringEngine::Post(Command cmd) {
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(cmd_mu_);
+    commands_.push_back(std::move(cmd));
+    wake = !wake_pending_;
+    wake_pending_ = true;
+  }
+  if (wake) {
+    uint64_t one = 1;
+    ssize_t ret = write(wake_fd_, &one, sizeof(one));
+    (void) ret;
+  }
+}
+
+void IoUringEngine::Loop() {
+  PrepareWake();
+  while (true) {
+    ProcessCommands();
+    // Submits everything prepared in this iteration and waits for one
+    // completion in a single syscall
+    Enter(to_submit_, 1);
+    Reap();
+  }
+}
+
+void IoUringEngine::ProcessCommands() {
+  std::vector<Command> commands;
+  {
+    std::lock_guard<std::mutex> lock(cmd_mu_);
+    commands.swap(commands_);
+    wake_pending_ = false;
+  }
+  for (auto& cmd : commands) {
+    if (cmd.type == Command::kAdd) {
+      std::unique_ptr<UringConn> uc(new UringConn());
+      uc->slot = cmd.slot;
+      uc->fd = cmd.fd;
+      uc->conn = std::move(cmd.conn);
+      uc->header_got = 0;
+      uc->body_got = 0;
+      uc->wrong_header = false;
+      uc->send_offset = 0;
+      uc->recv_active = false;
+      uc->send_inflight = false;
+      uc->closing = false;
+      uc->error_reported = false;
+      PrepareRecv(uc.get());
+      conns_.emplace(cmd.slot, std::move(uc));
+      continue;
+    }
+    auto iter = conns_.find(cmd.slot);
+    if (iter == conns_.end()) {
+      continue;
+    }
+    UringConn* uc = iter->second.get();
+    if (cmd.type == Command::kFlush) {
+      if (!uc->send_inflight && !uc->closing) {
+        PrepareSend(uc);
+      }
+    } else {
+      // Connection::Stop has shut the socket down, which ends the receive
+      uc->closing = true;
+      MaybeRelease(uc);
+    }
+  }
+}
+
+void IoUringEngine::Reap() {
+  while (true) {
+    DrainCompletions();
+    if (pending_cqes_.empty()) {
+      break;
+    }
+    // Completions drained while handling these are handled in the next pass
+    reaping_cqes_.swap(pending_cqes_);
+    for (const auto& cqe : reaping_cqes_) {
+      uint64_t op = cqe.user_data & 0xff;
+      if (op == kOpWake) {
+        PrepareWake();
+        continue;
+      }
+      auto iter = conns_.find(static_cast<uint32_t>(cqe.user_data >> 8));
+      if (iter == conns_.end()) {
+        continue;
+      }
+      if (op == kOpRecv) {
+        OnRecv(iter->second.get(), cqe);
+      } else if (op == kOpSend) {
+        OnSend(iter->second.get(), cqe);
+      }
+    }
+    reaping_cqes_.clear();
+  }
+}
+
+void IoUringEngine::DrainCompletions() {
+  unsigned head = *cq_head_;
+  unsigned tail = LoadAcquire(cq_tail_);
+  for (; head != tail; ++head) {
+    const io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+    pending_cqes_.push_back({cqe->user_data, cqe->res, cqe->flags});
+  }
+  StoreRelease(cq_head_, head);
+}
+
+io_uring_sqe* IoUringEngine::GetSqe() {
+  if (sq_local_tail_ - LoadAcquire(sq_head_) >= sq_entries_) {
+    Enter(to_submit_, 0);
+  }
+  unsigned idx = sq_local_tail_ & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[idx] = idx;
+  ++sq_local_tail_;
+  ++to_submit_;
+  return sqe;
+}
+
+int IoUringEngine::Enter(unsigned to_submit, unsigned min_complete) {
+  StoreRelease(sq_tail_, sq_local_tail_);
+  while (true) {
+    int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                      min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr,
+                      0);
+    if (ret >= 0) {
+      to_submit_ -= std::min<unsigned>(ret, to_submit_);
+      return ret;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EBUSY || errno == EAGAIN) {
+      // Completion queue overflows. Only frees the ring, as the caller may
+      // be handling a completion
+      DrainCompletions();
+      continue;
+    }
+    PLOG(FATAL) << "io_uring_enter failed";
+  }
+}
+
+void IoUringEngine::PrepareWake() {
+  io_uring_sqe* sqe = GetSqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wake_fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(&wake_buf_);
+  sqe->len = sizeof(wake_buf_);
+  sqe->user_data = EncodeUserData(0, kOpWake);
+}
+
+void IoUringEngine::PrepareRecv(UringConn* uc) {
+  io_uring_sqe* sqe = GetSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = uc->fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufGroup;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = EncodeUserData(uc->slot, kOpRecv);
+  uc->recv_active = true;
+}
+
+void IoUringEngine::PrepareSend(UringConn* uc) {
+  auto conn = uc->conn.get();
+  if (uc->sending.empty()) {
+    conn->uring_flush_pending_ = false;
+    std::vector<std::shared_ptr<Message> > dropped;
+    {
+      auto now = Clock::now();
+      std::lock_guard<std::mutex> lock(conn->write_queue_mutex_);
+      while (!conn->write_queue_.empty() && uc->sending.size() < kMaxIov) {
+        auto msg = std::move(conn->write_queue_.front());
+        conn->write_queue_.pop_front();
+        if (msg->expired(now)) {
+          dropped.push_back(std::move(msg));
+        } else {
+          msg->StampDeadline(now);
+          uc->sending.push_back(std::move(msg));
+        }
+      }
+    }
+    conn->ReportExpired(&dropped);
+    uc->send_offset = 0;
+  }
+  if (uc->sending.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < uc->sending.size(); ++i) {
+    size_t offset = (i == 0) ? uc->send_offset : 0;
+    uc->iov[i].iov_base = uc->sending[i]->data() + offset;
+    uc->iov[i].iov_len = uc->sending[i]->length() - offset;
+  }
+  memset(&uc->msghdr, 0, sizeof(uc->msghdr));
+  uc->msghdr.msg_iov = uc->iov;
+  uc->msghdr.msg_iovlen = uc->sending.size();
+  io_uring_sqe* sqe = GetSqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = uc->fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&uc->msghdr);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = EncodeUserData(uc->slot, kOpSend);
+  uc->send_inflight = true;
+}
+
+void IoUringEngine::OnRecv(UringConn* uc, const Completion& cqe) {
+  bool more = cqe.flags & IORING_CQE_F_MORE;
+  if (cqe.flags & IORING_CQE_F_BUFFER) {
+    uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    if (cqe.res > 0) {
+      Consume(uc, buffers_ + size_t(bid) * buffer_size_, cqe.res);
+    }
+    ReturnBuffer(bid);
+  }
+  if (!more) {
+    uc->recv_active = false;
+    if (cqe.res == 0) {
+      ReportError(uc, boost::asio::error::eof);
+    } else if (cqe.res < 0 && cqe.res != -ENOBUFS) {
+      ReportError(uc, boost::system::error_code(
+          -cqe.res, boost::system::system_category()));
+    } else if (!uc->closing) {
+      // Out of buffers or the kernel ended the multishot receive
+      PrepareRecv(uc);
+    }
+  }
+  MaybeRelease(uc);
+}
+
+void IoUringEngine::OnSend(UringConn* uc, const Completion& cqe) {
+  uc->send_inflight = false;
+  if (cqe.res < 0) {
+    uc->sending.clear();
+    ReportError(uc, boost::system::error_code(
+        -cqe.res, boost::system::system_category()));
+    MaybeRelease(uc);
+    return;
+  }
+  size_t sent = cqe.res;
+  size_t i = 0;
+  for (; i < uc->sending.size(); ++i) {
+    size_t left = uc->sending[i]->length() - uc->send_offset;
+    if (sent < left) {
+      uc->send_offset += sent;
+      break;
+    }
+    sent -= left;
+    uc->send_offset = 0;
+  }
+  uc->sending.erase(uc->sending.begin(), uc->sending.begin() + i);
+  if (!uc->closing) {
+    // Sends the rest of a partial send, or the messages queued meanwhile
+    PrepareSend(uc);
+  }
+  MaybeRelease(uc);
+}
+
+void IoUringEngine::Consume(UringConn* uc, const char* data, size_t size) {
+  auto& conn = uc->conn;
+  while (size > 0) {
+    if (uc->msg == nullptr) {
+      size_t n = std::min(size, MESSAGE_HEADER_SIZE - uc->header_got);
+      memcpy(uc->header + uc->header_got, data, n);
+      uc->header_got += n;
+      data += n;
+      size -= n;
+      if (uc->header_got < MESSAGE_HEADER_SIZE) {
+        return;
+      }
+      uc->header_got = 0;
+      MessageHeader msg_header;
+      if (!DecodeHeader(uc->header, &msg_header,
+                        conn->max_header_version_)) {
+        if (!uc->wrong_header) {
+          LOG(ERROR) << "Wrong header detected";
+          uc->wrong_header = true;
+        }
+        continue;
+      }
+      uc->wrong_header = false;
+      uc->msg = std::make_shared<Message>(msg_header);
+      uc->body_got = 0;
+    }
+    size_t n = std::min(size, uc->msg->payload_length() - uc->body_got);
+    memcpy(uc->msg->payload() + uc->body_got, data, n);
+    uc->body_got += n;
+    data += n;
+    size -= n;
+    if (uc->body_got == uc->msg->payload_length()) {
+      std::shared_ptr<Message> msg = std::move(uc->msg);
+      uc->msg.reset();
+      if (!conn->stopped_) {
+        conn->Dispatch(std::move(msg));
+      }
+    }
+  }
+}
+
+void IoUringEngine::ReportError(UringConn* uc, boost::system::error_code ec) {
+  uc->closing = true;
+  // Errors after Connection::Stop are aborted operations for asio
+  if (!uc->error_reported && !uc->conn->stopped_) {
+    uc->error_reported = true;
+    uc->conn->handler_->HandleError(uc->conn, ec);
+  }
+}
+
+void IoUringEngine::MaybeRelease(UringConn* uc) {
+  if (uc->closing && !uc->recv_active && !uc->send_inflight) {
+    close(uc->fd);
+    conns_.erase(uc->slot);
+  }
+}
+
+void IoUringEngine::ReturnBuffer(uint16_t bid) {
+  // Not buf_ring_->bufs, whose empty struct member shifts it by 8 bytes in C++
+  io_uring_buf* bufs = reinterpret_cast<io_uring_buf*>(buf_ring_);
+  io_uring_buf* buf = &bufs[buf_tail_ & (num_buffers_ - 1)];
+  buf->addr = reinterpret_cast<uint64_t>(buffers_ + size_t(bid) * buffer_size_);
+  buf->len = buffer_size_;
+  buf->bid = bid;
+  ++buf_tail_;
+  __atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+} // namespace nexus
@@ -0,0 +1,160 @@
+#ifndef NEXUS_COMMON_IO_URING_ENGINE_H_
+#define NEXUS_COMMON_IO_URING_ENGINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "nexus/common/connection.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace nexus {
+
+/*!
+ * \brief IoUringEngine moves the socket IO of connections from asio to a
+ * Linux io_uring, selected by --io_engine=io_uring.
+ *
+ * Each engine runs one ring on its own thread. A connection receives with a
+ * single multishot recv into a ring of provided buffers, and sends all its
+ * queued messages with one sendmsg. Operations prepared in one loop
+ * iteration are submitted with a single io_uring_enter. Connect and accept
+ * still go through asio, and the engine invokes the same MessageHandler
+ * callbacks as asio does, from the engine thread.
+ */
+class IoUringEngine {
+ public:
+  /*!
+   * \brief Picks the engine for a new connection in round robin.
+   * \return Engine, nullptr if io_uring is not selected or not supported
+   */
+  static IoUringEngine* Assign();
+
+  IoUringEngine(const IoUringEngine&) = delete;
+  IoUringEngine& operator=(const IoUringEngine&) = delete;
+  /*!
+   * \brief Starts receiving on a connected connection. The engine does its
+   * IO on a duplicate of the socket descriptor, which it closes once the
+   * connection is removed and its last operation completes, so the
+   * descriptor number cannot be reused under a pending operation.
+   * \return Slot of the connection in the engine
+   */
+  uint32_t Add(std::shared_ptr<Connection> conn);
+  /*! \brief Sends the messages queued in the connection. */
+  void Flush(uint32_t slot);
+  /*! \brief Releases the connection once its operations complete. */
+  void Remove(uint32_t slot);
+
+ private:
+  /*! \brief Engine-side state of a connection, owned by the engine thread */
+  struct UringConn;
+
+  struct Command {
+    enum Type { kAdd, kFlush, kRemove } type;
+    uint32_t slot;
+    std::shared_ptr<Connection> conn;
+    /*! \brief Duplicated socket descriptor of kAdd */
+    int fd;
+  };
+
+  /*! \brief Completion copied out of the completion ring */
+  struct Completion {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+  };
+
+  IoUringEngine();
+  /*! \brief Sets up the ring and the provided buffers, false if unsupported */
+  bool Init();
+  /*!
+   * \brief Checks that the kernel supports multishot recv (Linux 6.0), which
+   * older kernels reject with EINVAL.
+   */
+  bool ProbeMultishotRecv();
+
+  void Post(Command cmd);
+
+  void Loop();
+
+  void ProcessCommands();
+
+  void Reap();
+  /*!
+   * \brief Copies the available completions to pending_cqes_ and frees their
+   * slots in the completion ring, without handling them.
+   */
+  void DrainCompletions();
+
+  io_uring_sqe* GetSqe();
+
+  int Enter(unsigned to_submit, unsigned min_complete);
+
+  void PrepareWake();
+
+  void PrepareRecv(UringConn* uc);
+
+  void PrepareSend(UringConn* uc);
+
+  void OnRecv(UringConn* uc, const Completion& cqe);
+
+  void OnSend(UringConn* uc, const Completion& cqe);
+  /*! \brief Parses received bytes into messages and dispatches them. */
+  void Consume(UringConn* uc, const char* data, size_t size);
+
+  void ReportError(UringConn* uc, boost::system::error_code ec);
+
+  void MaybeRelease(UringConn* uc);
+
+  void ReturnBuffer(uint16_t bid);
+
+  int ring_fd_;
+  int wake_fd_;
+  uint64_t wake_buf_;
+  /*! \brief Submission ring */
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned* sq_array_;
+  io_uring_sqe* sqes_;
+  unsigned sq_local_tail_;
+  unsigned to_submit_;
+  /*! \brief Completion ring */
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+  /*!
+   * \brief Completions drained but not handled yet, and the ones being
+   * handled. Handling a completion may prepare submissions, which can drain
+   * the completion ring when it overflows, but never handles completions
+   * recursively.
+   */
+  std::vector<Completion> pending_cqes_;
+  std::vector<Completion> reaping_cqes_;
+  /*! \brief Provided buffers */
+  io_uring_buf_ring* buf_ring_;
+  char* buffers_;
+  uint32_t num_buffers_;
+  uint32_t buffer_size_;
+  uint16_t buf_tail_;
+  /*! \brief Connections by slot, only accessed on the engine thread */
+  std::unordered_map<uint32_t, std::unique_ptr<UringConn> > conns_;
+  std::atomic<uint32_t> next_slot_;
+  /*! \brief Commands from other threads. Guarded by cmd_mu_ */
+  std::vector<Command> commands_;
+  bool wake_pending_;
+  std::mutex cmd_mu_;
+  std::thread thread_;
+};
+
+} // namespace nexus
+
+#endif // NEXUS_COMMON_IO_URING_ENGINE_H_
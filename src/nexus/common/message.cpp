@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <cstring>
+#include <limits>
 #include <glog/logging.h>
 
+#include "nexus/common/alloc_tracker.h"
 #include "nexus/common/message.h"
 
 namespace nexus {
@@ -15,41 +18,218 @@ namespace nexus {
    ((uint64_t) ntohl((x) & 0xFFFFFFFF) << 32) | ntohl((uint64_t)(x) >> 32))
 #endif
 
-bool DecodeHeader(const char* buffer, MessageHeader* header) {
+namespace {
+
+const uint32_t kMessageTypeMask = 0xFFFF;
+const uint32_t kHeaderFlagShift = 16;
+const uint32_t kHeaderFlagMask = 0xFF;
+const uint32_t kHeaderVersionShift = 24;
+const uint32_t kKnownHeaderFlags = kHeaderDeadline | kHeaderCompressed;
+/*!
+ * \brief Largest ratio of uncompressed to compressed body length. Senders
+ * don't compress beyond it, so a receiver rejects a larger uncompressed
+ * length before allocating it.
+ */
+const size_t kMaxCompressionRatio = 256;
+
+/*! \brief Offset of the extension of the flag, after those of lower flags */
+size_t ExtensionOffset(uint32_t flags, uint32_t flag) {
+  size_t offset = 0;
+  if ((flags & kHeaderDeadline) && flag > kHeaderDeadline) {
+    offset += sizeof(uint32_t);
+  }
+  if ((flags & kHeaderCompressed) && flag > kHeaderCompressed) {
+    offset += 2 * sizeof(uint32_t);
+  }
+  return offset;
+}
+
+size_t ExtensionLength(uint32_t flags) {
+  return ExtensionOffset(flags, 1 << 8);
+}
+
+uint32_t HeaderFlags(const MessageHeader& header) {
+  return (header.msg_type >> kHeaderFlagShift) & kHeaderFlagMask;
+}
+
+} // namespace
+
+bool DecodeHeader(const char* buffer, MessageHeader* header,
+                  uint32_t max_version) {
   header->magic_number = ntohl(*(const uint32_t*) buffer);
   if (header->magic_number != NEXUS_SERVICE_MAGIC_NUMBER) {
     return false;
   }
   header->msg_type = ntohl(*(const uint32_t*) (buffer + 4));
   header->body_length = ntohl(*(const uint32_t*) (buffer + 8));
+  uint32_t version = header->msg_type >> kHeaderVersionShift;
+  uint32_t flags = HeaderFlags(*header);
+  if (version > std::min<uint32_t>(max_version, MESSAGE_HEADER_VERSION) ||
+      (version == 0 && flags != 0) ||
+      (flags & ~kKnownHeaderFlags) != 0 ||
+      header->body_length < ExtensionLength(flags)) {
+    return false;
+  }
   return true;
 }
 
 Message::Message(const MessageHeader& header) {
-  type_ = static_cast<MessageType>(header.msg_type);
-  body_length_ = header.body_length;
-  data_ = new char[MESSAGE_HEADER_SIZE + body_length_];
-  *((uint32_t*) data_) = htonl(NEXUS_SERVICE_MAGIC_NUMBER);
-  *((uint32_t*) (data_ + 4)) = htonl((uint32_t) type_);
-  *((uint32_t*) (data_ + 8)) = htonl(body_length_);
+  type_ = static_cast<MessageType>(header.msg_type & kMessageTypeMask);
+  flags_ = HeaderFlags(header);
+  ext_length_ = ExtensionLength(flags_);
+  body_length_ = header.body_length - ext_length_;
+  deadline_ = Clock::now();
+  inbound_ = true;
+  data_ = static_cast<char*>(AllocTracker::Singleton().Allocate(
+      kAllocNetwork, length()));
+  EncodeHeader();
 }
 
 Message::Message(MessageType type, size_t body_length) :
     type_(type),
-    body_length_(body_length) {
-  data_ = new char[MESSAGE_HEADER_SIZE + body_length];
-  *((uint32_t*) data_) = htonl(NEXUS_SERVICE_MAGIC_NUMBER);
-  *((uint32_t*) (data_ + 4)) = htonl((uint32_t) type);
-  *((uint32_t*) (data_ + 8)) = htonl(body_length_);
+    flags_(0),
+    ext_length_(0),
+    body_length_(body_length),
+    deadline_(TimePoint::max()),
+    inbound_(false) {
+  data_ = static_cast<char*>(AllocTracker::Singleton().Allocate(
+      kAllocNetwork, length()));
+  EncodeHeader();
+}
+
+Message::Message(MessageType type, size_t body_length, TimePoint deadline) :
+    type_(type),
+    flags_(kHeaderDeadline),
+    ext_length_(ExtensionLength(kHeaderDeadline)),
+    body_length_(body_length),
+    deadline_(deadline),
+    inbound_(false) {
+  data_ = static_cast<char*>(AllocTracker::Singleton().Allocate(
+      kAllocNetwork, length()));
+  EncodeHeader();
+  StampDeadline(Clock::now());
 }
 
 Message::~Message() {
-  delete[] data_;
+  AllocTracker::Singleton().Free(data_);
 }
 
 void Message::set_type(MessageType type) {
   type_ = type;
-  *((uint32_t*) (data_ + 4)) = htonl((uint32_t) type);
+  EncodeHeader();
+}
+
+TimePoint Message::deadline() const {
+  if (!has_deadline()) {
+    return TimePoint::max();
+  }
+  if (!inbound_) {
+    return deadline_;
+  }
+  uint32_t left_us = ntohl(*(const uint32_t*) (data_ + MESSAGE_HEADER_SIZE));
+  return deadline_ + std::chrono::microseconds(left_us);
+}
+
+void Message::StampDeadline(TimePoint now) {
+  if (!has_deadline()) {
+    return;
+  }
+  TimePoint deadline = this->deadline();
+  uint32_t left_us = 0;
+  if (deadline > now) {
+    left_us = std::min<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - now).count(),
+        std::numeric_limits<uint32_t>::max());
+  }
+  if (inbound_) {
+    // Keeps the absolute deadline before the extension is overwritten
+    deadline_ = deadline;
+    inbound_ = false;
+  }
+  *((uint32_t*) (data_ + MESSAGE_HEADER_SIZE)) = htonl(left_us);
+}
+
+CompressionCodec Message::codec() const {
+  if (!compressed()) {
+    return kCodecNone;
+  }
+  return static_cast<CompressionCodec>(ntohl(*(const uint32_t*) (
+      payload() + ExtensionOffset(flags_, kHeaderCompressed))));
+}
+
+std::shared_ptr<Message> Message::Compress(CompressionCodec codec) const {
+  size_t bound = CompressBound(codec, body_length_);
+  if (compressed() || bound == 0) {
+    return nullptr;
+  }
+  uint32_t flags = flags_ | kHeaderCompressed;
+  std::shared_ptr<Message> msg(new Message(
+      type_, flags, ExtensionLength(flags), bound));
+  CopyExtensions(msg.get());
+  size_t size = nexus::Compress(codec, body(), body_length_, msg->body());
+  if (size == 0 || size >= body_length_ ||
+      body_length_ > size * kMaxCompressionRatio) {
+    return nullptr;
+  }
+  // Shrinks the body to the compressed size, the buffer stays as allocated
+  msg->body_length_ = size;
+  msg->EncodeHeader();
+  char* ext = msg->payload() + ExtensionOffset(flags, kHeaderCompressed);
+  *((uint32_t*) ext) = htonl(codec);
+  *((uint32_t*) (ext + 4)) = htonl(body_length_);
+  return msg;
+}
+
+std::shared_ptr<Message> Message::Decompress() const {
+  if (!compressed()) {
+    return nullptr;
+  }
+  const char* ext = payload() + ExtensionOffset(flags_, kHeaderCompressed);
+  size_t raw_length = ntohl(*(const uint32_t*) (ext + 4));
+  // The length comes from the peer, bound it before allocating
+  if (raw_length > body_length_ * kMaxCompressionRatio) {
+    return nullptr;
+  }
+  uint32_t flags = flags_ & ~kHeaderCompressed;
+  std::shared_ptr<Message> msg(new Message(
+      type_, flags, ExtensionLength(flags), raw_length));
+  CopyExtensions(msg.get());
+  if (!nexus::Decompress(codec(), body(), body_length_, msg->body(),
+                         raw_length)) {
+    return nullptr;
+  }
+  return msg;
+}
+
+Message::Message(MessageType type, uint32_t flags, size_t ext_length,
+                 size_t body_length) :
+    type_(type),
+    flags_(flags),
+    ext_length_(ext_length),
+    body_length_(body_length),
+    deadline_(TimePoint::max()),
+    inbound_(false) {
+  data_ = static_cast<char*>(AllocTracker::Singleton().Allocate(
+      kAllocNetwork, length()));
+  EncodeHeader();
+}
+
+void Message::CopyExtensions(Message* msg) const {
+  if (has_deadline()) {
+    msg->deadline_ = deadline_;
+    msg->inbound_ = inbound_;
+    memcpy(msg->payload(), payload(), sizeof(uint32_t));
+  }
+}
+
+void Message::EncodeHeader() {
+  uint32_t version = flags_ == 0 ? 0 : MESSAGE_HEADER_VERSION;
+  *((uint32_t*) data_) = htonl(NEXUS_SERVICE_MAGIC_NUMBER);
+  *((uint32_t*) (data_ + 4)) = htonl(
+      (uint32_t) type_ | (flags_ << kHeaderFlagShift) |
+      (version << kHeaderVersionShift));
+  *((uint32_t*) (data_ + 8)) = htonl(ext_length_ + body_length_);
 }
 
 void Message::DecodeBody(google::protobuf::Message* message) const {
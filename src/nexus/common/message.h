@@ -3,8 +3,12 @@
 
 #include <arpa/inet.h>
 #include <google/protobuf/message.h>
+#include <memory>
 #include <string>
 
+#include "nexus/common/compression.h"
+#include "nexus/common/time_util.h"
+
 namespace nexus {
 
 /*! \brief Message types */
@@ -25,24 +29,57 @@ enum MessageType {
   kBackendRelay = 102,
   /*! \brief relay reply from backup */
   kBackendRelayReply = 103,
+  /*!
+   * \brief header features supported by the sender, exchanged when a
+   * frontend or backend connects to a backend. Handled by Connection.
+   */
+  kLinkHello = 104,
+};
+
+/*!
+ * \brief Header extensions. Each extension adds a fixed-size field between
+ * the header and the body, in the order of the flag bits, and is counted in
+ * the payload length.
+ */
+enum MessageHeaderFlag {
+  /*! \brief 4-byte time left until the deadline of the message in us */
+  kHeaderDeadline = 1 << 0,
+  /*! \brief 8-byte codec and uncompressed length of a compressed body */
+  kHeaderCompressed = 1 << 1,
 };
 
-/*! \brief Message header format */
+/*!
+ * \brief Message header format. The type field holds the header version in
+ * bits 24-31, the extension flags in bits 16-23, and the MessageType in bits
+ * 0-15. Version 0 is the plain header without extensions, which is all that
+ * user clients send and receive. Version 1 adds the extension flags.
+ */
 struct MessageHeader {
   /*! \brief magic number field */
   uint32_t magic_number;
-  /*! \brief message type */
+  /*! \brief header version, extension flags and message type */
   uint32_t msg_type;
-  /*! \brief length of payload */
+  /*! \brief length of payload, including header extensions */
   uint32_t body_length;
 };
 
+/*! \brief Latest header version */
+#define MESSAGE_HEADER_VERSION      1
+
 /*! \brief Magic number for Nexus service */
 #define NEXUS_SERVICE_MAGIC_NUMBER  0xDEADBEEF
 /*! \brief Header length in bytes */
 #define MESSAGE_HEADER_SIZE         sizeof(MessageHeader)
 
-bool DecodeHeader(const char* buffer, MessageHeader* header);
+/*!
+ * \brief Decode the header from the buffer.
+ * \param max_version Latest header version the connection accepts, 0 for
+ *   user connections
+ * \return false if the magic number, the version or the extensions are
+ *   invalid
+ */
+bool DecodeHeader(const char* buffer, MessageHeader* header,
+                  uint32_t max_version = MESSAGE_HEADER_VERSION);
 
 /*!
  * \brief Message is used to hold the packets that are communicated between
@@ -68,20 +105,70 @@ class Message {
    * \param body_length Length of payload in bytes
    */
   Message(MessageType type, size_t body_length);
+  /*!
+   * \brief Construct an outbound message with a deadline, which is carried in
+   * a header extension. Connections send messages in deadline order and
+   * drop them once the deadline passes.
+   *
+   * \param body_length Length of payload in bytes
+   * \param deadline Time by which the message is useless to the peer
+   */
+  Message(MessageType type, size_t body_length, TimePoint deadline);
   /*! \brief Destruct a message. */
   ~Message();
   /*! \brief Get the data pointer */
   char* data() { return data_; }
   /*! \brief Get the read-only data pointer */
   const char* data() const { return data_; }
+  /*! \brief Get the pointer to the header extensions and the body */
+  char* payload() { return data_ + MESSAGE_HEADER_SIZE; }
+  /*! \brief Get the read-only pointer to the header extensions and body */
+  const char* payload() const { return data_ + MESSAGE_HEADER_SIZE; }
+  /*! \brief Get the length of header extensions and body in bytes */
+  size_t payload_length() const { return ext_length_ + body_length_; }
   /*! \brief Get the body pointer */
-  char* body() { return data_ + MESSAGE_HEADER_SIZE; }
+  char* body() { return data_ + MESSAGE_HEADER_SIZE + ext_length_; }
   /*! \brief Get the read-only body pointer */
-  const char* body() const { return data_ + MESSAGE_HEADER_SIZE; }
+  const char* body() const {
+    return data_ + MESSAGE_HEADER_SIZE + ext_length_;
+  }
   /*! \brief Get the length of entire message in bytes */
-  size_t length() const { return MESSAGE_HEADER_SIZE + body_length_; }
+  size_t length() const {
+    return MESSAGE_HEADER_SIZE + ext_length_ + body_length_;
+  }
   /*! \brief Get the length of body in bytes */
   size_t body_length() const { return body_length_; }
+  /*! \brief Whether the message carries a deadline */
+  bool has_deadline() const { return flags_ & kHeaderDeadline; }
+  /*!
+   * \brief Get the deadline, TimePoint::max() if there is none. The deadline
+   * of an inbound message counts from the arrival of its header.
+   */
+  TimePoint deadline() const;
+  /*! \brief Whether the deadline of the message has passed */
+  bool expired(TimePoint now) const { return deadline() < now; }
+  /*!
+   * \brief Write the time left until the deadline into the header extension,
+   * right before the message is sent.
+   */
+  void StampDeadline(TimePoint now);
+  /*! \brief Whether the body is compressed */
+  bool compressed() const { return flags_ & kHeaderCompressed; }
+  /*! \brief Get the codec of the body, kCodecNone if not compressed */
+  CompressionCodec codec() const;
+  /*!
+   * \brief Compress the body into a new message with the same type and
+   * deadline.
+   * \return Compressed message, nullptr if the body does not shrink
+   */
+  std::shared_ptr<Message> Compress(CompressionCodec codec) const;
+  /*!
+   * \brief Decompress the body into a new message with the same type and
+   * deadline.
+   * \return Decompressed message, nullptr if the body is not compressed or
+   * corrupted
+   */
+  std::shared_ptr<Message> Decompress() const;
   /*! \brief Get the type of message */
   MessageType type() const { return type_; }
   /*!
@@ -101,12 +188,29 @@ class Message {
   void EncodeBody(const google::protobuf::Message& message);
 
  private:
+  Message(MessageType type, uint32_t flags, size_t ext_length,
+          size_t body_length);
+  /*! \brief Copy the header extensions other than compression to msg. */
+  void CopyExtensions(Message* msg) const;
+
+  void EncodeHeader();
+
   /*! \brief Data buffer */
   char* data_;
   /*! \brief Message type */
   MessageType type_;
+  /*! \brief Header extension flags */
+  uint32_t flags_;
+  /*! \brief Length of header extensions in bytes */
+  size_t ext_length_;
   /*! \brief Length of message body in bytes */
   size_t body_length_;
+  /*!
+   * \brief Deadline of an outbound message, or arrival time of the header of
+   * an inbound one, whose deadline is relative to it
+   */
+  TimePoint deadline_;
+  bool inbound_;
 };
 
 } // namespace nexus
@@ -16,6 +16,26 @@ void Counter::Reset() {
   count_.exchange(0, std::memory_order_relaxed);
 }
 
+Gauge::Gauge() :
+    value_(0) {
+}
+
+void Gauge::Increase(int64_t value) {
+  value_.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Gauge::Decrease(int64_t value) {
+  value_.fetch_sub(value, std::memory_order_relaxed);
+}
+
+void Gauge::Set(int64_t value) {
+  value_.store(value, std::memory_order_relaxed);
+}
+
+void Gauge::Reset() {
+  value_.exchange(0, std::memory_order_relaxed);
+}
+
 IntervalCounter::IntervalCounter(uint32_t interval_sec) :
     Tickable(interval_sec),
     count_(0) {
@@ -88,6 +108,13 @@ std::shared_ptr<Counter> MetricRegistry::CreateCounter() {
   return metric;
 }
 
+std::shared_ptr<Gauge> MetricRegistry::CreateGauge() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto metric = std::make_shared<Gauge>();
+  metrics_.insert(metric);
+  return metric;
+}
+
 std::shared_ptr<IntervalCounter> MetricRegistry::CreateIntervalCounter(
     uint32_t interval_sec) {
   std::lock_guard<std::mutex> lock(mutex_);
@@ -5,6 +5,7 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include "nexus/common/time_util.h"
@@ -22,12 +23,33 @@ class Counter : public Metric {
 
   void Increase(uint64_t value);
 
+  uint64_t value() const { return count_.load(std::memory_order_relaxed); }
+
   void Reset() final;
   
  private:
   std::atomic<uint64_t> count_;
 };
 
+/*! \brief Gauge tracks a value that can go up and down, e.g., live bytes. */
+class Gauge : public Metric {
+ public:
+  Gauge();
+
+  void Increase(int64_t value);
+
+  void Decrease(int64_t value);
+
+  void Set(int64_t value);
+
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+  void Reset() final;
+
+ private:
+  std::atomic<int64_t> value_;
+};
+
 class IntervalCounter : public Metric, public Tickable {
  public:
   IntervalCounter(uint32_t interval_sec);
@@ -77,6 +99,8 @@ class MetricRegistry {
 
   std::shared_ptr<Counter> CreateCounter();
 
+  std::shared_ptr<Gauge> CreateGauge();
+
   std::shared_ptr<IntervalCounter> CreateIntervalCounter(uint32_t interval_sec);
 
   void RemoveMetric(std::shared_ptr<IntervalCounter> metric);
@@ -1,6 +1,9 @@
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <fstream>
 #include <queue>
+#include <thread>
 #include <boost/filesystem.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
@@ -22,10 +25,60 @@ namespace fs = boost::filesystem;
 
 DEFINE_string(model_root, "", "Model root dicrectory");
 DEFINE_double(profile_multiplier, 1.15, "Multiplier to forward latency in profile.");
+DEFINE_int32(model_db_threads, 0, "Number of threads to load the model "
+             "database, 0 to use all cores");
 
 namespace nexus {
 
+namespace {
+
+std::string GetString(const YAML::Node& node, const std::string& key) {
+  if (!node[key]) {
+    return "";
+  }
+  return node[key].as<std::string>();
+}
+
+std::vector<float> GetFloats(const YAML::Node& node, const std::string& key) {
+  std::vector<float> values;
+  const YAML::Node& seq = node[key];
+  if (!seq) {
+    return values;
+  }
+  CHECK(seq.IsSequence()) << key << " in the model info is not sequence";
+  for (size_t i = 0; i < seq.size(); ++i) {
+    values.push_back(seq[i].as<float>());
+  }
+  return values;
+}
+/*! \brief Reads a single string or a sequence of strings. */
+std::vector<std::string> GetStrings(const YAML::Node& node,
+                                    const std::string& key) {
+  std::vector<std::string> values;
+  const YAML::Node& value = node[key];
+  if (!value) {
+    return values;
+  }
+  if (value.IsSequence()) {
+    for (size_t i = 0; i < value.size(); ++i) {
+      values.push_back(value[i].as<std::string>());
+    }
+  } else {
+    values.push_back(value.as<std::string>());
+  }
+  return values;
+}
+
+} // namespace
+
 void MergeMeanStd(ProfileEntry& dst, const ProfileEntry& src) {
+  if (src.repeat == 0) {
+    return;
+  }
+  if (dst.repeat == 0) {
+    dst = src;
+    return;
+  }
   double mean, std;
   std::tie(mean, std) = ::MergeMeanStd(
       dst.latency_mean, dst.latency_std, dst.repeat,
@@ -53,6 +106,28 @@ void ModelProfile::MergeProfile(const ModelProfile& rhs) {
   }
   MergeMeanStd(preprocess_, rhs.preprocess_);
   MergeMeanStd(postprocess_, rhs.postprocess_);
+  MergeMeanStd(frontend_preprocess_, rhs.frontend_preprocess_);
+  MergeMeanStd(raw_preprocess_, rhs.raw_preprocess_);
+  for (const auto& iter : rhs.corun_slowdowns_) {
+    auto it = corun_slowdowns_.find(iter.first);
+    if (it == corun_slowdowns_.end()) {
+      corun_slowdowns_.emplace(iter.first, iter.second);
+      continue;
+    }
+    // Weighted by count since an entry can come from a single batch size
+    auto& dst = it->second;
+    const auto& src = iter.second;
+    int n = dst.repeat + src.repeat;
+    double mean = (dst.latency_mean * dst.repeat +
+                   src.latency_mean * src.repeat) / n;
+    double sq = (dst.repeat * (dst.latency_std * dst.latency_std +
+                               dst.latency_mean * dst.latency_mean) +
+                 src.repeat * (src.latency_std * src.latency_std +
+                               src.latency_mean * src.latency_mean)) / n;
+    dst.latency_mean = mean;
+    dst.latency_std = std::sqrt(std::max(sq - mean * mean, 0.));
+    dst.repeat = n;
+  }
 }
 
 void ModelProfile::LoadProfile(const std::string& filepath) {
@@ -89,6 +164,45 @@ void ModelProfile::LoadProfile(const std::string& filepath) {
   postprocess_.latency_mean = stof(tokens[0]) * FLAGS_profile_multiplier;
   postprocess_.latency_std = stof(tokens[1]) * FLAGS_profile_multiplier;
   postprocess_.repeat = std::stoi(tokens[2]);
+  // Profiles without the placement sections assume that the frontend does
+  // all the preprocessing work
+  frontend_preprocess_ = preprocess_;
+  raw_preprocess_ = ProfileEntry();
+  corun_slowdowns_.clear();
+  bool has_line = false;
+  while (has_line || std::getline(fin, line)) {
+    has_line = false;
+    ProfileEntry* entry;
+    if (line.find("Co-run slowdown (profile_id,mean,std,repeat)") == 0) {
+      // One line per co-located model, up to the next section header
+      while (std::getline(fin, line)) {
+        if (line.empty() || line.find(' ') != std::string::npos) {
+          has_line = true;
+          break;
+        }
+        SplitString(line, ',', &tokens);
+        ProfileEntry slowdown;
+        slowdown.latency_mean = stof(tokens[1]);
+        slowdown.latency_std = stof(tokens[2]);
+        slowdown.memory_usage = 0;
+        slowdown.repeat = std::stoi(tokens[3]);
+        corun_slowdowns_[tokens[0]] = slowdown;
+      }
+      continue;
+    }
+    if (line.find("Frontend preprocess latency (mean,std,repeat)") == 0) {
+      entry = &frontend_preprocess_;
+    } else if (line.find("Raw preprocess latency (mean,std,repeat)") == 0) {
+      entry = &raw_preprocess_;
+    } else {
+      continue;
+    }
+    std::getline(fin, line);
+    SplitString(line, ',', &tokens);
+    entry->latency_mean = stof(tokens[0]) * FLAGS_profile_multiplier;
+    entry->latency_std = stof(tokens[1]) * FLAGS_profile_multiplier;
+    entry->repeat = std::stoi(tokens[2]);
+  }
 }
 
 float ModelProfile::GetForwardLatency(uint32_t batch) const {
@@ -108,6 +222,36 @@ float ModelProfile::GetPostprocessLatency() const {
   return postprocess_.latency_mean + postprocess_.latency_std;
 }
 
+float ModelProfile::GetFrontendPreprocessLatency() const {
+  return frontend_preprocess_.latency_mean + frontend_preprocess_.latency_std;
+}
+
+float ModelProfile::GetRawPreprocessLatency() const {
+  return raw_preprocess_.latency_mean + raw_preprocess_.latency_std;
+}
+
+float ModelProfile::GetLatencyQuantile(uint32_t batch, float z) const {
+  if (forward_lats_.find(batch) == forward_lats_.end()) {
+    LOG(FATAL) << "Cannot find forward latency: model=" << profile_id() << " batch=" << batch;
+    return 0.;
+  }
+  auto entry = forward_lats_.at(batch);
+  float mean = preprocess_.latency_mean + entry.latency_mean +
+               postprocess_.latency_mean;
+  float var = preprocess_.latency_std * preprocess_.latency_std +
+              entry.latency_std * entry.latency_std +
+              postprocess_.latency_std * postprocess_.latency_std;
+  return mean + z * std::sqrt(var);
+}
+
+float ModelProfile::GetCorunSlowdown(const std::string& profile_id) const {
+  auto iter = corun_slowdowns_.find(profile_id);
+  if (iter == corun_slowdowns_.end()) {
+    return 1.;
+  }
+  return iter->second.latency_mean;
+}
+
 size_t ModelProfile::GetMemoryUsage(uint32_t batch) const {
   if (forward_lats_.find(batch) == forward_lats_.end()) {
     return 0;
@@ -164,26 +308,28 @@ ModelDatabase& ModelDatabase::Singleton() {
   return model_db_;
 }
 
-const YAML::Node* ModelDatabase::GetModelInfo(const std::string& model_id)
+const ModelInfo* ModelDatabase::GetModelInfo(const std::string& model_id)
     const {
-  auto itr = model_info_table_.find(model_id);
-  if (itr == model_info_table_.end()) {
+  auto itr = model_index_.find(model_id);
+  if (itr == model_index_.end()) {
     LOG(ERROR) << "Cannot find model info for " << model_id;
     return nullptr;
   }
-  return &itr->second;
+  return &model_infos_[itr->second];
 }
 
-const YAML::Node* ModelDatabase::GetModelInfo(
+const ModelInfo* ModelDatabase::GetModelInfo(
     const std::string& framework, const std::string& model_name,
     uint32_t version) const {
-  auto model_id = ModelID(framework, model_name, version);
-  auto itr = model_info_table_.find(model_id);
-  if (itr == model_info_table_.end()) {
-    LOG(ERROR) << "Cannot find model info for " << model_id;
+  return GetModelInfo(ModelID(framework, model_name, version));
+}
+
+const ModelInfo* ModelDatabase::GetModelInfoByIndex(uint32_t index) const {
+  if (index >= model_infos_.size()) {
+    LOG(ERROR) << "Model index " << index << " out of range";
     return nullptr;
   }
-  return &itr->second;
+  return &model_infos_[index];
 }
 
 const ModelProfile* ModelDatabase::GetModelProfile(
@@ -268,15 +414,17 @@ ModelDatabase::ModelDatabase(const std::string& db_root_dir) {
   CHECK(fs::is_directory(model_store_dir)) << "Model store directory " <<
       model_store_dir << " doesn't exist";
   model_store_dir_ = model_store_dir.string();
-  // Load model DB file
   fs::path db_file = db_dir / "db" / "model_db.yml";
   CHECK(fs::exists(db_file)) << "Model DB file " << db_file << " doesn't exist";
-  LoadModelInfo(db_file.string());
-  // Load model profiles
   fs::path profile_dir = db_dir / "profiles";
   CHECK(fs::is_directory(profile_dir)) << "Model profile directory " <<
       profile_dir << " doesn't exist";
-  LoadModelProfiles(profile_dir.string());
+  // Load model profiles in the background while parsing the model DB file.
+  // They fill disjoint tables.
+  std::thread profile_loader(&ModelDatabase::LoadModelProfiles, this,
+                             profile_dir.string());
+  LoadModelInfo(db_file.string());
+  profile_loader.join();
 }
 
 void ModelDatabase::LoadModelInfo(const std::string& db_file) {
@@ -297,12 +445,7 @@ void ModelDatabase::LoadModelInfo(const std::string& db_file) {
     if (!model_info["type"]) {
       LOG(FATAL) << "Missing type in the model DB";
     }
-    model_info["model_dir"] = model_store_dir_;
-    std::string framework = model_info["framework"].as<std::string>();
-    std::string model_name = model_info["model_name"].as<std::string>();
-    uint32_t version = model_info["version"].as<uint32_t>();
-    std::string model_id = ModelID(framework, model_name, version);
-    model_info_table_[model_id] = model_info;
+    AddModelInfo(model_info);
   }
 
   const YAML::Node& shares = db["share_prefix"];
@@ -341,14 +484,15 @@ void ModelDatabase::LoadModelInfo(const std::string& db_file) {
       const auto &name = suffix_model.first;
       CHECK(tf_share_models_.count(name) == 0) << "Duplicated model " << name;
       tf_share_models_[name] = info;
-      CHECK(model_info_table_.count(name) == 0) << "Duplicated model " << name;
+      CHECK(model_index_.count(name) == 0) << "Duplicated model " << name;
       output_layers[suffix_model.second.suffix_index] = suffix_model.second.output_layer;
 
       // FIXME: hack for the ModelInstance constructor
       YAML::Node model_info;
-      model_info["model_dir"] = model_store_dir_;
-      std::string model_id = ModelID("tf_share", name, 1);
-      model_info_table_[model_id] = model_info;
+      model_info["framework"] = "tf_share";
+      model_info["model_name"] = name;
+      model_info["version"] = 1;
+      AddModelInfo(model_info);
     }
 
     // TODO refactor ModelInstance constructor so that it doesn't look up the ModelDB Singleton
@@ -357,13 +501,27 @@ void ModelDatabase::LoadModelInfo(const std::string& db_file) {
     model_info["model_name"] = info->hack_internal_id;
     model_info["version"] = 1;
     model_info["type"] = "classification";  // FIXME
-    model_info["model_dir"] = model_store_dir_;
     model_info["output_layer"] = output_layers;
-    std::string model_id = ModelID("tensorflow", info->hack_internal_id, 1);
-    model_info_table_[model_id] = model_info;
+    AddModelInfo(model_info);
   }
 }
 
+void ModelDatabase::AddModelInfo(const YAML::Node& node) {
+  std::string model_id = ModelID(node["framework"].as<std::string>(),
+                                 node["model_name"].as<std::string>(),
+                                 node["version"].as<uint32_t>());
+  auto iter = model_index_.find(model_id);
+  if (iter != model_index_.end()) {
+    // Later entries override earlier ones with the same model ID
+    model_infos_[iter->second] = ModelInfo(iter->second, node,
+                                           model_store_dir_);
+    return;
+  }
+  uint32_t index = model_infos_.size();
+  model_infos_.emplace_back(index, node, model_store_dir_);
+  model_index_.emplace(model_id, index);
+}
+
 void ModelDatabase::LoadModelProfiles(const std::string& profile_dir) {
   std::vector<fs::path> files;
   fs::directory_iterator end_iter;
@@ -386,8 +544,31 @@ void ModelDatabase::LoadModelProfiles(const std::string& profile_dir) {
     }
   }
 
-  for (const auto &filepath : files) {
-    ModelProfile profile(filepath.string());
+  // Parse the profile files in parallel, then merge them in file order so that
+  // the merged generic profiles don't depend on thread timing.
+  std::vector<ModelProfile> profiles(files.size());
+  std::atomic<size_t> next_file(0);
+  auto load_profiles = [&]() {
+    for (size_t i = next_file++; i < files.size(); i = next_file++) {
+      profiles[i].LoadProfile(files[i].string());
+    }
+  };
+  size_t num_threads = FLAGS_model_db_threads > 0 ?
+                       FLAGS_model_db_threads :
+                       std::max(std::thread::hardware_concurrency(), 1u);
+  num_threads = std::min(num_threads, std::max(files.size(), size_t(1)));
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(load_profiles);
+  }
+  load_profiles();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  VLOG(1) << "Loaded " << files.size() << " profiles with " << num_threads <<
+      " threads";
+
+  for (const auto &profile : profiles) {
     auto device = profile.gpu_device_name();
     if (device_profile_table_.find(device) == device_profile_table_.end()) {
       device_profile_table_.emplace(device, ProfileTable());
@@ -409,11 +590,38 @@ void ModelDatabase::LoadModelProfiles(const std::string& profile_dir) {
   }
 }
 
+ModelInfo::ModelInfo(uint32_t index_, const YAML::Node& node,
+                     const std::string& model_dir_) :
+    index(index_),
+    framework(node["framework"].as<std::string>()),
+    model_name(node["model_name"].as<std::string>()),
+    version(node["version"].as<uint32_t>()),
+    type(GetString(node, "type")),
+    model_type(ParseModelType(type)),
+    model_dir(model_dir_),
+    image_height(node["image_height"] ? node["image_height"].as<int>() : 0),
+    image_width(node["image_width"] ? node["image_width"].as<int>() : 0),
+    resizable(node["resizable"] && node["resizable"].as<bool>()),
+    input_std(GetFloats(node, "input_std")),
+    scale(node["scale"] ? node["scale"].as<float>() : 1.f),
+    mean_file(GetString(node, "mean_file")),
+    class_names(GetString(node, "class_names")),
+    config(node) {
+  model_id = ModelID(framework, model_name, version);
+  input_name = node["input_blob"] ? GetString(node, "input_blob") :
+               GetString(node, "input_layer");
+  output_names = node["output_blob"] ? GetStrings(node, "output_blob") :
+                 GetStrings(node, "output_layer");
+  input_mean = node["input_mean"] ? GetFloats(node, "input_mean") :
+               GetFloats(node, "mean_value");
+}
+
 TFShareSuffixInfo::TFShareSuffixInfo(size_t suffix_index_, const YAML::Node &node) :
     suffix_index(suffix_index_),
     model_name(node["model_name"].as<std::string>()),
     output_layer(node["output_layer"].as<std::string>()),
     type(node["type"].as<std::string>()),
+    model_type(ParseModelType(type)),
     class_names(node["class_names"].as<std::string>()) {
 }
 
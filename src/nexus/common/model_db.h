@@ -2,9 +2,13 @@
 #define NEXUS_COMMON_MODEL_DB_H_
 
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <vector>
 #include <yaml-cpp/yaml.h>
 
+#include "nexus/common/model_def.h"
+
 namespace nexus {
 
 struct ProfileEntry {
@@ -36,6 +40,35 @@ class ModelProfile {
   float GetPreprocessLatency() const;
 
   float GetPostprocessLatency() const;
+  /*!
+   * \brief Gets the latency for a frontend to decode and resize an input
+   * image into the RAW format, which is the preprocessing work moved off the
+   * backend when the frontend preprocesses.
+   */
+  float GetFrontendPreprocessLatency() const;
+  /*!
+   * \brief Gets the backend preprocess latency when the input image is
+   * already RAW at the model input size.
+   */
+  float GetRawPreprocessLatency() const;
+
+  /*!
+   * \brief Gets the end-to-end backend latency of a batch, preprocess,
+   * forward and postprocess, at z standard deviations above its mean. The
+   * three are taken as independent normal variables.
+   * \param batch Batch size
+   * \param z Number of standard deviations, 0 for the mean
+   * \return latency in us
+   */
+  float GetLatencyQuantile(uint32_t batch, float z) const;
+
+  /*!
+   * \brief Gets how much the forward latency grows when the model shares the
+   * GPU and host with another model, from the co-run section of the profile.
+   * \param profile_id Profile ID of the co-located model
+   * \return ratio of co-run to solo forward latency, 1 if not profiled
+   */
+  float GetCorunSlowdown(const std::string& profile_id) const;
 
   size_t GetMemoryUsage(uint32_t batch) const;
   /*!
@@ -58,14 +91,66 @@ class ModelProfile {
   std::unordered_map<uint32_t, ProfileEntry> forward_lats_;
   ProfileEntry preprocess_;
   ProfileEntry postprocess_;
+  ProfileEntry frontend_preprocess_;
+  ProfileEntry raw_preprocess_;
+  /*!
+   * \brief Mapping from the profile ID of a co-located model to the slowdown
+   * of forward latency, stored in latency_mean and latency_std
+   */
+  std::unordered_map<std::string, ProfileEntry> corun_slowdowns_;
   float network_latency_us_ = 2000; // us
 };
 
+/*!
+ * \brief ModelInfo is the metadata of a model in the model database, parsed
+ * once when the database is loaded.
+ *
+ * Keys shared across frameworks are typed. Framework specific keys, which are
+ * only read when a model instance is constructed, are left in config.
+ */
+struct ModelInfo {
+  /*! \brief Position of the model in the database */
+  uint32_t index;
+  std::string model_id;
+  std::string framework;
+  std::string model_name;
+  uint32_t version;
+  /*! \brief Model type string, empty if not specified */
+  std::string type;
+  ModelType model_type;
+  /*! \brief Directory that all file names in the model info are relative to */
+  std::string model_dir;
+  /*! \brief Default input size, 0 if not specified */
+  int image_height;
+  int image_width;
+  /*! \brief Whether the model accepts any input size */
+  bool resizable;
+  /*! \brief Name of the input blob (input_blob or input_layer) */
+  std::string input_name;
+  /*! \brief Names of the output blobs (output_blob or output_layer) */
+  std::vector<std::string> output_names;
+  /*! \brief Per channel mean (input_mean or mean_value), empty if not set */
+  std::vector<float> input_mean;
+  /*! \brief Per channel standard deviation, empty if not set */
+  std::vector<float> input_std;
+  float scale;
+  /*! \brief Mean blob file, empty if not set */
+  std::string mean_file;
+  /*! \brief Class names file, empty if not set */
+  std::string class_names;
+  /*! \brief Entry of the model in the model DB file */
+  YAML::Node config;
+
+  ModelInfo(uint32_t index_, const YAML::Node& node,
+            const std::string& model_dir_);
+};
+
 struct TFShareSuffixInfo {
   size_t suffix_index;
   std::string model_name;
   std::string output_layer;
   std::string type;
+  ModelType model_type;
   std::string class_names;
 
   TFShareSuffixInfo(size_t suffix_index_, const YAML::Node &node);
@@ -88,11 +173,15 @@ class ModelDatabase {
  public:
   static ModelDatabase& Singleton();
 
-  const YAML::Node* GetModelInfo(const std::string& model_id) const;
+  const ModelInfo* GetModelInfo(const std::string& model_id) const;
 
-  const YAML::Node* GetModelInfo(const std::string& framework,
-                                 const std::string& model_name,
-                                 uint32_t version) const;
+  const ModelInfo* GetModelInfo(const std::string& framework,
+                                const std::string& model_name,
+                                uint32_t version) const;
+
+  const ModelInfo* GetModelInfoByIndex(uint32_t index) const;
+
+  size_t num_models() const { return model_infos_.size(); }
 
   const ModelProfile* GetModelProfile(const std::string& gpu_device,
                                       const std::string& gpu_uuid,
@@ -111,6 +200,8 @@ class ModelDatabase {
 
   void LoadModelInfo(const std::string& db_file);
 
+  void AddModelInfo(const YAML::Node& node);
+
   void LoadModelProfiles(const std::string& profile_dir);
 
  private:
@@ -121,8 +212,10 @@ class ModelDatabase {
   std::string db_root_dir_;
   /*! \brief Model store directory */
   std::string model_store_dir_;
-  /*! \brief Map from model ID to model information */
-  std::unordered_map<std::string, YAML::Node> model_info_table_;
+  /*! \brief Model information, never changed after the database is loaded */
+  std::vector<ModelInfo> model_infos_;
+  /*! \brief Map from model ID to index in model_infos_ */
+  std::unordered_map<std::string, uint32_t> model_index_;
   /*! \brief Map from device name to profile table */
   std::unordered_map<std::string, ProfileTable> device_profile_table_;
 
@@ -83,6 +83,23 @@ inline bool ParseModelSession(const std::string& str, ModelSession* sess) {
   return true;
 }
 
+/*! \brief Task type of a model, parsed from the "type" field in model info */
+enum ModelType {
+  kUnknownModelType = 0,
+  kClassification = 1,
+  kDetection = 2,
+};
+
+inline ModelType ParseModelType(const std::string& type) {
+  if (type == "classification") {
+    return kClassification;
+  }
+  if (type == "detection") {
+    return kDetection;
+  }
+  return kUnknownModelType;
+}
+
 } // namespace nexus
 
 #endif // NEXUS_COMMON_MODEL_DEF_H_
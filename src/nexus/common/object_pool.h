@@ -0,0 +1,157 @@
+#ifndef NEXUS_COMMON_OBJECT_POOL_H_
+#define NEXUS_COMMON_OBJECT_POOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "nexus/common/spinlock.h"
+
+namespace nexus {
+
+/*!
+ * \brief PoolAllocator is a stateless allocator that keeps freed single-object
+ * allocations on a per-type free list. It is used to recycle the control
+ * blocks of shared_ptr created by ObjectPool.
+ */
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if (n == 1) {
+      FreeList& list = GetFreeList();
+      SpinlockGuard guard(list.lock);
+      if (!list.blocks.empty()) {
+        void* p = list.blocks.back();
+        list.blocks.pop_back();
+        return static_cast<T*>(p);
+      }
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) {
+    if (n == 1) {
+      FreeList& list = GetFreeList();
+      SpinlockGuard guard(list.lock);
+      if (list.blocks.size() < kMaxFreeBlocks) {
+        list.blocks.push_back(p);
+        return;
+      }
+    }
+    ::operator delete(p);
+  }
+
+ private:
+  struct FreeList {
+    Spinlock lock;
+    std::vector<void*> blocks;
+  };
+
+  static constexpr size_t kMaxFreeBlocks = 4096;
+
+  static FreeList& GetFreeList() {
+    // Never destructed so that blocks released during static destruction
+    // still have a valid free list.
+    static FreeList* list = new FreeList();
+    return *list;
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return false;
+}
+
+/*!
+ * \brief ObjectPool recycles objects that are expensive to construct, such as
+ * per-request contexts with protobuf arenas.
+ *
+ * T must be default constructible and provide `void Clear()`, which releases
+ * all references held by the object so that it can be reused. The caller of
+ * Get() is responsible for re-initializing the object.
+ */
+template <typename T>
+class ObjectPool {
+ public:
+  /*!
+   * \brief Construct an object pool
+   * \param max_free Maximum number of free objects to keep
+   */
+  explicit ObjectPool(size_t max_free = 1024) :
+      max_free_(max_free) {}
+
+  ~ObjectPool() {
+    for (T* obj : free_) {
+      delete obj;
+    }
+  }
+
+  ObjectPool(const ObjectPool&) = delete;
+  ObjectPool& operator=(const ObjectPool&) = delete;
+  /*!
+   * \brief Gets an object from the pool, or creates a new one if the pool is
+   * empty. The object is returned to the pool when the last reference is
+   * released.
+   * \return Shared pointer to the object
+   */
+  std::shared_ptr<T> Get() {
+    T* obj = nullptr;
+    {
+      SpinlockGuard guard(lock_);
+      if (!free_.empty()) {
+        obj = free_.back();
+        free_.pop_back();
+      }
+    }
+    if (obj == nullptr) {
+      obj = new T();
+    }
+    return std::shared_ptr<T>(obj, Recycler{this}, PoolAllocator<T>());
+  }
+  /*! \brief Number of free objects in the pool */
+  size_t NumFree() {
+    SpinlockGuard guard(lock_);
+    return free_.size();
+  }
+
+ private:
+  struct Recycler {
+    ObjectPool* pool;
+
+    void operator()(T* obj) const { pool->Recycle(obj); }
+  };
+
+  void Recycle(T* obj) {
+    obj->Clear();
+    {
+      SpinlockGuard guard(lock_);
+      if (free_.size() < max_free_) {
+        free_.push_back(obj);
+        return;
+      }
+    }
+    delete obj;
+  }
+
+  size_t max_free_;
+  Spinlock lock_;
+  std::vector<T*> free_;
+};
+
+} // namespace nexus
+
+#endif // NEXUS_COMMON_OBJECT_POOL_H_
@@ -1,10 +1,76 @@
+#include <algorithm>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <pthread.h>
 #include <signal.h>
+#include <thread>
 
+#include "nexus/common/metric.h"
 #include "nexus/common/server_base.h"
+#include "nexus/common/time_util.h"
+
+DEFINE_int32(listeners, 1, "Number of listeners accepting on the server port "
+             "with SO_REUSEPORT, each with its own io_context pinned to a CPU");
 
 namespace nexus {
 
+using ReusePort = boost::asio::detail::socket_option::boolean<
+  SOL_SOCKET, SO_REUSEPORT>;
+
+struct ServerBase::Listener {
+  Listener(boost::asio::io_context& io_ctx, int cpu) :
+      io_context(io_ctx),
+      acceptor(io_ctx),
+      socket(io_ctx),
+      cpu(cpu),
+      num_accepted(MetricRegistry::Singleton().CreateCounter()),
+      num_connections(MetricRegistry::Singleton().CreateGauge()),
+      sweep_size(64),
+      last_accepted(0),
+      last_stats_time(Clock::now()) {}
+
+  boost::asio::io_context& io_context;
+  boost::asio::ip::tcp::acceptor acceptor;
+  boost::asio::ip::tcp::socket socket;
+  /*! \brief io_context of the listener, nullptr for the first listener */
+  std::unique_ptr<boost::asio::io_context> own_io_context;
+  std::thread thread;
+  int cpu;
+  std::shared_ptr<Counter> num_accepted;
+  std::shared_ptr<Gauge> num_connections;
+  /*! \brief Accepted connections, to count the live ones. Guarded by mu */
+  std::vector<std::weak_ptr<Connection> > conns;
+  /*! \brief Size of conns at which expired connections are dropped */
+  size_t sweep_size;
+  uint64_t last_accepted;
+  TimePoint last_stats_time;
+  std::mutex mu;
+};
+
+namespace {
+
+void PinThread(pthread_t thread, int cpu) {
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  CPU_SET(cpu, &cpuset);
+  int rc = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
+  if (rc != 0) {
+    LOG(ERROR) << "Error calling pthread_setaffinity_np: " << rc;
+  }
+}
+
+/*! \brief Drops expired connections and returns the number of live ones. */
+int64_t CountLive(std::vector<std::weak_ptr<Connection> >* conns) {
+  conns->erase(std::remove_if(conns->begin(), conns->end(),
+                              [](const std::weak_ptr<Connection>& conn) {
+                                return conn.expired();
+                              }),
+               conns->end());
+  return conns->size();
+}
+
+} // namespace
+
 ServerBase::ServerBase(std::string port) :
     ServerBase("0.0.0.0", port) {
 }
@@ -13,9 +79,7 @@ ServerBase::ServerBase(std::string ip, std::string port)
     : ip_(ip),
       port_(port),
       io_context_(),
-      signals_(io_context_),
-      acceptor_(io_context_),
-      socket_(io_context_) {
+      signals_(io_context_) {
   // handle stop signal
   signals_.add(SIGINT);
   signals_.add(SIGTERM);
@@ -24,33 +88,131 @@ ServerBase::ServerBase(std::string ip, std::string port)
 
   boost::asio::ip::tcp::resolver resolver(io_context_);
   boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve({ip, port});
-  acceptor_.open(endpoint.protocol());
-  acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-  acceptor_.bind(endpoint);
-  acceptor_.listen();
+  int num_listeners = std::max(FLAGS_listeners, 1);
+  int num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+  for (int i = 0; i < num_listeners; ++i) {
+    std::unique_ptr<Listener> listener;
+    int cpu = num_listeners > 1 ? i % num_cpus : -1;
+    if (i == 0) {
+      listener.reset(new Listener(io_context_, cpu));
+    } else {
+      std::unique_ptr<boost::asio::io_context> io_ctx(
+          new boost::asio::io_context(1));
+      listener.reset(new Listener(*io_ctx, cpu));
+      listener->own_io_context = std::move(io_ctx);
+    }
+    auto& acceptor = listener->acceptor;
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    if (num_listeners > 1) {
+      // The kernel spreads incoming connections over the listening sockets
+      acceptor.set_option(ReusePort(true));
+    }
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    DoAccept(listener.get());
+    listeners_.push_back(std::move(listener));
+  }
+}
 
-  DoAccept();
+ServerBase::~ServerBase() {
+  for (auto& listener : listeners_) {
+    if (listener->own_io_context != nullptr) {
+      listener->own_io_context->stop();
+    }
+    if (listener->thread.joinable()) {
+      listener->thread.join();
+    }
+  }
 }
 
 void ServerBase::Run() {
+  RunListeners();
+}
+
+void ServerBase::RunListeners() {
+  for (size_t i = 1; i < listeners_.size(); ++i) {
+    Listener* listener = listeners_[i].get();
+    listener->thread = std::thread([listener]() {
+        auto work_guard = boost::asio::make_work_guard(listener->io_context);
+        listener->io_context.run();
+      });
+    if (listener->cpu >= 0) {
+      PinThread(listener->thread.native_handle(), listener->cpu);
+    }
+  }
+  if (listeners_[0]->cpu >= 0) {
+    PinThread(pthread_self(), listeners_[0]->cpu);
+  }
+  LOG(INFO) << "Running " << listeners_.size() << " listener(s) on port " <<
+      port_;
   io_context_.run();
 }
 
 void ServerBase::Stop() {
-  acceptor_.close();
+  // Each acceptor is only touched on the thread of its listener
+  for (auto& listener : listeners_) {
+    Listener* l = listener.get();
+    boost::asio::post(l->io_context, [l]() { l->acceptor.close(); });
+  }
+}
+
+std::vector<ListenerStats> ServerBase::GetListenerStats() {
+  std::vector<ListenerStats> stats;
+  auto now = Clock::now();
+  for (auto& listener : listeners_) {
+    std::lock_guard<std::mutex> lock(listener->mu);
+    ListenerStats st;
+    st.cpu = listener->cpu;
+    st.num_accepted = listener->num_accepted->value();
+    double sec = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - listener->last_stats_time).count() / 1e6;
+    st.accept_rate = sec > 0 ?
+                     (st.num_accepted - listener->last_accepted) / sec : 0.;
+    listener->num_connections->Set(CountLive(&listener->conns));
+    st.num_connections = listener->num_connections->value();
+    listener->last_accepted = st.num_accepted;
+    listener->last_stats_time = now;
+    stats.push_back(st);
+  }
+  return stats;
+}
+
+void ServerBase::LogListenerStats() {
+  if (!VLOG_IS_ON(1)) {
+    return;
+  }
+  auto stats = GetListenerStats();
+  for (size_t i = 0; i < stats.size(); ++i) {
+    VLOG(1) << "Listener " << i << " (cpu " << stats[i].cpu << "): " <<
+        stats[i].num_accepted << " accepted, " << stats[i].accept_rate <<
+        " accepts/s, " << stats[i].num_connections << " connections";
+  }
 }
 
-void ServerBase::DoAccept() {
-  acceptor_.async_accept(
-      socket_,
-      [this](boost::system::error_code ec){
-        if (!acceptor_.is_open()) {
+void ServerBase::DoAccept(Listener* listener) {
+  listener->acceptor.async_accept(
+      listener->socket,
+      [this, listener](boost::system::error_code ec){
+        if (!listener->acceptor.is_open()) {
           return;
         }
         if (!ec) {
-          HandleAccept();
+          listener->num_accepted->Increase(1);
+          auto conn = HandleAccept(std::move(listener->socket));
+          if (conn != nullptr) {
+            std::lock_guard<std::mutex> lock(listener->mu);
+            // Amortized sweep keeps the list bounded by twice the live ones
+            if (listener->conns.size() >= listener->sweep_size) {
+              int64_t live = CountLive(&listener->conns);
+              listener->num_connections->Set(live);
+              listener->sweep_size = std::max<size_t>(64, 2 * live);
+            }
+            listener->conns.push_back(conn);
+            listener->num_connections->Increase(1);
+          }
         }
-        DoAccept();
+        DoAccept(listener);
       });
 }
 
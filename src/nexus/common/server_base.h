@@ -4,9 +4,24 @@
 #include <boost/asio.hpp>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "nexus/common/connection.h"
 
 namespace nexus {
 
+/*! \brief Accept and connection counts of one listener */
+struct ListenerStats {
+  /*! \brief CPU the listener is pinned to, -1 if not pinned */
+  int cpu;
+  /*! \brief Number of connections accepted since start */
+  uint64_t num_accepted;
+  /*! \brief Connections accepted per second since the previous call */
+  double accept_rate;
+  /*! \brief Number of accepted connections still alive */
+  int64_t num_connections;
+};
+
 class ServerBase {
  public:
   // Disable copy
@@ -16,6 +31,8 @@ class ServerBase {
   ServerBase(std::string port);
   // Construct the server given the IP address and port.
   ServerBase(std::string ip, std::string port);
+
+  virtual ~ServerBase();
   // Get the server address
   std::string address() const { return ip_ + ":" + port_; }
   // Get listening port
@@ -24,20 +41,45 @@ class ServerBase {
   virtual void Run();
   // Hanlde a stop operation.
   virtual void Stop();
+  /*!
+   * \brief Gets the stats of each listener, with the accept rate measured
+   * since the previous call.
+   */
+  std::vector<ListenerStats> GetListenerStats();
+  /*! \brief Logs the listener stats at VLOG(1). */
+  void LogListenerStats();
+
  protected:
+  /*!
+   * \brief Listener accepts connections on the server port, with its own
+   * acceptor and io_context. The first listener runs on io_context_.
+   */
+  struct Listener;
+  /*!
+   * \brief Runs the listeners. Every listener but the first runs on its own
+   * thread, and the first runs io_context_ on the calling thread until the
+   * server stops. Listener threads are pinned to distinct CPUs with
+   * --listeners > 1.
+   */
+  void RunListeners();
   // Asynchronously wait an accept request.
-  void DoAccept();
+  void DoAccept(Listener* listener);
   // Asynchronously wait a stop request.
   void DoAwaitStop();
-  // Handle an accept operation.
-  virtual void HandleAccept() = 0;
+  /*!
+   * \brief Handles an accepted connection. Runs on the thread of the
+   * listener that accepts it, concurrently with other listeners.
+   * \param socket Accepted socket, bound to the io_context of the listener
+   * \return Connection created for the socket, nullptr if rejected
+   */
+  virtual std::shared_ptr<Connection> HandleAccept(
+      boost::asio::ip::tcp::socket socket) = 0;
   // data fields
   std::string ip_;
   std::string port_;
   boost::asio::io_context io_context_;
   boost::asio::signal_set signals_;
-  boost::asio::ip::tcp::acceptor acceptor_;
-  boost::asio::ip::tcp::socket socket_;
+  std::vector<std::unique_ptr<Listener> > listeners_;
 };
 
 } // namespace nexus
@@ -3,6 +3,7 @@
 
 #include <atomic>
 #include <chrono>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -23,6 +24,8 @@ class Timer {
    * \param tag Tag of time point
    */
   void Record(const std::string& tag);
+  /*! \brief Clears all recorded time points */
+  void Reset() { time_points_.clear(); }
   /*!
    * \brief Get the interval between two tags in millisecond
    * \param beg_tag Tag of begining time point
@@ -1,4 +1,5 @@
 #include <arpa/inet.h>
+#include <fstream>
 #include <glog/logging.h>
 #include <ifaddrs.h>
 #include <netinet/in.h>
@@ -131,4 +132,29 @@ std::string GetIpAddress(const std::string& prefix) {
   return "";
 }
 
+double CpuUtilization::Update() {
+  std::ifstream stat("/proc/stat");
+  std::string cpu;
+  // user nice system idle iowait irq softirq steal
+  uint64_t fields[8] = {0};
+  stat >> cpu;
+  for (int i = 0; i < 8 && stat >> fields[i]; ++i) {}
+  if (!stat || cpu != "cpu") {
+    return 0.;
+  }
+  uint64_t idle = fields[3] + fields[4];
+  uint64_t total = 0;
+  for (uint64_t field : fields) {
+    total += field;
+  }
+  uint64_t busy = total - idle;
+  double util = 0.;
+  if (last_total_ > 0 && total > last_total_) {
+    util = double(busy - last_busy_) / (total - last_total_);
+  }
+  last_busy_ = busy;
+  last_total_ = total;
+  return util;
+}
+
 } // namespace nexus
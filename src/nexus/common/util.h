@@ -2,7 +2,9 @@
 #define NEXUS_COMMON_UTIL_H_
 
 #include <gflags/gflags.h>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "nexus/common/device.h"
 
@@ -19,6 +21,25 @@ void Memcpy(void *dst, const Device *dst_device, const void *src,
 // GetIpAddress returns the first IP addres that is not localhost (127.0.0.1)
 std::string GetIpAddress(const std::string &prefix);
 
+/*!
+ * \brief CpuUtilization measures the fraction of busy CPU time of the host
+ * between two calls to Update, from the counters in /proc/stat.
+ */
+class CpuUtilization {
+ public:
+  CpuUtilization() : last_busy_(0), last_total_(0) {}
+  /*!
+   * \brief Samples the CPU counters.
+   * \return Busy fraction of all cores since the last call, 0 on the first
+   *   call or if /proc/stat cannot be read
+   */
+  double Update();
+
+ private:
+  uint64_t last_busy_;
+  uint64_t last_total_;
+};
+
 } // namespace nexus
 
 #endif // NEXUS_COMMON_UTIL_H_
@@ -1,10 +1,20 @@
+#include <algorithm>
 #include <cmath>
 #include <sstream>
+#include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include "nexus/common/model_db.h"
 #include "nexus/scheduler/backend_delegate.h"
 #include "nexus/scheduler/scheduler.h"
+#include "nexus/scheduler/slo_model.h"
+
+DEFINE_bool(multi_rate_cycle, false, "Let models with loose latency SLA run "
+            "once every power-of-two multiple of the backend duty cycle");
+DEFINE_int32(max_cycle_period, 16, "Max number of duty cycles between two "
+             "executions of a model in multi-rate cycle");
+DEFINE_bool(interference_aware, true, "Inflate the forward latency of models "
+            "sharing a GPU by their profiled co-run slowdowns");
 
 uint32_t BatchSizeCeilEps(double x, double eps) {
   double floor = std::floor(x);
@@ -20,15 +30,87 @@ struct CalcCycleResult {
   struct InstanceInfoChange {
     uint32_t batch;
     double fwd_latency_us;
+    uint32_t cycle_period;
+    uint32_t cycle_phase;
   };
+  /*! \brief Max total forward latency in one duty cycle */
   double exec_cycle_us;
   double duty_cycle_us;
   bool overload;
+  /*! \brief Co-run slowdown pushes a model past its latency SLA */
+  bool late;
   std::vector<InstanceInfoChange> changes;
 };
 
+/*!
+ * \brief Computes the batch size to hold the requests arriving in a cycle,
+ * with headroom for bursts if --slo_percentile is set. Then a max_batch below
+ * the burst also suffices if the overflowing requests can wait for later
+ * cycles within latency SLA.
+ */
+uint32_t plan_batch_size(const InstanceInfo& inst_info, double cycle_us) {
+  double arrival_mean = cycle_us * inst_info.workload / 1e6;
+  if (!UseSloModel()) {
+    return BatchSizeCeilEps(arrival_mean, 1e-3);
+  }
+  uint32_t batch = SloBatchSize(arrival_mean);
+  uint32_t max_batch = inst_info.max_batch;
+  if (batch <= max_batch || max_batch == 0) {
+    return batch;
+  }
+  double latency_sla_us = inst_info.model_sessions[0].latency_sla() * 1000.;
+  double slack_us = latency_sla_us - SloLatency(*inst_info.profile, max_batch);
+  uint32_t horizon = static_cast<uint32_t>(std::max(slack_us / cycle_us, 0.));
+  if (horizon > 1 &&
+      SloBatchSize(arrival_mean * horizon) <= max_batch * horizon) {
+    return max_batch;
+  }
+  return batch;
+}
+
+/*!
+ * \brief Computes the expected requests per cycle a batch size holds, which
+ * is the batch size itself unless --slo_percentile is set.
+ */
+double plan_arrivals(uint32_t batch) {
+  return UseSloModel() ? SloMaxArrivalMean(batch) : batch;
+}
+
+/*!
+ * \brief Computes the backend latency of a batch to plan for, at the
+ * quantile set by --slo_percentile if set.
+ */
+double plan_latency(const ModelProfile& profile, uint32_t batch) {
+  if (UseSloModel()) {
+    return SloLatency(profile, batch);
+  }
+  return profile.GetForwardLatency(batch) + profile.GetPreprocessLatency() +
+      profile.GetPostprocessLatency();
+}
+
+/*!
+ * \brief Computes the longest power-of-two period, in number of duty cycles,
+ * at which the model still meets its latency SLA and max batch.
+ */
+uint32_t calc_cycle_period(const InstanceInfo& inst_info,
+                           double duty_cycle_us) {
+  double latency_sla_us = inst_info.model_sessions[0].latency_sla() * 1000.;
+  uint32_t period = 1;
+  while (period * 2 <= static_cast<uint32_t>(FLAGS_max_cycle_period)) {
+    double cycle_us = duty_cycle_us * period * 2;
+    uint32_t batch = plan_batch_size(inst_info, cycle_us);
+    if (batch == 0 || batch > inst_info.max_batch) {
+      break;
+    }
+    if (cycle_us + plan_latency(*inst_info.profile, batch) > latency_sla_us) {
+      break;
+    }
+    period *= 2;
+  }
+  return period;
+}
+
 CalcCycleResult calc_cycle(const std::vector<InstanceInfoPtr> &models) {
-  double exec_cycle_us = 0;
   double duty_cycle_us = 0;
   bool overload = false;
   std::vector<CalcCycleResult::InstanceInfoChange> changes;
@@ -37,9 +119,16 @@ CalcCycleResult calc_cycle(const std::vector<InstanceInfoPtr> &models) {
       duty_cycle_us = inst_info->max_duty_cycle_us;
     }
   }
-  for (const auto &inst_info : models) {
+  bool late = false;
+  uint32_t hyper_period = 1;
+  for (size_t i = 0; i < models.size(); ++i) {
+    const auto &inst_info = models[i];
+    uint32_t period = 1;
+    if (FLAGS_multi_rate_cycle) {
+      period = calc_cycle_period(*inst_info, duty_cycle_us);
+    }
     double fwd_latency_us;
-    uint32_t batch = BatchSizeCeilEps(duty_cycle_us * inst_info->workload / 1e6, 1e-3);
+    uint32_t batch = plan_batch_size(*inst_info, duty_cycle_us * period);
     if (batch > inst_info->max_batch) {
       overload = true;
       batch = 0;
@@ -48,13 +137,58 @@ CalcCycleResult calc_cycle(const std::vector<InstanceInfoPtr> &models) {
       CHECK_NE(batch, 0);
       fwd_latency_us = inst_info->profile->GetForwardLatency(batch);
     }
-    exec_cycle_us += fwd_latency_us;
-    changes.push_back({batch, fwd_latency_us});
+    double slowdown = FLAGS_interference_aware ? CorunSlowdown(models, i) : 1.;
+    if (slowdown > 1.) {
+      double latency_sla_us = inst_info->model_sessions[0].latency_sla() *
+          1000.;
+      if (batch > 0 && duty_cycle_us * period +
+          plan_latency(*inst_info->profile, batch) +
+          (slowdown - 1.) * fwd_latency_us > latency_sla_us) {
+        late = true;
+      }
+      fwd_latency_us *= slowdown;
+    }
+    hyper_period = std::max(hyper_period, period);
+    changes.push_back({batch, fwd_latency_us, period, 0});
+  }
+  // Assign phases so that the forward latency is balanced across the duty
+  // cycles in a hyper period. Models with shorter periods take more cycles,
+  // so they are placed first.
+  std::vector<size_t> order(changes.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&changes](size_t a, size_t b) {
+      return changes[a].cycle_period < changes[b].cycle_period;
+    });
+  std::vector<double> cycle_load(hyper_period, 0.);
+  for (size_t i : order) {
+    auto &change = changes[i];
+    uint32_t best_phase = 0;
+    double best_load = -1.;
+    for (uint32_t phase = 0; phase < change.cycle_period; ++phase) {
+      double load = 0.;
+      for (uint32_t c = phase; c < hyper_period; c += change.cycle_period) {
+        load = std::max(load, cycle_load[c]);
+      }
+      if (best_load < 0 || load < best_load) {
+        best_load = load;
+        best_phase = phase;
+      }
+    }
+    change.cycle_phase = best_phase;
+    for (uint32_t c = best_phase; c < hyper_period; c += change.cycle_period) {
+      cycle_load[c] += change.fwd_latency_us;
+    }
+  }
+  double exec_cycle_us = 0;
+  for (double load : cycle_load) {
+    exec_cycle_us = std::max(exec_cycle_us, load);
   }
   if (exec_cycle_us > duty_cycle_us) {
     overload = true;
   }
-  return {exec_cycle_us, duty_cycle_us, overload, changes};
+  return {exec_cycle_us, duty_cycle_us, overload, late, changes};
 }
 
 BackendDelegate::BackendDelegate(uint32_t node_id, const std::string& ip,
@@ -76,6 +210,7 @@ BackendDelegate::BackendDelegate(uint32_t node_id, const std::string& ip,
     exec_cycle_us_(0.),
     duty_cycle_us_(0.),
     overload_(false),
+    cpu_utilization_(0.),
     dirty_model_table_(false) {
   std::stringstream rpc_addr;
   rpc_addr << ip_ << ":" << rpc_port_;
@@ -159,7 +294,10 @@ bool BackendDelegate::PrepareLoadModel(
     const auto &change = res.changes.back();
     inst_info->batch = change.batch;
     inst_info->fwd_latency_us = change.fwd_latency_us;
-    inst_info->throughput = inst_info->batch * 1e6 / duty_cycle_us_;
+    inst_info->cycle_period = change.cycle_period;
+    inst_info->cycle_phase = change.cycle_phase;
+    inst_info->throughput = plan_arrivals(inst_info->batch) * 1e6 /
+                            (duty_cycle_us_ * change.cycle_period);
     CHECK_NE(inst_info->batch, 0);
   }
 
@@ -167,6 +305,10 @@ bool BackendDelegate::PrepareLoadModel(
     // Doesn't have enough spare cycles to load this workload
     return false;
   }
+  if (res.late) {
+    // Co-located models would slow each other past their latency SLA
+    return false;
+  }
   *occupancy = res.exec_cycle_us / res.duty_cycle_us;
   CHECK_LE(*occupancy, 1.0 + 1e-3) << "Backend is overloaded";
   return true;
@@ -183,6 +325,7 @@ void BackendDelegate::LoadModel(const InstanceInfo& inst_info) {
   LOG(INFO) << "Backend " << node_id_ << " loads " << model_session_id <<
       ", batch " << info->batch << ", max batch " << info->max_batch <<
       ", max duty cycle " << info->max_duty_cycle_us << " us, " <<
+      "cycle period " << info->cycle_period << ", " <<
       "throughput " << info->throughput << " req/s. Backend exec cycle " <<
       exec_cycle_us_ << " us, duty cycle: " << duty_cycle_us_ << " us";
 }
@@ -398,11 +541,16 @@ CtrlStatus BackendDelegate::UpdateModelTableRpc() {
   for (auto inst_info : models_) {
     auto cfg = request.add_model_instance_config();
     for (auto& model_sess : inst_info->model_sessions) {
-      cfg->add_model_session()->CopyFrom(model_sess);
+      auto sess = cfg->add_model_session();
+      sess->CopyFrom(model_sess);
+      sess->set_session_index(SessionIndexer::Singleton().GetIndex(
+          ModelSessionToString(model_sess)));
     }
     CHECK_NE(inst_info->batch, 0);
     cfg->set_batch(inst_info->batch);
     cfg->set_max_batch(inst_info->max_batch);
+    cfg->set_cycle_period(inst_info->cycle_period);
+    cfg->set_cycle_phase(inst_info->cycle_phase);
     cfg->set_memory_usage(inst_info->memory_usage);
     cfg->set_backup(inst_info->backup);
     for (auto iter : inst_info->backup_backends) {
@@ -412,7 +560,10 @@ CtrlStatus BackendDelegate::UpdateModelTableRpc() {
   for (auto inst_info : backup_models_) {
     auto cfg = request.add_model_instance_config();
     for (auto& model_sess : inst_info->model_sessions) {
-      cfg->add_model_session()->CopyFrom(model_sess);
+      auto sess = cfg->add_model_session();
+      sess->CopyFrom(model_sess);
+      sess->set_session_index(SessionIndexer::Singleton().GetIndex(
+          ModelSessionToString(model_sess)));
     }
     cfg->set_batch(inst_info->batch);
     cfg->set_max_batch(inst_info->max_batch);
@@ -476,9 +627,15 @@ double BackendDelegate::GetModelGPUShare(const std::string& model_sess_id)
   if (iter == session_model_map_.end()) {
     return 0.;
   }
+  // Average forward latency per duty cycle
+  double total_exec_cycle = 0.;
+  for (auto const& inst_info : models_) {
+    total_exec_cycle += inst_info->fwd_latency_us / inst_info->cycle_period;
+  }
   auto model_inst = iter->second;
-  double model_exec_cycle = model_inst->fwd_latency_us;
-  return model_exec_cycle / exec_cycle_us_;
+  double model_exec_cycle = model_inst->fwd_latency_us /
+                            model_inst->cycle_period;
+  return model_exec_cycle / total_exec_cycle;
 }
 
 double BackendDelegate::GetModelWeight(const std::string& model_sess_id)
@@ -519,8 +676,31 @@ void BackendDelegate::ComputeBatchSize(InstanceInfo* inst_info,
   double max_throughput;
   max_batch = inst_info->profile->GetMaxBatch(
       inst_info->model_sessions[0].latency_sla());
-  max_throughput = max_batch * 1e6 / inst_info->profile->GetForwardLatency(
-      max_batch);
+  double latency_sla_us = inst_info->model_sessions[0].latency_sla() * 1000;
+  if (UseSloModel()) {
+    // A saturated GPU runs max_batch back to back, so a request waits one
+    // forward pass for a batch to start, or several if it still meets the
+    // latency SLA after them
+    double fwd_lat = inst_info->profile->GetForwardLatency(max_batch);
+    while (max_batch > 1 &&
+           fwd_lat + SloLatency(*inst_info->profile, max_batch) >
+           latency_sla_us) {
+      --max_batch;
+      fwd_lat = inst_info->profile->GetForwardLatency(max_batch);
+    }
+    double slack_us = latency_sla_us -
+        SloLatency(*inst_info->profile, max_batch);
+    uint32_t horizon = static_cast<uint32_t>(std::max(slack_us / fwd_lat, 1.));
+    max_throughput = SloMaxArrivalMean(max_batch, horizon) * 1e6 / fwd_lat;
+    if (max_throughput < 1e-3) {
+      // Bursts overflow even an empty GPU too often for slo_percentile
+      inst_info->batch = 0;
+      return;
+    }
+  } else {
+    max_throughput = max_batch * 1e6 / inst_info->profile->GetForwardLatency(
+        max_batch);
+  }
   // std::tie(batch, max_throughput) = inst_info->profile->GetMaxThroughput(
   //     inst_info->model_session.latency_sla());
   if (workload == 0 || workload >= max_throughput) {
@@ -537,16 +717,13 @@ void BackendDelegate::ComputeBatchSize(InstanceInfo* inst_info,
   }
 
   // 2. Compute the max batch for residue load
-  double latency_sla_us = inst_info->model_sessions[0].latency_sla() * 1000;
-  double preprocess = inst_info->profile->GetPreprocessLatency();
-  double postprocess = inst_info->profile->GetPostprocessLatency();
   batch = 1;
   for (; batch <= max_batch; ++batch) {
-    double fwd_lat = inst_info->profile->GetForwardLatency(batch);
-    // because batch = ceil(workload * duty_cycle),
-    // duty_cycle >= (batch - 1) / workload
-    double min_duty_cycle = (batch - 1) * 1e6 / workload;
-    if (min_duty_cycle + fwd_lat + preprocess + postprocess > latency_sla_us) {
+    // because the batch is planned for workload * duty_cycle requests,
+    // duty_cycle > plan_arrivals(batch - 1) / workload
+    double min_duty_cycle = plan_arrivals(batch - 1) * 1e6 / workload;
+    if (min_duty_cycle + plan_latency(*inst_info->profile, batch) >
+        latency_sla_us) {
       break;
     }
   }
@@ -561,13 +738,14 @@ void BackendDelegate::ComputeBatchSize(InstanceInfo* inst_info,
   inst_info->max_batch = max_batch;
   inst_info->fwd_latency_us = inst_info->profile->GetForwardLatency(batch);
   // duty_cycle are constrainted by the following condition:
-  // (1) throughput = batch / duty_cycle >= workload
-  //     => duty_cycle <= batch / workload
+  // (1) throughput = plan_arrivals(batch) / duty_cycle >= workload
+  //     => duty_cycle <= plan_arrivals(batch) / workload
   // (2) duty_cycle + preprocess + postprocess + fwd_lat <= latency_sla
   inst_info->max_duty_cycle_us = std::min(
-      latency_sla_us - inst_info->fwd_latency_us - preprocess - postprocess,
-      batch * 1e6 / workload);
-  inst_info->throughput = batch * 1e6 / inst_info->max_duty_cycle_us;
+      latency_sla_us - plan_latency(*inst_info->profile, batch),
+      plan_arrivals(batch) * 1e6 / workload);
+  inst_info->throughput = plan_arrivals(batch) * 1e6 /
+      inst_info->max_duty_cycle_us;
   CHECK_GE(inst_info->throughput, workload - 1e-3) << "Throughput is less " <<
       "than workload";
   inst_info->workload = workload;
@@ -579,10 +757,12 @@ void BackendDelegate::UpdateCycle() {
   auto res = calc_cycle(models_);
   exec_cycle_us_ = res.exec_cycle_us;
   duty_cycle_us_ = res.duty_cycle_us;
-  overload_ = res.overload;
+  overload_ = res.overload || res.late;
   for (size_t i = 0; i < res.changes.size(); ++i) {
     models_[i]->batch = res.changes[i].batch;
     models_[i]->fwd_latency_us = res.changes[i].fwd_latency_us;
+    models_[i]->cycle_period = res.changes[i].cycle_period;
+    models_[i]->cycle_phase = res.changes[i].cycle_phase;
   }
 
   dirty_model_table_ = true;
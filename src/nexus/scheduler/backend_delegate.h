@@ -31,6 +31,8 @@ class BackendDelegate {
  
   std::string gpu_device() const { return gpu_device_; }
 
+  std::string gpu_uuid() const { return gpu_uuid_; }
+
   size_t gpu_available_memory() const { return gpu_available_memory_; }
 
   int workload_id() const { return workload_id_; }
@@ -39,6 +41,12 @@ class BackendDelegate {
 
   bool overload() const { return overload_; }
 
+  double duty_cycle_us() const { return duty_cycle_us_; }
+
+  double cpu_utilization() const { return cpu_utilization_; }
+
+  void set_cpu_utilization(double util) { cpu_utilization_ = util; }
+
   double Occupancy() const;
 
   void GetInfo(BackendInfo* info) const;
@@ -127,6 +135,8 @@ class BackendDelegate {
   double exec_cycle_us_;
   double duty_cycle_us_;
   bool overload_;
+  /*! \brief CPU utilization reported in the last keep alive */
+  double cpu_utilization_;
   /*! \brief Indicates whether model table is dirty. */
   bool dirty_model_table_;
   std::chrono::time_point<std::chrono::system_clock> last_time_;
@@ -15,7 +15,8 @@ FrontendDelegate::FrontendDelegate(uint32_t node_id, const std::string& ip,
     server_port_(server_port),
     rpc_port_(rpc_port),
     beacon_sec_(beacon_sec),
-    timeout_ms_(beacon_sec * 3 * 1000) {
+    timeout_ms_(beacon_sec * 3 * 1000),
+    cpu_utilization_(0.) {
   std::stringstream rpc_addr;
   rpc_addr << ip_ << ":" << rpc_port_;
   auto channel = grpc::CreateChannel(rpc_addr.str(),
@@ -58,6 +59,10 @@ void FrontendDelegate::SubscribeModel(const std::string& model_session_id) {
   subscribe_models_.insert(model_session_id);
 }
 
+void FrontendDelegate::UnsubscribeModel(const std::string& model_session_id) {
+  subscribe_models_.erase(model_session_id);
+}
+
 CtrlStatus FrontendDelegate::UpdateModelRoutesRpc(
     const ModelRouteUpdates& request) {
   RpcReply reply;
@@ -28,8 +28,14 @@ class FrontendDelegate {
 
   bool IsAlive();
 
+  double cpu_utilization() const { return cpu_utilization_; }
+
+  void set_cpu_utilization(double util) { cpu_utilization_ = util; }
+
   void SubscribeModel(const std::string& model_session_id);
 
+  void UnsubscribeModel(const std::string& model_session_id);
+
   const std::unordered_set<std::string>& subscribe_models() const {
     return subscribe_models_;
   }
@@ -46,6 +52,8 @@ class FrontendDelegate {
   std::unique_ptr<FrontendCtrl::Stub> stub_;
   std::chrono::time_point<std::chrono::system_clock> last_time_;
   std::unordered_set<std::string> subscribe_models_;
+  /*! \brief CPU utilization reported in the last keep alive */
+  double cpu_utilization_;
 };
 
 } // namespace scheduler
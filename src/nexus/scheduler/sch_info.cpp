@@ -1,9 +1,26 @@
 #include "nexus/scheduler/sch_info.h"
+#include <algorithm>
 #include <glog/logging.h>
 
 namespace nexus {
 namespace scheduler {
 
+SessionIndexer& SessionIndexer::Singleton() {
+  static SessionIndexer session_indexer_;
+  return session_indexer_;
+}
+
+uint32_t SessionIndexer::GetIndex(const std::string& model_sess_id) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto iter = indices_.find(model_sess_id);
+  if (iter != indices_.end()) {
+    return iter->second;
+  }
+  uint32_t index = next_index_++;
+  indices_.emplace(model_sess_id, index);
+  return index;
+}
+
 void SessionInfo::UpdateWorkload(uint32_t frontend_id, const ModelStatsProto &model_stats) {
   auto iter = workloads.find(frontend_id);
   if (iter == workloads.end()) {
@@ -52,5 +69,29 @@ bool SessionInfo::UnsubscribleModelSession(uint32_t frontend_id, const std::stri
   }
   return true;
 }
+
+double DegradeShift(double unassigned_workload, double throughput,
+                    double variant_throughput) {
+  if (throughput <= 0 || variant_throughput <= throughput) {
+    return 0.;
+  }
+  return unassigned_workload * variant_throughput /
+      (variant_throughput - throughput);
 }
-}
\ No newline at end of file
+
+double CorunSlowdown(const std::vector<std::shared_ptr<InstanceInfo> >& models,
+                     size_t index) {
+  const ModelProfile* profile = models[index]->profile;
+  double slowdown = 1.;
+  for (size_t i = 0; i < models.size(); ++i) {
+    if (i == index) {
+      continue;
+    }
+    slowdown += profile->GetCorunSlowdown(models[i]->profile->profile_id()) -
+        1.;
+  }
+  return std::max(slowdown, 1.);
+}
+
+} // namespace scheduler
+} // namespace nexus
@@ -6,6 +6,7 @@
 #include <unordered_set>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <gflags/gflags.h>
 #include "nexus/common/metric.h"
 #include "nexus/common/model_db.h"
@@ -21,9 +22,37 @@ namespace scheduler {
 using SessionGroup = std::vector<ModelSession>;
 using ServerList = std::unordered_set<uint32_t>;
 
+/*!
+ * \brief SessionIndexer interns model session IDs into compact indices.
+ *
+ * Frontends and backends key their per-request tables by the index instead
+ * of the model session ID string. Indices start from 1 and are never reused,
+ * so a stale index can't alias another model session.
+ */
+class SessionIndexer {
+ public:
+  static SessionIndexer& Singleton();
+  /*!
+   * \brief Gets the index of a model session, assigning a new one if the
+   * model session hasn't been seen before.
+   * \param model_sess_id Model session ID
+   * \return Model session index
+   */
+  uint32_t GetIndex(const std::string& model_sess_id);
+
+ private:
+  SessionIndexer() : next_index_(1) {}
+
+  std::mutex mu_;
+  std::unordered_map<std::string, uint32_t> indices_;
+  uint32_t next_index_;
+};
+
 struct SessionInfo {
   SessionInfo() :
       has_static_workload(false),
+      variant_only(false),
+      frontend_preprocess(false),
       unassigned_workload(0) {}
 
   double TotalThroughput() const;
@@ -42,6 +71,10 @@ struct SessionInfo {
   std::unordered_set<uint32_t> backup_backends;
   /*! \brief Whether there is a static workload for this session */
   bool has_static_workload;
+  /*! \brief Whether the session only serves queries degraded from others */
+  bool variant_only;
+  /*! \brief Whether frontends preprocess the input images */
+  bool frontend_preprocess;
 
   std::unordered_map<std::string, ServerList> session_subscribers;
   /*! \brief Map from frontend id to workload */
@@ -54,6 +87,43 @@ struct SessionInfo {
   std::string complex_query_id;
 };
 
+/*!
+ * \brief CascadeInfo links the two model sessions of a cascade, so that the
+ * heavy model session is provisioned from the workload of the fast one.
+ */
+struct CascadeInfo {
+  std::string fast_model_sess_id;
+  std::string heavy_model_sess_id;
+  /*! \brief Fraction of queries escalated to the heavy model */
+  double escalation_rate;
+};
+
+/*!
+ * \brief VariantGroup holds the cheaper variants of a model session and the
+ * fraction of its queries degraded to each of them.
+ */
+struct VariantGroup {
+  /*! \brief Variant session IDs from the most to the least accurate */
+  std::vector<std::string> variant_sess_ids;
+  /*! \brief Fraction of the queries sent to each variant */
+  std::vector<double> shares;
+};
+
+/*!
+ * \brief Computes how many requests to move from an overloaded model to a
+ * cheaper variant so that the unassigned workload fits.
+ *
+ * Moving x req/s frees x / throughput - x / variant_throughput GPUs, which
+ * must cover the unassigned_workload / throughput GPUs missing.
+ *
+ * \param unassigned_workload Requests per second that cannot be served
+ * \param throughput Max throughput of the overloaded model on one GPU
+ * \param variant_throughput Max throughput of the variant on one GPU
+ * \return Requests per second to move, 0 if the variant is not cheaper
+ */
+double DegradeShift(double unassigned_workload, double throughput,
+                    double variant_throughput);
+
 struct InstanceInfo {
   SessionGroup model_sessions;
   uint32_t batch;
@@ -61,6 +131,10 @@ struct InstanceInfo {
   const ModelProfile* profile;
   double fwd_latency_us;
   double max_duty_cycle_us;
+  /*! \brief Model runs once every cycle_period duty cycles */
+  uint32_t cycle_period;
+  /*! \brief Index of the duty cycle the model runs in within its period */
+  uint32_t cycle_phase;
   double workload;
   double throughput;
   double weight;
@@ -74,6 +148,8 @@ struct InstanceInfo {
       profile(nullptr),
       fwd_latency_us(0.),
       max_duty_cycle_us(0.),
+      cycle_period(1),
+      cycle_phase(0),
       workload(0.),
       throughput(0.),
       weight(0.),
@@ -87,6 +163,8 @@ struct InstanceInfo {
       profile(other.profile),
       fwd_latency_us(other.fwd_latency_us),
       max_duty_cycle_us(other.max_duty_cycle_us),
+      cycle_period(other.cycle_period),
+      cycle_phase(other.cycle_phase),
       workload(other.workload),
       throughput(other.throughput),
       weight(other.weight),
@@ -101,6 +179,8 @@ struct InstanceInfo {
       profile = other.profile;
       fwd_latency_us = other.fwd_latency_us;
       max_duty_cycle_us = other.max_duty_cycle_us;
+      cycle_period = other.cycle_period;
+      cycle_phase = other.cycle_phase;
       workload = other.workload;
       throughput = other.throughput;
       weight = other.weight;
@@ -115,6 +195,18 @@ struct InstanceInfo {
   }
 };
 
+/*!
+ * \brief Computes the factor by which the forward latency of a model grows
+ * on a GPU shared with other models. The pairwise co-run slowdowns in the
+ * profiles add up, e.g., a model slowed by 10% by each of two co-located
+ * models runs at 1.2x its solo latency.
+ * \param models Models loaded on the GPU
+ * \param index Index of the model in models
+ * \return slowdown factor, 1 if running alone or not profiled
+ */
+double CorunSlowdown(const std::vector<std::shared_ptr<InstanceInfo> >& models,
+                     size_t index);
+
 } // namespace scheduler
 } // namespace nexus
 
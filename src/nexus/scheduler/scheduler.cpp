@@ -1,11 +1,15 @@
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <glog/logging.h>
 #include <unordered_set>
 #include <cmath>
+#include <limits>
+#include <numeric>
 
 #include "nexus/common/config.h"
 #include "nexus/common/model_db.h"
 #include "nexus/scheduler/scheduler.h"
+#include "nexus/scheduler/static_workload.h"
 
 namespace fs = boost::filesystem;
 
@@ -16,6 +20,19 @@ DEFINE_int32(epoch, 30, "Epoch scheduling interval in seconds");
 DEFINE_int32(min_epoch, 10, "Minimum time interval in seconds to invoke "
              "epoch schedule");
 DEFINE_int32(avg_interval, 10, "Moving average interval for backend rate");
+DEFINE_bool(degrade, true, "Degrade overloaded model sessions to their "
+            "cheaper variants");
+DEFINE_bool(preprocess_placement, true, "Move image preprocessing between "
+            "frontends and backends based on their CPU utilization");
+DEFINE_double(cpu_high_util, 0.85, "CPU utilization above which a tier sheds "
+              "preprocessing");
+DEFINE_double(cpu_low_util, 0.6, "CPU utilization below which a tier takes "
+              "over preprocessing");
+DEFINE_string(workload_gpu_device, "", "If set, check at startup that each "
+              "backend of the static workload meets the latency SLA and the "
+              "planned rates of its models on this GPU device");
+DEFINE_string(workload_gpu_uuid, "generic", "GPU UUID to look up the model "
+              "profiles to check the static workload with");
 
 namespace nexus {
 namespace scheduler {
@@ -27,13 +44,37 @@ INSTANTIATE_RPC_CALL(AsyncService, ReportWorkload, WorkloadStatsProto, RpcReply)
 INSTANTIATE_RPC_CALL(AsyncService, KeepAlive, KeepAliveRequest, RpcReply);
 INSTANTIATE_RPC_CALL(AsyncService, ComplexQuerySetup, ComplexQuerySetupRequest, RpcReply);
 INSTANTIATE_RPC_CALL(AsyncService, ComplexQueryAddEdge, ComplexQueryAddEdgeRequest, RpcReply);
+INSTANTIATE_RPC_CALL(AsyncService, LoadCascade, LoadCascadeRequest, LoadCascadeReply);
+
+namespace {
+
+/*!
+ * \brief Sets the default image size for resizable models.
+ * \return false if the model is not in the model database
+ */
+bool SetDefaultImageSize(ModelSession* model_sess) {
+  auto info = ModelDatabase::Singleton().GetModelInfo(
+      ModelSessionToModelID(*model_sess));
+  if (info == nullptr) {
+    return false;
+  }
+  if (info->resizable && model_sess->image_height() == 0) {
+    model_sess->set_image_height(info->image_height);
+    model_sess->set_image_width(info->image_width);
+  }
+  return true;
+}
+
+} // namespace
 
 Scheduler::Scheduler(std::string port, size_t nthreads) :
     AsyncRpcServiceBase(port, nthreads),
     beacon_interval_sec_(FLAGS_beacon),
     epoch_interval_sec_(FLAGS_epoch),
     enable_epoch_schedule_(FLAGS_epoch_schedule),
-    enable_prefix_batch_(FLAGS_prefix_batch) {
+    enable_prefix_batch_(FLAGS_prefix_batch),
+    enable_degrade_(FLAGS_degrade),
+    enable_preprocess_placement_(FLAGS_preprocess_placement) {
   history_len_ = (FLAGS_avg_interval * 3 + beacon_interval_sec_ - 1) /
                  beacon_interval_sec_;
   if (!enable_epoch_schedule_) {
@@ -42,6 +83,10 @@ Scheduler::Scheduler(std::string port, size_t nthreads) :
   if (!enable_prefix_batch_) {
     LOG(INFO) << "Prefix batching is off";
   }
+  auto& metrics = MetricRegistry::Singleton();
+  num_degrades_ = metrics.CreateCounter();
+  num_recoveries_ = metrics.CreateCounter();
+  degraded_rps_ = metrics.CreateGauge();
 }
 
 void Scheduler::LoadWorkloadFile(const std::string& workload_file) {
@@ -58,6 +103,29 @@ void Scheduler::LoadWorkloadFile(const std::string& workload_file) {
     }
     static_workloads_.push_back(models);
   }
+  if (FLAGS_workload_gpu_device.empty()) {
+    return;
+  }
+  size_t num_infeasible = 0;
+  for (uint i = 0; i < static_workloads_.size(); ++i) {
+    std::vector<InstanceInfoPtr> models;
+    for (const auto& model_info : static_workloads_[i]) {
+      models.push_back(ParseStaticModel(model_info, FLAGS_workload_gpu_device,
+                                        FLAGS_workload_gpu_uuid));
+    }
+    double duty_cycle_us;
+    std::string error;
+    if (CheckStaticBackend(models, &duty_cycle_us, &error)) {
+      LOG(INFO) << "Backend " << i << " duty cycle " << duty_cycle_us <<
+          " us on " << FLAGS_workload_gpu_device;
+    } else {
+      LOG(ERROR) << "Backend " << i << " is infeasible on " <<
+          FLAGS_workload_gpu_device << ": " << error;
+      ++num_infeasible;
+    }
+  }
+  CHECK_EQ(num_infeasible, 0) << "Static workload " << workload_file <<
+      " doesn't fit on " << FLAGS_workload_gpu_device;
 }
 
 void Scheduler::Run() {
@@ -125,20 +193,27 @@ void Scheduler::Unregister(const grpc::ServerContext& ctx,
 void Scheduler::LoadModel(const grpc::ServerContext& ctx,
                           const LoadModelRequest& request,
                           LoadModelReply* reply) {
-  ModelSession model_sess(request.model_session());
-  {
-    auto info = ModelDatabase::Singleton().GetModelInfo(ModelSessionToModelID(model_sess));
-    if (info == nullptr) {
+  for (auto variant : request.variants()) {
+    if (!SetDefaultImageSize(&variant)) {
       reply->set_status(MODEL_NOT_FOUND);
       return;
     }
-    if ((*info)["resizable"] && (*info)["resizable"].as<bool>()) {
-      if (model_sess.image_height() == 0) {
-        // Set default image size for resizable CNN
-        model_sess.set_image_height((*info)["image_height"].as<uint32_t>());
-        model_sess.set_image_width((*info)["image_width"].as<uint32_t>());
-      }
-    }
+  }
+  LoadModelSession(request, reply);
+  if (reply->status() != CTRL_OK || request.variants_size() == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  reply->set_status(LoadModelVariants(
+      request, reply->model_route().model_session_id(), reply));
+}
+
+void Scheduler::LoadModelSession(const LoadModelRequest& request,
+                                 LoadModelReply* reply) {
+  ModelSession model_sess(request.model_session());
+  if (!SetDefaultImageSize(&model_sess)) {
+    reply->set_status(MODEL_NOT_FOUND);
+    return;
   }
   std::string model_sess_id = ModelSessionToString(model_sess);
   double workload = request.estimate_workload();
@@ -153,6 +228,7 @@ void Scheduler::LoadModel(const grpc::ServerContext& ctx,
   if (session_iter != session_table_.end()) {
     // TODO: For now, if model session is already loaded, don't allocate
     // new backends, just rely on epoch scheduling
+    session_iter->second->variant_only = false;
     reply->set_status(CTRL_OK);
     GetModelRoute(model_sess_id, reply->mutable_model_route());
     frontend->SubscribeModel(model_sess_id);
@@ -302,6 +378,47 @@ void Scheduler::LoadModel(const grpc::ServerContext& ctx,
   GetModelRoute(model_sess_id, reply->mutable_model_route());
 }
 
+CtrlStatus Scheduler::LoadModelVariants(const LoadModelRequest& request,
+                                        const std::string& model_sess_id,
+                                        LoadModelReply* reply) {
+  auto frontend = GetFrontend(request.node_id());
+  if (frontend == nullptr) {
+    return CTRL_SERVER_NOT_REGISTERED;
+  }
+  VariantGroup group;
+  for (auto variant : request.variants()) {
+    if (variant.latency_sla() == 0) {
+      variant.set_latency_sla(request.model_session().latency_sla());
+    }
+    SetDefaultImageSize(&variant);
+    std::string variant_sess_id = ModelSessionToString(variant);
+    SessionInfoPtr session_info;
+    auto iter = session_table_.find(variant_sess_id);
+    if (iter == session_table_.end()) {
+      session_info = std::make_shared<SessionInfo>();
+      session_info->variant_only = true;
+      session_info->model_sessions.push_back(variant);
+      session_table_.emplace(variant_sess_id, session_info);
+    } else {
+      session_info = iter->second;
+    }
+    frontend->SubscribeModel(variant_sess_id);
+    session_info->SubscribeModelSession(frontend->node_id(), variant_sess_id);
+    GetModelRoute(variant_sess_id, reply->add_variant_route());
+    group.variant_sess_ids.push_back(variant_sess_id);
+    group.shares.push_back(0.);
+  }
+  // Keep the degradation state if another frontend loaded the variants
+  if (variant_groups_.count(model_sess_id) == 0) {
+    LOG(INFO) << model_sess_id << " has " << group.variant_sess_ids.size() <<
+        " variants";
+    variant_groups_.emplace(model_sess_id, group);
+  }
+  reply->clear_model_route();
+  GetModelRoute(model_sess_id, reply->mutable_model_route());
+  return CTRL_OK;
+}
+
 void Scheduler::ReportWorkload(const grpc::ServerContext& ctx,
                                const WorkloadStatsProto& request,
                                RpcReply* reply) {
@@ -329,6 +446,7 @@ void Scheduler::KeepAlive(const grpc::ServerContext& ctx,
       return;
     }
     frontend->Tick();
+    frontend->set_cpu_utilization(request.cpu_utilization());
   } else {
     auto backend = GetBackend(request.node_id());
     if (backend == nullptr) {
@@ -336,6 +454,7 @@ void Scheduler::KeepAlive(const grpc::ServerContext& ctx,
       return;
     }
     backend->Tick();
+    backend->set_cpu_utilization(request.cpu_utilization());
   }
   reply->set_status(CTRL_OK);
 }
@@ -375,6 +494,92 @@ void Scheduler::ComplexQueryAddEdge(const grpc::ServerContext &ctx,
   iter_dst->second->complex_query_id = request.cq_id();
 }
 
+void Scheduler::LoadCascade(const grpc::ServerContext& ctx,
+                            const LoadCascadeRequest& request,
+                            LoadCascadeReply* reply) {
+  ModelSession fast_sess(request.fast_model_session());
+  ModelSession heavy_sess(request.heavy_model_session());
+  if (!SetDefaultImageSize(&fast_sess) || !SetDefaultImageSize(&heavy_sess)) {
+    reply->set_status(MODEL_NOT_FOUND);
+    return;
+  }
+  double workload = request.estimate_workload();
+  double escalation_rate = std::min(std::max(request.escalation_rate(), 0.),
+                                    1.);
+  // Whether the frontend already used the fast stage outside this cascade
+  bool fast_subscribed = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto frontend = GetFrontend(request.node_id());
+    if (frontend != nullptr) {
+      fast_subscribed = frontend->subscribe_models().count(
+          ModelSessionToString(fast_sess)) > 0;
+    }
+    uint32_t fast_sla_ms, heavy_sla_ms;
+    CtrlStatus status = SplitCascadeLatency(
+        fast_sess, heavy_sess, request.latency_sla(), workload,
+        escalation_rate, &fast_sla_ms, &heavy_sla_ms);
+    if (status != CTRL_OK) {
+      reply->set_status(status);
+      return;
+    }
+    fast_sess.set_latency_sla(fast_sla_ms);
+    heavy_sess.set_latency_sla(heavy_sla_ms);
+  }
+  LOG(INFO) << "Cascade " << ModelSessionToString(fast_sess) << " -> " <<
+      ModelSessionToString(heavy_sess) << ", escalation rate " <<
+      escalation_rate;
+
+  // Both stages are loaded as ordinary model sessions
+  LoadModelRequest load_req;
+  LoadModelReply load_reply;
+  load_req.set_node_id(request.node_id());
+  load_req.mutable_model_session()->CopyFrom(fast_sess);
+  load_req.set_estimate_workload(workload);
+  LoadModel(ctx, load_req, &load_reply);
+  if (load_reply.status() != CTRL_OK) {
+    reply->set_status(load_reply.status());
+    return;
+  }
+  reply->mutable_fast_model_route()->Swap(load_reply.mutable_model_route());
+  load_req.mutable_model_session()->CopyFrom(heavy_sess);
+  load_req.set_estimate_workload(workload * escalation_rate);
+  load_reply.Clear();
+  LoadModel(ctx, load_req, &load_reply);
+  if (load_reply.status() != CTRL_OK) {
+    reply->set_status(load_reply.status());
+    reply->clear_fast_model_route();
+    if (!fast_subscribed) {
+      // Releases the fast stage loaded above for the failed cascade
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto frontend = GetFrontend(request.node_id());
+      if (frontend != nullptr) {
+        UnloadModelSession(frontend, ModelSessionToString(fast_sess));
+      }
+    }
+    return;
+  }
+  reply->mutable_heavy_model_route()->Swap(load_reply.mutable_model_route());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  CascadeInfo cascade;
+  cascade.fast_model_sess_id = reply->fast_model_route().model_session_id();
+  cascade.heavy_model_sess_id = reply->heavy_model_route().model_session_id();
+  cascade.escalation_rate = escalation_rate;
+  auto& heavy_cascades = cascades_[cascade.heavy_model_sess_id];
+  auto iter = std::find_if(
+      heavy_cascades.begin(), heavy_cascades.end(),
+      [&cascade](const CascadeInfo& other) {
+        return other.fast_model_sess_id == cascade.fast_model_sess_id;
+      });
+  if (iter != heavy_cascades.end()) {
+    *iter = cascade;
+  } else {
+    heavy_cascades.push_back(cascade);
+  }
+  reply->set_status(CTRL_OK);
+}
+
 void Scheduler::HandleRpcs() {
   using namespace std::placeholders;
   new Register_Call(&service_, cq_.get(),
@@ -391,6 +596,8 @@ void Scheduler::HandleRpcs() {
                              std::bind(&Scheduler::ComplexQuerySetup, this, _1, _2, _3));
   new ComplexQueryAddEdge_Call(&service_, cq_.get(),
                                std::bind(&Scheduler::ComplexQueryAddEdge, this, _1, _2, _3));
+  new LoadCascade_Call(&service_, cq_.get(),
+                       std::bind(&Scheduler::LoadCascade, this, _1, _2, _3));
   void* tag;
   bool ok;
   while (running_) {
@@ -668,6 +875,27 @@ void Scheduler::RemoveFrontend(FrontendDelegatePtr frontend) {
   }
 }
 
+void Scheduler::UnloadModelSession(FrontendDelegatePtr frontend,
+                                   const std::string& model_sess_id) {
+  auto session_iter = session_table_.find(model_sess_id);
+  if (session_iter == session_table_.end()) {
+    return;
+  }
+  auto session_info = session_iter->second;
+  frontend->UnsubscribeModel(model_sess_id);
+  if (!session_info->UnsubscribleModelSession(frontend->node_id(),
+                                              model_sess_id)) {
+    return;
+  }
+  LOG(INFO) << "Remove model session: " << model_sess_id;
+  for (auto iter : session_info->backend_weights) {
+    auto backend = GetBackend(iter.first);
+    backend->UnloadModel(model_sess_id);
+    backend->UpdateModelTableRpc();
+  }
+  session_table_.erase(model_sess_id);
+}
+
 BackendDelegatePtr Scheduler::GetBackend(uint32_t node_id) {
   auto iter = backends_.find(node_id);
   if (iter == backends_.end()) {
@@ -689,11 +917,136 @@ FrontendDelegatePtr Scheduler::GetFrontend(uint32_t node_id) {
 void Scheduler::GetModelRoute(const std::string& model_sess_id,
                               ModelRouteProto* route) {
   route->set_model_session_id(model_sess_id);
-  for (auto iter : session_table_.at(model_sess_id)->backend_weights) {
+  route->set_session_index(SessionIndexer::Singleton().GetIndex(
+      model_sess_id));
+  ModelSession model_sess;
+  ParseModelSession(model_sess_id, &model_sess);
+  if (model_sess.image_height() > 0) {
+    route->set_image_height(model_sess.image_height());
+    route->set_image_width(model_sess.image_width());
+  } else {
+    auto info = ModelDatabase::Singleton().GetModelInfo(
+        ModelSessionToModelID(model_sess));
+    if (info != nullptr) {
+      route->set_image_height(info->image_height);
+      route->set_image_width(info->image_width);
+    }
+  }
+  auto session_info = session_table_.at(model_sess_id);
+  route->set_frontend_preprocess(session_info->frontend_preprocess &&
+                                 route->image_height() > 0);
+  for (auto iter : session_info->backend_weights) {
     auto backend_rate = route->add_backend_rate();
     backends_.at(iter.first)->GetInfo(backend_rate->mutable_info());
     backend_rate->set_throughput(iter.second);
   }
+  auto group_iter = variant_groups_.find(model_sess_id);
+  if (group_iter != variant_groups_.end()) {
+    auto const& group = group_iter->second;
+    for (size_t i = 0; i < group.variant_sess_ids.size(); ++i) {
+      auto variant_share = route->add_variant_share();
+      variant_share->set_model_session_id(group.variant_sess_ids[i]);
+      variant_share->set_share(group.shares[i]);
+    }
+  }
+}
+
+double Scheduler::GetMaxThroughput(const ModelSession& model_sess) {
+  if (backends_.empty()) {
+    return 0.;
+  }
+  auto backend = backends_.begin()->second;
+  auto profile = ModelDatabase::Singleton().GetModelProfile(
+      backend->gpu_device(), backend->gpu_uuid(),
+      ModelSessionToProfileID(model_sess));
+  if (profile == nullptr) {
+    return 0.;
+  }
+  return profile->GetMaxThroughput(model_sess.latency_sla()).second;
+}
+
+CtrlStatus Scheduler::SplitCascadeLatency(
+    const ModelSession& fast_sess, const ModelSession& heavy_sess,
+    uint32_t latency_sla_ms, double request_rate, double escalation_rate,
+    uint32_t* fast_sla_ms, uint32_t* heavy_sla_ms) {
+  if (backends_.empty()) {
+    return NOT_ENOUGH_BACKENDS;
+  }
+  // Use the profiles on the GPU of any backend to split the latency SLA
+  auto backend = backends_.begin()->second;
+  auto& model_db = ModelDatabase::Singleton();
+  auto fast_profile = model_db.GetModelProfile(
+      backend->gpu_device(), backend->gpu_uuid(),
+      ModelSessionToProfileID(fast_sess));
+  auto heavy_profile = model_db.GetModelProfile(
+      backend->gpu_device(), backend->gpu_uuid(),
+      ModelSessionToProfileID(heavy_sess));
+  if (fast_profile == nullptr || heavy_profile == nullptr) {
+    return MODEL_NOT_FOUND;
+  }
+  // Same objective as the dynamic programming in ComplexQuery for a chain of
+  // two models: try every split in 1 ms steps and keep the one that needs the
+  // fewest GPUs for the fast workload plus the escalated workload.
+  double rate = std::max(request_rate, 1.);
+  double min_gpus = std::numeric_limits<double>::infinity();
+  for (uint32_t fast_ms = 1; fast_ms < latency_sla_ms; ++fast_ms) {
+    uint32_t heavy_ms = latency_sla_ms - fast_ms;
+    float fast_tp = fast_profile->GetMaxThroughput(fast_ms).second;
+    float heavy_tp = heavy_profile->GetMaxThroughput(heavy_ms).second;
+    if (fast_tp <= 0 || heavy_tp <= 0) {
+      continue;
+    }
+    double gpus = rate / fast_tp + rate * escalation_rate / heavy_tp;
+    if (gpus < min_gpus) {
+      min_gpus = gpus;
+      *fast_sla_ms = fast_ms;
+      *heavy_sla_ms = heavy_ms;
+    }
+  }
+  if (std::isinf(min_gpus)) {
+    LOG(ERROR) << "Cannot split latency SLA " << latency_sla_ms << " ms " <<
+        "between " << ModelSessionToString(fast_sess) << " and " <<
+        ModelSessionToString(heavy_sess);
+    return CTRL_INVALID_LOAD_MODEL_REQUEST;
+  }
+  return CTRL_OK;
+}
+
+void Scheduler::UpdateCascadeEscalation() {
+  for (auto& iter : cascades_) {
+    auto heavy_iter = session_table_.find(iter.first);
+    if (heavy_iter == session_table_.end() ||
+        heavy_iter->second->rps_history.size() < history_len_) {
+      continue;
+    }
+    const auto& heavy_history = heavy_iter->second->rps_history;
+    double heavy_total = std::accumulate(heavy_history.begin(),
+                                         heavy_history.end(), 0.);
+    // The heavy model only sees the sum of the escalations of its cascades,
+    // so they share one escalation rate
+    double fast_total = 0.;
+    bool complete = true;
+    for (const auto& cascade : iter.second) {
+      auto fast_iter = session_table_.find(cascade.fast_model_sess_id);
+      if (fast_iter == session_table_.end() ||
+          fast_iter->second->rps_history.size() < history_len_) {
+        complete = false;
+        break;
+      }
+      const auto& fast_history = fast_iter->second->rps_history;
+      fast_total += std::accumulate(fast_history.begin(),
+                                    fast_history.end(), 0.);
+    }
+    if (!complete || fast_total < 1.) {
+      continue;
+    }
+    double escalation_rate = std::min(heavy_total / fast_total, 1.);
+    for (auto& cascade : iter.second) {
+      cascade.escalation_rate = escalation_rate;
+    }
+    VLOG(1) << "Cascades to " << iter.first << " (" << iter.second.size() <<
+        ") escalation rate: " << escalation_rate;
+  }
 }
 
 void Scheduler::FindBestBackend(
@@ -830,6 +1183,7 @@ void Scheduler::EpochSchedule() {
   std::vector<BackendDelegatePtr> overload_backends;
 
   VLOG(1) << "Epoch schedule";
+  UpdateCascadeEscalation();
   // 1. Adjust the GPU allocation based on the workload
   for (auto iter : session_table_) {
     auto const& model_sess_id = iter.first;
@@ -857,6 +1211,24 @@ void Scheduler::EpochSchedule() {
     //     session_info->rps_history[n - 1] + rps_std, 0.1);
     //double estimate_rps = std::max(rps_mean + rps_std, 0.1);
     double estimate_rps = std::max(session_info->rps_history[n - 1], 0.1);
+    if (session_info->variant_only) {
+      // Variants only get backends when queries are degraded to them
+      estimate_rps = session_info->rps_history[n - 1];
+    }
+    auto cascade_iter = cascades_.find(model_sess_id);
+    if (cascade_iter != cascades_.end()) {
+      // The heavy model of cascades follows the workload of the fast models
+      double escalated_rps = 0.;
+      for (const auto& cascade : cascade_iter->second) {
+        auto fast_iter = session_table_.find(cascade.fast_model_sess_id);
+        if (fast_iter != session_table_.end() &&
+            !fast_iter->second->rps_history.empty()) {
+          escalated_rps += fast_iter->second->rps_history.back() *
+              cascade.escalation_rate;
+        }
+      }
+      estimate_rps = std::max(estimate_rps, escalated_rps);
+    }
     session_info->unassigned_workload = std::max(0., estimate_rps - throughput);
     VLOG(1) << model_sess_id << " estimate rps: " << estimate_rps <<
         " (last: " << session_info->rps_history[n - 1] << ", mean: " <<
@@ -959,7 +1331,17 @@ void Scheduler::EpochSchedule() {
   // 4. Allocate the unassigned workloads to backends that still have space
   AllocateUnassignedWorkloads(&changed_sessions);
 
-  // 5. Update model table to backends and model routes to frontends
+  // 5. Degrade overloaded sessions to cheaper variants
+  if (enable_degrade_) {
+    DegradeOverloadedSessions(&changed_sessions);
+  }
+
+  // 6. Place preprocessing on the tier with spare CPU
+  if (enable_preprocess_placement_) {
+    PlacePreprocessing(&changed_sessions);
+  }
+
+  // 7. Update model table to backends and model routes to frontends
   for (auto iter : backends_) {
     iter.second->UpdateModelTableRpc();
   }
@@ -1026,6 +1408,228 @@ void Scheduler::AllocateUnassignedWorkloads(
   }
 }
 
+void Scheduler::ReleaseThroughput(const std::string& model_sess_id,
+                                  SessionInfoPtr session_info,
+                                  double release) {
+  // Release from the backends with the lowest throughput first, backends
+  // with static configured workload are fixed
+  std::vector<std::pair<uint32_t, double> > adjust_backends;
+  for (auto iter : session_info->backend_weights) {
+    if (backends_.at(iter.first)->workload_id() < 0) {
+      adjust_backends.push_back(iter);
+    }
+  }
+  std::sort(adjust_backends.begin(), adjust_backends.end(),
+            [](std::pair<uint32_t, double> a, std::pair<uint32_t, double> b) {
+              return a.second < b.second;
+            });
+  for (auto iter : adjust_backends) {
+    if (release < 1e-3) {
+      break;
+    }
+    auto backend = backends_.at(iter.first);
+    if (iter.second <= release) {
+      backend->UnloadModel(model_sess_id);
+      session_info->backend_weights.erase(iter.first);
+      release -= iter.second;
+    } else {
+      backend->UpdateModelThroughput(model_sess_id, iter.second - release);
+      session_info->backend_weights[iter.first] = backend->GetModelWeight(
+          model_sess_id);
+      release = 0.;
+    }
+  }
+}
+
+void Scheduler::DegradeOverloadedSessions(
+    std::unordered_set<SessionInfoPtr>* changed_sessions) {
+  double degraded_rps = 0.;
+  for (auto& group_iter : variant_groups_) {
+    auto& group = group_iter.second;
+    // Level 0 is the model session itself, followed by its variants
+    std::vector<std::string> level_ids{group_iter.first};
+    level_ids.insert(level_ids.end(), group.variant_sess_ids.begin(),
+                     group.variant_sess_ids.end());
+    std::vector<SessionInfoPtr> levels;
+    for (auto const& id : level_ids) {
+      auto iter = session_table_.find(id);
+      if (iter == session_table_.end()) {
+        break;
+      }
+      levels.push_back(iter->second);
+    }
+    if (levels.size() != level_ids.size()) {
+      continue;
+    }
+    // Total demand includes the queries already degraded. This assumes the
+    // variants get no queries other than the degraded ones.
+    double demand = 0.;
+    for (auto const& session_info : levels) {
+      if (!session_info->rps_history.empty()) {
+        demand += session_info->rps_history.back();
+      }
+    }
+    if (demand < 1e-3) {
+      continue;
+    }
+    std::vector<double> shares{1.};
+    for (double share : group.shares) {
+      shares.push_back(share);
+      shares[0] -= share;
+    }
+    bool overload = false;
+    bool changed = false;
+    for (size_t i = 0; i + 1 < levels.size(); ++i) {
+      double unassigned = levels[i]->unassigned_workload;
+      if (unassigned < 1e-3) {
+        continue;
+      }
+      overload = true;
+      double level_rps = shares[i] * demand;
+      double shift = std::min(DegradeShift(
+          unassigned, GetMaxThroughput(levels[i]->model_sessions[0]),
+          GetMaxThroughput(levels[i + 1]->model_sessions[0])), level_rps);
+      if (shift < 1e-3) {
+        continue;
+      }
+      // The backends of this level keep serving level_rps - shift
+      ReleaseThroughput(level_ids[i], levels[i], shift - unassigned);
+      levels[i]->unassigned_workload = std::max(0., unassigned - shift);
+      levels[i + 1]->unassigned_workload += shift;
+      shares[i] -= shift / demand;
+      shares[i + 1] += shift / demand;
+      changed_sessions->insert(levels[i]);
+      AllocateUnassignedWorkloads(changed_sessions);
+      num_degrades_->Increase(1);
+      changed = true;
+      LOG(INFO) << "Degrade " << shift << " req/s from " << level_ids[i] <<
+          " to " << level_ids[i + 1];
+    }
+    if (!overload) {
+      // Move queries back one level at a time when there are spare backends
+      for (size_t i = levels.size() - 1; i > 0; --i) {
+        double level_rps = shares[i] * demand;
+        if (level_rps < 1e-3) {
+          continue;
+        }
+        BackendDelegatePtr backend;
+        InstanceInfo inst_info;
+        FindBestBackend(levels[i - 1]->model_sessions[0], level_rps, {},
+                        &backend, &inst_info);
+        if (backend == nullptr) {
+          break;
+        }
+        double recover = std::min(inst_info.throughput, level_rps);
+        levels[i - 1]->unassigned_workload += recover;
+        shares[i] -= recover / demand;
+        shares[i - 1] += recover / demand;
+        AllocateUnassignedWorkloads(changed_sessions);
+        num_recoveries_->Increase(1);
+        changed = true;
+        LOG(INFO) << "Recover " << recover << " req/s from " << level_ids[i] <<
+            " to " << level_ids[i - 1];
+        break;
+      }
+    }
+    for (size_t i = 0; i < group.shares.size(); ++i) {
+      group.shares[i] = std::min(std::max(shares[i + 1], 0.), 1.);
+      degraded_rps += group.shares[i] * demand;
+    }
+    if (changed) {
+      changed_sessions->insert(levels[0]);
+    }
+  }
+  degraded_rps_->Set(static_cast<int64_t>(degraded_rps));
+  VLOG(1) << "Degraded workload: " << degraded_rps << " req/s, " <<
+      num_degrades_->value() << " degrades, " << num_recoveries_->value() <<
+      " recoveries";
+}
+
+void Scheduler::PlacePreprocessing(
+    std::unordered_set<SessionInfoPtr>* changed_sessions) {
+  // Best model session to move to frontends by backend CPU time saved, and
+  // best to move back to backends by frontend CPU time saved, in us per sec
+  SessionInfoPtr to_frontend, to_backend;
+  double max_backend_saving = 0., max_frontend_saving = 0.;
+  std::unordered_set<SessionInfoPtr> visited;
+  for (auto iter : session_table_) {
+    auto session_info = iter.second;
+    if (visited.count(session_info) > 0) {
+      continue;
+    }
+    visited.insert(session_info);
+    if (session_info->backend_weights.empty() ||
+        session_info->rps_history.empty()) {
+      continue;
+    }
+    double backend_util = 0.;
+    BackendDelegatePtr backend;
+    for (auto backend_iter : session_info->backend_weights) {
+      backend = backends_.at(backend_iter.first);
+      backend_util += backend->cpu_utilization();
+    }
+    backend_util /= session_info->backend_weights.size();
+    std::unordered_set<uint32_t> frontend_ids;
+    for (auto const& sub_iter : session_info->session_subscribers) {
+      frontend_ids.insert(sub_iter.second.begin(), sub_iter.second.end());
+    }
+    double frontend_util = 0.;
+    size_t num_frontends = 0;
+    for (auto frontend_id : frontend_ids) {
+      auto frontend = GetFrontend(frontend_id);
+      if (frontend != nullptr) {
+        frontend_util += frontend->cpu_utilization();
+        ++num_frontends;
+      }
+    }
+    if (num_frontends == 0) {
+      continue;
+    }
+    frontend_util /= num_frontends;
+    auto profile = ModelDatabase::Singleton().GetModelProfile(
+        backend->gpu_device(), backend->gpu_uuid(),
+        ModelSessionToProfileID(session_info->model_sessions[0]));
+    if (profile == nullptr) {
+      continue;
+    }
+    double rps = session_info->rps_history.back();
+    if (!session_info->frontend_preprocess) {
+      if (backend_util > FLAGS_cpu_high_util &&
+          frontend_util < FLAGS_cpu_low_util) {
+        double saving = rps * (profile->GetPreprocessLatency() -
+                               profile->GetRawPreprocessLatency());
+        if (saving > max_backend_saving) {
+          max_backend_saving = saving;
+          to_frontend = session_info;
+        }
+      }
+    } else if (frontend_util > FLAGS_cpu_high_util &&
+               backend_util < FLAGS_cpu_low_util) {
+      double saving = rps * profile->GetFrontendPreprocessLatency();
+      if (saving > max_frontend_saving) {
+        max_frontend_saving = saving;
+        to_backend = session_info;
+      }
+    }
+  }
+  if (to_frontend != nullptr) {
+    to_frontend->frontend_preprocess = true;
+    changed_sessions->insert(to_frontend);
+    LOG(INFO) << "Move preprocessing of " <<
+        ModelSessionToString(to_frontend->model_sessions[0]) <<
+        " to frontends, saving " << max_backend_saving <<
+        " us/s of backend CPU";
+  }
+  if (to_backend != nullptr) {
+    to_backend->frontend_preprocess = false;
+    changed_sessions->insert(to_backend);
+    LOG(INFO) << "Move preprocessing of " <<
+        ModelSessionToString(to_backend->model_sessions[0]) <<
+        " back to backends, saving " << max_frontend_saving <<
+        " us/s of frontend CPU";
+  }
+}
+
 void Scheduler::ConsolidateBackends(
     std::unordered_set<SessionInfoPtr>* changed_sessions) {
   std::vector<BackendDelegatePtr> backends;
@@ -109,6 +109,18 @@ class Scheduler : public AsyncRpcServiceBase<AsyncService> {
 
   void ComplexQueryAddEdge(const grpc::ServerContext& ctx,
                            const ComplexQueryAddEdgeRequest& request, RpcReply* reply);
+  /*!
+   * \brief Handles LoadCascade RPC. Splits the latency SLA between the two
+   * stages and loads them as separate model sessions.
+   *
+   * This function acquires mutex_.
+   *
+   * \param ctx RPC server context
+   * \param request Load cascade request
+   * \param reply Reply to RPC
+   */
+  void LoadCascade(const grpc::ServerContext& ctx,
+                   const LoadCascadeRequest& request, LoadCascadeReply* reply);
 
  private:
   /*! \brief Initializes RPC handlers. */
@@ -172,6 +184,17 @@ class Scheduler : public AsyncRpcServiceBase<AsyncService> {
    * \param backend Backend client pointer
    */
   void RemoveFrontend(FrontendDelegatePtr frontend);
+  /*!
+   * \brief Unsubscribes a frontend from a model session, and unloads the
+   * session if no one else subscribes it.
+   *
+   * This function doesn't acquire mutex_.
+   *
+   * \param frontend Frontend client pointer
+   * \param model_sess_id Model session ID
+   */
+  void UnloadModelSession(FrontendDelegatePtr frontend,
+                          const std::string& model_sess_id);
   /*!
    * \brief Get backend rpc client given the node id.
    *
@@ -200,6 +223,99 @@ class Scheduler : public AsyncRpcServiceBase<AsyncService> {
    */
   void GetModelRoute(const std::string& model_session_id,
                      ModelRouteProto* route);
+  /*!
+   * \brief Loads a model session without its variants.
+   *
+   * This function acquires mutex_.
+   *
+   * \param request Load model request.
+   * \param reply Load model reply.
+   */
+  void LoadModelSession(const LoadModelRequest& request,
+                        LoadModelReply* reply);
+  /*!
+   * \brief Registers the cheaper variants of a loaded model session. Variants
+   * get no backends until queries are degraded to them.
+   *
+   * This function doesn't acquire mutex_.
+   *
+   * \param request Load model request with variants.
+   * \param model_sess_id Model session ID of the loaded model session.
+   * \param reply Load model reply to fill in variant routes.
+   * \return CTRL_OK if succeeded, otherwise error code.
+   */
+  CtrlStatus LoadModelVariants(const LoadModelRequest& request,
+                               const std::string& model_sess_id,
+                               LoadModelReply* reply);
+  /*!
+   * \brief Gets the max throughput of a model session on one GPU.
+   *
+   * This function doesn't acquire mutex_.
+   *
+   * \param model_sess Model session.
+   * \return Max throughput, 0 if there is no backend or profile.
+   */
+  double GetMaxThroughput(const ModelSession& model_sess);
+  /*!
+   * \brief Releases throughput from the backends of a model session.
+   *
+   * This function doesn't acquire mutex_.
+   *
+   * \param model_sess_id Model session ID.
+   * \param session_info Session info of the model session.
+   * \param release Requests per second to release.
+   */
+  void ReleaseThroughput(const std::string& model_sess_id,
+                         SessionInfoPtr session_info, double release);
+  /*!
+   * \brief Moves the unassigned workload of overloaded model sessions to
+   * their cheaper variants, and moves queries back when there are spare
+   * backends.
+   *
+   * This function doesn't acquire mutex_.
+   *
+   * \param changed_sessions Output sessions whose routes changed.
+   */
+  void DegradeOverloadedSessions(
+      std::unordered_set<SessionInfoPtr>* changed_sessions);
+  /*!
+   * \brief Moves image preprocessing of model sessions between frontends and
+   * backends, from the tier whose CPU is saturated to the tier with spare
+   * CPU. At most one model session moves in each direction per epoch, so the
+   * utilization reported in the next keep alives reflects the move.
+   *
+   * This function doesn't acquire mutex_.
+   *
+   * \param changed_sessions Output sessions whose routes changed.
+   */
+  void PlacePreprocessing(std::unordered_set<SessionInfoPtr>* changed_sessions);
+  /*!
+   * \brief Splits the latency SLA of a cascade between its fast and heavy
+   * model sessions to minimize the GPUs needed.
+   *
+   * This function doesn't acquire mutex_.
+   *
+   * \param fast_sess Model session of the fast stage.
+   * \param heavy_sess Model session of the heavy stage.
+   * \param latency_sla_ms End-to-end latency SLA in ms.
+   * \param request_rate Requests per second to the cascade.
+   * \param escalation_rate Fraction of requests sent to the heavy stage.
+   * \param fast_sla_ms Latency SLA of the fast stage.
+   * \param heavy_sla_ms Latency SLA of the heavy stage.
+   * \return CTRL_OK if a split exists, otherwise error code.
+   */
+  CtrlStatus SplitCascadeLatency(const ModelSession& fast_sess,
+                                 const ModelSession& heavy_sess,
+                                 uint32_t latency_sla_ms, double request_rate,
+                                 double escalation_rate, uint32_t* fast_sla_ms,
+                                 uint32_t* heavy_sla_ms);
+  /*!
+   * \brief Updates the escalation rate of cascades from the request rates of
+   * their model sessions.
+   *
+   * This function doesn't acquire mutex_.
+   */
+  void UpdateCascadeEscalation();
   /*!
    * \brief Find the best-fit backend to load the model session with workload.
    *
@@ -283,6 +399,23 @@ class Scheduler : public AsyncRpcServiceBase<AsyncService> {
   std::unordered_map<std::string, SessionInfoPtr> session_table_;
   /*! \brief Mapping from complex query ID to ComplexQuery */
   std::unordered_map<std::string, ComplexQuery> complex_queries_;
+  /*!
+   * \brief Mapping from heavy model session ID to the cascades escalating to
+   * it, one per fast model session
+   */
+  std::unordered_map<std::string, std::vector<CascadeInfo> > cascades_;
+  /*! \brief Mapping from model session ID to its cheaper variants */
+  std::unordered_map<std::string, VariantGroup> variant_groups_;
+  /*! \brief Whether to degrade overloaded sessions to cheaper variants */
+  bool enable_degrade_;
+  /*! \brief Number of times queries are moved to a cheaper variant */
+  std::shared_ptr<Counter> num_degrades_;
+  /*! \brief Number of times queries are moved back from a cheaper variant */
+  std::shared_ptr<Counter> num_recoveries_;
+  /*! \brief Requests per second currently served by cheaper variants */
+  std::shared_ptr<Gauge> degraded_rps_;
+  /*! \brief Whether to move preprocessing between frontends and backends */
+  bool enable_preprocess_placement_;
   /*! \brief Mutex for accessing internal data */
   std::mutex mutex_;
 };
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cmath>
+#include <glog/logging.h>
+
+#include "nexus/scheduler/slo_model.h"
+
+DEFINE_double(slo_percentile, 0., "Plan batch sizes and duty cycles for this "
+              "fraction of requests to finish within latency SLA, given "
+              "bursty arrivals and latency variance. 0 plans for the mean "
+              "arrival rate and mean plus std latency");
+DEFINE_double(arrival_dispersion, 1., "Variance to mean ratio of the requests "
+              "arriving in a duty cycle, 1 for Poisson arrivals");
+
+namespace nexus {
+namespace scheduler {
+
+namespace {
+
+/*! \brief Means above this use the normal approximation. */
+const double kMaxExactMean = 500.;
+
+/*! \brief Fraction of requests each of the two miss causes may make late. */
+double SplitMissBudget() {
+  return (1. - FLAGS_slo_percentile) / 2;
+}
+
+} // namespace
+
+double NormalQuantile(double p) {
+  // Acklam's rational approximation, relative error below 1.2e-9
+  static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+                             -2.759285104469687e+02, 1.383577518672690e+02,
+                             -3.066479806614716e+01, 2.506628277459239e+00};
+  static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+                             -1.556989798598866e+02, 6.680131188771972e+01,
+                             -1.328068155288572e+01};
+  static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+                             -2.400758277161838e+00, -2.549732539343734e+00,
+                             4.374664141464968e+00, 2.938163982698783e+00};
+  static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+                             2.445134137142996e+00, 3.754408661907416e+00};
+  const double p_low = 0.02425;
+  CHECK(p > 0. && p < 1.) << "Quantile of p=" << p;
+  if (p < p_low) {
+    double q = std::sqrt(-2 * std::log(p));
+    return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q +
+            c[5]) / ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+  }
+  if (p > 1 - p_low) {
+    return -NormalQuantile(1 - p);
+  }
+  double q = p - 0.5;
+  double r = q * q;
+  return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r +
+          a[5]) * q / (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r +
+                        b[4]) * r + 1);
+}
+
+uint32_t BatchForArrivals(double mean, double dispersion, double miss) {
+  if (mean <= 0.) {
+    return 0;
+  }
+  dispersion = std::max(dispersion, 1.);
+  // Requests beyond batch b are E[(N - b)+] = mean - sum_{j<b} P(N > j), so
+  // add P(N > j) for growing b until the rest is within the budget.
+  // Poisson pmf(k+1) = pmf(k) * mean / (k+1), negative binomial with r
+  // successes of probability 1/dispersion pmf(k+1) = pmf(k) * (k+r) / (k+1) *
+  // (1 - 1/dispersion)
+  double r = 0., fail = 0., pmf;
+  if (dispersion == 1.) {
+    pmf = std::exp(-mean);
+  } else {
+    r = mean / (dispersion - 1);
+    fail = 1 - 1 / dispersion;
+    pmf = std::exp(-r * std::log(dispersion));
+  }
+  double budget = miss * mean;
+  double excess = mean;
+  uint32_t b = 0;
+  if (mean > kMaxExactMean || pmf == 0.) {
+    // Normal approximation, E[(N - b)+] = std * (phi(z) - z * (1 - Phi(z)))
+    // with z = (b - mean) / std
+    double std = std::sqrt(mean * dispersion);
+    b = static_cast<uint32_t>(mean);
+    while (true) {
+      double z = (b - mean) / std;
+      double phi = std::exp(-z * z / 2) / std::sqrt(2 * M_PI);
+      double tail = 0.5 * std::erfc(z / std::sqrt(2.));
+      if (std * (phi - z * tail) <= budget) {
+        break;
+      }
+      ++b;
+    }
+  } else {
+    double cdf = pmf;
+    while (excess > budget && cdf < 1.) {
+      excess -= 1. - cdf;
+      ++b;
+      pmf *= dispersion == 1. ? mean / b : (b - 1 + r) / b * fail;
+      cdf += pmf;
+    }
+  }
+  return std::max(b, 1u);
+}
+
+bool UseSloModel() {
+  CHECK_LT(FLAGS_slo_percentile, 1.) << "slo_percentile must be below 1";
+  return FLAGS_slo_percentile > 0.;
+}
+
+uint32_t SloBatchSize(double arrival_mean) {
+  return BatchForArrivals(arrival_mean, FLAGS_arrival_dispersion,
+                          SplitMissBudget());
+}
+
+double SloMaxArrivalMean(uint32_t batch, uint32_t horizon) {
+  horizon = std::max(horizon, 1u);
+  double lo = 0., hi = batch;
+  for (int i = 0; i < 40; ++i) {
+    double mid = (lo + hi) / 2;
+    if (SloBatchSize(mid * horizon) <= batch * horizon) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  // Margin so that the mean recomputed from a duty cycle maps back to batch
+  return lo * (1 - 1e-6);
+}
+
+double SloLatency(const ModelProfile& profile, uint32_t batch) {
+  return profile.GetLatencyQuantile(batch,
+                                    NormalQuantile(1. - SplitMissBudget()));
+}
+
+} // namespace scheduler
+} // namespace nexus
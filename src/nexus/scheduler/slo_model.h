@@ -0,0 +1,62 @@
+#ifndef NEXUS_SCHEDULER_SLO_MODEL_H_
+#define NEXUS_SCHEDULER_SLO_MODEL_H_
+
+#include <cstdint>
+#include <gflags/gflags.h>
+
+#include "nexus/common/model_db.h"
+
+DECLARE_double(slo_percentile);
+DECLARE_double(arrival_dispersion);
+
+namespace nexus {
+namespace scheduler {
+
+/*! \brief Inverse of the standard normal CDF, for p in (0, 1). */
+double NormalQuantile(double p);
+
+/*!
+ * \brief Computes the smallest batch size b such that the requests beyond b
+ * among the N arriving in a window, E[(N - b)+], are at most a fraction miss
+ * of E[N]. N is Poisson if dispersion is 1, and negative binomial with
+ * variance dispersion * mean if it is larger, which models bursty traffic.
+ * Large means use the normal approximation.
+ * \param mean Expected number of arrivals in the window
+ * \param dispersion Variance to mean ratio of the arrivals in the window
+ * \param miss Fraction of the arrivals allowed beyond the batch
+ * \return batch size, at least 1 if mean is positive
+ */
+uint32_t BatchForArrivals(double mean, double dispersion, double miss);
+
+/*!
+ * \brief Whether batches and duty cycles are planned for --slo_percentile
+ * of the requests on time, instead of for the mean arrival rate.
+ *
+ * The miss budget 1 - --slo_percentile is split evenly between requests
+ * overflowing the batch of their duty cycle, with arrivals modeled by
+ * --arrival_dispersion, and the latency of a full batch exceeding its
+ * planned quantile, with preprocess, forward and postprocess latency taken
+ * as independent normal variables with the profiled mean and std.
+ */
+bool UseSloModel();
+
+/*! \brief Batch size that holds the arrivals in a cycle within the budget. */
+uint32_t SloBatchSize(double arrival_mean);
+
+/*!
+ * \brief Computes the largest expected arrivals per cycle that a batch size
+ * holds within the budget.
+ * \param batch Batch size run once per cycle
+ * \param horizon Number of cycles a request can wait for a batch with room
+ * and still meet its latency SLA. Requests overflowing one batch are then
+ * late only beyond horizon batches of the arrivals over the horizon.
+ */
+double SloMaxArrivalMean(uint32_t batch, uint32_t horizon = 1);
+
+/*! \brief Latency of a batch at its planned quantile in us. */
+double SloLatency(const ModelProfile& profile, uint32_t batch);
+
+} // namespace scheduler
+} // namespace nexus
+
+#endif // NEXUS_SCHEDULER_SLO_MODEL_H_
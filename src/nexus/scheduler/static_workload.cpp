@@ -0,0 +1,158 @@
+#include <cmath>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "nexus/common/model_db.h"
+#include "nexus/scheduler/static_workload.h"
+
+DECLARE_bool(interference_aware);
+
+namespace nexus {
+namespace scheduler {
+
+namespace {
+
+bool Fail(std::string* error, const std::string& reason) {
+  if (error != nullptr) {
+    *error = reason;
+  }
+  return false;
+}
+
+/*!
+ * \brief Sets the forward latency of the models at their batch size,
+ * including co-run slowdown.
+ * \return duty cycle of running the models back to back in us
+ */
+double UpdateForwardLatency(const std::vector<InstanceInfoPtr>& models) {
+  double duty_cycle_us = 0.;
+  for (size_t i = 0; i < models.size(); ++i) {
+    double fwd_lat = models[i]->profile->GetForwardLatency(models[i]->batch);
+    if (FLAGS_interference_aware) {
+      fwd_lat *= CorunSlowdown(models, i);
+    }
+    models[i]->fwd_latency_us = fwd_lat;
+    duty_cycle_us += fwd_lat;
+  }
+  return duty_cycle_us;
+}
+
+} // namespace
+
+InstanceInfoPtr ParseStaticModel(const YAML::Node& model_info,
+                                const std::string& gpu_device,
+                                const std::string& gpu_uuid) {
+  auto inst_info = std::make_shared<InstanceInfo>();
+  std::vector<YAML::Node> sess_infos;
+  if (model_info["share_prefix"]) {
+    // Models sharing a prefix run in the batch of the first one
+    for (const auto& share_model_info : model_info["share_prefix"]) {
+      sess_infos.push_back(share_model_info);
+    }
+  } else {
+    sess_infos.push_back(model_info);
+  }
+  for (const auto& sess_info : sess_infos) {
+    ModelSession sess;
+    sess.set_framework(sess_info["framework"].as<std::string>());
+    sess.set_model_name(sess_info["model_name"].as<std::string>());
+    sess.set_version(sess_info["version"].as<uint32_t>());
+    sess.set_latency_sla(sess_info["latency_sla"].as<uint32_t>());
+    if (model_info["image_height"]) {
+      sess.set_image_height(model_info["image_height"].as<uint32_t>());
+      sess.set_image_width(model_info["image_width"].as<uint32_t>());
+    }
+    inst_info->model_sessions.push_back(sess);
+  }
+  const auto& sess = inst_info->model_sessions[0];
+  inst_info->profile = ModelDatabase::Singleton().GetModelProfile(
+      gpu_device, gpu_uuid, ModelSessionToProfileID(sess));
+  if (inst_info->profile != nullptr) {
+    inst_info->max_batch = inst_info->profile->GetMaxBatch(
+        sess.latency_sla());
+  }
+  inst_info->batch = model_info["batch"].as<uint32_t>();
+  if (model_info["rate"]) {
+    inst_info->workload = model_info["rate"].as<double>();
+  }
+  if (model_info["backup"]) {
+    inst_info->backup = model_info["backup"].as<bool>();
+  }
+  return inst_info;
+}
+
+bool CheckStaticBackend(const std::vector<InstanceInfoPtr>& models,
+                        double* duty_cycle_us, std::string* error) {
+  std::vector<InstanceInfoPtr> active;
+  for (const auto& inst_info : models) {
+    if (inst_info->backup) {
+      continue;
+    }
+    std::string sess_id = ModelSessionToString(inst_info->model_sessions[0]);
+    if (inst_info->profile == nullptr) {
+      return Fail(error, sess_id + " is not profiled on the GPU");
+    }
+    if (inst_info->batch == 0 || inst_info->batch > inst_info->max_batch) {
+      return Fail(error, sess_id + " batch " +
+                  std::to_string(inst_info->batch) + " is not within 1 and " +
+                  "max batch " + std::to_string(inst_info->max_batch));
+    }
+    active.push_back(inst_info);
+  }
+  double duty_cycle = UpdateForwardLatency(active);
+  if (duty_cycle_us != nullptr) {
+    *duty_cycle_us = duty_cycle;
+  }
+  for (const auto& inst_info : active) {
+    const auto& sess = inst_info->model_sessions[0];
+    std::string sess_id = ModelSessionToString(sess);
+    double latency_us = duty_cycle + inst_info->fwd_latency_us +
+        inst_info->profile->GetPreprocessLatency() +
+        inst_info->profile->GetPostprocessLatency();
+    if (latency_us > sess.latency_sla() * 1000.) {
+      return Fail(error, sess_id + " takes up to " +
+                  std::to_string(int(latency_us / 1000)) + " ms");
+    }
+    inst_info->throughput = inst_info->batch * 1e6 / duty_cycle;
+    if (inst_info->throughput < inst_info->workload * (1 - 1e-6)) {
+      return Fail(error, sess_id + " serves only " +
+                  std::to_string(int(inst_info->throughput)) + " of " +
+                  std::to_string(int(std::ceil(inst_info->workload))) +
+                  " req/s");
+    }
+  }
+  return true;
+}
+
+bool PlanStaticBackend(const std::vector<InstanceInfoPtr>& models) {
+  std::vector<InstanceInfoPtr> active;
+  for (const auto& inst_info : models) {
+    if (inst_info->profile == nullptr) {
+      return false;
+    }
+    if (!inst_info->backup) {
+      inst_info->batch = 1;
+      active.push_back(inst_info);
+    }
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    double duty_cycle_us = UpdateForwardLatency(active);
+    for (const auto& inst_info : active) {
+      auto batch = static_cast<uint32_t>(std::ceil(
+          inst_info->workload * duty_cycle_us / 1e6 - 1e-9));
+      if (batch > inst_info->batch) {
+        if (batch > inst_info->max_batch) {
+          return false;
+        }
+        inst_info->batch = batch;
+        changed = true;
+      }
+    }
+  }
+  return CheckStaticBackend(models, nullptr, nullptr);
+}
+
+} // namespace scheduler
+} // namespace nexus
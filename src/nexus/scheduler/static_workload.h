@@ -0,0 +1,62 @@
+#ifndef NEXUS_SCHEDULER_STATIC_WORKLOAD_H_
+#define NEXUS_SCHEDULER_STATIC_WORKLOAD_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+#include "nexus/scheduler/backend_delegate.h"
+
+namespace nexus {
+namespace scheduler {
+
+/*!
+ * \brief Parses a model entry of a backend in a static workload file, as
+ * loaded by BackendDelegate::LoadModel(const YAML::Node&).
+ * \param model_info Model entry, with an optional planned request rate in
+ *   req/s under key rate
+ * \param gpu_device GPU device name to look up the model profile
+ * \param gpu_uuid GPU UUID to look up the model profile
+ * \return instance info with the batch, the planned rate as workload, and a
+ *   null profile if the model is not profiled on the GPU
+ */
+InstanceInfoPtr ParseStaticModel(const YAML::Node& model_info,
+                                const std::string& gpu_device,
+                                const std::string& gpu_uuid);
+
+/*!
+ * \brief Checks that a backend of a static workload meets the latency SLA of
+ * all its models and serves their planned rates.
+ *
+ * A static backend runs the batches of its models back to back, so its duty
+ * cycle is the sum of their forward latencies, inflated by the co-run
+ * slowdowns if --interference_aware is set. A request waits at most a duty
+ * cycle for its batch, and models without a planned rate are only checked
+ * against their latency SLA.
+ * \param models Models loaded on the backend, backup models are skipped
+ * \param duty_cycle_us Output duty cycle in us, can be nullptr
+ * \param error Output reason if infeasible, can be nullptr
+ * \return true if feasible
+ */
+bool CheckStaticBackend(const std::vector<InstanceInfoPtr>& models,
+                        double* duty_cycle_us, std::string* error);
+
+/*!
+ * \brief Sets the smallest batch sizes with which models sharing a static
+ * backend serve their planned rates, and checks the result.
+ *
+ * Batches only grow as the duty cycle grows, so starting from batch 1 the
+ * iteration reaches the shortest duty cycle that serves all rates. If the
+ * models miss their latency SLA at that duty cycle, they do with any other
+ * batch sizes too.
+ * \param models Models to load on the backend, with planned rates as
+ *   workload
+ * \return true if the models fit on one backend
+ */
+bool PlanStaticBackend(const std::vector<InstanceInfoPtr>& models);
+
+} // namespace scheduler
+} // namespace nexus
+
+#endif // NEXUS_SCHEDULER_STATIC_WORKLOAD_H_
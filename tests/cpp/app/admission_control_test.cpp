@@ -0,0 +1,117 @@
+#include <chrono>
+#include <gtest/gtest.h>
+
+#include "nexus/app/admission_control.h"
+
+namespace nexus {
+namespace app {
+
+TEST(TokenBucketTest, RateAndBurst) {
+  auto now = Clock::now();
+  TokenBucket bucket(10., 2., now);
+  uint32_t retry_after_ms = 0;
+  EXPECT_TRUE(bucket.TryAcquire(now, &retry_after_ms));
+  EXPECT_TRUE(bucket.TryAcquire(now, &retry_after_ms));
+  EXPECT_FALSE(bucket.TryAcquire(now, &retry_after_ms));
+  EXPECT_EQ(retry_after_ms, 100u);
+  EXPECT_FALSE(bucket.Full(now));
+
+  now += std::chrono::milliseconds(50);
+  EXPECT_FALSE(bucket.TryAcquire(now, &retry_after_ms));
+  EXPECT_EQ(retry_after_ms, 50u);
+  now += std::chrono::milliseconds(50);
+  EXPECT_TRUE(bucket.TryAcquire(now, &retry_after_ms));
+
+  // Tokens never exceed the burst however long the bucket is idle
+  now += std::chrono::seconds(10);
+  EXPECT_TRUE(bucket.Full(now));
+  EXPECT_TRUE(bucket.TryAcquire(now, &retry_after_ms));
+  EXPECT_TRUE(bucket.TryAcquire(now, &retry_after_ms));
+  EXPECT_FALSE(bucket.TryAcquire(now, &retry_after_ms));
+}
+
+TEST(AdmissionControllerTest, InflightAccounting) {
+  AdmissionController admission;
+  auto now = Clock::now();
+  uint32_t retry_after_ms = 0;
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  }
+  EXPECT_EQ(admission.num_inflight(), 3);
+  admission.Complete(now, 1000);
+  admission.Abandon();
+  EXPECT_EQ(admission.num_inflight(), 1);
+  admission.Complete(now, 1000);
+  EXPECT_EQ(admission.num_inflight(), 0);
+  EXPECT_EQ(admission.num_overloaded(), 0u);
+  EXPECT_EQ(admission.num_rate_limited(), 0u);
+}
+
+TEST(AdmissionControllerTest, ShedsOnBacklog) {
+  AdmissionController admission;
+  admission.SetSlo(100.);
+  admission.SetCapacity(100.);
+  auto now = Clock::now();
+  uint32_t retry_after_ms = 0;
+  ASSERT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  admission.Complete(now, 20000);
+
+  // 20 ms minimum latency plus 10 ms per request in flight
+  for (int i = 0; i < 9; ++i) {
+    EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK) << i;
+  }
+  EXPECT_DOUBLE_EQ(admission.EstimateLatency(now), 110.);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), OVERLOADED);
+  EXPECT_EQ(retry_after_ms, 10u);
+  EXPECT_EQ(admission.num_overloaded(), 1u);
+  EXPECT_EQ(admission.num_inflight(), 9);
+
+  // Rejected requests take no slot, replied and abandoned ones free theirs
+  admission.Abandon();
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  admission.Complete(now, 20000);
+  admission.Complete(now, 20000);
+  EXPECT_DOUBLE_EQ(admission.EstimateLatency(now), 90.);
+
+  // Without a capacity nothing is shed
+  admission.SetCapacity(0.);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+}
+
+TEST(AdmissionControllerTest, SloBelowMinLatency) {
+  AdmissionController admission;
+  admission.SetSlo(100.);
+  admission.SetCapacity(100.);
+  auto now = Clock::now();
+  uint32_t retry_after_ms = 0;
+  ASSERT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  admission.Complete(now, 200000);
+  // Unreachable SLO only sheds on the backlog, not every request
+  EXPECT_DOUBLE_EQ(admission.EstimateLatency(now), 0.);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+}
+
+TEST(AdmissionControllerTest, UserRateLimit) {
+  AdmissionController admission;
+  admission.SetUserRateLimit(1., 2.);
+  auto now = Clock::now();
+  uint32_t retry_after_ms = 0;
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), RATE_LIMITED);
+  EXPECT_EQ(retry_after_ms, 1000u);
+  // Other users have their own buckets
+  EXPECT_EQ(admission.Admit(2, now, &retry_after_ms), CTRL_OK);
+  EXPECT_EQ(admission.num_rate_limited(), 1u);
+  EXPECT_EQ(admission.num_inflight(), 3);
+
+  // Idle users are evicted with a full bucket and start over with one
+  now += std::chrono::seconds(5);
+  EXPECT_EQ(admission.Admit(3, now, &retry_after_ms), CTRL_OK);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), CTRL_OK);
+  EXPECT_EQ(admission.Admit(1, now, &retry_after_ms), RATE_LIMITED);
+}
+
+} // namespace app
+} // namespace nexus
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "nexus/common/flat_map.h"
+
+namespace nexus {
+
+namespace {
+
+/*! \brief Maps every key into 4 home slots to force long probe runs */
+struct CollidingHash {
+  size_t operator()(uint64_t key) const { return key % 4; }
+};
+
+template <typename Map>
+void ExpectSameEntries(const Map& map,
+                       const std::unordered_map<uint64_t, uint64_t>& ref) {
+  ASSERT_EQ(map.size(), ref.size());
+  size_t num_iterated = 0;
+  for (auto const& kv : map) {
+    auto iter = ref.find(kv.first);
+    ASSERT_NE(iter, ref.end()) << "unexpected key " << kv.first;
+    EXPECT_EQ(kv.second, iter->second);
+    ++num_iterated;
+  }
+  EXPECT_EQ(num_iterated, ref.size());
+  for (auto const& kv : ref) {
+    EXPECT_EQ(map.count(kv.first), 1u) << "missing key " << kv.first;
+    EXPECT_EQ(map.at(kv.first), kv.second);
+  }
+}
+
+template <typename Map>
+void RandomOps(Map* map, uint64_t key_range, int num_ops) {
+  std::unordered_map<uint64_t, uint64_t> ref;
+  std::mt19937_64 rng(42);
+  for (int i = 0; i < num_ops; ++i) {
+    uint64_t key = rng() % key_range;
+    if (rng() % 3 == 0) {
+      EXPECT_EQ(map->erase(key), ref.erase(key));
+    } else {
+      bool inserted = map->emplace(key, i).second;
+      EXPECT_EQ(inserted, ref.emplace(key, i).second);
+    }
+  }
+  ExpectSameEntries(*map, ref);
+}
+
+} // namespace
+
+TEST(FlatMapTest, InsertFindErase) {
+  FlatMap<uint64_t, std::string> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.emplace(1, "a").second);
+  EXPECT_TRUE(map.emplace(2, "b").second);
+  // Existing entries are not overwritten
+  auto ret = map.emplace(1, "c");
+  EXPECT_FALSE(ret.second);
+  EXPECT_EQ(ret.first->second, "a");
+  EXPECT_EQ(map.size(), 2u);
+
+  map[3] = "d";
+  EXPECT_EQ(map.at(3), "d");
+  EXPECT_EQ(map.find(4), map.end());
+  EXPECT_THROW(map.at(4), std::out_of_range);
+
+  EXPECT_EQ(map.erase(2), 1u);
+  EXPECT_EQ(map.erase(2), 0u);
+  EXPECT_EQ(map.count(2), 0u);
+  map.erase(map.find(1));
+  EXPECT_EQ(map.count(1), 0u);
+  EXPECT_EQ(map.size(), 1u);
+  EXPECT_EQ(map.begin()->first, 3u);
+}
+
+TEST(FlatMapTest, RehashKeepsEntries) {
+  FlatMap<uint64_t, uint64_t> map(2);
+  std::unordered_map<uint64_t, uint64_t> ref;
+  // Strided IDs, as query IDs of one frontend are
+  for (uint64_t i = 0; i < 1000; ++i) {
+    map.emplace(i * 64, i);
+    ref.emplace(i * 64, i);
+  }
+  ExpectSameEntries(map, ref);
+
+  map.reserve(10000);
+  ExpectSameEntries(map, ref);
+}
+
+TEST(FlatMapTest, ClearKeepsMapUsable) {
+  FlatMap<uint64_t, uint64_t> map;
+  for (uint64_t i = 0; i < 100; ++i) {
+    map.emplace(i, i);
+  }
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+  EXPECT_EQ(map.count(5), 0u);
+  map.emplace(5, 6);
+  EXPECT_EQ(map.at(5), 6u);
+  EXPECT_EQ(map.size(), 1u);
+}
+
+TEST(FlatMapTest, RandomOps) {
+  FlatMap<uint64_t, uint64_t> map;
+  RandomOps(&map, 500, 20000);
+}
+
+TEST(FlatMapTest, RandomOpsWithCollisions) {
+  // Every erase shifts back long probe runs that wrap around the slot array
+  FlatMap<uint64_t, uint64_t, CollidingHash> map;
+  RandomOps(&map, 200, 5000);
+}
+
+} // namespace nexus
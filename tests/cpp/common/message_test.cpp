@@ -0,0 +1,192 @@
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "nexus/common/message.h"
+
+namespace nexus {
+
+namespace {
+
+MessageHeader EncodedHeader(uint32_t version, uint32_t flags, uint32_t type,
+                            uint32_t body_length, char* buffer) {
+  *((uint32_t*) buffer) = htonl(NEXUS_SERVICE_MAGIC_NUMBER);
+  *((uint32_t*) (buffer + 4)) = htonl(
+      (version << 24) | (flags << 16) | type);
+  *((uint32_t*) (buffer + 8)) = htonl(body_length);
+  MessageHeader header;
+  header.magic_number = NEXUS_SERVICE_MAGIC_NUMBER;
+  header.msg_type = (version << 24) | (flags << 16) | type;
+  header.body_length = body_length;
+  return header;
+}
+/*! \brief Copies msg into a new inbound message as a connection would. */
+std::shared_ptr<Message> Receive(const Message& msg) {
+  MessageHeader header;
+  if (!DecodeHeader(msg.data(), &header)) {
+    return nullptr;
+  }
+  std::shared_ptr<Message> received(new Message(header));
+  memcpy(received->payload(), msg.payload(), msg.payload_length());
+  return received;
+}
+
+std::shared_ptr<Message> MessageWithBody(const std::string& body,
+                                         TimePoint deadline) {
+  std::shared_ptr<Message> msg(
+      new Message(kBackendRequest, body.size(), deadline));
+  memcpy(msg->body(), body.data(), body.size());
+  return msg;
+}
+
+std::string Body(const Message& msg) {
+  return std::string(msg.body(), msg.body_length());
+}
+
+} // namespace
+
+TEST(MessageTest, DecodeHeader) {
+  char buffer[MESSAGE_HEADER_SIZE];
+  MessageHeader header;
+
+  EncodedHeader(0, 0, kUserRequest, 100, buffer);
+  ASSERT_TRUE(DecodeHeader(buffer, &header));
+  EXPECT_EQ(header.msg_type, static_cast<uint32_t>(kUserRequest));
+  EXPECT_EQ(header.body_length, 100u);
+  EXPECT_TRUE(DecodeHeader(buffer, &header, 0));
+
+  // Version 1 with extensions, only accepted on internal connections
+  EncodedHeader(1, kHeaderDeadline | kHeaderCompressed, kBackendRequest, 12,
+                buffer);
+  EXPECT_TRUE(DecodeHeader(buffer, &header));
+  EXPECT_FALSE(DecodeHeader(buffer, &header, 0));
+
+  // Extensions need version 1
+  EncodedHeader(0, kHeaderDeadline, kBackendRequest, 100, buffer);
+  EXPECT_FALSE(DecodeHeader(buffer, &header));
+  // Unknown version and flags
+  EncodedHeader(MESSAGE_HEADER_VERSION + 1, 0, kBackendRequest, 100, buffer);
+  EXPECT_FALSE(DecodeHeader(buffer, &header));
+  EncodedHeader(1, 1 << 7, kBackendRequest, 100, buffer);
+  EXPECT_FALSE(DecodeHeader(buffer, &header));
+  // Payload shorter than the extensions it announces
+  EncodedHeader(1, kHeaderDeadline | kHeaderCompressed, kBackendRequest, 11,
+                buffer);
+  EXPECT_FALSE(DecodeHeader(buffer, &header));
+  // Bad magic number
+  EncodedHeader(0, 0, kUserRequest, 100, buffer);
+  buffer[0] = 0;
+  EXPECT_FALSE(DecodeHeader(buffer, &header));
+}
+
+TEST(MessageTest, EncodeHeader) {
+  Message plain(kUserReply, 10);
+  MessageHeader header;
+  ASSERT_TRUE(DecodeHeader(plain.data(), &header, 0));
+  EXPECT_EQ(header.msg_type, static_cast<uint32_t>(kUserReply));
+  EXPECT_EQ(header.body_length, 10u);
+  EXPECT_FALSE(plain.has_deadline());
+  EXPECT_EQ(plain.deadline(), TimePoint::max());
+
+  auto msg = MessageWithBody("0123456789",
+                             Clock::now() + std::chrono::seconds(1));
+  ASSERT_TRUE(DecodeHeader(msg->data(), &header));
+  EXPECT_FALSE(DecodeHeader(msg->data(), &header, 0));
+  EXPECT_EQ(header.body_length, 14u);
+
+  auto received = Receive(*msg);
+  ASSERT_NE(received, nullptr);
+  EXPECT_EQ(received->type(), kBackendRequest);
+  EXPECT_TRUE(received->has_deadline());
+  EXPECT_FALSE(received->compressed());
+  EXPECT_EQ(Body(*received), "0123456789");
+}
+
+TEST(MessageTest, StampDeadline) {
+  auto now = Clock::now();
+  auto msg = MessageWithBody("x", now + std::chrono::milliseconds(500));
+  msg->StampDeadline(now);
+  auto received = Receive(*msg);
+  ASSERT_NE(received, nullptr);
+  // Counted from the arrival of the header, so no earlier than it was sent
+  auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+      received->deadline() - now).count();
+  EXPECT_GE(left, 500);
+  EXPECT_LT(left, 1500);
+  EXPECT_FALSE(received->expired(now));
+
+  // Forwarding restamps the time left from the absolute deadline
+  auto deadline = received->deadline();
+  auto later = now + std::chrono::milliseconds(200);
+  received->StampDeadline(later);
+  EXPECT_EQ(received->deadline(), deadline);
+
+  // A passed deadline is sent as no time left
+  auto late = MessageWithBody("x", now - std::chrono::milliseconds(1));
+  late->StampDeadline(now);
+  auto late_received = Receive(*late);
+  ASSERT_NE(late_received, nullptr);
+  EXPECT_TRUE(late_received->expired(Clock::now() +
+                                     std::chrono::milliseconds(1)));
+}
+
+TEST(MessageTest, CompressRoundTrip) {
+  std::string body;
+  for (int i = 0; i < 1000; ++i) {
+    body += "nexus " + std::to_string(i % 10);
+  }
+  auto deadline = Clock::now() + std::chrono::seconds(10);
+  auto msg = MessageWithBody(body, deadline);
+  for (auto codec : {kCodecLz4, kCodecZstd}) {
+    if ((SupportedCodecs() & (1 << codec)) == 0) {
+      EXPECT_EQ(msg->Compress(codec), nullptr);
+      continue;
+    }
+    SCOPED_TRACE("codec " + std::to_string(codec));
+    auto compressed = msg->Compress(codec);
+    ASSERT_NE(compressed, nullptr);
+    EXPECT_TRUE(compressed->compressed());
+    EXPECT_EQ(compressed->codec(), codec);
+    EXPECT_LT(compressed->body_length(), body.size());
+    EXPECT_EQ(compressed->deadline(), deadline);
+    EXPECT_EQ(compressed->Compress(codec), nullptr);
+
+    auto received = Receive(*compressed);
+    ASSERT_NE(received, nullptr);
+    ASSERT_TRUE(received->compressed());
+    auto decompressed = received->Decompress();
+    ASSERT_NE(decompressed, nullptr);
+    EXPECT_FALSE(decompressed->compressed());
+    EXPECT_TRUE(decompressed->has_deadline());
+    EXPECT_EQ(decompressed->type(), kBackendRequest);
+    EXPECT_EQ(Body(*decompressed), body);
+
+    // Uncompressed length that doesn't match the body
+    char* raw_length = received->body() - sizeof(uint32_t);
+    *((uint32_t*) raw_length) = htonl(body.size() + 1);
+    EXPECT_EQ(received->Decompress(), nullptr);
+    // Corrupted body
+    *((uint32_t*) raw_length) = htonl(body.size());
+    memset(received->body(), 0xff, received->body_length());
+    EXPECT_EQ(received->Decompress(), nullptr);
+  }
+  EXPECT_EQ(msg->Decompress(), nullptr);
+}
+
+TEST(MessageTest, DecompressRejectsOversizedLength) {
+  // Peer claims a 4 GB body for a 16-byte compressed one, which must be
+  // rejected before it is allocated
+  char buffer[MESSAGE_HEADER_SIZE];
+  auto header = EncodedHeader(1, kHeaderCompressed, kBackendReply,
+                              8 + 16, buffer);
+  Message msg(header);
+  *((uint32_t*) msg.payload()) = htonl(kCodecLz4);
+  *((uint32_t*) (msg.payload() + 4)) = htonl(0xFFFFFFFF);
+  memset(msg.body(), 0, msg.body_length());
+  EXPECT_EQ(msg.Decompress(), nullptr);
+}
+
+} // namespace nexus
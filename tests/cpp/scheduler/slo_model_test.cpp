@@ -0,0 +1,132 @@
+#include <cmath>
+#include <gtest/gtest.h>
+
+#include "nexus/scheduler/slo_model.h"
+
+namespace nexus {
+namespace scheduler {
+
+namespace {
+
+/*!
+ * \brief E[(N - b)+] by summing the pmf, with N negative binomial of
+ * variance dispersion * mean, or Poisson if dispersion is 1.
+ */
+double ExpectedExcess(double mean, double dispersion, uint32_t b) {
+  double excess = 0.;
+  double max_k = mean + 20 * std::sqrt(mean * dispersion) + 20;
+  for (uint32_t k = b + 1; k < max_k; ++k) {
+    double log_pmf;
+    if (dispersion == 1.) {
+      log_pmf = k * std::log(mean) - mean - std::lgamma(k + 1.);
+    } else {
+      double r = mean / (dispersion - 1);
+      double p = 1 / dispersion;
+      log_pmf = std::lgamma(k + r) - std::lgamma(r) - std::lgamma(k + 1.) +
+                r * std::log(p) + k * std::log(1 - p);
+    }
+    excess += (k - b) * std::exp(log_pmf);
+  }
+  return excess;
+}
+/*! \brief Checks that b is the smallest batch within the miss budget. */
+void ExpectSmallestBatch(double mean, double dispersion, double miss) {
+  uint32_t b = BatchForArrivals(mean, dispersion, miss);
+  SCOPED_TRACE("mean " + std::to_string(mean) + " dispersion " +
+               std::to_string(dispersion) + " batch " + std::to_string(b));
+  ASSERT_GE(b, 1u);
+  EXPECT_LE(ExpectedExcess(mean, dispersion, b), miss * mean * (1 + 1e-9));
+  if (b > 1) {
+    EXPECT_GT(ExpectedExcess(mean, dispersion, b - 1), miss * mean);
+  }
+}
+
+class SloFlags {
+ public:
+  SloFlags(double percentile, double dispersion) :
+      percentile_(FLAGS_slo_percentile),
+      dispersion_(FLAGS_arrival_dispersion) {
+    FLAGS_slo_percentile = percentile;
+    FLAGS_arrival_dispersion = dispersion;
+  }
+
+  ~SloFlags() {
+    FLAGS_slo_percentile = percentile_;
+    FLAGS_arrival_dispersion = dispersion_;
+  }
+
+ private:
+  double percentile_;
+  double dispersion_;
+};
+
+} // namespace
+
+TEST(SloModelTest, NormalQuantile) {
+  EXPECT_NEAR(NormalQuantile(0.5), 0., 1e-9);
+  EXPECT_NEAR(NormalQuantile(0.975), 1.959963985, 1e-6);
+  EXPECT_NEAR(NormalQuantile(0.99), 2.326347874, 1e-6);
+  // Tail region of the approximation
+  EXPECT_NEAR(NormalQuantile(0.001), -3.090232306, 1e-6);
+  EXPECT_NEAR(NormalQuantile(1e-6), -4.753424309, 1e-6);
+  for (double p : {0.01, 0.1, 0.3}) {
+    EXPECT_NEAR(NormalQuantile(p), -NormalQuantile(1 - p), 1e-9);
+  }
+}
+
+TEST(SloModelTest, BatchForPoissonArrivals) {
+  EXPECT_EQ(BatchForArrivals(0., 1., 0.01), 0u);
+  EXPECT_EQ(BatchForArrivals(0.01, 1., 0.01), 1u);
+  for (double mean : {0.5, 3., 10., 42., 200., 499.}) {
+    for (double miss : {0.05, 0.005}) {
+      ExpectSmallestBatch(mean, 1., miss);
+    }
+  }
+}
+
+TEST(SloModelTest, BatchForBurstyArrivals) {
+  for (double mean : {2., 10., 100.}) {
+    for (double dispersion : {1.5, 4.}) {
+      ExpectSmallestBatch(mean, dispersion, 0.01);
+    }
+    EXPECT_GT(BatchForArrivals(mean, 4., 0.01),
+              BatchForArrivals(mean, 1., 0.01));
+  }
+  // Dispersion below 1 is taken as Poisson
+  EXPECT_EQ(BatchForArrivals(10., 0.5, 0.01), BatchForArrivals(10., 1., 0.01));
+}
+
+TEST(SloModelTest, NormalApproximation) {
+  // Past the exact range the batch stays close to the exact answer
+  for (double mean : {1000., 5000.}) {
+    uint32_t b = BatchForArrivals(mean, 1., 0.005);
+    EXPECT_LE(ExpectedExcess(mean, 1., b + 2), 0.005 * mean);
+    EXPECT_GT(ExpectedExcess(mean, 1., b - 2), 0.005 * mean);
+  }
+}
+
+TEST(SloModelTest, MaxArrivalMean) {
+  SloFlags flags(0.99, 1.);
+  ASSERT_TRUE(UseSloModel());
+  for (uint32_t batch : {1u, 4u, 16u, 64u}) {
+    for (uint32_t horizon : {1u, 3u}) {
+      double mean = SloMaxArrivalMean(batch, horizon);
+      EXPECT_GT(mean, 0.);
+      EXPECT_LT(mean, batch);
+      EXPECT_LE(SloBatchSize(mean * horizon), batch * horizon);
+      EXPECT_GT(SloBatchSize(mean * horizon * 1.01), batch * horizon);
+    }
+  }
+  // Waiting for later batches lets each one run fuller
+  EXPECT_GT(SloMaxArrivalMean(16, 3), SloMaxArrivalMean(16, 1));
+
+  // Bursty arrivals fill a batch less, and small batches can't absorb the
+  // bursts at all
+  double poisson_mean = SloMaxArrivalMean(64);
+  FLAGS_arrival_dispersion = 2.;
+  EXPECT_LT(SloMaxArrivalMean(64), poisson_mean);
+  EXPECT_LT(SloMaxArrivalMean(1), 1e-6);
+}
+
+} // namespace scheduler
+} // namespace nexus
@@ -0,0 +1,156 @@
+#include <fstream>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "nexus/common/model_db.h"
+#include "nexus/scheduler/static_workload.h"
+
+DECLARE_bool(interference_aware);
+DECLARE_double(profile_multiplier);
+
+namespace nexus {
+namespace scheduler {
+
+class StaticWorkloadTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    interference_aware_ = FLAGS_interference_aware;
+    profile_multiplier_ = FLAGS_profile_multiplier;
+    FLAGS_interference_aware = false;
+    FLAGS_profile_multiplier = 1.;
+  }
+
+  virtual void TearDown() {
+    FLAGS_interference_aware = interference_aware_;
+    FLAGS_profile_multiplier = profile_multiplier_;
+  }
+  /*!
+   * \brief Loads a profile whose forward latency is base_us + per_batch_us *
+   * batch, with 100 us preprocess and postprocess latency.
+   * \param corun_id Profile ID of a model that slows this one down by 1.5x,
+   *   empty if none
+   */
+  const ModelProfile* MakeProfile(const std::string& model_name,
+                                  float base_us, float per_batch_us,
+                                  const std::string& corun_id = "") {
+    std::string path = ::testing::TempDir() + "static_workload_" +
+                       model_name + ".txt";
+    {
+      std::ofstream fout(path);
+      fout << "tensorflow:" << model_name << ":1\nTEST_GPU\nGPU-0\n" <<
+          "Forward latency\nbatch,latency(us),std(us),memory(B),repeat\n";
+      for (int batch = 1; batch <= 32; ++batch) {
+        fout << batch << "," << base_us + per_batch_us * batch << ",0,0,1\n";
+      }
+      fout << "Preprocess latency (mean,std,repeat)\n100,0,1\n" <<
+          "Postprocess latency (mean,std,repeat)\n100,0,1\n";
+      if (!corun_id.empty()) {
+        fout << "Co-run slowdown (profile_id,mean,std,repeat)\n" <<
+            corun_id << ",1.5,0,1\n";
+      }
+    }
+    profiles_.emplace_back(new ModelProfile(path));
+    return profiles_.back().get();
+  }
+
+  InstanceInfoPtr MakeModel(const std::string& model_name,
+                            const ModelProfile* profile, uint32_t batch,
+                            double rate, uint32_t latency_sla_ms = 50) {
+    ModelSession sess;
+    sess.set_framework("tensorflow");
+    sess.set_model_name(model_name);
+    sess.set_version(1);
+    sess.set_latency_sla(latency_sla_ms);
+    auto inst_info = std::make_shared<InstanceInfo>();
+    inst_info->model_sessions.push_back(sess);
+    inst_info->profile = profile;
+    inst_info->max_batch = 16;
+    inst_info->batch = batch;
+    inst_info->workload = rate;
+    return inst_info;
+  }
+
+  bool interference_aware_;
+  double profile_multiplier_;
+  std::vector<std::unique_ptr<ModelProfile> > profiles_;
+};
+
+TEST_F(StaticWorkloadTest, CheckSingleModel) {
+  auto profile = MakeProfile("a", 1000, 1000);
+  double duty_cycle_us = 0.;
+  std::string error;
+  // Duty cycle 5 ms serves 800 req/s, and a request takes up to 10.2 ms
+  auto model = MakeModel("a", profile, 4, 700.);
+  EXPECT_TRUE(CheckStaticBackend({model}, &duty_cycle_us, &error)) << error;
+  EXPECT_DOUBLE_EQ(duty_cycle_us, 5000.);
+  EXPECT_DOUBLE_EQ(model->throughput, 800.);
+
+  model->workload = 900.;
+  EXPECT_FALSE(CheckStaticBackend({model}, nullptr, &error));
+  EXPECT_NE(error.find("serves only 800 of 900 req/s"), std::string::npos)
+      << error;
+
+  model = MakeModel("a", profile, 4, 0., 10);
+  EXPECT_FALSE(CheckStaticBackend({model}, nullptr, &error));
+  EXPECT_NE(error.find("takes up to 10 ms"), std::string::npos) << error;
+}
+
+TEST_F(StaticWorkloadTest, CheckRejectsInvalidModels) {
+  auto profile = MakeProfile("a", 1000, 1000);
+  std::string error;
+  EXPECT_FALSE(CheckStaticBackend({MakeModel("a", profile, 0, 0.)}, nullptr,
+                                  &error));
+  EXPECT_FALSE(CheckStaticBackend({MakeModel("a", profile, 17, 0.)}, nullptr,
+                                  &error));
+  EXPECT_NE(error.find("max batch 16"), std::string::npos) << error;
+  auto unprofiled = MakeModel("b", nullptr, 1, 0.);
+  EXPECT_FALSE(CheckStaticBackend({unprofiled}, nullptr, &error));
+  EXPECT_NE(error.find("not profiled"), std::string::npos) << error;
+
+  // Backup models are not run, so they are not checked
+  unprofiled->backup = true;
+  double duty_cycle_us = 0.;
+  EXPECT_TRUE(CheckStaticBackend({MakeModel("a", profile, 1, 0.), unprofiled},
+                                 &duty_cycle_us, &error)) << error;
+  EXPECT_DOUBLE_EQ(duty_cycle_us, 2000.);
+}
+
+TEST_F(StaticWorkloadTest, CheckCorunSlowdown) {
+  auto profile_a = MakeProfile("a", 1000, 1000, "tensorflow:b:1");
+  auto profile_b = MakeProfile("b", 2000, 500);
+  auto a = MakeModel("a", profile_a, 2, 0.);
+  auto b = MakeModel("b", profile_b, 2, 0.);
+  double duty_cycle_us = 0.;
+  std::string error;
+  ASSERT_TRUE(CheckStaticBackend({a, b}, &duty_cycle_us, &error)) << error;
+  EXPECT_DOUBLE_EQ(duty_cycle_us, 6000.);
+
+  FLAGS_interference_aware = true;
+  ASSERT_TRUE(CheckStaticBackend({a, b}, &duty_cycle_us, &error)) << error;
+  EXPECT_DOUBLE_EQ(a->fwd_latency_us, 4500.);
+  EXPECT_DOUBLE_EQ(b->fwd_latency_us, 3000.);
+  EXPECT_DOUBLE_EQ(duty_cycle_us, 7500.);
+}
+
+TEST_F(StaticWorkloadTest, PlanSmallestBatches) {
+  auto a = MakeModel("a", MakeProfile("a", 1000, 1000), 0, 400.);
+  auto b = MakeModel("b", MakeProfile("b", 2000, 500), 0, 200.);
+  // Batches (1, 1) run in 4.5 ms, so a needs 2 and b 1; then 5.5 ms needs
+  // (3, 2), which run in 7 ms and still need (3, 2)
+  ASSERT_TRUE(PlanStaticBackend({a, b}));
+  EXPECT_EQ(a->batch, 3u);
+  EXPECT_EQ(b->batch, 2u);
+  double duty_cycle_us = 0.;
+  EXPECT_TRUE(CheckStaticBackend({a, b}, &duty_cycle_us, nullptr));
+  EXPECT_DOUBLE_EQ(duty_cycle_us, 7000.);
+
+  // At 1000 req/s a needs batches of 1000 * (2 + b) ms, which never catch up
+  a->workload = 1000.;
+  EXPECT_FALSE(PlanStaticBackend({a, b}));
+  EXPECT_FALSE(PlanStaticBackend({a, MakeModel("c", nullptr, 0, 1.)}));
+}
+
+} // namespace scheduler
+} // namespace nexus
@@ -3,6 +3,8 @@
 #include <gtest/gtest.h>
 
 DECLARE_string(model_root);
+// Defined by the scheduler, which sch_info.cpp reads
+DEFINE_int32(avg_interval, 10, "Moving average interval for backend rate");
 
 int main(int argc, char ** argv) {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <iterator>
+#include <opencv2/opencv.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "nexus/common/image.h"
+
+DEFINE_string(image_dir, "tests/data/images", "Directory of JPEG images");
+DEFINE_int32(frame_height, 1080, "Images are resized to camera frames of "
+             "this height and encoded again, kept as they are if 0");
+DEFINE_int32(frame_width, 1920, "Width of the camera frames");
+DEFINE_int32(quality, 90, "JPEG quality of the camera frames");
+DEFINE_string(input_sizes, "224,300", "Model input sizes to decode for");
+DEFINE_int32(windows, 0, "If positive, decode for this many windows of a "
+             "quarter of the frame each instead of the whole frame");
+DEFINE_int32(iterations, 20, "Number of decodes per image and input size");
+DEFINE_double(max_extra_error, 2.0, "Allowed increase of the mean absolute "
+              "pixel error of the model input over full resolution decode");
+
+namespace nexus {
+
+/*!
+ * \brief Compares decoding camera frames at full resolution against
+ * decoding them at the reduced resolution picked for the model input, both
+ * followed by the resize ImagePreprocessor does.
+ *
+ * The accuracy of both paths is the mean absolute pixel error of the model
+ * input against a reference made by area interpolation from the full
+ * resolution frame. Reduced decode stays within tolerance if it adds at most
+ * --max_extra_error to the error of the full resolution path.
+ */
+class BenchDecode {
+ public:
+  BenchDecode() {
+    for (boost::filesystem::directory_iterator it(FLAGS_image_dir), end;
+         it != end; ++it) {
+      std::ifstream fin(it->path().string(), std::ios::binary);
+      std::string data((std::istreambuf_iterator<char>(fin)),
+                       std::istreambuf_iterator<char>());
+      if (FLAGS_frame_height > 0) {
+        cv::Mat img = cv::imdecode(
+            cv::Mat(1, data.size(), CV_8UC1, &data[0]), cv::IMREAD_COLOR);
+        if (!img.data) {
+          continue;
+        }
+        cv::Mat frame;
+        cv::resize(img, frame, cv::Size(FLAGS_frame_width,
+                                        FLAGS_frame_height));
+        std::vector<uchar> buf;
+        cv::imencode(".jpg", frame, buf,
+                     {cv::IMWRITE_JPEG_QUALITY, FLAGS_quality});
+        data.assign(buf.begin(), buf.end());
+      }
+      ImageProto image;
+      image.set_format(ImageProto::JPEG);
+      image.set_color(true);
+      image.set_data(data);
+      images_.push_back(image);
+    }
+    CHECK(!images_.empty()) << "No images in " << FLAGS_image_dir;
+  }
+
+  bool Run(int input_size) {
+    cv::Size size(input_size, input_size);
+    double full_us = 0., reduced_us = 0.;
+    double full_err = 0., reduced_err = 0.;
+    int scale_denom = 1;
+    for (const auto& image : images_) {
+      // Also warms up the decoder
+      cv::Mat full_img = DecodeImage(image, CO_BGR);
+      DecodeTarget target = MakeTarget(full_img.size(), size);
+      std::vector<cv::Mat> full_inputs;
+      auto beg = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < FLAGS_iterations; ++i) {
+        cv::Mat img = DecodeImage(image, CO_BGR);
+        full_inputs = Resize(img, target, 1);
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      full_us += Micros(beg, end);
+      std::vector<cv::Mat> reduced_inputs;
+      cv::Size full_size;
+      beg = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < FLAGS_iterations; ++i) {
+        cv::Mat img = DecodeImage(image, CO_BGR, target, &scale_denom,
+                                  &full_size);
+        reduced_inputs = Resize(img, target, scale_denom);
+      }
+      end = std::chrono::high_resolution_clock::now();
+      reduced_us += Micros(beg, end);
+
+      for (size_t i = 0; i < target.regions.size(); ++i) {
+        cv::Mat ref;
+        cv::resize(full_img(target.regions[i]), ref, size, 0, 0,
+                   cv::INTER_AREA);
+        full_err += MeanAbsError(full_inputs[i], ref);
+        reduced_err += MeanAbsError(reduced_inputs[i], ref);
+      }
+    }
+    double n = images_.size();
+    double num_inputs = n * std::max(FLAGS_windows, 1);
+    full_us /= n * FLAGS_iterations;
+    reduced_us /= n * FLAGS_iterations;
+    full_err /= num_inputs;
+    reduced_err /= num_inputs;
+    bool ok = reduced_err <= full_err + FLAGS_max_extra_error;
+    std::cout << "input " << input_size << "x" << input_size <<
+        ", scale 1/" << scale_denom << " (last image): full " << full_us <<
+        " us, reduced " << reduced_us << " us, speedup " <<
+        full_us / reduced_us << "x; mean abs error full " << full_err <<
+        ", reduced " << reduced_err <<
+        (ok ? " (ok)" : " (exceeds tolerance)") << std::endl;
+    return ok;
+  }
+
+ private:
+  static double Micros(std::chrono::high_resolution_clock::time_point beg,
+                       std::chrono::high_resolution_clock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        end - beg).count();
+  }
+
+  static DecodeTarget MakeTarget(cv::Size full_size, cv::Size size) {
+    DecodeTarget target;
+    target.size = size;
+    if (FLAGS_windows <= 0) {
+      target.regions.emplace_back(0, 0, full_size.width, full_size.height);
+      return target;
+    }
+    int width = full_size.width / 4;
+    int height = full_size.height / 4;
+    for (int i = 0; i < FLAGS_windows; ++i) {
+      int x = (i * width / 2) % (full_size.width - width);
+      int y = (i * height / 2) % (full_size.height - height);
+      target.regions.emplace_back(x, y, width, height);
+    }
+    return target;
+  }
+
+  /*! \brief Crops and resizes the regions like ImagePreprocessor. */
+  static std::vector<cv::Mat> Resize(const cv::Mat& img,
+                                     const DecodeTarget& target,
+                                     int scale_denom) {
+    std::vector<cv::Mat> inputs;
+    for (const auto& rect : target.regions) {
+      cv::Mat crop = img(cv::Rect(
+          rect.x / scale_denom, rect.y / scale_denom,
+          rect.width / scale_denom, rect.height / scale_denom));
+      cv::Mat input;
+      cv::resize(crop, input, target.size);
+      inputs.push_back(input);
+    }
+    return inputs;
+  }
+
+  static double MeanAbsError(const cv::Mat& a, const cv::Mat& b) {
+    cv::Mat diff;
+    cv::absdiff(a, b, diff);
+    cv::Scalar err = cv::mean(diff);
+    return (err[0] + err[1] + err[2]) / 3;
+  }
+
+  std::vector<ImageProto> images_;
+};
+
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  nexus::BenchDecode bench;
+  bool ok = true;
+  std::stringstream ss(FLAGS_input_sizes);
+  std::string size;
+  while (std::getline(ss, size, ',')) {
+    ok = bench.Run(std::stoi(size)) && ok;
+  }
+  return ok ? 0 : 1;
+}
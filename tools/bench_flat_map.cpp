@@ -0,0 +1,100 @@
+#include <chrono>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <yaml-cpp/yaml.h>
+
+#include "nexus/backend/task.h"
+#include "nexus/common/flat_map.h"
+
+DEFINE_int32(inflight, 64, "Number of outstanding queries in the table");
+DEFINE_int32(num_requests, 2000000, "Number of requests");
+
+namespace nexus {
+
+/*!
+ * \brief Benchmarks the per-request pattern of the bookkeeping tables: insert
+ * the query when it's sent, look it up and erase it when the result comes
+ * back, with a fixed number of queries in flight.
+ */
+template <typename Map>
+double BenchTable(int inflight, int num_requests) {
+  Map table;
+  auto value = std::make_shared<int>(0);
+  uint64_t sum = 0;
+  auto beg = std::chrono::high_resolution_clock::now();
+  for (uint64_t qid = 0; qid < static_cast<uint64_t>(num_requests); ++qid) {
+    table.emplace(qid, value);
+    if (qid >= static_cast<uint64_t>(inflight)) {
+      uint64_t done = qid - inflight;
+      auto iter = table.find(done);
+      CHECK(iter != table.end());
+      sum += iter->first;
+      table.erase(iter);
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  CHECK_GT(sum + 1, 0);
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - beg).count() / static_cast<double>(num_requests);
+}
+
+/*! \brief Benchmarks setting and reading the image size attributes. */
+double BenchYamlAttrs(int num_requests) {
+  int64_t sum = 0;
+  auto beg = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_requests; ++i) {
+    YAML::Node attrs;
+    attrs["im_height"] = i;
+    attrs["im_width"] = i + 1;
+    sum += attrs["im_height"].as<int>() + attrs["im_width"].as<int>();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  CHECK_NE(sum, -1);
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - beg).count() / static_cast<double>(num_requests);
+}
+
+double BenchStructAttrs(int num_requests) {
+  int64_t sum = 0;
+  auto beg = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_requests; ++i) {
+    backend::TaskAttrs attrs;
+    attrs.im_height = i;
+    attrs.im_width = i + 1;
+    // Keep the compiler from folding the loop
+    volatile int* height = &attrs.im_height;
+    sum += *height + attrs.im_width;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  CHECK_NE(sum, -1);
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - beg).count() / static_cast<double>(num_requests);
+}
+
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  using Value = std::shared_ptr<int>;
+  double unordered_ns = nexus::BenchTable<
+      std::unordered_map<uint64_t, Value> >(FLAGS_inflight,
+                                            FLAGS_num_requests);
+  double flat_ns = nexus::BenchTable<nexus::FlatMap<uint64_t, Value> >(
+      FLAGS_inflight, FLAGS_num_requests);
+  double yaml_ns = nexus::BenchYamlAttrs(FLAGS_num_requests);
+  double struct_ns = nexus::BenchStructAttrs(FLAGS_num_requests);
+  std::cout << "inflight: " << FLAGS_inflight << ", requests: " <<
+      FLAGS_num_requests << std::endl;
+  std::cout << "unordered_map: " << unordered_ns << " ns/request" << std::endl;
+  std::cout << "FlatMap:       " << flat_ns << " ns/request" << std::endl;
+  std::cout << "YAML attrs:    " << yaml_ns << " ns/request" << std::endl;
+  std::cout << "struct attrs:  " << struct_ns << " ns/request" << std::endl;
+}
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/async_log.h"
+
+DEFINE_int32(threads, 8, "Number of worker threads");
+DEFINE_int32(num_requests, 100000, "Number of requests per thread");
+DEFINE_int32(work_us, 20, "CPU time spent on each request");
+
+namespace nexus {
+
+/*!
+ * \brief Overload test of logging on the request path, where every request
+ * logs an error like a worker that cannot find a backup server.
+ *
+ * Run with stderr redirected to a file or a terminal; glog output is the
+ * cost being measured.
+ */
+class BenchLogging {
+ public:
+  enum Mode {
+    SYNC = 0,
+    ASYNC = 1,
+    RATE_LIMITED = 2,
+  };
+
+  void Run(Mode mode, int threads, int num_requests) {
+    std::vector<std::vector<uint64_t> > lats(threads);
+    std::vector<std::thread> workers;
+    auto beg = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t]() {
+          lats[t].reserve(num_requests);
+          for (int i = 0; i < num_requests; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            Work();
+            if (mode == RATE_LIMITED) {
+              LOG_EVERY_MS(ERROR, 1000) << "Cannot find query context for " <<
+                  "query " << i;
+            } else {
+              LOG(ERROR) << "Cannot find query context for query " << i;
+            }
+            auto end = std::chrono::steady_clock::now();
+            lats[t].push_back(std::chrono::duration_cast<
+                              std::chrono::nanoseconds>(end - start).count());
+          }
+        });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::vector<uint64_t> all;
+    for (auto& thread_lats : lats) {
+      all.insert(all.end(), thread_lats.begin(), thread_lats.end());
+    }
+    std::sort(all.begin(), all.end());
+    double sec = std::chrono::duration_cast<std::chrono::microseconds>(
+        end - beg).count() / 1e6;
+    static const char* names[] = {"sync", "async", "rate limited"};
+    std::cout << names[mode] << ": " << all.size() / sec << " req/s, " <<
+        "p50 " << all[all.size() / 2] / 1e3 << " us, p99 " <<
+        all[all.size() * 99 / 100] / 1e3 << " us, max " << all.back() / 1e3 <<
+        " us" << std::endl;
+  }
+
+ private:
+  void Work() {
+    auto until = std::chrono::steady_clock::now() +
+                 std::chrono::microseconds(FLAGS_work_us);
+    while (std::chrono::steady_clock::now() < until) {
+    }
+  }
+};
+
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  nexus::BenchLogging bench;
+  bench.Run(nexus::BenchLogging::SYNC, FLAGS_threads, FLAGS_num_requests);
+  FLAGS_async_log = true;
+  nexus::InitAsyncLogging();
+  bench.Run(nexus::BenchLogging::ASYNC, FLAGS_threads, FLAGS_num_requests);
+  bench.Run(nexus::BenchLogging::RATE_LIMITED, FLAGS_threads,
+            FLAGS_num_requests);
+  auto volume = nexus::GetLogVolume();
+  std::cout << "log volume: " << volume.logged << " written, " <<
+      volume.dropped << " dropped, " << volume.suppressed << " suppressed" <<
+      std::endl;
+  nexus::ShutdownAsyncLogging();
+}
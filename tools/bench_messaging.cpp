@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+#include "nexus/common/backend_pool.h"
+#include "nexus/common/connection.h"
+#include "nexus/common/server_base.h"
+
+DEFINE_string(port, "9099", "Port of the loopback echo server");
+DEFINE_int32(connections, 4, "Number of client connections");
+DEFINE_int32(inflight, 32, "Number of messages in flight per connection");
+DEFINE_int32(msg_size, 256, "Message body size in bytes");
+DEFINE_int32(duration_sec, 10, "Duration of the benchmark in sec");
+DEFINE_int32(bulk_size, 0, "If positive, connect as backend sessions and mix "
+             "in messages of this size to measure small message latency");
+DEFINE_int32(bulk_inflight, 4, "Number of bulk messages in flight per "
+             "connection");
+DEFINE_int32(link_mbps, 0, "If positive, clients reach the echo server "
+             "through a link throttled to this many Mbit/s each way, and the "
+             "latency of every message is reported");
+DEFINE_int32(payload_alphabet, 256, "Message bodies are random bytes drawn "
+             "from this many values; smaller alphabets compress better");
+DECLARE_string(compression);
+DECLARE_string(io_engine);
+DECLARE_int32(backend_lanes);
+
+namespace nexus {
+
+/*! \brief Server that sends every message back on its connection. */
+class EchoServer : public ServerBase, public MessageHandler {
+ public:
+  EchoServer(const std::string& port) : ServerBase(port) {}
+
+  std::shared_ptr<Connection> HandleAccept(
+      boost::asio::ip::tcp::socket socket) final {
+    auto conn = std::make_shared<Connection>(std::move(socket), this);
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      conns_.push_back(conn);
+    }
+    conn->Start();
+    return conn;
+  }
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    conn->Write(std::move(message));
+  }
+
+  void HandleError(std::shared_ptr<Connection>,
+                   boost::system::error_code ec) final {
+    LOG(ERROR) << "Server connection error: " << ec.message();
+  }
+
+ private:
+  std::vector<std::shared_ptr<Connection> > conns_;
+  std::mutex mu_;
+};
+
+class BenchSession : public Connection {
+ public:
+  BenchSession(boost::asio::io_context& io_context, MessageHandler* handler) :
+      Connection(io_context, handler) {}
+
+  void Connect(const std::string& port) {
+    boost::asio::ip::tcp::resolver resolver(socket_.get_executor());
+    boost::asio::connect(socket_, resolver.resolve("127.0.0.1", port));
+    socket_.set_option(boost::asio::ip::tcp::no_delay(true));
+    StartReading();
+    SendHello();
+  }
+};
+
+/*!
+ * \brief Forwards connections on a port to the echo server over a link
+ * throttled to --link_mbps in each direction, standing in for a link
+ * between racks. Every direction of every connection shares the bandwidth.
+ */
+class ThrottledLink {
+ public:
+  ThrottledLink(const std::string& port, const std::string& server_port) :
+      acceptor_(io_context_, boost::asio::ip::tcp::endpoint(
+          boost::asio::ip::tcp::v4(), std::stoi(port))),
+      server_port_(server_port) {}
+
+  void Run() {
+    while (true) {
+      auto client = std::make_shared<boost::asio::ip::tcp::socket>(
+          io_context_);
+      acceptor_.accept(*client);
+      auto server = std::make_shared<boost::asio::ip::tcp::socket>(
+          io_context_);
+      boost::asio::ip::tcp::resolver resolver(io_context_);
+      boost::asio::connect(*server, resolver.resolve("127.0.0.1",
+                                                     server_port_));
+      client->set_option(boost::asio::ip::tcp::no_delay(true));
+      server->set_option(boost::asio::ip::tcp::no_delay(true));
+      std::thread(&ThrottledLink::Forward, this, client, server, &up_).detach();
+      std::thread(&ThrottledLink::Forward, this, server, client,
+                  &down_).detach();
+    }
+  }
+
+ private:
+  struct Direction {
+    std::mutex mu;
+    /*! \brief Time the link finishes sending the bytes queued so far */
+    std::chrono::steady_clock::time_point next_free;
+  };
+
+  void Forward(std::shared_ptr<boost::asio::ip::tcp::socket> from,
+               std::shared_ptr<boost::asio::ip::tcp::socket> to,
+               Direction* dir) {
+    std::vector<char> buf(16384);
+    boost::system::error_code ec;
+    while (true) {
+      size_t n = from->read_some(boost::asio::buffer(buf), ec);
+      if (ec) {
+        break;
+      }
+      std::chrono::steady_clock::time_point send_at;
+      {
+        std::lock_guard<std::mutex> lock(dir->mu);
+        auto transmit = std::chrono::duration_cast<
+          std::chrono::steady_clock::duration>(
+              std::chrono::duration<double, std::micro>(
+                  n * 8. / FLAGS_link_mbps));
+        dir->next_free = std::max(dir->next_free,
+                                  std::chrono::steady_clock::now()) + transmit;
+        send_at = dir->next_free;
+      }
+      std::this_thread::sleep_until(send_at);
+      boost::asio::write(*to, boost::asio::buffer(buf.data(), n), ec);
+      if (ec) {
+        break;
+      }
+    }
+    boost::system::error_code ignored_ec;
+    to->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
+  }
+
+  boost::asio::io_context io_context_;
+  boost::asio::ip::tcp::acceptor acceptor_;
+  std::string server_port_;
+  Direction up_;
+  Direction down_;
+};
+
+/*!
+ * \brief Closed-loop loopback benchmark of Connection. Each client
+ * connection keeps a fixed number of messages in flight to an echo server in
+ * the same process. Reports messages per second and per CPU core, as
+ * measured by the CPU time of the process.
+ *
+ * Run once with --io_engine=asio and once with --io_engine=io_uring. With
+ * --listeners > 1, also reports how the connections spread over listeners.
+ *
+ * With --bulk_size, clients are backend sessions that also keep bulk
+ * messages in flight, and the latency of small messages is reported. Run
+ * with --backend_lanes=1 and > 1 to see the head-of-line blocking of small
+ * messages behind bulk ones.
+ *
+ * With --link_mbps, clients go through a throttled link, and the bytes on
+ * the wire, the CPU time spent on compression and the message latency are
+ * reported. Run with --compression=none, lz4 and zstd, and lower
+ * --payload_alphabet for more compressible bodies.
+ */
+class BenchMessaging : public MessageHandler {
+ public:
+  BenchMessaging() : num_messages_(0), num_bulk_bytes_(0), measuring_(false) {}
+
+  void Run() {
+    // Leaked, the echo server runs until the process exits
+    auto server = new EchoServer(FLAGS_port);
+    std::thread server_thread([server]() { server->Run(); });
+    server_thread.detach();
+    std::string port = FLAGS_port;
+    if (FLAGS_link_mbps > 0) {
+      port = std::to_string(std::stoi(FLAGS_port) + 1);
+      // Leaked as well
+      auto link = new ThrottledLink(port, FLAGS_port);
+      std::thread link_thread([link]() { link->Run(); });
+      link_thread.detach();
+    }
+    boost::asio::io_context io_context;
+    auto work_guard = boost::asio::make_work_guard(io_context);
+    std::thread client_thread([&io_context]() { io_context.run(); });
+
+    std::vector<std::shared_ptr<Connection> > sessions;
+    for (int i = 0; i < FLAGS_connections; ++i) {
+      if (FLAGS_bulk_size > 0) {
+        BackendInfo info;
+        info.set_node_id(i);
+        info.set_ip("127.0.0.1");
+        info.set_server_port(port);
+        info.set_rpc_port("0");
+        auto session = std::make_shared<BackendSession>(info, io_context,
+                                                        this);
+        session->Start();
+        sessions.push_back(session);
+      } else {
+        auto session = std::make_shared<BenchSession>(io_context, this);
+        session->Connect(port);
+        sessions.push_back(session);
+      }
+    }
+    if (FLAGS_bulk_size > 0 || FLAGS_link_mbps > 0) {
+      // Backend sessions connect and links negotiate asynchronously
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    for (auto& session : sessions) {
+      for (int i = 0; i < FLAGS_inflight; ++i) {
+        session->Write(NewMessage(FLAGS_msg_size));
+      }
+      if (FLAGS_bulk_size > 0) {
+        for (int i = 0; i < FLAGS_bulk_inflight; ++i) {
+          session->Write(NewMessage(FLAGS_bulk_size));
+        }
+      }
+    }
+    // Warm up before measuring
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    measuring_ = true;
+    uint64_t beg_msgs = num_messages_;
+    uint64_t beg_bulk_bytes = num_bulk_bytes_;
+    auto beg_cs = GetCompressionStats();
+    double beg_cpu = CpuSeconds();
+    auto beg = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(FLAGS_duration_sec));
+    measuring_ = false;
+    uint64_t msgs = num_messages_ - beg_msgs;
+    uint64_t bulk_bytes = num_bulk_bytes_ - beg_bulk_bytes;
+    double cpu = CpuSeconds() - beg_cpu;
+    double sec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - beg).count() / 1e6;
+    std::cout << FLAGS_io_engine << ": " << msgs / sec << " msg/s, " <<
+        cpu / sec << " cores, " << msgs / cpu << " msg/s per core" <<
+        std::endl;
+    if (FLAGS_link_mbps > 0) {
+      auto cs = GetCompressionStats();
+      cs.raw_bytes -= beg_cs.raw_bytes;
+      cs.wire_bytes -= beg_cs.wire_bytes;
+      cs.num_compressed -= beg_cs.num_compressed;
+      cs.num_skipped -= beg_cs.num_skipped;
+      cs.cpu_us -= beg_cs.cpu_us;
+      std::lock_guard<std::mutex> lock(latency_mu_);
+      std::sort(latencies_us_.begin(), latencies_us_.end());
+      size_t n = latencies_us_.size();
+      std::cout << "compression " << FLAGS_compression << " over " <<
+          FLAGS_link_mbps << " Mbit/s: " << cs.raw_bytes << " -> " <<
+          cs.wire_bytes << " bytes (" << cs.num_compressed <<
+          " compressed, " << cs.num_skipped << " skipped), " <<
+          cs.cpu_us / 1e6 / sec << " cores compressing, latency p50 " <<
+          (n ? latencies_us_[n / 2] : 0) << " us, p99 " <<
+          (n ? latencies_us_[n * 99 / 100] : 0) << " us" << std::endl;
+    } else if (FLAGS_bulk_size > 0) {
+      std::lock_guard<std::mutex> lock(latency_mu_);
+      std::sort(latencies_us_.begin(), latencies_us_.end());
+      size_t n = latencies_us_.size();
+      std::cout << FLAGS_backend_lanes << " lane(s): small message latency " <<
+          "p50 " << (n ? latencies_us_[n / 2] : 0) << " us, p99 " <<
+          (n ? latencies_us_[n * 99 / 100] : 0) << " us, bulk " <<
+          bulk_bytes / sec / 1e6 << " MB/s" << std::endl;
+    }
+    auto listener_stats = server->GetListenerStats();
+    for (size_t i = 0; i < listener_stats.size(); ++i) {
+      std::cout << "listener " << i << " (cpu " << listener_stats[i].cpu <<
+          "): " << listener_stats[i].num_connections << " connections" <<
+          std::endl;
+    }
+
+    for (auto& session : sessions) {
+      session->Stop();
+    }
+    work_guard.reset();
+    io_context.stop();
+    client_thread.join();
+  }
+
+  void HandleMessage(std::shared_ptr<Connection> conn,
+                     std::shared_ptr<Message> message) final {
+    num_messages_.fetch_add(1, std::memory_order_relaxed);
+    if (FLAGS_bulk_size <= 0 && FLAGS_link_mbps <= 0) {
+      conn->Write(std::move(message));
+      return;
+    }
+    if (FLAGS_bulk_size > 0 &&
+        message->body_length() == size_t(FLAGS_bulk_size)) {
+      num_bulk_bytes_.fetch_add(message->length(), std::memory_order_relaxed);
+    } else if (measuring_) {
+      uint64_t sent_us;
+      memcpy(&sent_us, message->body(), sizeof(sent_us));
+      std::lock_guard<std::mutex> lock(latency_mu_);
+      latencies_us_.push_back(NowMicros() - sent_us);
+    }
+    conn->Write(NewMessage(message->body_length()));
+  }
+
+  void HandleError(std::shared_ptr<Connection>,
+                   boost::system::error_code ec) final {
+    LOG(ERROR) << "Client connection error: " << ec.message();
+  }
+
+ private:
+  static uint64_t NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+  /*!
+   * \brief Creates a message whose body starts with the send time, followed
+   * by random bytes from --payload_alphabet values.
+   */
+  static std::shared_ptr<Message> NewMessage(size_t size) {
+    static const std::vector<char> pattern = []() {
+      std::vector<char> bytes(1 << 20);
+      std::mt19937 gen(1);
+      std::uniform_int_distribution<int> dist(
+          0, std::min(std::max(FLAGS_payload_alphabet, 1), 256) - 1);
+      for (auto& b : bytes) {
+        b = char(dist(gen));
+      }
+      return bytes;
+    }();
+    size = std::max(size, sizeof(uint64_t));
+    auto msg = std::make_shared<Message>(kUserRequest, size);
+    size_t fill = std::min(size, pattern.size()) - sizeof(uint64_t);
+    size_t offset = NowMicros() % (pattern.size() - fill);
+    memcpy(msg->body() + sizeof(uint64_t), pattern.data() + offset, fill);
+    uint64_t now_us = NowMicros();
+    memcpy(msg->body(), &now_us, sizeof(now_us));
+    return msg;
+  }
+
+  static double CpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  }
+
+  std::atomic<uint64_t> num_messages_;
+  std::atomic<uint64_t> num_bulk_bytes_;
+  std::atomic<bool> measuring_;
+  std::vector<uint64_t> latencies_us_;
+  std::mutex latency_mu_;
+};
+
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  nexus::BenchMessaging bench;
+  bench.Run();
+  std::_Exit(0);
+}
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <chrono>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+#include "nexus/backend/preprocess.h"
+#include "nexus/common/model_def.h"
+
+DEFINE_string(pipeline, "tensorflow", "Preprocessing pipeline to benchmark: "
+              "tensorflow, ssd_mobilenet, or caffe2");
+DEFINE_int32(height, 224, "Model input height");
+DEFINE_int32(width, 224, "Model input width");
+DEFINE_int32(image_height, 480, "Height of the synthetic image");
+DEFINE_int32(image_width, 640, "Width of the synthetic image");
+DEFINE_int32(iterations, 2000, "Number of iterations");
+DEFINE_int32(windows, 0, "If positive, also compares converting this many "
+             "windows of the image serially and on the preprocess pool");
+
+namespace nexus {
+namespace backend {
+
+/*!
+ * \brief Compares the per-request preprocessing and postprocessing dispatch
+ * before and after specializing the pipeline at model load time.
+ *
+ * The dynamic path mirrors the code it replaced: the model name and model
+ * type are compared as strings for every request, and normalization branches
+ * on every pixel. The bound path calls the function returned by
+ * MakeImageTransform and switches on nothing.
+ */
+class BenchPreprocess {
+ public:
+  BenchPreprocess(const std::string& pipeline, int height, int width) :
+      pipeline_(pipeline) {
+    param_.height = height;
+    param_.width = width;
+    if (pipeline == "tensorflow") {
+      model_name_ = "inception";
+    } else if (pipeline == "ssd_mobilenet") {
+      model_name_ = "ssd_mobilenet";
+      param_.data_type = DT_UINT8;
+    } else if (pipeline == "caffe2") {
+      model_name_ = "resnet50";
+      param_.layout = kLayoutNCHW;
+      param_.channel_order = CO_BGR;
+      param_.norm = kNormMeanValue;
+      float mean[3] = {103.939, 116.779, 123.68};
+      for (int c = 0; c < 3; ++c) {
+        param_.mean[c] = mean[c];
+        mean_value_.push_back(mean[c]);
+      }
+    } else {
+      LOG(FATAL) << "Unknown pipeline " << pipeline;
+    }
+    model_info_["type"] = "classification";
+    out_.resize(static_cast<size_t>(height) * width * 3);
+    transform_ = MakeImageTransform(param_);
+    model_type_ = ParseModelType(model_info_["type"].as<std::string>());
+  }
+
+  double RunDynamic(const cv::Mat& image, int iterations) {
+    int matched = 0;
+    auto beg = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      if (pipeline_ == "caffe2") {
+        PrepareImageNCHW(image, mean_blob_.empty());
+      } else if (model_name_ == "ssd_mobilenet" ||
+                 model_name_ == "ssd_mobilenet_0.75") {
+        cv::Mat resized(param_.height, param_.width, CV_8UC3, out_.data());
+        cv::resize(image, resized, cv::Size(param_.width, param_.height));
+      } else {
+        cv::Mat fimg;
+        image.convertTo(fimg, CV_32FC3);
+        cv::Mat resized(param_.height, param_.width, CV_32FC3, out_.data());
+        cv::resize(fimg, resized, cv::Size(param_.width, param_.height));
+      }
+      if (model_info_["type"].as<std::string>() == "classification") {
+        ++matched;
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    CHECK_EQ(matched, iterations);
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        end - beg).count() / static_cast<double>(iterations);
+  }
+
+  /*!
+   * \brief Converts the windows of one query, serially or on the
+   * PreprocessPool, and returns the latency per query.
+   */
+  double RunWindows(const cv::Mat& image, int num_windows, bool parallel,
+                    int iterations) {
+    std::vector<cv::Rect> windows;
+    int width = image.cols / 4;
+    int height = image.rows / 4;
+    for (int i = 0; i < num_windows; ++i) {
+      windows.emplace_back((i * width / 2) % (image.cols - width),
+                           (i * height / 2) % (image.rows - height),
+                           width, height);
+    }
+    std::vector<std::vector<float> > outs(
+        num_windows, std::vector<float>(out_.size()));
+    auto transform_window = [&](size_t i) {
+      transform_(image(windows[i]), outs[i].data());
+    };
+    auto beg = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      if (parallel) {
+        PreprocessPool::Singleton().ParallelFor(num_windows,
+                                                transform_window);
+      } else {
+        for (int j = 0; j < num_windows; ++j) {
+          transform_window(j);
+        }
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        end - beg).count() / static_cast<double>(iterations);
+  }
+
+  double RunBound(const cv::Mat& image, int iterations) {
+    int matched = 0;
+    auto beg = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      transform_(image, out_.data());
+      if (model_type_ == kClassification) {
+        ++matched;
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    CHECK_EQ(matched, iterations);
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        end - beg).count() / static_cast<double>(iterations);
+  }
+
+ private:
+  void PrepareImageNCHW(const cv::Mat& image, bool use_mean_value) {
+    cv::Mat resized;
+    cv::resize(image, resized, cv::Size(param_.width, param_.height));
+    float* out_ptr = out_.data();
+    for (int h = 0; h < param_.height; ++h) {
+      const uchar* ptr = resized.ptr<uchar>(h);
+      int in_index = 0;
+      for (int w = 0; w < param_.width; ++w) {
+        for (int c = 0; c < 3; ++c) {
+          int out_index = (c * param_.height + h) * param_.width + w;
+          float pixel = static_cast<float>(ptr[in_index++]);
+          if (!use_mean_value) {
+            out_ptr[out_index] = (pixel - mean_blob_[out_index]) * scale_;
+          } else {
+            out_ptr[out_index] = (pixel - mean_value_[c]) * scale_;
+          }
+        }
+      }
+    }
+  }
+
+  std::string pipeline_;
+  std::string model_name_;
+  YAML::Node model_info_;
+  ModelType model_type_;
+  ImageTransformParam param_;
+  ImageTransformFunc transform_;
+  std::vector<float> mean_value_;
+  std::vector<float> mean_blob_;
+  float scale_ = 1.;
+  /*! \brief Large enough for both float and uint8 inputs */
+  std::vector<float> out_;
+};
+
+} // namespace backend
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  cv::Mat image(FLAGS_image_height, FLAGS_image_width, CV_8UC3);
+  cv::randu(image, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+  nexus::backend::BenchPreprocess bench(FLAGS_pipeline, FLAGS_height,
+                                        FLAGS_width);
+  // Warm up
+  bench.RunDynamic(image, 10);
+  bench.RunBound(image, 10);
+  double dynamic_us = bench.RunDynamic(image, FLAGS_iterations);
+  double bound_us = bench.RunBound(image, FLAGS_iterations);
+  std::cout << "pipeline: " << FLAGS_pipeline << ", image " <<
+      FLAGS_image_height << "x" << FLAGS_image_width << " -> " <<
+      FLAGS_height << "x" << FLAGS_width << std::endl;
+  std::cout << "dynamic dispatch: " << dynamic_us << " us/request" <<
+      std::endl;
+  std::cout << "bound at load:    " << bound_us << " us/request" << std::endl;
+  std::cout << "savings:          " << dynamic_us - bound_us <<
+      " us/request" << std::endl;
+  if (FLAGS_windows > 0) {
+    int iterations = std::max(FLAGS_iterations / FLAGS_windows, 1);
+    bench.RunWindows(image, FLAGS_windows, true, 10);
+    double serial_us = bench.RunWindows(image, FLAGS_windows, false,
+                                        iterations);
+    double parallel_us = bench.RunWindows(image, FLAGS_windows, true,
+                                          iterations);
+    std::cout << FLAGS_windows << " windows serial:   " << serial_us <<
+        " us/request" << std::endl;
+    std::cout << FLAGS_windows << " windows parallel: " << parallel_us <<
+        " us/request" << std::endl;
+  }
+}
@@ -0,0 +1,107 @@
+#include <atomic>
+#include <chrono>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nexus/backend/task.h"
+#include "nexus/common/alloc_tracker.h"
+#include "nexus/common/message.h"
+#include "nexus/proto/nnquery.pb.h"
+
+DEFINE_bool(pool, true, "Get tasks from the task pool");
+DEFINE_int32(threads, 4, "Number of threads");
+DEFINE_int32(payload, 16384, "Size of the synthetic image payload in bytes");
+DEFINE_int32(num_requests, 1000000, "Number of requests per thread");
+
+namespace nexus {
+namespace backend {
+
+/*!
+ * \brief Echo benchmark for the per-request path of the backend without
+ * model execution: decode a query into a task, fill in the result and encode
+ * the reply.
+ */
+class BenchTaskPool {
+ public:
+  BenchTaskPool(bool pool, int payload) :
+      pool_(pool) {
+    QueryProto query;
+    query.set_query_id(1);
+    query.set_session_index(1);
+    auto image = query.mutable_input()->mutable_image();
+    image->set_data(std::string(payload, 'x'));
+    image->set_format(ImageProto::JPEG);
+    image->set_color(true);
+    query.add_output_field("class_name");
+    query_msg_ = std::make_shared<Message>(kBackendRequest,
+                                           query.ByteSizeLong());
+    query_msg_->EncodeBody(query);
+  }
+
+  uint64_t Run(int num_requests) {
+    uint64_t bytes = 0;
+    for (int i = 0; i < num_requests; ++i) {
+      std::shared_ptr<Task> task;
+      if (pool_) {
+        task = Task::Create(nullptr);
+      } else {
+        task = std::make_shared<Task>();
+      }
+      task->DecodeQuery(query_msg_);
+      task->result->set_query_id(task->query->query_id());
+      task->result->set_session_index(task->query->session_index());
+      task->result->set_status(CTRL_OK);
+      auto record = task->result->add_output();
+      auto value = record->add_named_value();
+      value->set_name("class_name");
+      value->set_data_type(DT_STRING);
+      value->set_s("echo");
+      auto reply = std::make_shared<Message>(kBackendReply,
+                                             task->result->ByteSizeLong());
+      reply->EncodeBody(*task->result);
+      bytes += reply->length();
+    }
+    return bytes;
+  }
+
+ private:
+  bool pool_;
+  std::shared_ptr<Message> query_msg_;
+};
+
+} // namespace backend
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  nexus::backend::BenchTaskPool bench(FLAGS_pool, FLAGS_payload);
+  std::vector<std::thread> threads;
+  std::atomic<uint64_t> total_bytes(0);
+  auto beg = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < FLAGS_threads; ++i) {
+    threads.emplace_back([&]() {
+      total_bytes += bench.Run(FLAGS_num_requests);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  double sec = std::chrono::duration_cast<std::chrono::microseconds>(
+      end - beg).count() / 1e6;
+  uint64_t total_requests = static_cast<uint64_t>(FLAGS_threads) *
+                            FLAGS_num_requests;
+  std::cout << "pool: " << FLAGS_pool << ", threads: " << FLAGS_threads <<
+      ", payload: " << FLAGS_payload << " bytes" << std::endl;
+  std::cout << "throughput: " << total_requests / sec << " req/s (" <<
+      total_bytes / sec / 1024. / 1024. << " MB/s replies)" << std::endl;
+  nexus::AllocTracker::Singleton().LogStats();
+}
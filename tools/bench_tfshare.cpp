@@ -60,12 +60,13 @@ class BenchTFShare {
         model_sess.set_image_height(height);
         model_sess.set_image_width(width);
       } else {
-        if ((*model_info_)["resizable"] && (*model_info_)["resizable"].as<bool>()) {
+        if (model_info_->resizable) {
           // Set default image size for resizable CNN
-          model_sess.set_image_height((*model_info_)["image_height"].as<uint32_t>());
-          model_sess.set_image_width((*model_info_)["image_width"].as<uint32_t>());
+          model_sess.set_image_height(model_info_->image_height);
+          model_sess.set_image_width(model_info_->image_width);
         }
       }
+      model_sess.set_session_index(model_sessions_.size() + 1);
       model_sessions_.push_back(model_sess);
     }
     // Get test dataset
@@ -99,7 +100,7 @@ class BenchTFShare {
         std::string im;
         ReadImage(test_images_[idx], &im);
         auto task = std::make_shared<Task>();
-        auto input = task->query.mutable_input();
+        auto input = task->query->mutable_input();
         input->set_data_type(DT_IMAGE);
         auto image = input->mutable_image();
         image->set_data(im);
@@ -121,13 +122,13 @@ class BenchTFShare {
     int total_tasks = 0;
     for (int num_try = -dryrun; num_try < repeat; ++num_try) {
       for (size_t i = 0; i < batch_sizes_.size(); ++i) {
-        auto model_sess_id = ModelSessionToString(model_sessions_[i]);
+        uint32_t session_index = model_sessions_[i].session_index();
         for (size_t j = 0; j < batch_sizes_[i]; ++j) {
           auto idx = total_tasks % preproc_tasks.size();
           auto task = std::make_shared<Task>();
           task->SetDeadline(std::chrono::milliseconds(1000000));
-          task->query.set_query_id(total_tasks);
-          task->query.set_model_session_id(model_sess_id);
+          task->query->set_query_id(total_tasks);
+          task->query->set_session_index(session_index);
           task->attrs = preproc_tasks[idx]->attrs;
           task->AppendInput(preproc_tasks[idx]->inputs[0]->array);
           model->AddPreprocessedTask(task);
@@ -151,7 +152,7 @@ class BenchTFShare {
     }
     for (int i = 0; i < total_tasks; ++i) {
       auto task = task_queue.pop();
-      CHECK_EQ(task->result.status(), CTRL_OK) << "Error detected: " << task->result.status();
+      CHECK_EQ(task->result->status(), CTRL_OK) << "Error detected: " << task->result->status();
     }
     CHECK_EQ(task_queue.size(), 0) << "Task queue is not empty";
     preproc_tasks.clear();
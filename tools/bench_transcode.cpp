@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+#include "nexus/common/image.h"
+#include "nexus/common/image_transcoder.h"
+
+DEFINE_string(image, "", "JPEG image to send, a synthetic frame if empty");
+DEFINE_int32(image_height, 1080, "Height of the synthetic frame");
+DEFINE_int32(image_width, 1920, "Width of the synthetic frame");
+DEFINE_int32(windows, 4, "Number of detected windows sent to each "
+             "recognition model");
+DEFINE_string(format, "jpeg", "Transcoded image format, jpeg or raw");
+DEFINE_int32(quality, 90, "JPEG quality of transcoded images");
+DEFINE_int32(iterations, 100, "Number of iterations");
+DEFINE_int32(frontend_cores, 8, "CPU cores of the frontend tier");
+DEFINE_int32(backend_cores, 8, "CPU cores of the backend tier");
+
+namespace nexus {
+
+/*!
+ * \brief Computes the request rate the CPUs of the two tiers can sustain.
+ * \param frontend_us Frontend CPU time per request in us
+ * \param backend_us Backend CPU time per request in us
+ * \return Requests per second
+ */
+double CpuBoundRate(double frontend_us, double backend_us) {
+  double rate = std::numeric_limits<double>::max();
+  if (frontend_us > 0) {
+    rate = std::min(rate, FLAGS_frontend_cores * 1e6 / frontend_us);
+  }
+  if (backend_us > 0) {
+    rate = std::min(rate, FLAGS_backend_cores * 1e6 / backend_us);
+  }
+  return rate;
+}
+
+/*! \brief Model a request is fanned out to and its input size */
+struct FanOutTarget {
+  std::string name;
+  int height;
+  int width;
+  bool use_windows;
+};
+
+/*!
+ * \brief Compares sending the original JPEG to every model in a
+ * traffic_complex style app against transcoding it once at the frontend.
+ *
+ * The request goes to SSD on the full frame, and to the car and face models
+ * on the detected windows. The backend cost is the decode and the resize of
+ * each model input, as done by ImagePreprocessor.
+ */
+class BenchTranscode {
+ public:
+  BenchTranscode(const ImageProto& image, ImageProto::ImageFormat format,
+                 int quality, int num_windows) :
+      image_(image),
+      format_(format),
+      quality_(quality) {
+    targets_ = {{"ssd_mobilenet", 300, 300, false},
+                {"googlenet_cars", 224, 224, true},
+                {"vgg_face", 224, 224, true}};
+    cv::Mat img = DecodeImage(image_, CO_BGR);
+    CHECK(img.data != nullptr) << "Cannot decode image";
+    for (int i = 0; i < num_windows; ++i) {
+      RectProto rect;
+      rect.set_left(img.cols * i / (num_windows + 1));
+      rect.set_top(img.rows / 4);
+      rect.set_right(rect.left() + img.cols / (num_windows + 1));
+      rect.set_bottom(img.rows * 3 / 4);
+      windows_.push_back(rect);
+    }
+  }
+
+  void RunOriginal(int iterations, double* bytes, double* frontend_us,
+                   double* backend_us) {
+    *bytes = 0.;
+    *frontend_us = 0.;
+    *backend_us = 0.;
+    for (int i = 0; i < iterations; ++i) {
+      for (const auto& target : targets_) {
+        *bytes += image_.data().size();
+        *backend_us += Backend(image_, target, target.use_windows ?
+                               windows_ : std::vector<RectProto>{});
+      }
+    }
+    *bytes /= iterations;
+    *backend_us /= iterations;
+  }
+
+  void RunTranscoded(int iterations, double* bytes, double* frontend_us,
+                     double* backend_us) {
+    *bytes = 0.;
+    *frontend_us = 0.;
+    *backend_us = 0.;
+    for (int i = 0; i < iterations; ++i) {
+      ImageTranscoder transcoder(image_, quality_);
+      for (const auto& target : targets_) {
+        std::vector<RectProto> windows;
+        if (target.use_windows) {
+          windows = windows_;
+        }
+        ValueProto value;
+        auto beg = std::chrono::high_resolution_clock::now();
+        bool transcoded = transcoder.Transcode(target.height, target.width,
+                                               format_, &windows, &value);
+        auto end = std::chrono::high_resolution_clock::now();
+        *frontend_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            end - beg).count();
+        const ImageProto& sent = transcoded ? value.image() : image_;
+        *bytes += sent.data().size();
+        *backend_us += Backend(sent, target, windows);
+      }
+    }
+    *bytes /= iterations;
+    *frontend_us /= iterations;
+    *backend_us /= iterations;
+  }
+
+ private:
+  double Backend(const ImageProto& image, const FanOutTarget& target,
+                 const std::vector<RectProto>& windows) {
+    auto beg = std::chrono::high_resolution_clock::now();
+    cv::Mat img = DecodeImage(image, CO_BGR);
+    cv::Mat resized;
+    if (windows.empty()) {
+      cv::resize(img, resized, cv::Size(target.width, target.height));
+    }
+    for (const auto& rect : windows) {
+      cv::Mat crop = img(cv::Rect(rect.left(), rect.top(),
+                                  rect.right() - rect.left(),
+                                  rect.bottom() - rect.top()));
+      cv::resize(crop, resized, cv::Size(target.width, target.height));
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        end - beg).count();
+  }
+
+  const ImageProto& image_;
+  ImageProto::ImageFormat format_;
+  int quality_;
+  std::vector<FanOutTarget> targets_;
+  std::vector<RectProto> windows_;
+};
+
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  nexus::ImageProto image;
+  image.set_format(nexus::ImageProto::JPEG);
+  image.set_color(true);
+  if (FLAGS_image.empty()) {
+    cv::Mat frame(FLAGS_image_height, FLAGS_image_width, CV_8UC3);
+    cv::randu(frame, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    cv::GaussianBlur(frame, frame, cv::Size(15, 15), 0);
+    std::vector<uchar> buf;
+    cv::imencode(".jpg", frame, buf);
+    image.set_data(buf.data(), buf.size());
+  } else {
+    std::ifstream fin(FLAGS_image, std::ios::binary);
+    CHECK(fin.good()) << "Cannot open " << FLAGS_image;
+    std::string data((std::istreambuf_iterator<char>(fin)),
+                     std::istreambuf_iterator<char>());
+    image.set_data(data);
+  }
+  auto format = (FLAGS_format == "raw") ? nexus::ImageProto::RAW :
+                nexus::ImageProto::JPEG;
+  nexus::BenchTranscode bench(image, format, FLAGS_quality, FLAGS_windows);
+  double orig_bytes, orig_frontend_us, orig_backend_us;
+  double bytes, frontend_us, backend_us;
+  bench.RunOriginal(FLAGS_iterations, &orig_bytes, &orig_frontend_us,
+                    &orig_backend_us);
+  bench.RunTranscoded(FLAGS_iterations, &bytes, &frontend_us, &backend_us);
+  std::cout << "3-model fan-out, " << FLAGS_windows << " windows, " <<
+      FLAGS_format << std::endl;
+  std::cout << "original:   " << orig_bytes << " bytes/request, frontend " <<
+      orig_frontend_us << " us, backend " << orig_backend_us << " us" <<
+      std::endl;
+  std::cout << "transcoded: " << bytes << " bytes/request, frontend " <<
+      frontend_us << " us, backend " << backend_us << " us" << std::endl;
+  std::cout << "CPU bound on " << FLAGS_frontend_cores << " frontend and " <<
+      FLAGS_backend_cores << " backend cores: preprocess on backend " <<
+      nexus::CpuBoundRate(orig_frontend_us, orig_backend_us) <<
+      " req/s, on frontend " << nexus::CpuBoundRate(frontend_us, backend_us) <<
+      " req/s" << std::endl;
+}
@@ -0,0 +1,39 @@
+#include <chrono>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "nexus/common/image_pack.h"
+
+DEFINE_string(image_root, "", "Directory of .jpg images to pack");
+DEFINE_string(output, "", "Output image pack file");
+DEFINE_int32(threads, std::thread::hardware_concurrency(),
+             "Number of threads copying images");
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+  CHECK(!FLAGS_image_root.empty()) << "Missing image_root";
+  CHECK(!FLAGS_output.empty()) << "Missing output";
+
+  auto beg = std::chrono::high_resolution_clock::now();
+  size_t num_images = nexus::ImagePack::Build(FLAGS_image_root, FLAGS_output,
+                                              FLAGS_threads);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cout << "Packed " << num_images << " images into " << FLAGS_output <<
+      " in " << std::chrono::duration_cast<std::chrono::milliseconds>(
+          end - beg).count() << " ms" << std::endl;
+
+  beg = std::chrono::high_resolution_clock::now();
+  nexus::ImagePack pack(FLAGS_output);
+  end = std::chrono::high_resolution_clock::now();
+  CHECK_EQ(pack.size(), num_images) << "Image pack is inconsistent";
+  std::cout << "Opened in " << std::chrono::duration_cast<
+      std::chrono::microseconds>(end - beg).count() << " us" << std::endl;
+  std::cout << "Run backends with --hack_image_pack=" << FLAGS_output <<
+      std::endl;
+}
@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+#include "nexus/common/model_db.h"
+#include "nexus/common/model_def.h"
+#include "nexus/scheduler/static_workload.h"
+
+DEFINE_string(workload, "", "Workload file with a list of model sessions and "
+              "their request rates, as read by sim_duty_cycle");
+DEFINE_string(gpu_device, "", "GPU device name of the backends");
+DEFINE_string(gpu_uuid, "generic", "GPU UUID to look up model profiles");
+DEFINE_string(output, "", "Static workload file to write the placement to, "
+              "for the scheduler --workload");
+DEFINE_int32(search_moves, 1000, "Max number of attempts to empty a backend "
+             "in local search");
+// Defined by the scheduler, which sch_info.cpp reads
+DEFINE_int32(avg_interval, 10, "Moving average interval for backend rate");
+
+namespace nexus {
+namespace scheduler {
+
+/*! \brief Request rate of a model session placed on one backend. */
+struct Demand {
+  ModelSession model_session;
+  const ModelProfile* profile;
+  uint32_t max_batch;
+  double rate;
+  /*! \brief Max throughput of a backend running only this model */
+  double peak_throughput;
+};
+
+using Backend = std::vector<Demand>;
+using Placement = std::vector<Backend>;
+
+/*!
+ * \brief Places a static workload on the fewest backends, offline.
+ *
+ * Each model session takes as many backends of its own as its rate
+ * saturates, and the residual rates are packed by first fit decreasing.
+ * Local search then tries to empty the least loaded backends by moving
+ * their residuals to others, splitting a residual across backends if it
+ * doesn't fit in one. Backends run their models back to back like static
+ * workloads in the scheduler, see CheckStaticBackend.
+ *
+ * The lower bound charges each model session its rate over the max
+ * throughput of a dedicated backend, as sharing a backend only lowers the
+ * throughput a model gets per unit of GPU time.
+ */
+class PlacementSolver {
+ public:
+  PlacementSolver(const std::string& gpu_device,
+                  const std::string& gpu_uuid) :
+      gpu_device_(gpu_device),
+      gpu_uuid_(gpu_uuid),
+      lower_bound_(0.) {}
+
+  void LoadWorkload(const std::string& workload_file) {
+    YAML::Node config = YAML::LoadFile(workload_file);
+    for (const auto& node : config["models"]) {
+      Demand demand;
+      auto& sess = demand.model_session;
+      sess.set_framework(node["framework"].as<std::string>());
+      sess.set_model_name(node["model_name"].as<std::string>());
+      sess.set_version(node["version"].as<uint32_t>());
+      sess.set_latency_sla(node["latency_sla"].as<uint32_t>());
+      if (node["image_height"]) {
+        sess.set_image_height(node["image_height"].as<uint32_t>());
+        sess.set_image_width(node["image_width"].as<uint32_t>());
+      }
+      double rate = node["rate"].as<double>();
+      demand.profile = ModelDatabase::Singleton().GetModelProfile(
+          gpu_device_, gpu_uuid_, ModelSessionToProfileID(sess));
+      CHECK(demand.profile != nullptr) << "Missing profile of " <<
+          ModelSessionToProfileID(sess) << " on " << gpu_device_;
+      demand.max_batch = demand.profile->GetMaxBatch(sess.latency_sla());
+      uint32_t batch = demand.profile->GetMaxThroughput(
+          sess.latency_sla()).first;
+      if (batch == 0) {
+        LOG(WARNING) << ModelSessionToString(sess) << " misses latency " <<
+            "SLA even at batch 1, skipped";
+        continue;
+      }
+      demand.peak_throughput = batch * 1e6 /
+          demand.profile->GetForwardLatency(batch);
+      lower_bound_ += rate / demand.peak_throughput;
+      auto full = static_cast<uint32_t>(
+          rate / demand.peak_throughput + 1e-9);
+      demand.rate = demand.peak_throughput;
+      for (uint32_t i = 0; i < full; ++i) {
+        full_.push_back(demand);
+      }
+      demand.rate = rate - full * demand.peak_throughput;
+      if (demand.rate > 1e-6 * demand.peak_throughput) {
+        residuals_.push_back(demand);
+      }
+    }
+  }
+  /*! \brief Fractional number of backends no placement can go below. */
+  double lower_bound() const { return lower_bound_; }
+  /*!
+   * \brief Places the residual rates by first fit, on top of the dedicated
+   * backends.
+   * \param decreasing Whether to place the largest residuals first instead
+   *   of in workload file order
+   */
+  Placement FirstFit(bool decreasing) const {
+    std::vector<Demand> residuals(residuals_);
+    if (decreasing) {
+      std::stable_sort(residuals.begin(), residuals.end(),
+                       [](const Demand& a, const Demand& b) {
+                         return Load(a) > Load(b);
+                       });
+    }
+    Placement placement;
+    for (const auto& demand : full_) {
+      placement.push_back({demand});
+    }
+    for (const auto& demand : residuals) {
+      bool placed = false;
+      for (auto& backend : placement) {
+        if (TryAdd(demand, demand.rate, &backend)) {
+          placed = true;
+          break;
+        }
+      }
+      if (!placed) {
+        placement.push_back({demand});
+        CHECK(Fits(placement.back())) <<
+            ModelSessionToString(demand.model_session) << " doesn't fit " <<
+            "on an empty backend";
+      }
+    }
+    return placement;
+  }
+  /*!
+   * \brief Repeatedly empties the least loaded backend that can be emptied,
+   * by moving its demands to other backends.
+   * \param placement Placement to improve in place
+   * \param max_moves Max number of backends to try emptying
+   */
+  void LocalSearch(Placement* placement, int max_moves) const {
+    int moves = 0;
+    bool improved = true;
+    while (improved && moves < max_moves) {
+      improved = false;
+      std::vector<size_t> order(placement->size());
+      std::iota(order.begin(), order.end(), 0);
+      std::stable_sort(order.begin(), order.end(),
+                       [placement](size_t a, size_t b) {
+                         return Load((*placement)[a]) < Load((*placement)[b]);
+                       });
+      for (size_t src : order) {
+        if (moves++ >= max_moves) {
+          break;
+        }
+        Placement trial(*placement);
+        trial[src].clear();
+        bool emptied = true;
+        for (const auto& demand : (*placement)[src]) {
+          if (!MoveDemand(demand, src, &trial)) {
+            emptied = false;
+            break;
+          }
+        }
+        if (emptied) {
+          trial.erase(trial.begin() + src);
+          *placement = trial;
+          improved = true;
+          break;
+        }
+      }
+    }
+  }
+  /*!
+   * \brief Plans the batch sizes of a backend.
+   * \param models Output models with their batch size
+   * \return whether the demands fit on one backend
+   */
+  bool Plan(const Backend& backend, std::vector<InstanceInfoPtr>* models)
+      const {
+    models->clear();
+    std::unordered_set<std::string> sessions;
+    for (const auto& demand : backend) {
+      // A model session is loaded at most once on a backend
+      if (!sessions.insert(ModelSessionToString(
+              demand.model_session)).second) {
+        return false;
+      }
+      auto inst_info = std::make_shared<InstanceInfo>();
+      inst_info->model_sessions.push_back(demand.model_session);
+      inst_info->profile = demand.profile;
+      inst_info->max_batch = demand.max_batch;
+      inst_info->workload = demand.rate;
+      models->push_back(inst_info);
+    }
+    return PlanStaticBackend(*models);
+  }
+
+  void Save(const Placement& placement, const std::string& output) const {
+    YAML::Emitter out;
+    out << YAML::BeginSeq;
+    for (const auto& backend : placement) {
+      std::vector<InstanceInfoPtr> models;
+      CHECK(Plan(backend, &models));
+      out << YAML::BeginSeq;
+      for (const auto& inst_info : models) {
+        const auto& sess = inst_info->model_sessions[0];
+        out << YAML::BeginMap;
+        out << YAML::Key << "framework" << YAML::Value << sess.framework();
+        out << YAML::Key << "model_name" << YAML::Value << sess.model_name();
+        out << YAML::Key << "version" << YAML::Value << sess.version();
+        out << YAML::Key << "latency_sla" << YAML::Value <<
+            sess.latency_sla();
+        if (sess.image_height() > 0) {
+          out << YAML::Key << "image_height" << YAML::Value <<
+              sess.image_height();
+          out << YAML::Key << "image_width" << YAML::Value <<
+              sess.image_width();
+        }
+        out << YAML::Key << "batch" << YAML::Value << inst_info->batch;
+        out << YAML::Key << "rate" << YAML::Value << inst_info->workload;
+        out << YAML::EndMap;
+      }
+      out << YAML::EndSeq;
+    }
+    out << YAML::EndSeq;
+    std::ofstream fout(output);
+    fout << out.c_str() << std::endl;
+    CHECK(fout.good()) << "Failed to write " << output;
+  }
+
+  /*!
+   * \brief Loads a static workload file the way the scheduler does with
+   * --workload_gpu_device and checks every backend.
+   * \return number of backends that don't fit
+   */
+  size_t Verify(const std::string& workload_file) const {
+    YAML::Node config = YAML::LoadFile(workload_file);
+    size_t num_infeasible = 0;
+    for (size_t i = 0; i < config.size(); ++i) {
+      std::vector<InstanceInfoPtr> models;
+      for (const auto& model_info : config[i]) {
+        models.push_back(ParseStaticModel(model_info, gpu_device_,
+                                          gpu_uuid_));
+      }
+      std::string error;
+      if (!CheckStaticBackend(models, nullptr, &error)) {
+        LOG(ERROR) << "Backend " << i << ": " << error;
+        ++num_infeasible;
+      }
+    }
+    return num_infeasible;
+  }
+
+ private:
+  static double Load(const Demand& demand) {
+    return demand.rate / demand.peak_throughput;
+  }
+
+  static double Load(const Backend& backend) {
+    double load = 0.;
+    for (const auto& demand : backend) {
+      load += Load(demand);
+    }
+    return load;
+  }
+
+  bool Fits(const Backend& backend) const {
+    std::vector<InstanceInfoPtr> models;
+    return Plan(backend, &models);
+  }
+  /*!
+   * \brief Adds rate of the model session of demand to a backend, merged
+   * with the demand of the same model session if the backend has one.
+   * \return whether it fits, the backend is left unchanged if not
+   */
+  bool TryAdd(const Demand& demand, double rate, Backend* backend) const {
+    std::string sess_id = ModelSessionToString(demand.model_session);
+    for (auto& other : *backend) {
+      if (ModelSessionToString(other.model_session) == sess_id) {
+        double old_rate = other.rate;
+        other.rate += rate;
+        if (Fits(*backend)) {
+          return true;
+        }
+        other.rate = old_rate;
+        return false;
+      }
+    }
+    backend->push_back(demand);
+    backend->back().rate = rate;
+    if (Fits(*backend)) {
+      return true;
+    }
+    backend->pop_back();
+    return false;
+  }
+  /*!
+   * \brief Moves a demand to the backends other than src, whole to the
+   * first that fits it, or else split across them from the most loaded.
+   * \return false if some of the rate is left
+   */
+  bool MoveDemand(const Demand& demand, size_t src, Placement* placement)
+      const {
+    for (size_t dst = 0; dst < placement->size(); ++dst) {
+      if (dst != src && TryAdd(demand, demand.rate, &(*placement)[dst])) {
+        return true;
+      }
+    }
+    std::vector<size_t> order;
+    for (size_t dst = 0; dst < placement->size(); ++dst) {
+      if (dst != src) {
+        order.push_back(dst);
+      }
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [placement](size_t a, size_t b) {
+                       return Load((*placement)[a]) > Load((*placement)[b]);
+                     });
+    double left = demand.rate;
+    for (size_t dst : order) {
+      auto& backend = (*placement)[dst];
+      // Binary search for the largest rate that still fits
+      double lo = 0., hi = left;
+      for (int i = 0; i < 20; ++i) {
+        double mid = (lo + hi) / 2;
+        Backend trial(backend);
+        if (TryAdd(demand, mid, &trial)) {
+          lo = mid;
+        } else {
+          hi = mid;
+        }
+      }
+      if (lo < 1e-3 * demand.rate || !TryAdd(demand, lo, &backend)) {
+        continue;
+      }
+      left -= lo;
+      if (left < 1e-6 * demand.peak_throughput) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::string gpu_device_;
+  std::string gpu_uuid_;
+  /*! \brief Demands that saturate a backend each */
+  std::vector<Demand> full_;
+  /*! \brief Rates left of each model session after its full backends */
+  std::vector<Demand> residuals_;
+  double lower_bound_;
+};
+
+} // namespace scheduler
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+  CHECK(!FLAGS_workload.empty()) << "Missing workload";
+  CHECK(!FLAGS_gpu_device.empty()) << "Missing gpu_device";
+
+  nexus::scheduler::PlacementSolver solver(FLAGS_gpu_device, FLAGS_gpu_uuid);
+  solver.LoadWorkload(FLAGS_workload);
+  auto file_order = solver.FirstFit(false);
+  auto placement = solver.FirstFit(true);
+  size_t ffd_backends = placement.size();
+  solver.LocalSearch(&placement, FLAGS_search_moves);
+  double bound = solver.lower_bound();
+  auto min_backends = static_cast<size_t>(std::ceil(bound - 1e-9));
+  std::cout << "first fit in file order: " << file_order.size() <<
+      " backends" << std::endl;
+  std::cout << "first fit decreasing: " << ffd_backends << " backends" <<
+      std::endl;
+  std::cout << "local search: " << placement.size() << " backends" <<
+      std::endl;
+  // Signed so that the gap never wraps around
+  auto gap = static_cast<int64_t>(placement.size()) -
+             static_cast<int64_t>(min_backends);
+  std::cout << "lower bound: " << min_backends << " backends (" << bound <<
+      " fractional), gap " << gap;
+  if (min_backends > 0) {
+    std::cout << " (" << 100. * gap / min_backends << "%)";
+  }
+  std::cout << std::endl;
+  if (!FLAGS_output.empty()) {
+    solver.Save(placement, FLAGS_output);
+    size_t num_infeasible = solver.Verify(FLAGS_output);
+    CHECK_EQ(num_infeasible, 0) << "Placement in " << FLAGS_output <<
+        " fails verification";
+    std::cout << "wrote " << FLAGS_output << std::endl;
+  }
+  return 0;
+}
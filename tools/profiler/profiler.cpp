@@ -1,3 +1,4 @@
+#include <atomic>
 #include <boost/filesystem.hpp>
 #include <cmath>
 #include <fstream>
@@ -5,6 +6,7 @@
 #include <glog/logging.h>
 #include <iostream>
 #include <cstdlib>
+#include <sstream>
 #include <string>
 #include <time.h>
 #include <thread>
@@ -14,6 +16,7 @@
 
 #include "nexus/common/device.h"
 #include "nexus/common/block_queue.h"
+#include "nexus/common/image_transcoder.h"
 #include "nexus/common/model_db.h"
 #include "nexus/backend/model_exec.h"
 #include "nexus/backend/model_ins.h"
@@ -31,6 +34,10 @@ DEFINE_int32(height, 0, "Image height");
 DEFINE_int32(width, 0, "Image width");
 DEFINE_bool(share_prefix, false, "Enable share prefix");
 DEFINE_int32(repeat, 10, "Repeat times for profiling");
+DEFINE_string(corun, "", "Comma separated model IDs, framework:model:version, "
+              "to measure the forward latency slowdown against when each "
+              "shares the GPU and host with the profiled model");
+DEFINE_int32(corun_batch, 8, "Batch size of the co-located model");
 
 namespace nexus {
 namespace backend {
@@ -58,15 +65,14 @@ class ModelProfiler {
       model_sess_.set_image_height(height);
       model_sess_.set_image_width(width);
     } else {
-      if ((*model_info_)["resizable"] &&
-          (*model_info_)["resizable"].as<bool>()) {
+      if (model_info_->resizable) {
         // Set default image size for resizable CNN
-        model_sess_.set_image_height(
-            (*model_info_)["image_height"].as<uint32_t>());
-        model_sess_.set_image_width(
-            (*model_info_)["image_width"].as<uint32_t>());
+        model_sess_.set_image_height(model_info_->image_height);
+        model_sess_.set_image_width(model_info_->image_width);
       }
     }
+    // Session indices are assigned by position in model_sessions_
+    model_sess_.set_session_index(1);
     LOG(INFO) << model_sess_.DebugString();
     model_sessions_.push_back(ModelSessionToString(model_sess_));
     LOG(INFO) << "Profile model " << ModelSessionToProfileID(model_sess_);
@@ -84,6 +90,8 @@ class ModelProfiler {
 
     std::vector<uint64_t> preprocess_lats;
     std::vector<uint64_t> postprocess_lats;
+    std::vector<uint64_t> frontend_preprocess_lats;
+    std::vector<uint64_t> raw_preprocess_lats;
     std::unordered_map<int, std::tuple<float, float, size_t> > forward_stats;
     ModelInstanceConfig config;
     config.add_model_session()->CopyFrom(model_sess_);
@@ -100,7 +108,8 @@ class ModelProfiler {
           share_sess->set_image_height(model_sess_.image_height());
           share_sess->set_image_width(model_sess_.image_width());
         }
-        model_sessions_.push_back(ModelSessionToString(*share_sess));
+        share_sess->set_session_index(model_sessions_.size() + 1);
+      model_sessions_.push_back(ModelSessionToString(*share_sess));
       }
     }
     LOG(INFO) << config.DebugString();
@@ -125,7 +134,7 @@ class ModelProfiler {
         std::string im;
         ReadImage(test_images_[idx], &im);
         auto task = std::make_shared<Task>();
-        auto input = task->query.mutable_input();
+        auto input = task->query->mutable_input();
         input->set_data_type(DT_IMAGE);
         auto image = input->mutable_image();
         image->set_data(im);
@@ -141,6 +150,44 @@ class ModelProfiler {
               std::chrono::duration_cast<duration>(end - beg).count());
         }
       }
+      // Measure preprocessing split between frontend and backend, i.e., the
+      // frontend transcodes the image into RAW at the model input size and
+      // the backend preprocesses the RAW image
+      int height = model_sess_.image_height();
+      int width = model_sess_.image_width();
+      if (height == 0) {
+        height = model_info_->image_height;
+        width = model_info_->image_width;
+      }
+      for (int i = 0; height > 0 && i < num_inputs; ++i) {
+        int idx = rand() % test_images_.size();
+        ImageProto image;
+        std::string im;
+        ReadImage(test_images_[idx], &im);
+        image.set_data(im);
+        image.set_format(ImageProto::JPEG);
+        image.set_color(true);
+        auto task = std::make_shared<Task>();
+        auto input = task->query->mutable_input();
+        std::vector<RectProto> windows;
+        auto beg = std::chrono::high_resolution_clock::now();
+        ImageTranscoder transcoder(image, 0);
+        bool ok = transcoder.Transcode(height, width, ImageProto::RAW,
+                                       &windows, input);
+        auto end = std::chrono::high_resolution_clock::now();
+        if (!ok) {
+          // Image is already smaller than the model input
+          continue;
+        }
+        model->Preprocess(task);
+        auto raw_end = std::chrono::high_resolution_clock::now();
+        if (i > 0) {
+          frontend_preprocess_lats.push_back(
+              std::chrono::duration_cast<duration>(end - beg).count());
+          raw_preprocess_lats.push_back(
+              std::chrono::duration_cast<duration>(raw_end - end).count());
+        }
+      }
     }
     std::this_thread::sleep_for(std::chrono::microseconds(200));
     LOG(INFO) << "Preprocess finished";
@@ -156,9 +203,8 @@ class ModelProfiler {
         int idx = i % preproc_tasks.size();
         auto task = std::make_shared<Task>();
         task->SetDeadline(std::chrono::milliseconds(1000000));
-        task->query.set_query_id(i);
-        task->query.set_model_session_id(
-            model_sessions_[i % model_sessions_.size()]);
+        task->query->set_query_id(i);
+        task->query->set_session_index(i % model_sessions_.size() + 1);
         task->attrs = preproc_tasks[idx]->attrs;
         task->AppendInput(preproc_tasks[idx]->inputs[0]->array);
         model->AddPreprocessedTask(task);
@@ -180,8 +226,8 @@ class ModelProfiler {
       LOG(INFO) << "memory usage: " << memory_usage;
       for (int i = 0; i < batch * (repeat + dryrun); ++i) {
         auto task = task_queue.pop();
-        CHECK_EQ(task->result.status(), CTRL_OK) << "Error detected: " <<
-            task->result.status();
+        CHECK_EQ(task->result->status(), CTRL_OK) << "Error detected: " <<
+            task->result->status();
         auto beg = std::chrono::high_resolution_clock::now();
         model->Postprocess(task);
         auto end = std::chrono::high_resolution_clock::now();
@@ -197,6 +243,24 @@ class ModelProfiler {
       std::this_thread::sleep_for(std::chrono::microseconds(200));
     }
 
+    // co-run slowdown against each co-located model
+    std::vector<std::tuple<std::string, float, float, int> > corun_stats;
+    std::stringstream corun_ss(FLAGS_corun);
+    std::string corun_model_id;
+    while (std::getline(corun_ss, corun_model_id, ',')) {
+      std::string corun_profile_id;
+      auto ratios = ProfileCorun(corun_model_id, config, preproc_tasks,
+                                 forward_stats, min_batch, max_batch, repeat,
+                                 &corun_profile_id);
+      float mean = ratios[0], std = 0.;
+      if (ratios.size() > 1) {
+        std::tie(mean, std) = GetStats<float>(ratios);
+      }
+      LOG(INFO) << "Co-run slowdown with " << corun_profile_id << ": " <<
+          mean << " +- " << std;
+      corun_stats.emplace_back(corun_profile_id, mean, std, ratios.size());
+    }
+
     LOG(INFO) << "Final free memory: " << gpu_device_->FreeMemory();
     preproc_tasks.clear();
     
@@ -229,12 +293,156 @@ class ModelProfiler {
     *fout << "Postprocess latency (mean,std,repeat)\n";
     std::tie(mean, std) = GetStats<uint64_t>(postprocess_lats);
     *fout << mean << "," << std << "," << postprocess_lats.size() << "\n";
+    if (!frontend_preprocess_lats.empty()) {
+      *fout << "Frontend preprocess latency (mean,std,repeat)\n";
+      std::tie(mean, std) = GetStats<uint64_t>(frontend_preprocess_lats);
+      *fout << mean << "," << std << "," << frontend_preprocess_lats.size() <<
+          "\n";
+      *fout << "Raw preprocess latency (mean,std,repeat)\n";
+      std::tie(mean, std) = GetStats<uint64_t>(raw_preprocess_lats);
+      *fout << mean << "," << std << "," << raw_preprocess_lats.size() << "\n";
+    }
+    if (!corun_stats.empty()) {
+      *fout << "Co-run slowdown (profile_id,mean,std,repeat)\n";
+      for (const auto& stats : corun_stats) {
+        *fout << std::get<0>(stats) << "," << std::get<1>(stats) << "," <<
+            std::get<2>(stats) << "," << std::get<3>(stats) << "\n";
+      }
+    }
     if (fout != &std::cout) {
       delete fout;
     }
   }
 
  private:
+  /*!
+   * \brief Measures the forward latency of the profiled model while another
+   * model shares the GPU and host the way a backend runs co-located models.
+   * The two models alternate batches on the GPU, and a CPU thread keeps
+   * preprocessing and postprocessing requests of the other model.
+   * \param corun_model_id Model ID of the co-located model
+   * \param config Model instance config of the profiled model
+   * \param preproc_tasks Preprocessed inputs of the profiled model
+   * \param forward_stats Solo forward latency by batch size
+   * \param profile_id Output profile ID of the co-located model
+   * \return Ratio of co-run to solo forward latency at min_batch, max_batch
+   *   and the powers of two in between
+   */
+  std::vector<float> ProfileCorun(
+      const std::string& corun_model_id, ModelInstanceConfig config,
+      const std::vector<std::shared_ptr<Task> >& preproc_tasks,
+      const std::unordered_map<int, std::tuple<float, float, size_t> >&
+      forward_stats, int min_batch, int max_batch, int repeat,
+      std::string* profile_id) {
+    ModelSession corun_sess;
+    ParseModelID(corun_model_id, &corun_sess);
+    corun_sess.set_latency_sla(50000);
+    auto corun_info = ModelDatabase::Singleton().GetModelInfo(
+        corun_sess.framework(), corun_sess.model_name(), corun_sess.version());
+    CHECK(corun_info != nullptr) << "Cannot find model info for " <<
+        corun_model_id;
+    if (corun_info->resizable) {
+      corun_sess.set_image_height(corun_info->image_height);
+      corun_sess.set_image_width(corun_info->image_width);
+    }
+    corun_sess.set_session_index(1);
+    *profile_id = ModelSessionToProfileID(corun_sess);
+    LOG(INFO) << "Co-run with " << *profile_id;
+
+    ModelInstanceConfig corun_config;
+    corun_config.add_model_session()->CopyFrom(corun_sess);
+    corun_config.set_batch(FLAGS_corun_batch);
+    corun_config.set_max_batch(FLAGS_corun_batch);
+    BlockPriorityQueue<Task> corun_queue;
+    auto corun = std::make_shared<ModelExecutor>(gpu_, corun_config,
+                                                 corun_queue);
+    std::atomic<bool> stop(false);
+    std::thread host([&]() {
+        for (int i = 0; !stop; ) {
+          bool idle = true;
+          // Keep two batches of the co-located model preprocessed
+          if (corun->NumberOfOpenRequests() < 2 * FLAGS_corun_batch) {
+            std::string im;
+            ReadImage(test_images_[rand() % test_images_.size()], &im);
+            auto task = std::make_shared<Task>();
+            task->SetDeadline(std::chrono::milliseconds(1000000));
+            task->query->set_query_id(i++);
+            task->query->set_session_index(1);
+            auto image = task->query->mutable_input()->mutable_image();
+            task->query->mutable_input()->set_data_type(DT_IMAGE);
+            image->set_data(im);
+            image->set_format(ImageProto::JPEG);
+            image->set_color(true);
+            corun->Preprocess(task);
+            idle = false;
+          }
+          auto task = corun_queue.pop(std::chrono::microseconds(0));
+          if (task != nullptr) {
+            corun->Postprocess(task);
+            idle = false;
+          }
+          if (idle) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+          }
+        }
+      });
+
+    int dryrun = 4;
+    std::vector<float> ratios;
+    int batch = min_batch;
+    while (true) {
+      config.set_batch(batch);
+      config.set_max_batch(batch);
+      BlockPriorityQueue<Task> task_queue;
+      auto model = std::make_shared<ModelExecutor>(gpu_, config, task_queue);
+      int num_tasks = batch * (repeat + dryrun);
+      for (int i = 0; i < num_tasks; ++i) {
+        int idx = i % preproc_tasks.size();
+        auto task = std::make_shared<Task>();
+        task->SetDeadline(std::chrono::milliseconds(1000000));
+        task->query->set_query_id(i);
+        task->query->set_session_index(i % model_sessions_.size() + 1);
+        task->attrs = preproc_tasks[idx]->attrs;
+        task->AppendInput(preproc_tasks[idx]->inputs[0]->array);
+        model->AddPreprocessedTask(task);
+      }
+      for (int i = 0; i < dryrun; ++i) {
+        corun->Execute();
+        model->Execute();
+      }
+      std::vector<uint64_t> forward_lats;
+      for (int i = 0; i < repeat; ++i) {
+        corun->Execute();
+        auto beg = std::chrono::high_resolution_clock::now();
+        model->Execute();
+        auto end = std::chrono::high_resolution_clock::now();
+        forward_lats.push_back(
+            std::chrono::duration_cast<duration>(end - beg).count());
+      }
+      for (int i = 0; i < num_tasks; ++i) {
+        task_queue.pop();
+      }
+      float mean, std;
+      std::tie(mean, std) = GetStats<uint64_t>(forward_lats);
+      float solo = std::get<0>(forward_stats.at(batch));
+      LOG(INFO) << "batch " << batch << ": solo " << solo << " us, co-run " <<
+          mean << " us";
+      ratios.push_back(mean / solo);
+      if (batch >= max_batch) {
+        break;
+      }
+      // Next power of two
+      int next = 1;
+      while (next <= batch) {
+        next *= 2;
+      }
+      batch = std::min(next, max_batch);
+    }
+    stop = true;
+    host.join();
+    return ratios;
+  }
+
   template<class T>
   std::pair<float, float> GetStats(const std::vector<T>& lats) {
     float mean = 0.;
@@ -270,7 +478,7 @@ class ModelProfiler {
  private:
   int gpu_;
   ModelSession model_sess_;
-  const YAML::Node* model_info_;
+  const ModelInfo* model_info_;
   std::string framework_;
   std::string model_name_;
   int version_;
@@ -145,11 +145,22 @@ def run_profiler(gpu, prof_id, input_queue, output_queue):
         mean, std, repeat = next(lines).split(',')
         postprocess_lats = (float(mean), float(std), int(repeat))
 
+        corun_stats = {}
+        for line in lines:
+            if line.startswith('Co-run slowdown (profile_id,mean,std,repeat)'):
+                for line in lines:
+                    if not line or ' ' in line:
+                        break
+                    corun_id, mean, std, repeat = line.split(',')
+                    corun_stats[corun_id] = (float(mean), float(std),
+                                             int(repeat))
+                break
+
         output_queue.put((gpu_name, gpu_uuid, forward_stats,
-                          preprocess_lats, postprocess_lats))
+                          preprocess_lats, postprocess_lats, corun_stats))
 
 
-def print_profile(output, prof_id, gpu_name, gpu_uuid, forward_stats, preprocess_lats, postprocess_lats):
+def print_profile(output, prof_id, gpu_name, gpu_uuid, forward_stats, preprocess_lats, postprocess_lats, corun_stats):
     forward_stats.sort()
     with open(output, 'w') as f:
         f.write(f'{prof_id}\n')
@@ -165,6 +176,10 @@ def print_profile(output, prof_id, gpu_name, gpu_uuid, forward_stats, preprocess
         f.write('Postprocess latency (mean,std,repeat)\n')
         mean, std, repeat = postprocess_lats
         f.write(f'{mean},{std},{repeat}\n')
+        if corun_stats:
+            f.write('Co-run slowdown (profile_id,mean,std,repeat)\n')
+            for corun_id, (mean, std, repeat) in sorted(corun_stats.items()):
+                f.write(f'{corun_id},{mean},{std},{repeat}\n')
 
 
 def merge_mean_std(tuple1, tuple2):
@@ -178,6 +193,16 @@ def merge_mean_std(tuple1, tuple2):
     return mean, math.sqrt(var), n1 + n2
 
 
+def merge_samples(tuple1, tuple2):
+    # Weighted by count, as co-run stats can come from a single batch size
+    mean1, std1, n1 = tuple1
+    mean2, std2, n2 = tuple2
+    n = n1 + n2
+    mean = (n1 * mean1 + n2 * mean2) / n
+    sq = (n1 * (std1 ** 2 + mean1 ** 2) + n2 * (std2 ** 2 + mean2 ** 2)) / n
+    return mean, math.sqrt(max(sq - mean ** 2, 0.)), n
+
+
 def get_profiler_cmd(args):
     cmd = [_profiler,
            f'-model_root={args.model_root}', f'-image_dir={args.dataset}',
@@ -187,6 +212,8 @@ def get_profiler_cmd(args):
         cmd.append(f'-width={args.width}')
     if args.prefix:
         cmd.append('-share_prefix')
+    if args.corun:
+        cmd.append(f'-corun={args.corun}')
     return cmd
 
 
@@ -210,9 +237,10 @@ def profile_model_concurrent(gpus, min_batch, max_batch, prof_id, output):
     forward_stats = []
     preprocess_lats = None
     postprocess_lats = None
+    corun_stats = {}
     for _ in range(min_batch, max_batch + 1):
         try:
-            gpu_name, gpu_uuid, forward_stat, pre, post = output_queue.get()
+            gpu_name, gpu_uuid, forward_stat, pre, post, corun = output_queue.get()
         except KeyboardInterrupt:
             print('exiting...')
             for worker in workers:
@@ -230,10 +258,15 @@ def profile_model_concurrent(gpus, min_batch, max_batch, prof_id, output):
         else:
             preprocess_lats = merge_mean_std(preprocess_lats, pre)
             postprocess_lats = merge_mean_std(postprocess_lats, post)
+        for corun_id, stat in corun.items():
+            if corun_id in corun_stats:
+                stat = merge_samples(corun_stats[corun_id], stat)
+            corun_stats[corun_id] = stat
         if len(gpus) > 1:
             gpu_uuid = 'generic'
         print_profile(output, prof_id, gpu_name, gpu_uuid,
-                      forward_stats, preprocess_lats, postprocess_lats)
+                      forward_stats, preprocess_lats, postprocess_lats,
+                      corun_stats)
 
     print('joining worker...')
     for worker in workers:
@@ -254,7 +287,7 @@ def profile_model_single_gpu(gpu, min_batch, max_batch, prof_id, output):
     input_queue.close()
 
     try:
-        gpu_name, gpu_uuid, forward_stats, preprocess_lats, postprocess_lats = output_queue.get()
+        gpu_name, gpu_uuid, forward_stats, preprocess_lats, postprocess_lats, corun_stats = output_queue.get()
     except KeyboardInterrupt:
         print('exiting...')
         worker.terminate()
@@ -264,7 +297,8 @@ def profile_model_single_gpu(gpu, min_batch, max_batch, prof_id, output):
         output_queue.join_thread()
         raise
     print_profile(output, prof_id, gpu_name, gpu_uuid,
-                  forward_stats, preprocess_lats, postprocess_lats)
+                  forward_stats, preprocess_lats, postprocess_lats,
+                  corun_stats)
 
     print('joining worker...')
     worker.join()
@@ -343,6 +377,9 @@ def main():
                         help='Limit the min batch size (default: 0)')
     parser.add_argument('-f', '--force', action='store_true',
                         help='Overwrite the existing model profile in model DB')
+    parser.add_argument('--corun', type=str, default='',
+                        help='Comma separated model IDs, framework:model:version, '
+                        'to also measure co-run slowdown against')
     parser.add_argument('--gpu_uuid', action='store_true', default=False,
                         help='Save profile result to a subdirectory with the GPU UUID')
     global args
@@ -54,15 +54,14 @@ class ModelProfiler {
       model_sess_.set_image_height(height);
       model_sess_.set_image_width(width);
     } else {
-      if ((*model_info_)["resizable"] &&
-          (*model_info_)["resizable"].as<bool>()) {
+      if (model_info_->resizable) {
         // Set default image size for resizable CNN
-        model_sess_.set_image_height(
-            (*model_info_)["image_height"].as<uint32_t>());
-        model_sess_.set_image_width(
-            (*model_info_)["image_width"].as<uint32_t>());
+        model_sess_.set_image_height(model_info_->image_height);
+        model_sess_.set_image_width(model_info_->image_width);
       }
     }
+    // Session indices are assigned by position in model_sessions_
+    model_sess_.set_session_index(1);
     LOG(INFO) << model_sess_.DebugString();
     model_sessions_.push_back(ModelSessionToString(model_sess_));
     LOG(INFO) << "Profile model " << ModelSessionToProfileID(model_sess_);
@@ -106,6 +105,7 @@ class ModelProfiler {
       auto share_sess = config.add_model_session();
       ParseModelID(model_id, share_sess);
       share_sess->set_latency_sla(50000);
+      share_sess->set_session_index(model_sessions_.size() + 1);
       model_sessions_.push_back(ModelSessionToString(*share_sess));
     }
     LOG(INFO) << config.DebugString();
@@ -130,7 +130,7 @@ class ModelProfiler {
         std::string im;
         ReadImage(test_images_[idx], &im);
         auto task = std::make_shared<Task>();
-        auto input = task->query.mutable_input();
+        auto input = task->query->mutable_input();
         input->set_data_type(DT_IMAGE);
         auto image = input->mutable_image();
         image->set_data(im);
@@ -156,9 +156,8 @@ class ModelProfiler {
       int idx = i % preproc_tasks.size();
       auto task = std::make_shared<Task>();
       task->SetDeadline(std::chrono::milliseconds(1000000));
-      task->query.set_query_id(i);
-      task->query.set_model_session_id(
-          model_sessions_[i % model_sessions_.size()]);
+      task->query->set_query_id(i);
+      task->query->set_session_index(i % model_sessions_.size() + 1);
       task->attrs = preproc_tasks[idx]->attrs;
       task->AppendInput(preproc_tasks[idx]->inputs[0]->array);
       model->AddPreprocessedTask(task);
@@ -179,8 +178,8 @@ class ModelProfiler {
     size_t memory_usage = origin_freemem - curr_freemem;
     for (int i = 0; i < batch * (repeat + dryrun); ++i) {
       auto task = task_queue.pop();
-      CHECK_EQ(task->result.status(), CTRL_OK) << "Error detected: " <<
-          task->result.status();
+      CHECK_EQ(task->result->status(), CTRL_OK) << "Error detected: " <<
+          task->result->status();
       auto beg = std::chrono::high_resolution_clock::now();
       model->Postprocess(task);
       auto end = std::chrono::high_resolution_clock::now();
@@ -244,7 +243,7 @@ class ModelProfiler {
  private:
   int gpu_;
   ModelSession model_sess_;
-  const YAML::Node* model_info_;
+  const ModelInfo* model_info_;
   std::string framework_;
   std::string model_name_;
   int version_;
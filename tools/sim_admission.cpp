@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "nexus/app/admission_control.h"
+
+DEFINE_double(capacity, 500, "Requests per second the backends can serve");
+DEFINE_double(base_ms, 20, "Latency of a request without queuing in ms");
+DEFINE_double(slo_ms, 100, "End-to-end SLO in ms");
+DEFINE_int32(duration_sec, 60, "Simulated time of each load level in sec");
+DEFINE_string(loads, "0.5,0.9,1.0,1.2,1.5,2,3", "Request rates to simulate "
+              "as multiples of capacity");
+
+namespace nexus {
+namespace app {
+
+/*!
+ * \brief Simulates a frontend under overload with and without admission
+ * control, and reports goodput, i.e., requests replied within the SLO.
+ *
+ * Requests arrive as a Poisson process and are served in FIFO order at the
+ * backend capacity, after which each takes base_ms more to reply. Nothing
+ * is sent over the network, only AdmissionController is exercised.
+ */
+class AdmissionSimulator {
+ public:
+  struct Result {
+    double goodput;
+    double rejected;
+    double p99_ms;
+  };
+
+  Result Run(double load, bool admission_control) {
+    AdmissionController admission;
+    if (admission_control) {
+      admission.SetCapacity(FLAGS_capacity);
+      admission.SetSlo(FLAGS_slo_ms);
+    }
+    std::mt19937 gen(0);
+    std::exponential_distribution<double> interval(load * FLAGS_capacity);
+    // Completion time and latency of requests in flight, earliest first
+    std::priority_queue<std::pair<double, double>,
+                        std::vector<std::pair<double, double> >,
+                        std::greater<std::pair<double, double> > > inflight;
+    TimePoint origin = Clock::now();
+    auto at = [origin](double sec) {
+      return origin + std::chrono::microseconds(uint64_t(sec * 1e6));
+    };
+    double service_sec = 1. / FLAGS_capacity;
+    double server_free = 0.;
+    uint64_t num_good = 0;
+    uint64_t num_rejected = 0;
+    std::vector<double> latencies;
+    for (double now = interval(gen); now < FLAGS_duration_sec;
+         now += interval(gen)) {
+      while (!inflight.empty() && inflight.top().first <= now) {
+        admission.Complete(at(inflight.top().first),
+                           uint64_t(inflight.top().second * 1e3));
+        inflight.pop();
+      }
+      uint32_t retry_after_ms;
+      if (admission_control &&
+          admission.Admit(0, at(now), &retry_after_ms) != CTRL_OK) {
+        ++num_rejected;
+        continue;
+      }
+      server_free = std::max(server_free, now) + service_sec;
+      double done = server_free + FLAGS_base_ms / 1e3;
+      double latency_ms = (done - now) * 1e3;
+      if (admission_control) {
+        inflight.emplace(done, latency_ms);
+      }
+      latencies.push_back(latency_ms);
+      if (latency_ms <= FLAGS_slo_ms && done <= FLAGS_duration_sec) {
+        ++num_good;
+      }
+    }
+    Result result;
+    result.goodput = num_good / double(FLAGS_duration_sec);
+    result.rejected = num_rejected / double(FLAGS_duration_sec);
+    std::sort(latencies.begin(), latencies.end());
+    result.p99_ms = latencies.empty() ? 0. :
+                    latencies[latencies.size() * 99 / 100];
+    return result;
+  }
+};
+
+} // namespace app
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+
+  nexus::app::AdmissionSimulator sim;
+  std::cout << "load\tgoodput\tp99_ms\tadmit_goodput\tadmit_rejected\t" <<
+      "admit_p99_ms" << std::endl;
+  std::stringstream loads(FLAGS_loads);
+  std::string token;
+  while (std::getline(loads, token, ',')) {
+    double load = std::stod(token);
+    auto base = sim.Run(load, false);
+    auto admit = sim.Run(load, true);
+    std::cout << load << "\t" << base.goodput << "\t" << base.p99_ms << "\t" <<
+        admit.goodput << "\t" << admit.rejected << "\t" << admit.p99_ms <<
+        std::endl;
+  }
+}
@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <deque>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+#include "nexus/common/model_db.h"
+#include "nexus/common/model_def.h"
+#include "nexus/scheduler/backend_delegate.h"
+#include "nexus/scheduler/sch_info.h"
+#include "nexus/scheduler/slo_model.h"
+
+DEFINE_string(workload, "", "Workload file with a list of model sessions and "
+              "their request rates");
+DEFINE_string(gpu_device, "", "GPU device name of the simulated backends");
+DEFINE_string(gpu_uuid, "generic", "GPU UUID to look up model profiles");
+DEFINE_int32(max_gpus, 0, "Number of GPUs to simulate overload with, 0 "
+             "means unlimited");
+DEFINE_double(validate_sec, 0., "If positive, replay this many seconds of "
+              "arrivals on the packed backends and report the fraction of "
+              "requests within latency SLA, planning for the mean rate and "
+              "for --slo_percentile");
+DEFINE_int32(seed, 1, "Random seed of the replayed arrivals");
+// Defined by the scheduler, which sch_info.cpp reads
+DEFINE_int32(avg_interval, 10, "Moving average interval for backend rate");
+DECLARE_bool(multi_rate_cycle);
+DECLARE_bool(interference_aware);
+
+namespace nexus {
+namespace scheduler {
+
+struct SessionWorkload {
+  ModelSession model_session;
+  double rate;
+  /*! \brief Cheaper variants from the most to the least accurate */
+  std::vector<ModelSession> variants;
+};
+
+/*!
+ * \brief Packs a static workload onto as many simulated backends as needed,
+ * following the allocation in Scheduler::AllocateUnassignedWorkloads.
+ *
+ * Backends are never contacted, the simulation only runs the duty cycle
+ * computation of BackendDelegate.
+ */
+class DutyCycleSimulator {
+ public:
+  DutyCycleSimulator(const std::string& gpu_device,
+                     const std::string& gpu_uuid) :
+      gpu_device_(gpu_device),
+      gpu_uuid_(gpu_uuid),
+      max_backends_(0) {}
+
+  void LoadWorkload(const std::string& workload_file) {
+    YAML::Node config = YAML::LoadFile(workload_file);
+    for (const auto& node : config["models"]) {
+      SessionWorkload workload;
+      auto& sess = workload.model_session;
+      sess.set_framework(node["framework"].as<std::string>());
+      sess.set_model_name(node["model_name"].as<std::string>());
+      sess.set_version(node["version"].as<uint32_t>());
+      sess.set_latency_sla(node["latency_sla"].as<uint32_t>());
+      if (node["image_height"]) {
+        sess.set_image_height(node["image_height"].as<uint32_t>());
+        sess.set_image_width(node["image_width"].as<uint32_t>());
+      }
+      workload.rate = node["rate"].as<double>();
+      for (const auto& variant_node : node["variants"]) {
+        ModelSession variant(sess);
+        if (variant_node["framework"]) {
+          variant.set_framework(variant_node["framework"].as<std::string>());
+        }
+        variant.set_model_name(variant_node["model_name"].as<std::string>());
+        variant.set_version(variant_node["version"].as<uint32_t>());
+        workload.variants.push_back(variant);
+      }
+      workloads_.push_back(workload);
+    }
+    std::sort(workloads_.begin(), workloads_.end(),
+              [](const SessionWorkload& a, const SessionWorkload& b) {
+                return a.rate > b.rate;
+              });
+  }
+  /*!
+   * \brief Packs all workloads onto fresh backends.
+   * \param occupancy Average occupancy of the used backends
+   * \return Number of backends used
+   */
+  size_t Pack(double* occupancy) {
+    std::vector<double> served;
+    max_backends_ = 0;
+    return Pack(workloads_, &served, occupancy);
+  }
+  /*!
+   * \brief Packs all workloads onto at most max_backends backends. Queries
+   * that don't fit are degraded to cheaper variants the same way as
+   * Scheduler::DegradeOverloadedSessions, one level per round.
+   * \param max_backends Maximum number of backends
+   * \param degrade Whether to degrade queries to variants
+   * \return Fraction of the queries served
+   */
+  double PackOverload(size_t max_backends, bool degrade) {
+    max_backends_ = max_backends;
+    // Request rate of each workload at each level, level 0 is the workload
+    // itself followed by its variants
+    std::vector<std::vector<double> > level_rates;
+    double demand = 0.;
+    for (const auto& workload : workloads_) {
+      std::vector<double> rates(workload.variants.size() + 1, 0.);
+      rates[0] = workload.rate;
+      level_rates.push_back(rates);
+      demand += workload.rate;
+    }
+    double total_served = 0.;
+    for (size_t round = 0; ; ++round) {
+      std::vector<SessionWorkload> flat;
+      for (size_t i = 0; i < workloads_.size(); ++i) {
+        for (size_t level = 0; level < level_rates[i].size(); ++level) {
+          SessionWorkload level_workload;
+          level_workload.model_session = (level == 0) ?
+              workloads_[i].model_session : workloads_[i].variants[level - 1];
+          level_workload.rate = level_rates[i][level];
+          flat.push_back(level_workload);
+        }
+      }
+      std::vector<double> served;
+      double occupancy;
+      Pack(flat, &served, &occupancy);
+      total_served = 0.;
+      for (double rate : served) {
+        total_served += rate;
+      }
+      if (!degrade) {
+        break;
+      }
+      bool shifted = false;
+      size_t idx = 0;
+      for (size_t i = 0; i < workloads_.size(); ++i) {
+        auto& rates = level_rates[i];
+        for (size_t level = 0; level + 1 < rates.size(); ++level) {
+          double unassigned = rates[level] - served[idx + level];
+          if (unassigned < 1e-3) {
+            continue;
+          }
+          double shift = std::min(DegradeShift(
+              unassigned, MaxThroughput(flat[idx + level].model_session),
+              MaxThroughput(flat[idx + level + 1].model_session)),
+                                  rates[level]);
+          if (shift < 1e-3) {
+            continue;
+          }
+          rates[level] -= shift;
+          rates[level + 1] += shift;
+          shifted = true;
+          break;
+        }
+        idx += rates.size();
+      }
+      if (!shifted) {
+        break;
+      }
+      LOG(INFO) << "Round " << round << ": served " << total_served <<
+          " of " << demand << " req/s";
+    }
+    if (degrade) {
+      for (size_t i = 0; i < workloads_.size(); ++i) {
+        for (size_t level = 1; level < level_rates[i].size(); ++level) {
+          std::cout << ModelSessionToString(workloads_[i].model_session) <<
+              " -> " <<
+              ModelSessionToString(workloads_[i].variants[level - 1]) <<
+              ": " << level_rates[i][level] << " req/s" << std::endl;
+        }
+      }
+    }
+    return demand > 0 ? total_served / demand : 1.;
+  }
+  /*!
+   * \brief Replays arrivals on the backends of the last packing and measures
+   * the fraction of requests that finish within their latency SLA.
+   *
+   * Each model batches the requests arriving in a window of cycle_period
+   * duty cycles, up to its planned batch size, and runs the batch at the end
+   * of the window. Requests that don't fit wait for a later batch and are
+   * dropped once they can no longer make it. Arrival counts per window have
+   * --arrival_dispersion times their mean as variance, and batch latency is
+   * normal with the profiled mean and std, with the forward latency slowed
+   * down by the co-located models as profiled. Requests of the workload left
+   * unplaced count as late.
+   * \param seconds Simulated time in seconds
+   * \return Fraction of requests on time
+   */
+  double MeasureOnTime(double seconds) {
+    std::mt19937 rng(FLAGS_seed);
+    uint64_t total = 0, on_time = 0;
+    double unplaced = 0.;
+    for (const auto& workload : workloads_) {
+      unplaced += workload.rate;
+    }
+    for (auto& backend : backends_) {
+      auto models = backend->GetModels();
+      for (size_t m = 0; m < models.size(); ++m) {
+        const auto& inst_info = models[m];
+        if (inst_info->batch == 0 || inst_info->workload <= 0) {
+          continue;
+        }
+        double slowdown = CorunSlowdown(models, m);
+        double window_us = backend->duty_cycle_us() * inst_info->cycle_period;
+        double sla_us = inst_info->model_sessions[0].latency_sla() * 1000.;
+        double mean = inst_info->workload * window_us / 1e6;
+        unplaced -= inst_info->workload;
+        uint64_t model_total = 0, model_on_time = 0;
+        // Arrival times of the queued requests
+        std::deque<double> queue;
+        for (double start = 0.; start < seconds * 1e6; start += window_us) {
+          uint32_t n = SampleArrivals(mean, &rng);
+          std::uniform_real_distribution<double> when(start,
+                                                      start + window_us);
+          std::vector<double> arrivals;
+          for (uint32_t i = 0; i < n; ++i) {
+            arrivals.push_back(when(rng));
+          }
+          std::sort(arrivals.begin(), arrivals.end());
+          queue.insert(queue.end(), arrivals.begin(), arrivals.end());
+          model_total += n;
+          double exec_us = start + window_us;
+          while (!queue.empty() && queue.front() + sla_us < exec_us) {
+            queue.pop_front();
+          }
+          uint32_t batch = std::min<uint32_t>(queue.size(), inst_info->batch);
+          if (batch == 0) {
+            continue;
+          }
+          double lat_mean = inst_info->profile->GetLatencyQuantile(batch, 0.);
+          double lat_std = inst_info->profile->GetLatencyQuantile(batch, 1.) -
+                           lat_mean;
+          lat_mean += (slowdown - 1.) *
+              inst_info->profile->GetForwardLatency(batch);
+          double finish_us = exec_us + lat_mean;
+          if (lat_std > 0) {
+            std::normal_distribution<double> lat(lat_mean, lat_std);
+            finish_us = exec_us + std::max(lat(rng), 0.);
+          }
+          for (uint32_t i = 0; i < batch; ++i) {
+            if (finish_us - queue.front() <= sla_us) {
+              ++model_on_time;
+            }
+            queue.pop_front();
+          }
+        }
+        VLOG(1) << ModelSessionToString(inst_info->model_sessions[0]) <<
+            " on backend " << backend->node_id() << ": batch " <<
+            inst_info->batch << ", window " << window_us << " us, slowdown " <<
+            slowdown << ", " <<
+            (model_total > 0 ? double(model_on_time) / model_total : 1.) <<
+            " on time";
+        total += model_total;
+        on_time += model_on_time;
+      }
+    }
+    total += static_cast<uint64_t>(std::max(unplaced, 0.) * seconds);
+    return total > 0 ? double(on_time) / total : 1.;
+  }
+
+ private:
+  /*! \brief Draws the number of requests arriving in a window. */
+  static uint32_t SampleArrivals(double mean, std::mt19937* rng) {
+    double rate = mean;
+    if (FLAGS_arrival_dispersion > 1.) {
+      // Gamma mixed Poisson is negative binomial with the given dispersion
+      std::gamma_distribution<double> gamma(
+          mean / (FLAGS_arrival_dispersion - 1), FLAGS_arrival_dispersion - 1);
+      rate = gamma(*rng);
+    }
+    if (rate <= 0.) {
+      return 0;
+    }
+    std::poisson_distribution<uint32_t> poisson(rate);
+    return poisson(*rng);
+  }
+
+  size_t Pack(const std::vector<SessionWorkload>& workloads,
+              std::vector<double>* served, double* occupancy) {
+    backends_.clear();
+    std::vector<size_t> order(workloads.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return workloads[a].rate > workloads[b].rate;
+      });
+    served->assign(workloads.size(), 0.);
+    for (size_t i : order) {
+      const auto& workload = workloads[i];
+      double rate = workload.rate;
+      while (rate > 1e-3) {
+        BackendDelegate* backend;
+        InstanceInfo inst_info;
+        FindBestBackend(workload.model_session, rate, &backend, &inst_info);
+        if (backend == nullptr) {
+          LOG(WARNING) << "Cannot place " <<
+              ModelSessionToString(workload.model_session) << ", " << rate <<
+              " req/s left";
+          break;
+        }
+        backend->LoadModel(inst_info);
+        rate -= inst_info.throughput;
+      }
+      (*served)[i] = workload.rate - std::max(rate, 0.);
+    }
+    double total_occupancy = 0.;
+    for (auto& backend : backends_) {
+      total_occupancy += backend->Occupancy();
+    }
+    *occupancy = backends_.empty() ? 0. : total_occupancy / backends_.size();
+    return backends_.size();
+  }
+
+  double MaxThroughput(const ModelSession& model_sess) {
+    auto profile = ModelDatabase::Singleton().GetModelProfile(
+        gpu_device_, gpu_uuid_, ModelSessionToProfileID(model_sess));
+    if (profile == nullptr) {
+      return 0.;
+    }
+    return profile->GetMaxThroughput(model_sess.latency_sla()).second;
+  }
+
+  std::unique_ptr<BackendDelegate> NewBackend(uint32_t node_id) {
+    return std::unique_ptr<BackendDelegate>(new BackendDelegate(
+        node_id, "127.0.0.1", "0", "0", gpu_device_, gpu_uuid_, 0, 1));
+  }
+
+  void FindBestBackend(const ModelSession& model_sess, double rate,
+                       BackendDelegate** best_backend,
+                       InstanceInfo* best_info) {
+    *best_backend = nullptr;
+    BackendDelegate* max_tp_backend = nullptr;
+    InstanceInfo max_tp_info;
+    BackendDelegate* max_occ_backend = nullptr;
+    InstanceInfo max_occ_info;
+    double max_occ = 0.;
+    // An idle backend is always a candidate
+    auto idle = NewBackend(backends_.size() + 1);
+    std::vector<BackendDelegate*> candidates;
+    for (auto& backend : backends_) {
+      candidates.push_back(backend.get());
+    }
+    if (max_backends_ == 0 || backends_.size() < max_backends_) {
+      candidates.push_back(idle.get());
+    }
+    for (auto backend : candidates) {
+      InstanceInfo inst_info;
+      double occupancy;
+      if (!backend->PrepareLoadModel(model_sess, rate, &inst_info,
+                                     &occupancy)) {
+        continue;
+      }
+      if (max_tp_backend == nullptr ||
+          inst_info.throughput > max_tp_info.throughput) {
+        max_tp_backend = backend;
+        max_tp_info = inst_info;
+      }
+      if (max_occ_backend == nullptr || occupancy > max_occ) {
+        max_occ_backend = backend;
+        max_occ_info = inst_info;
+        max_occ = occupancy;
+      }
+    }
+    if (max_tp_backend == nullptr) {
+      return;
+    }
+    if (max_tp_info.throughput < rate) {
+      *best_backend = max_tp_backend;
+      *best_info = max_tp_info;
+    } else {
+      *best_backend = max_occ_backend;
+      *best_info = max_occ_info;
+    }
+    if (*best_backend == idle.get()) {
+      backends_.push_back(std::move(idle));
+    }
+  }
+
+  std::string gpu_device_;
+  std::string gpu_uuid_;
+  std::vector<SessionWorkload> workloads_;
+  /*! \brief Maximum number of backends, 0 means unlimited */
+  size_t max_backends_;
+  std::vector<std::unique_ptr<BackendDelegate> > backends_;
+};
+
+} // namespace scheduler
+} // namespace nexus
+
+int main(int argc, char** argv) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InstallFailureSignalHandler();
+  CHECK(!FLAGS_workload.empty()) << "Missing workload";
+  CHECK(!FLAGS_gpu_device.empty()) << "Missing gpu_device";
+
+  nexus::scheduler::DutyCycleSimulator sim(FLAGS_gpu_device, FLAGS_gpu_uuid);
+  sim.LoadWorkload(FLAGS_workload);
+  bool multi_rate_cycle = FLAGS_multi_rate_cycle;
+  double single_occ, multi_occ;
+  FLAGS_multi_rate_cycle = false;
+  size_t single_gpus = sim.Pack(&single_occ);
+  FLAGS_multi_rate_cycle = true;
+  size_t multi_gpus = sim.Pack(&multi_occ);
+  std::cout << "single duty cycle: " << single_gpus << " GPUs, " <<
+      "avg occupancy " << single_occ << std::endl;
+  std::cout << "multi-rate cycle:  " << multi_gpus << " GPUs, " <<
+      "avg occupancy " << multi_occ << std::endl;
+  FLAGS_multi_rate_cycle = multi_rate_cycle;
+  if (FLAGS_validate_sec > 0) {
+    bool interference_aware = FLAGS_interference_aware;
+    double occupancy;
+    for (bool aware : {false, true}) {
+      FLAGS_interference_aware = aware;
+      size_t gpus = sim.Pack(&occupancy);
+      double on_time = sim.MeasureOnTime(FLAGS_validate_sec);
+      std::cout << "interference " << (aware ? "aware" : "unaware") <<
+          ": " << gpus << " GPUs, " << on_time << " of requests on time" <<
+          std::endl;
+    }
+    FLAGS_interference_aware = interference_aware;
+    double slo_percentile = FLAGS_slo_percentile;
+    FLAGS_slo_percentile = 0.;
+    size_t mean_gpus = sim.Pack(&occupancy);
+    double mean_on_time = sim.MeasureOnTime(FLAGS_validate_sec);
+    std::cout << "mean rate planning: " << mean_gpus << " GPUs, " <<
+        mean_on_time << " of requests on time" << std::endl;
+    if (slo_percentile > 0) {
+      FLAGS_slo_percentile = slo_percentile;
+      size_t slo_gpus = sim.Pack(&occupancy);
+      double slo_on_time = sim.MeasureOnTime(FLAGS_validate_sec);
+      std::cout << "planning for " << slo_percentile << " on time: " <<
+          slo_gpus << " GPUs, " << slo_on_time << " of requests on time" <<
+          std::endl;
+    }
+  }
+  if (FLAGS_max_gpus > 0) {
+    double goodput = sim.PackOverload(FLAGS_max_gpus, false);
+    double degrade_goodput = sim.PackOverload(FLAGS_max_gpus, true);
+    std::cout << "overload on " << FLAGS_max_gpus << " GPUs, served " <<
+        goodput << " without and " << degrade_goodput <<
+        " with degradation" << std::endl;
+  }
+}